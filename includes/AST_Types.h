@@ -3,7 +3,6 @@
 
 #include <vector>
 #include <string>
-#include <unordered_map>
 #include "instruction.h"
 #include "variabletype.h"
 
@@ -12,10 +11,11 @@ typedef struct AST_Function {
     std::vector<VariableType> parameters = {};
     std::vector<VariableType> results = {};
     std::vector<Instruction*>* body = nullptr;
-    std::unordered_map<std::string, std::pair<uint32_t, uint8_t>> locals = {};
+    std::vector<uint8_t> locals = {};      // value type of each local, they are numbered after the parameters
     bool isImported = false;
     std::string importModule;
     std::string importField;
+    uint64_t sourceHash = 0;    // of the tokens of the module field it was parsed from, 0 if it wasn't
 } AST_Function;
 
 typedef struct AST_Memory {
@@ -27,10 +27,52 @@ typedef struct AST_Memory {
     std::string importField;
 } AST_Memory;
 
+// a global variable, its initial value is a constant instruction
+typedef struct AST_Global {
+    std::string name;           // exported as, empty if it isn't
+    uint8_t type = 0;
+    bool isMutable = false;
+    Instruction* value = nullptr;
+    bool isImported = false;
+    std::string importModule;
+    std::string importField;
+} AST_Global;
+
+typedef struct AST_Table {
+    int initial_value = 0;
+    int max_value = 0;
+} AST_Table;
+
+// an active element segment: the functions, by index, that go into the table from offset on
+typedef struct AST_Element {
+    uint32_t table = 0;
+    uint32_t offset = 0;
+    std::vector<uint32_t> functions;
+} AST_Element;
+
 typedef struct AST_Data {
     uint8_t type;
     uint32_t value;
+    uint32_t memory = 0;
+    bool passive = false;   // only memory.init copies it, there is no memory or offset then
     std::string data;
 } AST_Data;
 
+typedef struct AST_Type {
+    std::vector<VariableType> parameters;
+    std::vector<VariableType> results;
+} AST_Type;
+
+// Everything the Parser read, by index: imported functions, memories and globals come first in their
+// lists. The types are those the module declares, call_indirect refers to them.
+typedef struct AST_Module {
+    std::vector<AST_Type> types;
+    std::vector<AST_Function*> functions;
+    std::vector<AST_Memory*> memories;
+    std::vector<AST_Global*> globals;
+    std::vector<AST_Table*> tables;
+    std::vector<AST_Element*> elements;
+    std::vector<AST_Data*> datas;
+} AST_Module;
+
 #endif
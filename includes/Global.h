@@ -0,0 +1,19 @@
+#ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_GLOBAL_H
+#define SEIS_JARNETHYS_MARTIJNSNOEKS_GLOBAL_H
+
+#include "Variable.h"
+#include "variabletype.h"
+
+// A global variable of a module. One that is imported is the same object as the one it was exported
+// as, or that the embedder gave: a global.set in one module is what global.get reads in the other.
+// Whether a global may be set is checked when a module is loaded, global.get and global.set then only
+// read and write the value.
+struct Global {
+    Global(VariableType type, bool isMutable, Variable value) : type(type), isMutable(isMutable), value(value) {}
+
+    const VariableType type;
+    const bool isMutable;
+    Variable value;
+};
+
+#endif
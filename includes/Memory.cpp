@@ -1,45 +1,47 @@
 #include "Memory.h"
-#include <iostream>
 
-Memory::Memory(uint32_t init_size) : initial(init_size), maximum(0), memory() {
-    memory.reserve(init_size);
-}
+Memory::Memory(uint32_t init_size) : Memory(init_size, MAX_PAGES) {}
 
 Memory::Memory(uint32_t init_size, uint32_t max_size) : initial(init_size), maximum(max_size), memory() {
-    memory.reserve(init_size);
+    if (init_size > max_size || max_size > MAX_PAGES) {
+        throw MemoryException("memory limits out of range");
+    }
+    memory.resize((size_t)init_size * PAGE_SIZE);
+}
+
+int32_t Memory::grow(uint32_t delta) {
+    uint32_t previous = pages();
+    if ((uint64_t)previous + delta > maximum) {
+        return -1;
+    }
+    memory.resize((size_t)(previous + delta) * PAGE_SIZE);
+    return previous;
 }
 
-void Memory::setMemory(int index, Variable var) {
-    if (index >= memory.size()) {
-        if (index <= maximum || maximum == 0) {
-            memory.resize(index + 1);
-        } else {
-            std::cout << "Error: Memory index out of bounds" << std::endl;
-            throw;
-        }
+void Memory::copy(uint32_t destination, Memory& source, uint32_t from, uint32_t length) {
+    source.check(from, length);
+    check(destination, length);
+    if (length == 0) {
+        return;
     }
-    memory[index] = var;
+    std::memmove(memory.data() + destination, source.memory.data() + from, length);
 }
 
-Variable Memory::getMemory(int index) {
-    if (index < memory.size()) {
-        return memory[index];
-    } else {
-        std::cout << "Error: Memory index out of bounds" << std::endl;
-        throw;
+void Memory::fill(uint32_t destination, uint8_t value, uint32_t length) {
+    check(destination, length);
+    if (length == 0) {
+        return;
     }
+    std::memset(memory.data() + destination, value, length);
 }
 
-void Memory::fill(uint32_t offset, int32_t value, uint32_t length) {
-    if (offset + length >= memory.size()) {
-        if (offset + length <= maximum || maximum == 0) {
-            memory.resize(offset + length);
-        } else {
-            std::cout << "Error: Memory index out of bounds" << std::endl;
-            throw;
-        }
+void Memory::init(uint32_t destination, const std::vector<uint8_t>& segment, uint32_t from, uint32_t length) {
+    if ((uint64_t)from + length > segment.size()) {
+        throw MemoryException("out of bounds memory access");
     }
-    for (uint32_t i = offset; i < offset + length; i++) {
-        memory.emplace(memory.begin() + i, value);
+    check(destination, length);
+    if (length == 0) {
+        return;
     }
-}
\ No newline at end of file
+    std::memcpy(memory.data() + destination, segment.data() + from, length);
+}
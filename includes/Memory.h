@@ -1,29 +1,76 @@
 #ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_MEMORY_H
 #define SEIS_JARNETHYS_MARTIJNSNOEKS_MEMORY_H
 
+#include <cstdint>
+#include <cstring>
+#include <exception>
 #include <string>
 #include <vector>
-#include "Variable.h"
 
+// what an access outside of the memory traps with
+struct MemoryException : public std::exception {
+    std::string s;
+    MemoryException(std::string ss) : s(ss) {}
+    ~MemoryException() throw () {}
+    const char* what() const throw() { return s.c_str(); }
+};
+
+// A linear memory: bytes, as many pages of them as it has. Every access is checked against its
+// size as a whole, so that one out of bounds traps before anything was written.
 class Memory {
 public:
+    static constexpr uint32_t PAGE_SIZE = 65536;
+    // 4 GiB, all a 32 bit address reaches
+    static constexpr uint32_t MAX_PAGES = 65536;
+
+    // in pages
     Memory(uint32_t init_size);
     Memory(uint32_t init_size, uint32_t max_size);
 
-    void setMemory(int index, Variable var);
-    Variable getMemory(int index);
-
     void setName(std::string memName) { this->name = memName; }
     std::string getName() { return name; };
 
-    void fill(uint32_t offset, int32_t value, uint32_t length);
-    std::vector<Variable>* data() { return &memory; }
+    // little endian, at address + offset
+    template <typename T>
+    T load(uint32_t address, uint32_t offset) {
+        uint64_t effective = (uint64_t)address + offset;
+        check(effective, sizeof(T));
+        T value;
+        std::memcpy(&value, memory.data() + effective, sizeof(T));
+        return value;
+    }
+    template <typename T>
+    void store(uint32_t address, uint32_t offset, T value) {
+        uint64_t effective = (uint64_t)address + offset;
+        check(effective, sizeof(T));
+        std::memcpy(memory.data() + effective, &value, sizeof(T));
+    }
+
+    uint32_t pages() { return memory.size() / PAGE_SIZE; }
+    // the previous number of pages, -1 if the memory can't grow that much
+    int32_t grow(uint32_t delta);
+
+    // memory.copy, the ranges may overlap; source is this memory for a copy within it
+    void copy(uint32_t destination, Memory& source, uint32_t from, uint32_t length);
+    // memory.fill
+    void fill(uint32_t destination, uint8_t value, uint32_t length);
+    // memory.init, and active data segments when the module is instantiated
+    void init(uint32_t destination, const std::vector<uint8_t>& segment, uint32_t from, uint32_t length);
+
+    uint8_t* data() { return memory.data(); }
+    size_t size() { return memory.size(); }
 
 private:
     std::string name;
     uint32_t initial;
     uint32_t maximum;
-    std::vector<Variable> memory;
+    std::vector<uint8_t> memory;
+
+    void check(uint64_t address, uint64_t length) {
+        if (address + length > memory.size()) {
+            throw MemoryException("out of bounds memory access");
+        }
+    }
 };
 
 
@@ -0,0 +1,18 @@
+#include "Table.h"
+#include <algorithm>
+
+Table::Table(uint32_t init_size) : Table(init_size, MAX_SIZE) {}
+
+Table::Table(uint32_t init_size, uint32_t max_size) : initial(init_size), maximum(max_size), elements() {
+    if (init_size > max_size || init_size > MAX_SIZE) {
+        throw TableException("table limits out of range");
+    }
+    elements.resize(init_size, NULL_ELEMENT);
+}
+
+void Table::init(uint32_t destination, const std::vector<uint32_t>& segment) {
+    if ((uint64_t)destination + segment.size() > elements.size()) {
+        throw TableException("out of bounds table access");
+    }
+    std::copy(segment.begin(), segment.end(), elements.begin() + destination);
+}
@@ -0,0 +1,47 @@
+#ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_TABLE_H
+#define SEIS_JARNETHYS_MARTIJNSNOEKS_TABLE_H
+
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <vector>
+
+// what an element segment that doesn't fit its table traps with
+struct TableException : public std::exception {
+    std::string s;
+    TableException(std::string ss) : s(ss) {}
+    ~TableException() throw () {}
+    const char* what() const throw() { return s.c_str(); }
+};
+
+// A table of function references: each element is the index of a function of the module, or
+// NULL_ELEMENT. call_indirect picks the function it calls from one by an i32.
+class Table {
+public:
+    static constexpr uint32_t NULL_ELEMENT = UINT32_MAX;
+    // in elements, more than that isn't allocated for a module
+    static constexpr uint32_t MAX_SIZE = 10000000;
+
+    // in elements, all of them null
+    Table(uint32_t init_size);
+    Table(uint32_t init_size, uint32_t max_size);
+
+    void setName(std::string tableName) { this->name = tableName; }
+    std::string getName() { return name; };
+
+    uint32_t size() { return elements.size(); }
+    // the function at index, which has to be below size()
+    uint32_t operator[](uint32_t index) { return elements[index]; }
+
+    // active element segments when the module is instantiated: all of segment at destination
+    void init(uint32_t destination, const std::vector<uint32_t>& segment);
+
+private:
+    std::string name;
+    uint32_t initial;
+    uint32_t maximum;
+    std::vector<uint32_t> elements;
+};
+
+
+#endif
@@ -1,11 +1,30 @@
 #ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_VARIABLE_H
 #define SEIS_JARNETHYS_MARTIJNSNOEKS_VARIABLE_H
 
+#include <cstdint>
+#include <ostream>
 #include <variant>
 
 #define float32_t float
 #define float64_t double
 
-typedef std::variant<int32_t, int64_t, float32_t, float64_t> Variable;
+// a v128 of the SIMD proposal: 16 bytes in memory order, their lanes depend on the instruction
+struct v128_t {
+    alignas(16) uint8_t bytes[16];
+
+    bool operator==(const v128_t& other) const = default;
+};
+
+// as one hexadecimal number, the last byte first
+inline std::ostream& operator<<(std::ostream& out, const v128_t& value) {
+    const char* digits = "0123456789abcdef";
+    out << "0x";
+    for (int i = 15; i >= 0; --i) {
+        out << digits[value.bytes[i] >> 4] << digits[value.bytes[i] & 0xF];
+    }
+    return out;
+}
+
+typedef std::variant<int32_t, int64_t, float32_t, float64_t, v128_t> Variable;
 
 #endif //SEIS_JARNETHYS_MARTIJNSNOEKS_VARIABLE_H
@@ -0,0 +1,60 @@
+#include "arena.h"
+
+static const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+Arena::Arena(size_t blockSize) : blockSize(blockSize) {
+}
+
+Arena::~Arena() {
+    destroyAll();
+}
+
+void* Arena::allocateSlow(size_t size, size_t alignment) {
+    // every new block doubles in size, so large inputs need only a handful of them
+    size_t newSize = blocks.empty() ? blockSize : std::min(blockSizes.back() * 2, MAX_BLOCK_SIZE);
+    if (newSize < size + alignment) {
+        newSize = size + alignment;
+    }
+    blocks.emplace_back(new std::byte[newSize]);
+    blockSizes.push_back(newSize);
+    allocated += newSize;
+    current = blocks.back().get();
+    end = current + newSize;
+    return allocate(size, alignment);
+}
+
+void Arena::destroyAll() {
+    // objects are destroyed in reverse order of construction, like automatic variables
+    for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) {
+        it->destroy(it->object);
+    }
+    destructors.clear();
+}
+
+void Arena::reset() {
+    destroyAll();
+    if (blocks.empty()) {
+        return;
+    }
+    blocks.resize(1);
+    blockSizes.resize(1);
+    allocated = blockSizes[0];
+    current = blocks[0].get();
+    end = current + blockSizes[0];
+}
+
+void Arena::absorb(Arena& other) {
+    // the block allocations continue in stays the last one
+    auto position = blocks.empty() ? blocks.end() : blocks.end() - 1;
+    blocks.insert(position, std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+    blockSizes.insert(blockSizes.empty() ? blockSizes.end() : blockSizes.end() - 1, other.blockSizes.begin(), other.blockSizes.end());
+    destructors.insert(destructors.end(), other.destructors.begin(), other.destructors.end());
+    allocated += other.allocated;
+
+    other.blocks.clear();
+    other.blockSizes.clear();
+    other.destructors.clear();
+    other.allocated = 0;
+    other.current = nullptr;
+    other.end = nullptr;
+}
@@ -0,0 +1,64 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator owned by a compilation session: the Parser and Compiler allocate every AST and
+// Instruction node in here, and all of them are released at once when the arena goes away.
+class Arena {
+public:
+    Arena(size_t blockSize = 64 * 1024);
+    ~Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t alignment) {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (aligned + size > reinterpret_cast<uintptr_t>(end)) {
+            return allocateSlow(size, alignment);
+        }
+        current = reinterpret_cast<std::byte*>(aligned + size);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    template<typename T, typename... Args>
+    T* make(Args&&... args) {
+        T* object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            destructors.push_back({ [](void* p) { static_cast<T*>(p)->~T(); }, object });
+        }
+        return object;
+    }
+
+    // destroys every object and keeps the first block around for the next session
+    void reset();
+    // takes over the blocks and objects of another arena (e.g. one a worker thread allocated in),
+    // they are released together with its own then and the other one is left empty
+    void absorb(Arena& other);
+    size_t bytesAllocated() const { return allocated; }
+
+private:
+    struct Destructor {
+        void (*destroy)(void*);
+        void* object;
+    };
+
+    void* allocateSlow(size_t size, size_t alignment);
+    void destroyAll();
+
+    size_t blockSize;
+    size_t allocated = 0;
+    std::vector<std::unique_ptr<std::byte[]>> blocks;
+    std::vector<size_t> blockSizes;
+    std::vector<Destructor> destructors;
+    std::byte* current = nullptr;
+    std::byte* end = nullptr;
+};
+
+#endif // __ARENA_H__
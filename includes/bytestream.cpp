@@ -1,11 +1,15 @@
 #include <fstream>
 #include "bytestream.h"
+#include <bit>
 #include <iostream>
 #include <iomanip>
 #include <bitset>
-#include <string.h>
+#include <cstring>
 #include <stdexcept>
 #include <sstream>
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
 
 ByteStream::ByteStream(std::string filepath) : currentByteIndex{ 0 } {
     if (filepath.find(".wat") != std::string::npos) {
@@ -23,7 +27,7 @@ ByteStream::ByteStream(std::string filepath) : currentByteIndex{ 0 } {
             size = f.tellg();
             f.seekg (0, f.beg);
 
-            buffer.reserve(size);
+            buffer.resize(size);
             f.read((char*)buffer.data(), size);
         }
         f.close();
@@ -50,6 +54,8 @@ ByteStream::~ByteStream() {
 
 void ByteStream::addFromByteStream(ByteStream *stream) {
     buffer.insert(buffer.end(), stream->buffer.begin(), stream->buffer.end());
+    currentByteIndex += stream->size;
+    size += stream->size;
 }
 
 void ByteStream::readFile(std::string filepath) {
@@ -62,7 +68,7 @@ void ByteStream::readFile(std::string filepath) {
         size = f.tellg();
         f.seekg (0, f.beg);
 
-        buffer.reserve(size);
+        buffer.resize(size);
         f.read((char*)buffer.data(), size);
     }
     f.close();
@@ -72,7 +78,7 @@ void ByteStream::readCharVector(std::vector<uint8_t> vector) {
     buffer.clear();
     currentByteIndex = 0;
     size = vector.size();
-    buffer = vector;
+    buffer = std::move(vector);
 }
 
 void ByteStream::readVector(std::vector<uint8_t> vector) {
@@ -98,12 +104,12 @@ uint8_t ByteStream::readByte() {
 }
 
 std::vector<uint8_t> ByteStream::readBytes(int amount) {
-    std::vector<uint8_t> bytes;
-    bytes.reserve(amount);
-    for (int i = 0; i < amount; ++i) {
-        bytes.push_back(readByte());
+    if (amount < 0 || amount > getRemainingByteCount()) {
+        throw std::out_of_range("ByteStream at end of stream");
     }
-    return bytes;
+    const uint8_t* start = buffer.data() + currentByteIndex;
+    currentByteIndex += amount;
+    return std::vector<uint8_t>(start, start + amount);
 }
 
 uint8_t ByteStream::peekByte() {
@@ -122,6 +128,31 @@ void ByteStream::writeByte(uint8_t byte){
 }
 
 void ByteStream::writeUInt32(uint32_t val) {
+    uint8_t bytes[5];
+    int count = encodeUInt32(val, bytes);
+    buffer.insert(buffer.end(), bytes, bytes + count);
+    currentByteIndex += count;
+    size += count;
+}
+
+// signed LEB128, also used for i32 values: sign extending them first gives the same encoding
+void ByteStream::writeInt64(int64_t val) {
+    uint8_t bytes[10];
+    int count = encodeInt64(val, bytes);
+    buffer.insert(buffer.end(), bytes, bytes + count);
+    currentByteIndex += count;
+    size += count;
+}
+
+uint8_t* ByteStream::allocate(int count) {
+    buffer.resize(buffer.size() + count);
+    currentByteIndex += count;
+    size += count;
+    return buffer.data() + buffer.size() - count;
+}
+
+int ByteStream::encodeUInt32(uint32_t val, uint8_t* out) {
+    int count = 0;
     do {
         unsigned char byte = val & 0x7f;
         val >>= 7;
@@ -129,8 +160,45 @@ void ByteStream::writeUInt32(uint32_t val) {
         if (val != 0)
             byte |= 0x80;  // mark this byte to show that more bytes will follow
 
-        writeByte(byte);
+        out[count++] = byte;
     } while (val != 0);
+    return count;
+}
+
+int ByteStream::encodeInt64(int64_t val, uint8_t* out) {
+    int count = 0;
+    bool more = true;
+    while (more) {
+        uint8_t byte = val & 0x7f;
+        val >>= 7;
+
+        if ((val == 0 && (byte & 0x40) == 0) || (val == -1 && (byte & 0x40) != 0)) {
+            more = false;
+        } else {
+            byte |= 0x80;
+        }
+        out[count++] = byte;
+    }
+    return count;
+}
+
+int ByteStream::sizeOfUInt32(uint32_t val) {
+    int count = 1;
+    while (val >= 0x80) {
+        val >>= 7;
+        ++count;
+    }
+    return count;
+}
+
+int ByteStream::sizeOfInt64(int64_t val) {
+    // 7 bits per byte, plus the sign bit of the last one
+    int count = 1;
+    while (val >= 64 || val < -64) {
+        val >>= 7;
+        ++count;
+    }
+    return count;
 }
 
 std::string ByteStream::readASCIIString(int length) {
@@ -143,73 +211,105 @@ std::string ByteStream::readASCIIString(int length) {
     return s;
 }
 
-int32_t ByteStream::readInt32() {
-    int32_t result{0};
-    int shift{0};
-    uint8_t byte;
+namespace {
+
+constexpr uint64_t CONTINUATION_BITS = 0x8080808080808080ull;
+constexpr uint64_t PAYLOAD_BITS = 0x7F7F7F7F7F7F7F7Full;
+
+// the 7 bit groups of the first length bytes of word, next to each other
+inline uint64_t gather(uint64_t word, int length) {
+    uint64_t payload = length == 8 ? PAYLOAD_BITS : PAYLOAD_BITS & ((1ull << (8 * length)) - 1);
+#if defined(__BMI2__) && !defined(BYTESTREAM_SCALAR)
+    return _pext_u64(word, payload);
+#else
+    // pairs of groups into 16 bit lanes, then into 32 bit lanes, then all of them
+    uint64_t bits = word & payload;
+    bits = (bits & 0x007F007F007F007Full) | ((bits & 0x7F007F007F007F00ull) >> 1);
+    bits = (bits & 0x00003FFF00003FFFull) | ((bits & 0x3FFF00003FFF0000ull) >> 2);
+    return (bits & 0x000000000FFFFFFFull) | ((bits & 0x0FFFFFFF00000000ull) >> 4);
+#endif
+}
 
-    do
-    {
-        byte = readByte();
-        result |= ((byte & 0b0111'1111) << shift);
-        shift += 7;
-    } while ((byte & 0b1000'0000) != 0);
+// sign extends the 7 * length bits of a number, those of 10 bytes fill all of them
+inline int64_t signExtend(uint64_t bits, int length) {
+    int unused = 64 - 7 * length;
+    return unused > 0 ? (int64_t)(bits << unused) >> unused : (int64_t)bits;
+}
 
-    if ((shift < 32) && ((byte & 0b0100'0000) == 0b0100'0000)) {
-        result |= (~0 << shift);
-    }
+}
 
-    return result;
+int ByteStream::loadWord(uint64_t& word) const {
+    if (size - currentByteIndex < 8) {
+        return 0;
+    }
+    std::memcpy(&word, buffer.data() + currentByteIndex, 8);
+    if constexpr (std::endian::native == std::endian::big) {
+        word = __builtin_bswap64(word);
+    }
+    // the number ends at the first byte without its continuation bit
+    uint64_t ends = ~word & CONTINUATION_BITS;
+    return ends == 0 ? 0 : std::countr_zero(ends) / 8 + 1;
 }
 
-int64_t ByteStream::readInt64() {
-    int64_t result{0};
-    int shift{0};
+// near the end of the stream, and for numbers of 9 or 10 bytes
+uint64_t ByteStream::readBytewise(int maxBytes, int& count) {
+    uint64_t result{0};
     uint8_t byte;
+    count = 0;
 
     do
     {
+        if (count == maxBytes) {
+            throw std::out_of_range("ByteStream LEB128 number too long");
+        }
         byte = readByte();
-        result |= ((int64_t)(byte & 0b0111'1111) << shift);
-        shift += 7;
+        result |= ((uint64_t)(byte & 0b0111'1111) << (7 * count));
+        ++count;
     } while ((byte & 0b1000'0000) != 0);
 
-    if ((shift < 64) && ((byte & 0b0100'0000) == 0b0100'0000)) {
-        result |= ((int64_t)~0 << shift);
-    }
-
     return result;
 }
 
-uint32_t ByteStream::readUInt32() {
-    uint32_t result{0};
-    int shift{0};
-
-    while (true) {
-        uint8_t byte = readByte();
-        result |= ((byte & 0b0111'1111) << shift);
-        if ((byte & 0b1000'0000) == 0) {
-            break;
-        }
-        shift += 7;
+int32_t ByteStream::readLongInt32() {
+    uint64_t word;
+    int length = loadWord(word);
+    if (length != 0 && length <= 5) {
+        currentByteIndex += length;
+        return (int32_t)signExtend(gather(word, length), length);
     }
+    uint64_t bits = readBytewise(5, length);
+    return (int32_t)signExtend(bits, length);
+}
 
-    return result;
+int64_t ByteStream::readLongInt64() {
+    uint64_t word;
+    int length = loadWord(word);
+    if (length != 0) {
+        currentByteIndex += length;
+        return signExtend(gather(word, length), length);
+    }
+    uint64_t bits = readBytewise(10, length);
+    return signExtend(bits, length);
 }
 
-uint64_t ByteStream::readUInt64() {
-    uint64_t result{0};
-    int shift{0};
+uint32_t ByteStream::readLongUInt32() {
+    uint64_t word;
+    int length = loadWord(word);
+    if (length != 0 && length <= 5) {
+        currentByteIndex += length;
+        return (uint32_t)gather(word, length);
+    }
+    return (uint32_t)readBytewise(5, length);
+}
 
-    while (true) {
-        uint8_t byte = readByte();
-        result |= ((uint64_t)(byte & 0b0111'1111) << shift);
-        if ((byte & 0b1000'0000) == 0) {
-            break;
-        }
-        shift += 7;
+uint64_t ByteStream::readLongUInt64() {
+    uint64_t word;
+    int length = loadWord(word);
+    if (length != 0) {
+        currentByteIndex += length;
+        return gather(word, length);
     }
-    return result;
+    return readBytewise(10, length);
 }
 
 float32_t ByteStream::readFloat32() {
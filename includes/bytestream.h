@@ -15,6 +15,17 @@ private:
     int currentByteIndex;
     int size;
 
+    // the numbers readInt32() and co. don't read inline
+    int32_t readLongInt32();
+    int64_t readLongInt64();
+    uint32_t readLongUInt32();
+    uint64_t readLongUInt64();
+    // with 8 bytes left, loads them into word and returns the length of the number they start with,
+    // 0 if it is longer than 8 bytes or fewer are left
+    int loadWord(uint64_t& word) const;
+    // one byte at a time, at most maxBytes of them; returns the bits and the number of bytes read
+    uint64_t readBytewise(int maxBytes, int& count);
+
 public:
     ByteStream(std::string filepath);
     ByteStream(std::vector<uint8_t> stream);
@@ -38,15 +49,49 @@ public:
 
     void writeByte(uint8_t byte);
     void writeUInt32(uint32_t value);
+    void writeInt64(int64_t value);
     void fixUpByte(int index, uint8_t byte) { buffer[index] = byte; };
+    // appends count bytes for the caller to fill in and returns where they start
+    uint8_t* allocate(int count);
+
+    // LEB128 encodings: out needs room for 5 (unsigned 32 bit) or 10 bytes, returns the bytes written
+    static int encodeUInt32(uint32_t value, uint8_t* out);
+    static int encodeInt64(int64_t value, uint8_t* out);
+    static int sizeOfUInt32(uint32_t value);
+    static int sizeOfInt64(int64_t value);
 
     std::string readASCIIString(int length);
 
-    int32_t  readInt32();
-    int64_t readInt64();
+    // LEB128 decoding. Most numbers in a module (indices, sizes, small constants) take one byte, that
+    // is checked for inline; longer ones are read with one load of 8 bytes where there are that many
+    // left. Throw std::out_of_range when the stream ends within the number or it has more bytes than
+    // its type allows (5 or 10).
+    int32_t readInt32() {
+        if (currentByteIndex < size && buffer[currentByteIndex] < 0x80) {
+            // sign extend bit 6
+            return (int32_t)((uint32_t)buffer.data()[currentByteIndex++] << 25) >> 25;
+        }
+        return readLongInt32();
+    }
+    int64_t readInt64() {
+        if (currentByteIndex < size && buffer[currentByteIndex] < 0x80) {
+            return (int64_t)((uint64_t)buffer.data()[currentByteIndex++] << 57) >> 57;
+        }
+        return readLongInt64();
+    }
 
-    uint32_t readUInt32();
-    uint64_t readUInt64();
+    uint32_t readUInt32() {
+        if (currentByteIndex < size && buffer[currentByteIndex] < 0x80) {
+            return buffer.data()[currentByteIndex++];
+        }
+        return readLongUInt32();
+    }
+    uint64_t readUInt64() {
+        if (currentByteIndex < size && buffer[currentByteIndex] < 0x80) {
+            return buffer.data()[currentByteIndex++];
+        }
+        return readLongUInt64();
+    }
 
     float32_t readFloat32();
     float64_t readFloat64();
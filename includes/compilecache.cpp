@@ -0,0 +1,137 @@
+#include <algorithm>
+#include "compilecache.h"
+
+namespace {
+
+// FNV-1a
+constexpr uint64_t FNV_OFFSET = 0xCBF29CE484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001B3ull;
+
+uint64_t combine(uint64_t hash, const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t combine(uint64_t hash, uint64_t value) {
+    return combine(hash, &value, sizeof(value));
+}
+
+// The tokens of a function don't say what its names resolve to: a global, type or block type index
+// shifts when one is added in front of it, a (type $t) stands for whatever $t is declared as. The
+// signature and the instructions as the parser resolved them do.
+uint64_t resolvedHash(const AST_Function* function) {
+    uint64_t hash = function->sourceHash;
+    hash = combine(hash, function->parameters.size());
+    hash = combine(hash, function->parameters.data(), function->parameters.size() * sizeof(VariableType));
+    hash = combine(hash, function->results.size());
+    hash = combine(hash, function->results.data(), function->results.size() * sizeof(VariableType));
+    hash = combine(hash, function->locals.size());
+    hash = combine(hash, function->locals.data(), function->locals.size());
+    if (function->body == nullptr) {
+        return hash;
+    }
+    for (const Instruction* instruction : *function->body) {
+        hash = combine(hash, (uint64_t)instruction->type);
+        hash = combine(hash, instruction->prefix);
+        hash = combine(hash, instruction->instruction_code);
+        hash = combine(hash, instruction->parameter);
+        hash = combine(hash, (uint64_t)instruction->long_parameter);
+        hash = combine(hash, &instruction->float_parameter, sizeof(instruction->float_parameter));
+        hash = combine(hash, &instruction->double_parameter, sizeof(instruction->double_parameter));
+        hash = combine(hash, instruction->v128_parameter.bytes, sizeof(instruction->v128_parameter.bytes));
+        hash = combine(hash, instruction->block_parameters.size());
+        hash = combine(hash, instruction->block_parameters.data(), instruction->block_parameters.size());
+        hash = combine(hash, instruction->labels.size());
+        hash = combine(hash, instruction->labels.data(), instruction->labels.size() * sizeof(uint32_t));
+    }
+    return hash;
+}
+
+bool isCall(const Instruction* instruction) {
+    const opcodes::OpcodeInfo* info = instructionInfo(instruction);
+    return info != nullptr && info->prefix == 0 && info->code == constants::CALL;
+}
+
+}
+
+void CompileCache::prepare(const std::vector<AST_Function*>& functions) {
+    compilation++;
+    std::erase_if(entries, [this](const auto& entry) { return entry.second.lastUsed + KEEP_COMPILATIONS < compilation; });
+
+    keys.assign(functions.size(), NO_KEY);
+    for (auto function : functions) {
+        if (function->sourceHash == 0) {
+            return; // not parsed from text, nothing is cached
+        }
+    }
+
+    size_t count = functions.size();
+    std::vector<uint64_t> own(count, FNV_OFFSET);
+    std::vector<std::vector<uint32_t>> callees(count);
+    for (size_t i = 0; i < count; ++i) {
+        own[i] = resolvedHash(functions[i]);
+        if (functions[i]->body != nullptr) {
+            for (auto instruction : *functions[i]->body) {
+                if (isCall(instruction) && instruction->parameter < count) {
+                    callees[i].push_back(instruction->parameter);
+                }
+            }
+        }
+    }
+
+    // every function reachable from a function, in index order, goes into its key
+    std::vector<size_t> seen(count, count);
+    std::vector<uint32_t> pending;
+    std::vector<uint32_t> reachable;
+    for (size_t i = 0; i < count; ++i) {
+        pending = callees[i];
+        reachable.clear();
+        while (!pending.empty()) {
+            uint32_t callee = pending.back();
+            pending.pop_back();
+            if (seen[callee] == i) {
+                continue;
+            }
+            seen[callee] = i;
+            reachable.push_back(callee);
+            pending.insert(pending.end(), callees[callee].begin(), callees[callee].end());
+        }
+        std::sort(reachable.begin(), reachable.end());
+
+        uint64_t key = own[i];
+        for (auto callee : reachable) {
+            key = combine(combine(key, callee), own[callee]);
+        }
+        keys[i] = key == NO_KEY ? 1 : key;
+    }
+}
+
+const CompileCache::Entry* CompileCache::find(size_t index) {
+    if (index < keys.size() && keys[index] != NO_KEY) {
+        auto entry = entries.find(keys[index]);
+        if (entry != entries.end()) {
+            entry->second.lastUsed = compilation;
+            hits++;
+            return &entry->second;
+        }
+    }
+    misses++;
+    return nullptr;
+}
+
+void CompileCache::store(size_t index, const AST_Function* function, const uint8_t* code, size_t size) {
+    if (index >= keys.size() || keys[index] == NO_KEY) {
+        return;
+    }
+    Entry& entry = entries[keys[index]];
+    entry.body.clear();
+    for (auto instruction : *function->body) {
+        entry.body.push_back(*instruction);
+    }
+    entry.locals = function->locals;
+    entry.code.assign(code, code + size);
+    entry.lastUsed = compilation;
+}
@@ -0,0 +1,53 @@
+#ifndef __COMPILECACHE_H__
+#define __COMPILECACHE_H__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "AST_Types.h"
+#include "instruction.h"
+
+// What compiling a function gave, kept from one compilation of a module to the next: when the same
+// module comes in again with only some functions edited, the others skip the optimizations and get
+// the body they were encoded to last time. A function is known by a hash of its tokens, its
+// signature and locals, and its instructions with the indices its names resolved to, and by those
+// of every function it calls, directly or not, since inlining copies their bodies into its own. The
+// entries are what one pass pipeline made of the functions, a cache can only be shared by Compilers
+// that are configured the same. The hash of a function's tokens is what the Parser puts in its
+// sourceHash.
+class CompileCache {
+public:
+    // entries no module used for this many compilations are dropped
+    static constexpr uint64_t KEEP_COMPILATIONS = 4;
+
+    struct Entry {
+        std::vector<Instruction> body;      // after the optimizations
+        std::vector<uint8_t> locals;
+        std::vector<uint8_t> code;          // the encoded body, without its size
+        uint64_t lastUsed = 0;
+    };
+
+    // starts the compilation of a module: keys its functions, which the Parser read
+    void prepare(const std::vector<AST_Function*>& functions);
+
+    // the entry of a function of the prepared module, nullptr when it has to be compiled
+    const Entry* find(size_t index);
+    void store(size_t index, const AST_Function* function, const uint8_t* code, size_t size);
+
+    size_t size() const { return entries.size(); }
+    size_t getHits() const { return hits; }
+    size_t getMisses() const { return misses; }
+
+private:
+    static constexpr uint64_t NO_KEY = 0;
+
+    std::unordered_map<uint64_t, Entry> entries;
+    std::vector<uint64_t> keys;     // per function of the prepared module
+    uint64_t compilation = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+#endif // __COMPILECACHE_H__
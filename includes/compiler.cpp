@@ -1,339 +1,381 @@
 // Based on example on Toledo
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
 #include <iostream>
-#include <iomanip> // std::setw(), std::setfill()
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <string>
 #include "compiler.h"
 #include "constants.h"
 
-ByteStream* Compiler::compileBody(AST_Function* function) {
-    auto body = foldConstants(*(function->body));
-    fullOutput->writeByte(0);
-    int bodyFixup = fullOutput->getCurrentByteIndex();
+namespace {
+
+// first phase: counts the bytes that would be written
+class SizeCounter {
+public:
+    void byte(uint8_t) { ++count; }
+    void bytes(const void*, size_t size) { count += size; }
+    void u32(uint32_t value) { count += ByteStream::sizeOfUInt32(value); }
+    void s64(int64_t value) { count += ByteStream::sizeOfInt64(value); }
+    size_t size() const { return count; }
+
+private:
+    size_t count = 0;
+};
+
+// second phase: writes into memory that was sized by the first one
+class BufferWriter {
+public:
+    explicit BufferWriter(uint8_t* out) : out(out) {}
+    void byte(uint8_t value) { *out++ = value; }
+    void bytes(const void* data, size_t size) { std::memcpy(out, data, size); out += size; }
+    void u32(uint32_t value) { out += ByteStream::encodeUInt32(value, out); }
+    void s64(int64_t value) { out += ByteStream::encodeInt64(value, out); }
+    uint8_t* position() const { return out; }
+
+private:
+    uint8_t* out;
+};
+
+uint8_t valueType(VariableType type) {
+    switch (type) {
+        case VariableType::is_int32: return constants::INT32;
+        case VariableType::is_int64: return constants::INT64;
+        case VariableType::isfloat32_t: return constants::FLOAT32;
+        case VariableType::isv128_t: return constants::V128;
+        default: return constants::FLOAT64;
+    }
+}
+
+// names and data segments: their length, then the bytes
+template <typename Sink>
+void writeString(Sink& out, const std::string& string) {
+    out.u32(string.size());
+    out.bytes(string.data(), string.size());
+}
 
-    fullOutput->writeByte(function->locals.size());
-    for (const auto& local : function->locals) {
-        fullOutput->writeByte(1);
-        fullOutput->writeByte(local.second.second);
+// of a memory or a table
+template <typename Sink, typename Limited>
+void writeLimits(Sink& out, const Limited* limited) {
+    out.byte(limited->max_value > 0 ? 1 : 0); // limits flag for 2 limits
+    out.u32(limited->initial_value);
+    if (limited->max_value > 0) {
+        out.u32(limited->max_value);
     }
+}
 
-    for ( auto instruction : body ) {
-        fullOutput->writeByte( instruction->instruction_code );
+// the value type and whether it is mutable
+template <typename Sink>
+void writeGlobalType(Sink& out, const AST_Global* global) {
+    out.byte(global->type);
+    out.byte(global->isMutable ? 1 : 0);
+}
 
-        if (instruction->instruction_code == constants::I32STORE || instruction->instruction_code == constants::I32LOAD) {
-            fullOutput->writeByte(2); // alignment
-            fullOutput->writeByte(instruction->parameter);
-            continue;
-        }
-        if (instruction->instruction_code == constants::IF || instruction->instruction_code == constants::LOOP) {
-            for (auto type : instruction->block_parameters) {
-                fullOutput->writeByte(type);
-            }
-            continue;
-        }
+}
 
-        if ( instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER ) {
-            fullOutput->writeUInt32( instruction->parameter );
-        } else if ( instruction->type == InstructionType::CONST ) {
-            switch (instruction->instruction_code) {
-                case constants::I32CONST:
-                    {
-                        int32_t num = instruction->parameter;
-                        if (num == 0) {
-                            fullOutput->writeByte(0);
-                        } else {
-                            bool more = true;
-                            while (more) {
-                                uint8_t byte = num & 0b0111'1111;
-                                num >>= 7;
-                                if ((num == 0 && (byte & 0b0100'0000) == 0) || (num == -1 && (byte & 0b0100'0000) != 0)) {
-                                    more = false;
-                                } else {
-                                    byte |= 0b1000'0000;
-                                }
-                                fullOutput->writeByte(byte);
-                            }
-                        }
-                        break;
-                    }
-                case constants::F32CONST:
-                    {
-                        uint32_t num = reinterpret_cast<uint32_t&>(instruction->float_parameter);
-                        for (int i = 0; i < 4; ++i) {
-                            fullOutput->writeByte(num & 0xFF);
-                            num >>= 8;
-                        }
-                    }
-            }
-        }
-    }
-    fullOutput->fixUpByte(bodyFixup - 1, fullOutput->getCurrentByteIndex() - bodyFixup);
+ByteStream *Compiler::compile() {
+    compileBodies();
+    collectFunctionTypes();
+
+    SizeCounter counter;
+    writeModule(counter);
 
+    uint8_t* start = fullOutput->allocate(counter.size());
+    BufferWriter writer(start);
+    writeModule(writer);
+    if (writer.position() != start + counter.size()) {
+        throw std::logic_error("Compiler: the module came out at a different size than computed");
+    }
     return fullOutput;
 }
 
+void Compiler::compileBodies() {
+    size_t count = functions.size();
+    cached.assign(count, nullptr);
+    bodies.assign(count, {});
+    std::vector<uint32_t> work;
+    for (size_t i = 0; i < count; ++i) {
+        if (!functions[i]->isImported) {
+            cached[i] = cache != nullptr ? cache->find(i) : nullptr;
+            work.push_back(i);
+        }
+    }
+    passManager.prepare(functions);
+
+    // Callees go before their callers, so that they are inlined optimized. Recursive functions are
+    // never inlined and every other call leads to a function that can't call back: no cycles.
+    std::vector<bool> recursive = findRecursion(functions);
+    std::vector<std::vector<uint32_t>> callers(count);
+    std::vector<std::atomic<int>> waiting(count);
+    for (auto f : work) {
+        for (auto instruction : *functions[f]->body) {
+            const opcodes::OpcodeInfo* info = instructionInfo(instruction);
+            uint32_t g = instruction->parameter;
+            if (info != nullptr && info->prefix == 0 && info->code == constants::CALL && g < count && g != f &&
+                !recursive[g] && !functions[g]->isImported) {
+                callers[g].push_back(f);
+                waiting[f]++;
+            }
+        }
+    }
+    std::vector<uint32_t> ready;
+    for (auto f : work) {
+        if (waiting[f] == 0) {
+            ready.push_back(f);
+        }
+    }
 
-std::vector<Instruction*> Compiler::foldConstants(std::vector<Instruction*> input) {
-    std::vector<Instruction*> output;
-    bool mergedSomethingInPreviousIteration = true;
-
-    while( mergedSomethingInPreviousIteration ){
-        mergedSomethingInPreviousIteration = false;
-        output = std::vector<Instruction*>();
-
-        for ( int i = 0; i < input.size(); ++i ) {
-            Instruction* instruction = input[i];
-
-            if ( instruction->type == InstructionType::CONST ) {
-                // TODO: properly check if we're not at the end of the vector!
-                Instruction* next     = input[ i + 1 ];
-                Instruction* nextnext = input[ i + 2 ];
-
-                if ( next->type == InstructionType::CONST && nextnext->type == InstructionType::CALCULATION ) {
-                    // we can fold!
-					Instruction *folded = new Instruction( InstructionType::CONST );
-					folded->instruction_code = (int) instruction->instruction_code; // is i32.const!
-
-                    if ( nextnext->instruction_code == constants::I32ADD ) {
-					    folded->parameter = instruction->parameter + next->parameter;
-                        
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->parameter << " + " << next->parameter << " to " << folded->parameter << std::endl;
-                    } else if(nextnext->instruction_code == constants::I32SUB) {
-                        folded->parameter = instruction->parameter - next->parameter;
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->parameter << " - " << next->parameter << " to " << folded->parameter << std::endl;
-                    } else if (nextnext->instruction_code == constants::I32MUL) {
-                        folded->parameter = instruction->parameter * next->parameter;
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->parameter << " * " << next->parameter << " to " << folded->parameter << std::endl;
-                    } else if(nextnext->instruction_code == constants::F32ADD) {
-                        folded->float_parameter = instruction->float_parameter + next->float_parameter;
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->float_parameter << " + " << next->float_parameter << " to " << folded->float_parameter << std::endl;
-                    } else if(nextnext->instruction_code == constants::F32SUB) {
-                        folded->float_parameter = instruction->float_parameter - next->float_parameter;
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->float_parameter << " - " << next->float_parameter << " to " << folded->float_parameter << std::endl;
-                    } else if(nextnext->instruction_code == constants::F32MUL) {
-                        folded->float_parameter = instruction->float_parameter * next->float_parameter;
-                        std::cout << "Compiler::foldConstants : Folded " << instruction->float_parameter << " * " << next->float_parameter << " to " << folded->float_parameter << std::endl;
-                    }
-                    else {
-                        std::cout << "Compiler::foldConstants : can't fold " << nextnext->instruction_code << std::endl;
-                    }
-
-					output.push_back( folded );
-
-                    i += 2; // not 3, because the loop will do ++i at the end as well!
-                    mergedSomethingInPreviousIteration = true;
-                }
-                else {
-                    output.push_back( instruction );
+    std::optional<ThreadPool> ownPool;
+    ThreadPool* threads = pool;
+    if (threads == nullptr) {
+        ownPool.emplace(std::min(ThreadPool::defaultWorkers(), work.empty() ? 0 : work.size() - 1));
+        threads = &*ownPool;
+    }
+    // an arena per thread, they become part of the Compiler's once all bodies are done
+    std::vector<std::unique_ptr<Arena>> arenas;
+    for (size_t i = 0; i <= threads->size(); ++i) {
+        arenas.push_back(std::make_unique<Arena>());
+    }
+    std::function<void(uint32_t)> start = [&](uint32_t f) {
+        threads->submit([&, f](size_t thread) {
+            compileBody(f, arenas[thread].get());
+            for (auto caller : callers[f]) {
+                if (--waiting[caller] == 0) {
+                    start(caller);
                 }
             }
-            else {
-                output.push_back( instruction );
+        });
+    };
+    for (auto f : ready) {
+        start(f);
+    }
+    threads->wait();
+    for (auto& threadArena : arenas) {
+        arena->absorb(*threadArena);
+    }
+
+    if (cache != nullptr) {
+        for (auto f : work) {
+            if (cached[f] == nullptr) {
+                cache->store(f, functions[f], bodies[f].data(), bodies[f].size());
             }
         }
+    }
+}
 
-        input = output; // prepare for next iteration
+void Compiler::compileBody(size_t index, Arena* arena) {
+    AST_Function* function = functions[index];
+    if (cached[index] != nullptr) {
+        function->body = arena->make<std::vector<Instruction*>>();
+        for (const auto& instruction : cached[index]->body) {
+            function->body->push_back(arena->make<Instruction>(instruction));
+        }
+        function->locals = cached[index]->locals;
+        return;
     }
+    passManager.run(function, functions, arena);
 
-    return output;
+    SizeCounter counter;
+    writeCode(counter, function);
+    bodies[index].resize(counter.size());
+    BufferWriter writer(bodies[index].data());
+    writeCode(writer, function);
 }
 
-ByteStream *Compiler::compile() {
-    int fixUpByte;
-    bool exportFound = false;
-
+template <typename Sink>
+void Compiler::writeModule(Sink& out) {
     // magic number and version
-    for (uint8_t byte : {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00}) {
-        fullOutput->writeByte(byte);
+    static const uint8_t header[] = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+    out.bytes(header, sizeof(header));
+
+    // imported memories, functions and globals are always first in their lists
+    auto isImported = [](const auto* item) { return item->isImported; };
+    auto isExported = [](const auto* item) { return item->name.length() > 0 && !item->isImported; };
+    size_t importFunctions = std::count_if(functions.begin(), functions.end(), isImported);
+    size_t importMemories = std::count_if(memories.begin(), memories.end(), isImported);
+    size_t importGlobals = std::count_if(globals.begin(), globals.end(), isImported);
+    size_t ownFunctions = functions.size() - importFunctions;
+    bool exportFound = std::any_of(functions.begin(), functions.end(), isExported) ||
+                       std::any_of(memories.begin(), memories.end(), isExported) ||
+                       std::any_of(globals.begin(), globals.end(), isExported);
+
+    if (types.size() > 0) {
+        writeSection(out, constants::TYPE_SECTION, [&](auto& section) { writeTypeSection(section); });
     }
 
-    // type section
-    if (!functions.empty()) {
-        fullOutput->writeByte(0x01);
-        fullOutput->writeByte(0);
-        fixUpByte = fullOutput->getCurrentByteIndex();
-        writeTypeSection();
-        fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
+    if (importFunctions + importMemories + importGlobals > 0) {
+        writeSection(out, constants::IMPORT_SECTION, [&](auto& section) { writeImportSection(section); });
     }
 
-    // import section
-    // imported memory or functions will always be first in the list
-    if (!memories.empty()) {
-        if (memories[0]->isImported) {
-            writeImportSection();
-        }
-    } else if (!functions.empty()) {
-        if (functions[0]->isImported) {
-            writeImportSection();
-        }
+    if (ownFunctions > 0) {
+        writeSection(out, constants::FUNCTION_SECTION, [&](auto& section) {
+            section.u32(ownFunctions);
+            for (size_t i = 0; i < functions.size(); ++i) {
+                if (!functions[i]->isImported) {
+                    section.u32(functionTypes[i]);
+                }
+            }
+        });
     }
 
-    // function section
-    int importFunctions = 0;
-    for (auto function : functions) {
-        if (function->isImported) {
-            importFunctions++;
-        }
-    }
-    if ((functions.size() - importFunctions) > 0) {
-        fullOutput->writeByte(0x03);
-        fullOutput->writeByte(1 + (functions.size() - importFunctions));
-        fullOutput->writeByte((functions.size() - importFunctions));
-        for (auto func : functions) {
-            if (func->isImported) {
-                continue;
-            }
-            if (func->name.length() > 0) {
-                exportFound = true;
+    if (!tables.empty()) {
+        writeSection(out, constants::TABLE_SECTION, [&](auto& section) {
+            section.u32(tables.size());
+            for (auto table : tables) {
+                section.byte(constants::FUNCREF);
+                writeLimits(section, table);
             }
-            for (int i = 0; i < functionTypes.size(); i++) {
-                auto type = functionTypes[i];
-                if (type[0] == func->parameters && type[1] == func->results) {
-                    fullOutput->writeByte(i);
-                    break;
+        });
+    }
+
+    if (memories.size() > importMemories) {
+        writeSection(out, constants::MEMORY_SECTION, [&](auto& section) {
+            section.u32(memories.size() - importMemories);
+            for (auto memory : memories) {
+                if (!memory->isImported) {
+                    writeLimits(section, memory);
                 }
             }
-        }
+        });
     }
 
-    // memory section
-    if (!memories.empty()) {
-        if (!memories[0]->isImported) {
-            if (memories[0]->name.length() > 0) {
-                exportFound = true;
+    if (globals.size() > importGlobals) {
+        writeSection(out, constants::GLOBAL_SECTION, [&](auto& section) {
+            section.u32(globals.size() - importGlobals);
+            for (auto global : globals) {
+                if (!global->isImported) {
+                    writeGlobalType(section, global);
+                    writeInstruction(section, global->value);
+                    section.byte(0x0B); // end of the initial value
+                }
             }
-            fullOutput->writeByte(0x05);
-            fullOutput->writeByte(0);
-            fixUpByte = fullOutput->getCurrentByteIndex();
-            fullOutput->writeByte(memories.size());
-            for (auto memory: memories) {
-                if (memory->max_value > 0) {
-                    fullOutput->writeByte(1); // limits flag for 2 limits
+        });
+    }
+
+    if (exportFound) {
+        writeSection(out, constants::EXPORT_SECTION, [&](auto& section) { writeExportSection(section); });
+    }
+
+    if (!elements.empty()) {
+        writeSection(out, constants::ELEMENT_SECTION, [&](auto& section) {
+            section.u32(elements.size());
+            for (auto element : elements) {
+                if (element->table == 0) {
+                    section.byte(0); // flags: active, table 0, function indices
                 } else {
-                    fullOutput->writeByte(0); // no upper limit
+                    section.byte(2); // flags: active, with a table index
+                    section.u32(element->table);
                 }
-                fullOutput->writeByte(memory->initial_value);
-                if (memory->max_value > 0) {
-                    fullOutput->writeByte(memory->max_value);
+                section.byte(constants::I32CONST);
+                section.s64((int32_t) element->offset);
+                section.byte(0x0B); // end of the offset expression
+                if (element->table != 0) {
+                    section.byte(0x00); // element kind: functions
+                }
+                section.u32(element->functions.size());
+                for (uint32_t function : element->functions) {
+                    section.u32(function);
                 }
             }
-            fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
-        }
+        });
     }
 
-    // export section
-    if (exportFound) {
-        fullOutput->writeByte(0x07);
-        fullOutput->writeByte(0);
-        fixUpByte = fullOutput->getCurrentByteIndex();
-        writeExportSection();
-        fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
-    }
-
-    if (datas.size() > 0) {
-        // dataCount section
-        fullOutput->writeByte(0x0C);
-        fullOutput->writeByte(0);
-        fixUpByte = fullOutput->getCurrentByteIndex();
-        fullOutput->writeByte(datas.size());
-        fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
-
-        // data section
-        fullOutput->writeByte(0x0B);
-        fullOutput->writeByte(0);
-        fixUpByte = fullOutput->getCurrentByteIndex();
-        fullOutput->writeByte(datas.size());
-        for (auto data : datas) {
-            fullOutput->writeByte(0); // flags
-            fullOutput->writeByte(data->type);
-            fullOutput->writeByte(data->value);
-            fullOutput->writeByte(0xB);
-            fullOutput->writeByte(data->data.length());
-            for (char byte : data->data) {
-                fullOutput->writeByte(byte);
+    if (!datas.empty()) {
+        writeSection(out, constants::DATACOUNT_SECTION, [&](auto& section) { section.u32(datas.size()); });
+    }
+
+    if (ownFunctions > 0) {
+        writeSection(out, constants::CODE_SECTION, [&](auto& section) {
+            section.u32(ownFunctions);
+            for (size_t i = 0; i < functions.size(); ++i) {
+                if (!functions[i]->isImported) {
+                    writeBody(section, i);
+                }
             }
-        }
-        fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
-    }
-
-    // code section
-    if ((functions.size() - importFunctions) > 0) {
-        fullOutput->writeByte(0x0A);
-        fullOutput->writeByte(0);
-        fixUpByte = fullOutput->getCurrentByteIndex();
-        fullOutput->writeByte(functions.size() - importFunctions);
-        for (auto function : functions) {
-            if (function->isImported) {
-                continue;
+        });
+    }
+
+    // the data section comes after the code, as the spec orders them
+    if (!datas.empty()) {
+        writeSection(out, constants::DATA_SECTION, [&](auto& section) {
+            section.u32(datas.size());
+            for (auto data : datas) {
+                if (data->passive) {
+                    section.byte(1); // flags: passive
+                    writeString(section, data->data);
+                    continue;
+                }
+                if (data->memory == 0) {
+                    section.byte(0); // flags: active, memory 0
+                } else {
+                    section.byte(2); // flags: active, with a memory index
+                    section.u32(data->memory);
+                }
+                section.byte(data->type);
+                section.s64((int32_t) data->value);
+                section.byte(0x0B); // end of the offset expression
+                writeString(section, data->data);
             }
-            compileBody(function);
-        }
-        fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
+        });
     }
+}
 
-    return fullOutput;
+// what content writes, preceded by its size: measured in the first phase and taken from there in
+// the second one, in the same order
+template <typename Sink, typename Content>
+void Compiler::writeSized(Sink& out, Content content) {
+    if constexpr (std::is_same_v<Sink, SizeCounter>) {
+        size_t slot = sizes.size();
+        sizes.push_back(0);
+        SizeCounter inner;
+        content(inner);
+        sizes[slot] = inner.size();
+        out.u32(inner.size());
+        out.bytes(nullptr, inner.size());
+    } else {
+        out.u32(sizes[nextSize++]);
+        content(out);
+    }
 }
 
-void Compiler::writeTypeSection() {
-    // find function types
+template <typename Sink, typename Content>
+void Compiler::writeSection(Sink& out, uint8_t id, Content content) {
+    out.byte(id);
+    writeSized(out, content);
+}
+
+void Compiler::collectFunctionTypes() {
+    types = TypeTable();
+    for (const auto& type : declaredTypes) {
+        types.add(type);
+    }
+    functionTypes.clear();
     for (auto function : functions) {
-        bool exists = false;
-        for (auto type : functionTypes) {
-            if (type[0] == function->parameters && type[1] == function->results) {
-                exists = true;
-                break;
-            }
-        }
-        if (!exists) {
-            auto arr = std::array<std::vector<VariableType>, 2>();
-            arr[0] = function->parameters;
-            arr[1] = function->results;
-            functionTypes.push_back(arr);
-        }
+        functionTypes.push_back(types.intern(function->parameters, function->results));
     }
+}
 
-    fullOutput->writeByte(functionTypes.size());
-    for (auto type : functionTypes) {
-        fullOutput->writeByte(0x60);
-        fullOutput->writeByte(type[0].size());
-        for (auto par : type[0]) {
-            switch (par) {
-                case VariableType::is_int32:
-                    fullOutput->writeByte(constants::INT32);
-                    break;
-                case VariableType::is_int64:
-                    fullOutput->writeByte(constants::INT64);
-                    break;
-                case VariableType::isfloat32_t:
-                    fullOutput->writeByte(constants::FLOAT32);
-                    break;
-                case VariableType::isfloat64_t:
-                    fullOutput->writeByte(constants::FLOAT64);
-                    break;
-            }
-        }
-        fullOutput->writeByte(type[1].size());
-        for (auto par : type[1]) {
-            switch (par) {
-                case VariableType::is_int32:
-                    fullOutput->writeByte(constants::INT32);
-                    break;
-                case VariableType::is_int64:
-                    fullOutput->writeByte(constants::INT64);
-                    break;
-                case VariableType::isfloat32_t:
-                    fullOutput->writeByte(constants::FLOAT32);
-                    break;
-                case VariableType::isfloat64_t:
-                    fullOutput->writeByte(constants::FLOAT64);
-                    break;
+template <typename Sink>
+void Compiler::writeTypeSection(Sink& out) {
+    out.u32(types.size());
+    for (const auto& type : types.getTypes()) {
+        out.byte(0x60);
+        for (const auto* values : { &type.parameters, &type.results }) {
+            out.u32(values->size());
+            for (auto value : *values) {
+                out.byte(valueType(value));
             }
         }
     }
 }
 
-void Compiler::writeExportSection() {
+template <typename Sink>
+void Compiler::writeExportSection(Sink& out) {
     int memCount = 0;
     for (auto memory : memories) {
         if (memory->name.length() > 0 && !memory->isImported) {
@@ -346,36 +388,41 @@ void Compiler::writeExportSection() {
             funcCount++;
         }
     }
-    fullOutput->writeByte(funcCount + memCount);
-    for (int i = 0; i < memories.size(); i++) {
+    int globalCount = 0;
+    for (auto global : globals) {
+        if (global->name.length() > 0 && !global->isImported) {
+            globalCount++;
+        }
+    }
+    out.u32(funcCount + memCount + globalCount);
+    for (size_t i = 0; i < memories.size(); i++) {
         if (memories[i]->name.length() == 0 || memories[i]->isImported) {
             continue;
         }
-        fullOutput->writeByte(memories[i]->name.length());
-        for (auto c : memories[i]->name) {
-            fullOutput->writeByte(c);
-        }
-        fullOutput->writeByte(2); // type = memory
-        fullOutput->writeByte(i); // index
+        writeString(out, memories[i]->name);
+        out.byte(2); // type = memory
+        out.u32(i); // index
     }
-    for (int i = 0; i < functions.size(); i++) {
+    for (size_t i = 0; i < functions.size(); i++) {
         if (functions[i]->name.length() == 0 || functions[i]->isImported) {
             continue;
         }
-        fullOutput->writeByte(functions[i]->name.size());
-        for (auto c : functions[i]->name) {
-            fullOutput->writeByte(c);
+        writeString(out, functions[i]->name);
+        out.byte(0); // type = function
+        out.u32(i); // index
+    }
+    for (size_t i = 0; i < globals.size(); i++) {
+        if (globals[i]->name.length() == 0 || globals[i]->isImported) {
+            continue;
         }
-        fullOutput->writeByte(0); // type = function
-        fullOutput->writeByte(i); // index
+        writeString(out, globals[i]->name);
+        out.byte(3); // type = global
+        out.u32(i); // index
     }
 }
 
-void Compiler::writeImportSection() {
-    fullOutput->writeByte(0x02);
-    fullOutput->writeByte(0);
-    int fixUpByte = fullOutput->getCurrentByteIndex();
-
+template <typename Sink>
+void Compiler::writeImportSection(Sink& out) {
     int exportMem = 0, exportFunc = 0;
     for (auto memory : memories) {
         if (memory->isImported) {
@@ -387,45 +434,142 @@ void Compiler::writeImportSection() {
             exportFunc++;
         }
     }
-    fullOutput->writeByte(exportMem + exportFunc);
-    for (int i = 0; i < exportMem; i++) {
-        fullOutput->writeByte(memories[i]->importModule.length());
-        for (auto c : memories[i]->importModule) {
-            fullOutput->writeByte(c);
-        }
-        fullOutput->writeByte(memories[i]->importField.length());
-        for (auto c : memories[i]->importField) {
-            fullOutput->writeByte(c);
-        }
-        fullOutput->writeByte(2); // type = memory
-        if (memories[i]->max_value > 0) {
-            fullOutput->writeByte(1); // limits flag for 2 limits
-        } else {
-            fullOutput->writeByte(0); // no upper limit
-        }
-        fullOutput->writeByte(memories[i]->initial_value);
-        if (memories[i]->max_value > 0) {
-            fullOutput->writeByte(memories[i]->max_value);
+    int importGlobal = 0;
+    for (auto global : globals) {
+        if (global->isImported) {
+            importGlobal++;
         }
     }
+    out.u32(exportMem + exportFunc + importGlobal);
+    for (int i = 0; i < exportMem; i++) {
+        writeString(out, memories[i]->importModule);
+        writeString(out, memories[i]->importField);
+        out.byte(2); // type = memory
+        writeLimits(out, memories[i]);
+    }
     for (int i = 0; i < exportFunc; i++) {
-        fullOutput->writeByte(functions[i]->importModule.length());
-        for (auto c : functions[i]->importModule) {
-            fullOutput->writeByte(c);
-        }
-        fullOutput->writeByte(functions[i]->importField.length());
-        for (auto c : functions[i]->importField) {
-            fullOutput->writeByte(c);
+        writeString(out, functions[i]->importModule);
+        writeString(out, functions[i]->importField);
+        out.byte(0); // type = function
+        out.u32(functionTypes[i]);
+    }
+    for (int i = 0; i < importGlobal; i++) {
+        writeString(out, globals[i]->importModule);
+        writeString(out, globals[i]->importField);
+        out.byte(3); // type = global
+        writeGlobalType(out, globals[i]);
+    }
+}
+
+template <typename Sink>
+void Compiler::writeBody(Sink& out, size_t index) {
+    const std::vector<uint8_t>& code = cached[index] != nullptr ? cached[index]->code : bodies[index];
+    writeSized(out, [&](auto& body) { body.bytes(code.data(), code.size()); });
+}
+
+template <typename Sink>
+void Compiler::writeCode(Sink& out, const AST_Function* function) {
+    // runs of locals of the same type as one entry
+    std::vector<std::pair<uint32_t, uint8_t>> runs;
+    for (uint8_t type : function->locals) {
+        if (!runs.empty() && runs.back().second == type) {
+            runs.back().first++;
+        } else {
+            runs.emplace_back(1, type);
         }
-        fullOutput->writeByte(0); // type = function
-        for (int j = 0; j < functionTypes.size(); ++j) {
-            auto type = functionTypes[j];
-            if (type[0] == functions[i]->parameters && type[1] == functions[i]->results) {
-                fullOutput->writeByte(j);
+    }
+    out.u32(runs.size());
+    for (const auto& run : runs) {
+        out.u32(run.first);
+        out.byte(run.second);
+    }
+
+    for (auto instruction : *function->body) {
+        writeInstruction(out, instruction);
+    }
+}
+
+template <typename Sink>
+void Compiler::writeInstruction(Sink& out, const Instruction* instruction) {
+    if (instruction->prefix != 0) {
+        out.byte(instruction->prefix);
+        out.u32(instruction->instruction_code);
+    } else {
+        out.byte(instruction->instruction_code);
+    }
+
+    // types (e.g. the i32 of a result) are instructions without parameter too, but have no table entry
+    if (instruction->type == InstructionType::INSTRUCTION_WITHOUT_PARAMETER) {
+        return;
+    }
+
+    const opcodes::OpcodeInfo* info = opcodes::byCode(instruction->prefix, instruction->instruction_code);
+    switch (info->immediate) {
+        case opcodes::Immediate::NONE:
+            break;
+        case opcodes::Immediate::BLOCKTYPE:
+            out.bytes(instruction->block_parameters.data(), instruction->block_parameters.size());
+            break;
+        case opcodes::Immediate::MEMARG8:
+        case opcodes::Immediate::MEMARG16:
+        case opcodes::Immediate::MEMARG32:
+        case opcodes::Immediate::MEMARG64:
+        case opcodes::Immediate::MEMARG128:
+            out.u32(opcodes::naturalAlignment(info->immediate));
+            out.u32(instruction->parameter);
+            break;
+        case opcodes::Immediate::MEMORY:
+            out.byte(0);
+            break;
+        case opcodes::Immediate::MEMORY_MEMORY:
+            out.byte(0);
+            out.byte(0);
+            break;
+        case opcodes::Immediate::CALL_INDIRECT:
+        case opcodes::Immediate::DATA_MEMORY:
+            out.u32(instruction->parameter);
+            out.byte(0); // table or memory index
+            break;
+        case opcodes::Immediate::I32:
+            out.s64((int32_t) instruction->parameter);
+            break;
+        case opcodes::Immediate::I64:
+            out.s64(instruction->long_parameter);
+            break;
+        case opcodes::Immediate::F32:
+            {
+                uint32_t num = std::bit_cast<uint32_t>(instruction->float_parameter);
+                for (int i = 0; i < 4; ++i) {
+                    out.byte(num & 0xFF);
+                    num >>= 8;
+                }
                 break;
             }
-        }
+        case opcodes::Immediate::F64:
+            {
+                uint64_t num = std::bit_cast<uint64_t>(instruction->double_parameter);
+                for (int i = 0; i < 8; ++i) {
+                    out.byte(num & 0xFF);
+                    num >>= 8;
+                }
+                break;
+            }
+        case opcodes::Immediate::V128:
+        case opcodes::Immediate::SHUFFLE:
+            out.bytes(instruction->v128_parameter.bytes, 16);
+            break;
+        case opcodes::Immediate::LANE:
+            out.byte(instruction->parameter);
+            break;
+        case opcodes::Immediate::LABEL_TABLE:
+            out.u32(instruction->labels.size() - 1);
+            for (uint32_t label : instruction->labels) {
+                out.u32(label);
+            }
+            break;
+        default:
+            // LABEL, FUNCTION, LOCAL, GLOBAL, DATA: a single index
+            out.u32(instruction->parameter);
+            break;
     }
-
-    fullOutput->fixUpByte(fixUpByte - 1, fullOutput->getCurrentByteIndex() - fixUpByte);
 }
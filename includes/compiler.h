@@ -6,28 +6,74 @@
 #include "bytestream.h"
 #include "instruction.h"
 #include "AST_Types.h"
-#include <array>
+#include "arena.h"
+#include "optimizer.h"
+#include "compilecache.h"
+#include "symbols.h"
+#include "threadpool.h"
 
+// The function bodies are optimized and encoded each into a buffer of their own, on a ThreadPool:
+// a function starts once the functions it may inline are done. The module is then emitted in two
+// phases: the first one only counts bytes, which gives the size of every section and function body
+// up front, the second one writes into the output after it was allocated once at its final size.
+// Both go through the same write* templates, the Sink is what differs (see compiler.cpp).
 class Compiler {
 private:
-    ByteStream* fullOutput = new ByteStream();
+    Arena* arena;
+    ByteStream* fullOutput;
     std::vector<Instruction*> instructions;
     std::vector<AST_Function*> functions;
     std::vector<AST_Memory*> memories;
+    std::vector<AST_Global*> globals;
     std::vector<AST_Data*> datas;
-    std::vector<std::array<std::vector<VariableType>, 2>> functionTypes;
+    std::vector<AST_Table*> tables;
+    std::vector<AST_Element*> elements;
+    std::vector<AST_Type> declaredTypes;    // come first in the type section, call_indirect uses them
+    TypeTable types;
+    std::vector<uint32_t> functionTypes;    // per function, its index in types
+    PassManager passManager = PassManager::createDefault();
+    CompileCache* cache = nullptr;
+    ThreadPool* pool = nullptr;
+    std::vector<const CompileCache::Entry*> cached;    // per function, when its body came from the cache
+    std::vector<std::vector<uint8_t>> bodies;          // per function, its encoded body otherwise
 
-    std::vector<Instruction*> foldConstants(std::vector<Instruction*> input);
-    ByteStream* compileBody(AST_Function* function);
-    void writeTypeSection();
-    void writeImportSection();
-    void writeExportSection();
+    // the content size of each section and body in the order they are written, from the first phase
+    std::vector<uint32_t> sizes;
+    size_t nextSize = 0;
+
+    void compileBodies();
+    void compileBody(size_t index, Arena* arena);
+    void collectFunctionTypes();
+
+    template <typename Sink> void writeModule(Sink& out);
+    template <typename Sink, typename Content> void writeSized(Sink& out, Content content);
+    template <typename Sink, typename Content> void writeSection(Sink& out, uint8_t id, Content content);
+    template <typename Sink> void writeTypeSection(Sink& out);
+    template <typename Sink> void writeImportSection(Sink& out);
+    template <typename Sink> void writeExportSection(Sink& out);
+    template <typename Sink> void writeBody(Sink& out, size_t index);
+    template <typename Sink> void writeCode(Sink& out, const AST_Function* function);
+    template <typename Sink> void writeInstruction(Sink& out, const Instruction* instruction);
 
 public:
-    Compiler(std::vector<AST_Function*> funcs, std::vector<AST_Memory*> mems, std::vector<AST_Data*> data) : functions(funcs), memories(mems), datas(data) {};
+    Compiler(std::vector<AST_Function*> funcs, std::vector<AST_Memory*> mems, std::vector<AST_Data*> data, Arena* arena)
+        : arena(arena), fullOutput(arena->make<ByteStream>()), functions(funcs), memories(mems), datas(data) {};
+    Compiler(const AST_Module& module, Arena* arena)
+        : Compiler(module.functions, module.memories, module.datas, arena) {
+        declaredTypes = module.types;
+        globals = module.globals;
+        tables = module.tables;
+        elements = module.elements;
+    };
 
     ByteStream* compile();
     void writeFile(std::string filepath) { fullOutput->writeFile(filepath); };
+    // the optimizations run on every function body, passes can be added before compile()
+    PassManager& getPassManager() { return passManager; }
+    // functions the cache has are not optimized and encoded again, it has to be prepared for this module
+    void setCache(CompileCache* cache) { this->cache = cache; }
+    // without one, compile() starts threads of its own for modules of more than one function
+    void setThreadPool(ThreadPool* pool) { this->pool = pool; }
 };
 
-#endif // __COMPILER_H__
\ No newline at end of file
+#endif // __COMPILER_H__
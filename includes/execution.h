@@ -0,0 +1,127 @@
+#ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_EXECUTION_H
+#define SEIS_JARNETHYS_MARTIJNSNOEKS_EXECUTION_H
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+// what an execution may still run before it suspends, in instructions, and how deep its calls are
+struct Fuel {
+    uint64_t remaining = 0;
+    int depth = 0;
+};
+
+// A call of a module that runs in slices: each resume() runs it on for a number of instructions, then
+// it suspends and leaves the thread to something else, another execution for one. Every call it makes
+// is a coroutine of its own that the one making it awaits; they run one after the other on the
+// coroutine frames, so only the innermost one is resumed.
+//
+// An Execution is also what a coroutine of the embedder can co_await: it goes on once the call has
+// returned, the trap it ended with is thrown there. It doesn't run the execution, whoever resumes
+// that does, an event loop; the slice the call returns in goes on with the awaiting coroutine.
+class Execution {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // where a call goes once it returned: on with the call that made it, back to resume() for the first
+    struct Return {
+        bool await_ready() noexcept { return false; }
+        std::coroutine_handle<> await_suspend(Handle call) noexcept {
+            promise_type& promise = call.promise();
+            if (promise.parent) {
+                *promise.innermost = promise.parent;
+                return promise.parent;
+            }
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+        Handle parent;                          // the call that made this one, none for the first
+        Handle* innermost = &running;           // the first call's running, all its calls share it
+        Handle running;                         // of the first call: the call that runs now
+        std::coroutine_handle<> continuation;   // of the first call: the coroutine that awaits it
+        std::exception_ptr exception;
+
+        Execution get_return_object() {
+            running = Handle::from_promise(*this);
+            return Execution(running);
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        Return final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    Execution(Execution&& other) noexcept
+        : handle(std::exchange(other.handle, nullptr)), fuel(other.fuel), slice(other.slice) {}
+    Execution& operator=(Execution&& other) noexcept {
+        std::swap(handle, other.handle);
+        fuel = other.fuel;
+        slice = other.slice;
+        return *this;
+    }
+    // one that isn't done is cancelled, its calls are unwound
+    ~Execution() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool done() const { return handle.done(); }
+
+    // Runs the call on for a slice, true once it has returned. The trap it ended with is thrown here,
+    // unless a coroutine awaits it: that one goes on then, and it may well destroy this execution.
+    bool resume() {
+        if (!handle.done()) {
+            fuel->remaining = slice;
+            handle.promise().innermost->resume();
+        }
+        promise_type& promise = handle.promise();
+        if (!handle.done()) {
+            return false;
+        }
+        if (promise.continuation) {
+            std::exchange(promise.continuation, nullptr).resume();
+        } else if (promise.exception) {
+            std::rethrow_exception(std::exchange(promise.exception, nullptr));
+        }
+        return true;
+    }
+
+    bool await_ready() const { return handle.done(); }
+    template <typename P>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<P> awaiting) {
+        promise_type& promise = handle.promise();
+        if constexpr (std::is_same_v<P, promise_type>) {
+            // a call, it runs right away
+            promise.parent = awaiting;
+            promise.innermost = awaiting.promise().innermost;
+            *promise.innermost = handle;
+            return handle;
+        } else {
+            promise.continuation = awaiting;
+            return std::noop_coroutine();
+        }
+    }
+    void await_resume() {
+        if (handle.promise().exception) {
+            std::rethrow_exception(std::exchange(handle.promise().exception, nullptr));
+        }
+    }
+
+private:
+    friend class Module;
+
+    Handle handle;
+    Fuel* fuel = nullptr;   // of the module, the first call's only
+    uint64_t slice = 0;
+
+    explicit Execution(Handle call) : handle(call) {}
+};
+
+#endif
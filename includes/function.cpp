@@ -1,12 +1,36 @@
 #include "function.h"
-#include <iostream>
+#include "numeric.h"
+#include "opcodes.h"
 #include <math.h>
 using namespace constants;
 
-Function::Function(std::vector<VariableType> parameterList, std::vector<VariableType> resultList, Stack *globalStack,
-                   std::vector<Function> *moduleFunctions, std::vector<GlobalVariable> *moduleGlobals, std::vector<Memory> *moduleMemory)
-            : params{ parameterList }, results{ resultList }, stack{ globalStack },
-              functions{ moduleFunctions }, globals{ moduleGlobals }, memories{ moduleMemory } {}
+namespace {
+
+// the unsigned conversions of the interpreter's signed integers
+template <typename I, typename F>
+I truncateUnsigned(F value) { return (I)numeric::truncate<std::make_unsigned_t<I>, F>(value); }
+
+template <typename I, typename F>
+I truncateSaturatedUnsigned(F value) { return (I)numeric::truncateSaturated<std::make_unsigned_t<I>, F>(value); }
+
+template <typename F, typename I>
+F convertUnsigned(I value) { return (F)(std::make_unsigned_t<I>)value; }
+
+int64_t extendUnsigned(int32_t value) { return (uint32_t)value; }
+
+// calls deeper than this trap, before the interpreter runs out of native stack
+constexpr int MAX_CALL_DEPTH = 2000;
+thread_local int callDepth = 0;
+
+}
+
+Function::Function(std::vector<VariableType> parameterList, std::vector<VariableType> resultList, uint32_t typeId, Stack *globalStack,
+                   std::vector<Function> *moduleFunctions, std::vector<std::shared_ptr<Global>> *moduleGlobals, std::vector<Memory> *moduleMemory,
+                   std::vector<std::vector<uint8_t>> *moduleDatas, std::vector<Table> *moduleTables, std::vector<uint32_t> *moduleTypeIds,
+                   const TypeTable *moduleSignatures, std::vector<Label> *moduleLabels)
+            : params{ parameterList }, results{ resultList }, typeId{ typeId }, stack{ globalStack },
+              functions{ moduleFunctions }, globals{ moduleGlobals }, memories{ moduleMemory }, datas{ moduleDatas },
+              tables{ moduleTables }, typeIds{ moduleTypeIds }, signatures{ moduleSignatures }, labels{ moduleLabels } {}
 
 void Function::setName(std::string functionName) {
     name = functionName;
@@ -24,92 +48,241 @@ void Function::addLocalVars(VariableType varType, int count) {
 
 void Function::setBody(std::vector<uint8_t> functionBody) {
     body = functionBody;
+    bs.readVector(body);
+    findJumps();
 }
 
+// Once, when the body is set: where every block and if ends, where the else of an if is, and the
+// labels of every br_table. Executing them is then a lookup by the byte they are at. The globals it
+// uses are checked here as well, global.get and global.set don't check them again.
 void Function::findJumps() {
-    auto origStack = stack;
-    auto origGlobals = globals;
-    auto origMemories = memories;
-    Stack tempStack(*stack);
-    std::vector<GlobalVariable> tempGlobals(*globals);
-    std::vector<Memory> tempMemories(*memories);
-    stack = &tempStack;
-    globals = &tempGlobals;
-    memories = &tempMemories;
-    bs.readVector(body);
-    uint8_t byte;
-
-    std::vector<std::array<int, 2>> openIfJumps;
-    std::vector<int> openBlockJumps;
-    std::vector<int> openLoopJumps;
-    std::vector<blockType> last;
-    std::array<int, 7> forbidden = { BR, BR_IF, BLOCK, IF, ELSE, CALL, LOOP };
-    std::vector<int> dummy;
-    while (!bs.atEnd() && bs.getRemainingByteCount() > 1) {
-        byte = bs.readByte();
+    jumps.assign(body.size() + 1, Jump{});
+    branchTables.clear();
+    // the blocks, loops and ifs that enclose the byte being read: the byte after their opcode, and the opcode
+    std::vector<std::pair<int, uint8_t>> open;
+    bs.setByteIndex(0);
+    while (!bs.atEnd()) {
+        uint8_t byte = bs.readByte();
         switch (byte) {
             case BLOCK:
-                {
-                    openBlockJumps.push_back(bs.getCurrentByteIndex());
-                    last.push_back(blockType::BLOCK);
-                    break;
-                }
             case LOOP:
-                {
-                    openLoopJumps.push_back(bs.getCurrentByteIndex());
-                    last.push_back(blockType::LOOP);
-                    break;
-                }
             case IF:
+                open.emplace_back(bs.getCurrentByteIndex(), byte);
+                readBlockType(jumps[bs.getCurrentByteIndex()]);
+                break;
+            case ELSE:
+                if (!open.empty()) {
+                    jumps[open.back().first].next = bs.getCurrentByteIndex();
+                }
+                break;
+            case BLOCK_END:
                 {
-                    stack->pop<int32_t>();
-                    std::array<int, 2> a;
-                    a[0] = bs.getCurrentByteIndex();
-                    openIfJumps.push_back(a);
-                    last.push_back(blockType::IF);
+                    if (open.empty()) {
+                        break;  // the end of the function
+                    }
+                    Jump& jump = jumps[open.back().first];
+                    jump.end = bs.getCurrentByteIndex();
+                    if (open.back().second == IF && jump.next == 0) {
+                        // without an else branch a false condition goes to the end, which leaves the if
+                        jump.next = bs.getCurrentByteIndex() - 1;
+                    }
+                    open.pop_back();
                     break;
                 }
-            case ELSE:
+            case BR_TABLE:
                 {
-                    openIfJumps.back()[1] = bs.getCurrentByteIndex();
-                    bs.seek(-1);
+                    jumps[bs.getCurrentByteIndex()].next = branchTables.size();
+                    uint32_t count = bs.readUInt32();
+                    branchTables.push_back(count);
+                    for (uint32_t i = 0; i <= count; ++i) {
+                        branchTables.push_back(bs.readUInt32());
+                    }
                     break;
                 }
-            case BLOCK_END:
+            case GLOBALGET:
+            case GLOBALSET:
                 {
-                    if (last.back() == blockType::IF) {
-                        std::array<int, 2> a;
-                        a[0] = openIfJumps.back()[1];
-                        a[1] = bs.getCurrentByteIndex() - 1;
-                        ifJumps.insert(std::make_pair(openIfJumps.back()[0], a));
-                        openIfJumps.pop_back();
-                    } else if (last.back() == blockType::BLOCK) {
-                        blockJumps[openBlockJumps.back()] = bs.getCurrentByteIndex() - 1;
-                        openBlockJumps.pop_back();
-                    } else if (last.back() == blockType::LOOP) {
-                        loopJumps[bs.getCurrentByteIndex() - 1] = openLoopJumps.back();
-                        openLoopJumps.pop_back();
+                    uint32_t index = bs.readUInt32();
+                    if (index >= globals->size()) {
+                        throw FunctionException("Function '" + name + "' uses global " + std::to_string(index) + ", there are " +
+                                                std::to_string(globals->size()));
+                    }
+                    if (byte == GLOBALSET && !(*globals)[index]->isMutable) {
+                        throw FunctionException("Function '" + name + "' sets the immutable global " + std::to_string(index));
                     }
-                    last.pop_back();
                     break;
                 }
-
             default:
+                skipImmediates(byte);
                 break;
         }
-        if (std::any_of(forbidden.begin(), forbidden.end(), [byte](int i){ return byte == i; })) {
+    }
+}
+
+// empty (0x40), a value type, or the s33 index of a function type: as that is never negative, it reads
+// as an unsigned number
+void Function::readBlockType(Jump& jump) {
+    uint8_t byte = bs.peekByte();
+    if (byte >= 0x40 && byte < 0x80) {
+        bs.seek(1);
+        jump.results = byte == 0x40 ? 0 : 1;
+        return;
+    }
+    const AST_Type& type = (*signatures)[typeIds->at(bs.readUInt32())];
+    jump.params = type.parameters.size();
+    jump.results = type.results.size();
+}
+
+// by the immediate kind of the opcode table, so that every instruction of it can be stepped over
+void Function::skipImmediates(uint8_t byte) {
+    uint8_t prefix = 0;
+    uint32_t code = byte;
+    if (byte == MEMORY_BULK_OP || byte == SIMD_OP) {
+        prefix = byte;
+        code = bs.readUInt32();
+    }
+    const opcodes::OpcodeInfo* info = opcodes::byCode(prefix, code);
+    if (info == nullptr) {
+        return;
+    }
+    switch (info->immediate) {
+        case opcodes::Immediate::NONE:
+            break;
+        case opcodes::Immediate::BLOCKTYPE:
+            bs.readUInt32();
+            break;
+        case opcodes::Immediate::LANE:
             bs.seek(1);
+            break;
+        case opcodes::Immediate::LABEL_TABLE:
+            for (uint32_t count = bs.readUInt32(); count > 0; --count) {
+                bs.readUInt32();
+            }
+            bs.readUInt32(); // default label
+            break;
+        case opcodes::Immediate::CALL_INDIRECT:
+        case opcodes::Immediate::MEMARG8:
+        case opcodes::Immediate::MEMARG16:
+        case opcodes::Immediate::MEMARG32:
+        case opcodes::Immediate::MEMARG64:
+        case opcodes::Immediate::MEMARG128:
+        case opcodes::Immediate::MEMORY_MEMORY:
+        case opcodes::Immediate::DATA_MEMORY:
+            bs.readUInt32();
+            bs.readUInt32();
+            break;
+        case opcodes::Immediate::I32:
+            bs.readInt32();
+            break;
+        case opcodes::Immediate::I64:
+            bs.readInt64();
+            break;
+        case opcodes::Immediate::F32:
+            bs.seek(4);
+            break;
+        case opcodes::Immediate::F64:
+            bs.seek(8);
+            break;
+        case opcodes::Immediate::V128:
+        case opcodes::Immediate::SHUFFLE:
+            bs.seek(16);
+            break;
+        default:
+            // LABEL, FUNCTION, LOCAL, GLOBAL, MEMORY, DATA: a single index
+            bs.readUInt32();
+            break;
+    }
+}
+
+void Function::operator()(int offset) {
+    if (host.invoke != nullptr) {
+        host.invoke(host.target.get(), *stack, offset, memories);
+        return;
+    }
+    if (stack == nullptr) {
+        throw FunctionException("Imported function '" + name + "' is not provided");
+    }
+    if (callDepth == MAX_CALL_DEPTH) {
+        throw FunctionException("call stack exhausted");
+    }
+    // a function that calls itself runs on this same object again: where the caller was in the body,
+    // and its locals, are back once the call returns or traps
+    struct Activation {
+        Function* function;
+        int offset;
+        int labelBase;
+        int byte;
+        ~Activation() {
+            function->labels->resize(function->labelBase);
+            function->stackOffset = offset;
+            function->labelBase = labelBase;
+            function->bs.setByteIndex(byte);
+            --callDepth;
+        }
+    } activation{ this, stackOffset, labelBase, bs.getCurrentByteIndex() };
+    ++callDepth;
+
+    enter(offset);
+    bs.setByteIndex(0);
+    while (!bs.atEnd()) {
+        performOperation(bs.readByte(), *labels);
+    }
+    leave();
+}
+
+Execution Function::run(int offset, Fuel& fuel) {
+    if (host.invoke != nullptr || stack == nullptr) {
+        (*this)(offset);
+        co_return;
+    }
+    if (fuel.depth == MAX_CALL_DEPTH) {
+        throw FunctionException("call stack exhausted");
+    }
+    // as in operator(), but the frames of the calls are on the heap: they are kept while suspended
+    struct Activation {
+        Function* function;
+        Fuel& fuel;
+        int offset;
+        int labelBase;
+        int byte;
+        ~Activation() {
+            function->labels->resize(function->labelBase);
+            function->stackOffset = offset;
+            function->labelBase = labelBase;
+            function->bs.setByteIndex(byte);
+            --fuel.depth;
+        }
+    } activation{ this, fuel, stackOffset, labelBase, bs.getCurrentByteIndex() };
+    ++fuel.depth;
+
+    enter(offset);
+    bs.setByteIndex(0);
+    while (!bs.atEnd()) {
+        if (fuel.remaining == 0) {
+            co_await std::suspend_always();
+        }
+        --fuel.remaining;
+        uint8_t byte = bs.readByte();
+        if (byte != CALL && byte != CALL_INDIRECT) {
+            performOperation(byte, *labels);
+            continue;
+        }
+        uint32_t index = bs.readUInt32();
+        if (byte == CALL_INDIRECT) {
+            index = indirectTarget(index, bs.readUInt32());
+        }
+        Function& callee = (*functions)[index];
+        int calleeOffset = stack->size() - callee.params.size();
+        if (callee.host.invoke != nullptr) {
+            callee(calleeOffset);
         } else {
-            performOperation(byte, dummy, dummy);
+            co_await callee.run(calleeOffset, fuel);
         }
     }
-    stack = origStack;
-    globals = origGlobals;
-    memories = origMemories;
-    jumpsCalculated = true;
+    leave();
 }
 
-void Function::operator()(int offset) {
+void Function::enter(int offset) {
     stackOffset = offset;
     for (auto par : localVars) {
         switch (par) {
@@ -125,129 +298,89 @@ void Function::operator()(int offset) {
             case VariableType::isfloat64_t:
                 stack->push(float64_t());
                 break;
+            case VariableType::isv128_t:
+                stack->push(v128_t{});
+                break;
         }
     }
-    if (!jumpsCalculated) {
-        findJumps();
-    }
-    
-    std::vector<int> jumpStack;
-    std::vector<int> ifStack;
-    functionStart = stack->data();
-    bs.readVector(body);
-    uint8_t byte;
-    while (!bs.atEnd()) {
-        byte = bs.readByte();
-        performOperation(byte, jumpStack, ifStack);
-    }
-    // remove input variables from stack
-    stack->removeRange(stackOffset, stackOffset + params.size());
+    // the body is a block of its own, return is a branch to it
+    labelBase = labels->size();
+    labels->push_back({ (int)body.size(), stack->size(), (uint32_t)results.size(), false });
+}
+
+void Function::leave() {
+    // remove input and local variables from stack
+    stack->removeRange(stackOffset, stackOffset + params.size() + localVars.size());
 }
 
-void Function::performOperation(uint8_t byte, std::vector<int> &jumpStack, std::vector<int> &ifStack) {
+void Function::performOperation(uint8_t byte, std::vector<Label> &labels) {
     switch (byte) {
+        case UNREACHABLE:
+            throw FunctionException("unreachable");
+        case NOP:
+            break;
         case BLOCK:
             {
-                jumpStack.push_back(bs.getCurrentByteIndex());
-                bs.seek(1);
-                lastBlock.push(blockType::BLOCK);
+                const Jump& jump = jumps[bs.getCurrentByteIndex()];
+                bs.readUInt32();    // the block type, in the jump
+                labels.push_back({ jump.end, stack->size() - (int)jump.params, jump.results, false });
                 break;
             }
         case LOOP:
             {
-                loopStarts.push_back(stack->data());
-                jumpStack.push_back(bs.getCurrentByteIndex());
-                bs.seek(1);
-                lastBlock.push(blockType::LOOP);
+                const Jump& jump = jumps[bs.getCurrentByteIndex()];
+                bs.readUInt32();
+                labels.push_back({ bs.getCurrentByteIndex(), stack->size() - (int)jump.params, jump.params, true });
                 break;
             }
         case IF:
             {
-                if (stack->pop<int32_t>()) {
-                    ifStack.push_back(bs.getCurrentByteIndex());
-                    bs.seek(1); // Result type
-                } else {
-                    bs.setByteIndex(ifJumps[bs.getCurrentByteIndex()][0]);
+                const Jump& jump = jumps[bs.getCurrentByteIndex()];
+                bs.readUInt32();
+                bool condition = stack->pop<int32_t>();
+                labels.push_back({ jump.end, stack->size() - (int)jump.params, jump.results, false });
+                if (!condition) {
+                    bs.setByteIndex(jump.next);
                 }
                 break;
             }
         case ELSE:
+            // the end of the branch that ran, the other one is skipped
+            bs.setByteIndex(labels.back().continuation);
+            labels.pop_back();
+            break;
+        case BLOCK_END:
+            labels.pop_back();
+            break;
+        case BR:
+            branch(bs.readUInt32(), labels);
+            break;
+        case BR_IF:
             {
-                bs.setByteIndex(ifJumps[ifStack.back()][1]);
-                break;
-            }
-        case CALL:
-            {
-                uint32_t funcIndex = bs.readUInt32();
-                Function *func = &(*functions)[funcIndex];
-                if (func->name == "log") {
-                    auto var = stack->pop();
-                    switch (var.index()) {
-                        case 0:
-                            std::cout << "i32 log from wasm: " << std::get<int32_t>(var) << std::endl;
-                            break;
-                        case 1:
-                            std::cout << "i64 log from wasm: " << std::get<int64_t>(var) << std::endl;
-                            break;
-                        case 2:
-                            std::cout << "f32 log from wasm: " << std::get<float32_t>(var) << std::endl;
-                            break;
-                        case 3:
-                            std::cout << "f64 log from wasm: " << std::get<float64_t>(var) << std::endl;
-                            break;
-                        default:
-                            break;
-                    }
-                    return;
-                }
-                Function f = Function(func->params, func->results, func->stack, func->functions, func->globals, func->memories);
-                f.setBody(func->body);
-                if (stack->data() == functionStart && func->name == this->name) {
-                    std::cout << "Recursive function is endless\nStopping execution" << std::endl;
-                } else {
-                    f(stack->size() - functions->at(funcIndex).getParams().size());
+                uint32_t depth = bs.readUInt32();
+                if (stack->pop<int32_t>()) {
+                    branch(depth, labels);
                 }
                 break;
             }
-        case BR:
+        case BR_TABLE:
             {
-                int depth = bs.readUInt32();
-                bs.setByteIndex(blockJumps[jumpStack[jumpStack.size() - 1 - depth]]);
-                for (int i = 0; i < depth + 1; ++i) {
-                    jumpStack.pop_back();
-                }
+                // the count of labels, the labels, the default one: an index past them picks the default
+                const uint32_t* table = &branchTables[jumps[bs.getCurrentByteIndex()].next];
+                uint32_t index = stack->pop<int32_t>();
+                branch(table[1 + std::min(index, table[0])], labels);
                 break;
             }
-        case BR_IF:
+        case RETURN:
+            branch(labels.size() - 1 - labelBase, labels);
+            break;
+        case CALL:
+            call(bs.readUInt32());
+            break;
+        case CALL_INDIRECT:
             {
-                if (lastBlock.top() == blockType::BLOCK) {
-                    if (stack->pop<int32_t>()) {
-                        int depth = bs.readUInt32();
-                        bs.setByteIndex(blockJumps[jumpStack[jumpStack.size() - 1 - depth]]);
-                        for (int i = 0; i < depth + 1; ++i) {
-                            jumpStack.pop_back();
-                        }
-                    } else {
-                        bs.seek(1); // Break depth
-                    }
-                } else if (lastBlock.top() == blockType::LOOP) {
-                    if (stack->pop<int32_t>()) {
-                        if (stack->data() == loopStarts.back()) {
-                            std::cout << "Endless loop: stopping loop" << std::endl;
-                            bs.seek(1); // Break depth
-                        } else {
-                            int depth = bs.readUInt32();
-                            bs.setByteIndex(loopJumps[bs.getCurrentByteIndex()] - 1);
-                            for (int i = 0; i < depth + 1; ++i) {
-                                jumpStack.pop_back();
-                            }
-                        }
-                    } else {
-                        bs.seek(1); // Break depth
-                    }
-                    loopStarts.pop_back();
-                }
-                lastBlock.pop();
+                uint32_t type = bs.readUInt32();
+                callIndirect(type, bs.readUInt32());
                 break;
             }
         case DROP:
@@ -277,43 +410,96 @@ void Function::performOperation(uint8_t byte, std::vector<int> &jumpStack, std::
                 stack->at(bs.readUInt32() + stackOffset) = var;
                 break;
             }
+        // the index and the mutability were checked by findJumps
         case GLOBALGET:
-            stack->push(globals->at(bs.readUInt32()).getVariable());
+            stack->push((*globals)[bs.readUInt32()]->value);
             break;
         case GLOBALSET:
-            globals->at(bs.readUInt32()).setVariable(stack->pop());
+            (*globals)[bs.readUInt32()]->value = stack->pop();
             break;
         case I32LOAD:
+            {
+                bs.readUInt32(); // alignment
+                uint32_t offset = bs.readUInt32();
+                stack->push((*memories)[0].load<int32_t>(stack->pop<int32_t>(), offset));
+                break;
+            }
         case I64LOAD:
+            {
+                bs.readUInt32(); // alignment
+                uint32_t offset = bs.readUInt32();
+                stack->push((*memories)[0].load<int64_t>(stack->pop<int32_t>(), offset));
+                break;
+            }
         case F32LOAD:
-        case F64LOAD:
             {
-                auto index = stack->pop<int32_t>();
-                bs.seek(1); // alignment
+                bs.readUInt32(); // alignment
                 uint32_t offset = bs.readUInt32();
-                stack->push((*memories)[0].getMemory(index + (int)offset));
+                stack->push((*memories)[0].load<float32_t>(stack->pop<int32_t>(), offset));
                 break;
             }
+        case F64LOAD:
+            {
+                bs.readUInt32(); // alignment
+                uint32_t offset = bs.readUInt32();
+                stack->push((*memories)[0].load<float64_t>(stack->pop<int32_t>(), offset));
+                break;
+            }
+        case I32LOAD8_S: loadExtended<int8_t, int32_t>(); break;
+        case I32LOAD8_U: loadExtended<uint8_t, int32_t>(); break;
+        case I32LOAD16_S: loadExtended<int16_t, int32_t>(); break;
+        case I32LOAD16_U: loadExtended<uint16_t, int32_t>(); break;
+        case I64LOAD8_S: loadExtended<int8_t, int64_t>(); break;
+        case I64LOAD8_U: loadExtended<uint8_t, int64_t>(); break;
+        case I64LOAD16_S: loadExtended<int16_t, int64_t>(); break;
+        case I64LOAD16_U: loadExtended<uint16_t, int64_t>(); break;
+        case I64LOAD32_S: loadExtended<int32_t, int64_t>(); break;
+        case I64LOAD32_U: loadExtended<uint32_t, int64_t>(); break;
         case I32STORE:
+            {
+                auto value = stack->pop<int32_t>();
+                auto address = stack->pop<int32_t>();
+                bs.readUInt32(); // alignment
+                (*memories)[0].store(address, bs.readUInt32(), value);
+                break;
+            }
         case I64STORE:
+            {
+                auto value = stack->pop<int64_t>();
+                auto address = stack->pop<int32_t>();
+                bs.readUInt32(); // alignment
+                (*memories)[0].store(address, bs.readUInt32(), value);
+                break;
+            }
         case F32STORE:
+            {
+                auto value = stack->pop<float32_t>();
+                auto address = stack->pop<int32_t>();
+                bs.readUInt32(); // alignment
+                (*memories)[0].store(address, bs.readUInt32(), value);
+                break;
+            }
         case F64STORE:
             {
-                auto var = stack->pop();
-                auto index = stack->pop<int32_t>();
-                bs.seek(1); // alignment
-                uint32_t offset = bs.readUInt32();
-                (*memories)[0].setMemory(index + (int)offset, var);
+                auto value = stack->pop<float64_t>();
+                auto address = stack->pop<int32_t>();
+                bs.readUInt32(); // alignment
+                (*memories)[0].store(address, bs.readUInt32(), value);
                 break;
             }
+        case I32STORE8: storeTruncated<uint8_t, int32_t>(); break;
+        case I32STORE16: storeTruncated<uint16_t, int32_t>(); break;
+        case I64STORE8: storeTruncated<uint8_t, int64_t>(); break;
+        case I64STORE16: storeTruncated<uint16_t, int64_t>(); break;
+        case I64STORE32: storeTruncated<uint32_t, int64_t>(); break;
         case MEMORYSIZE:
-            stack->push(Variable(int32_t((int32_t)memories->at(bs.readUInt32()).data()->capacity())));
+            stack->push(int32_t(memories->at(bs.readUInt32()).pages()));
             break;
         case MEMORYGROW:
             {
                 uint32_t index = bs.readUInt32();
-                stack->push(Variable((int32_t)memories->at(index).data()->capacity()));
-                memories->at(index).data()->reserve(memories->at(index).data()->capacity() + stack->pop<int32_t>());
+                uint32_t delta = stack->pop<int32_t>();
+                stack->push(memories->at(index).grow(delta));
                 break;
             }
         case I32CONST:
@@ -328,312 +514,458 @@ void Function::performOperation(uint8_t byte, std::vector<int> &jumpStack, std::
         case F64CONST:
             stack->push(float64_t(bs.readFloat64()));
             break;
-        case I32EQZ:
-            {
-                int32_t var = stack->pop<int32_t>();
-                stack->push(int32_t(var == 0));
-                break;
-            }
-        case I32EQ:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 == var2));
-                break;
-            }
-        case I32NE:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 != var2));
-                break;
-            }
-        case I32LT_S:
-        case I32LT_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 < var2));
-                break;
-            }
-        case I32GT_S:
-        case I32GT_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 > var2));
-                break;
-            }
-        case I32LE_S:
-        case I32LE_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 <= var2));
-                break;
-            }
-        case I32GE_S:
-        case I32GE_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 >= var2));
-                break;
-            }
-        case F64LT:
-            {
-                float64_t var2 = stack->pop<float64_t>();
-                float64_t var1 = stack->pop<float64_t>();
-                stack->push(int32_t(var1 < var2));
-                break;
-            }
-        case I32CLZ:
-            {
-                int32_t var = stack->pop<int32_t>();
-                stack->push(int32_t(__builtin_clz(var)));
-                break;
-            }
-        case I32CTZ:
-            {
-                int32_t var = stack->pop<int32_t>();
-                stack->push(int32_t(__builtin_ctz(var)));
-                break;
-            }
-        case I32POPCNT:
-            {
-                int32_t var = stack->pop<int32_t>();
-                stack->push(int32_t(__builtin_popcount(var)));
-                break;
-            }
-        case I32ADD:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 + var2));
-                break;
-            }
-        case I32SUB:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 - var2));
-                break;
-            }
-        case I32MUL:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 * var2));
-                break;
-            }
-        case I32DIV_S:
-        case I32DIV_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 / var2));
-                break;
-            }
-        case I32REM_S:
-        case I32REM_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 % var2));
-                break;
-            }
-        case I32AND:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 & var2));
-                break;
-            }
-        case I32OR:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 | var2));
-                break;
-            }
-        case I32XOR:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 ^ var2));
-                break;
-            }
-        case I32SHL:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 << var2));
-                break;
-            }
-        case I32SHR_S:
-        case I32SHR_U:
-            {
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t(var1 >> var2));
-                break;
-            }
-        case I32ROTL:
-            {
-                // from https://www.geeksforgeeks.org/rotate-bits-of-an-integer/
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t((var1 << var2) | (var1 >> (32 - var2))));
-                break;
-            }
-        case I32ROTR:
-            {
-                // from https://www.geeksforgeeks.org/rotate-bits-of-an-integer/
-                int32_t var2 = stack->pop<int32_t>();
-                int32_t var1 = stack->pop<int32_t>();
-                stack->push(int32_t((var1 >> var2) | (var1 << (32 - var2))));
-                break;
-            }
-        case I64ADD:
-            {
-                int64_t var2 = stack->pop<int64_t>();
-                int64_t var1 = stack->pop<int64_t>();
-                stack->push(int64_t(var1 + var2));
-                break;
-            }
-        case I64SUB:
-            {
-                int64_t var2 = stack->pop<int64_t>();
-                int64_t var1 = stack->pop<int64_t>();
-                stack->push(int64_t(var1 - var2));
-                break;
-            }
-        case I64MUL:
-            {
-                int64_t var2 = stack->pop<int64_t>();
-                int64_t var1 = stack->pop<int64_t>();
-                stack->push(int64_t(var1 * var2));
-                break;
-            }
-        case F32ADD:
-            {
-                float32_t var2 = stack->pop<float32_t>();
-                float32_t var1 = stack->pop<float32_t>();
-                stack->push(float32_t(var1 + var2));
-                break;
-            }
-        case F32SUB:
-            {
-                float32_t var2 = stack->pop<float32_t>();
-                float32_t var1 = stack->pop<float32_t>();
-                stack->push(float32_t(var2 - var1));
-                break;
-            }
-        case F32MUL:
-            {
-                float32_t var2 = stack->pop<float32_t>();
-                float32_t var1 = stack->pop<float32_t>();
-                stack->push(float32_t(var1 * var2));
-                break;
-            }
-        case F64ADD:
-            {
-                float64_t var2 = stack->pop<float64_t>();
-                float64_t var1 = stack->pop<float64_t>();
-                stack->push(float64_t(var1 + var2));
-                break;
-            }
-        case F64SUB:
-            {
-                float64_t var2 = stack->pop<float64_t>();
-                float64_t var1 = stack->pop<float64_t>();
-                stack->push(float64_t(var1 - var2));
-                break;
-            }
-        case F64MUL:
-            {
-                float64_t var2 = stack->pop<float64_t>();
-                float64_t var1 = stack->pop<float64_t>();
-                stack->push(float64_t(var1 * var2));
-                break;
-            }
-        case I32WRAP_I64:
-            {
-                int64_t var = stack->pop<int64_t>();
-                stack->push(int32_t(var));
-                break;
-            }
-        case I32TRUNC_F32_S:
-            {
-                float32_t var = stack->pop<float32_t>();
-                stack->push(int32_t(std::trunc(var)));
+        case I32EQZ: unary<int32_t, numeric::eqz<int32_t>>(); break;
+        case I32EQ: binary<int32_t, numeric::eq<int32_t>>(); break;
+        case I32NE: binary<int32_t, numeric::ne<int32_t>>(); break;
+        case I32LT_S: binary<int32_t, numeric::ltS<int32_t>>(); break;
+        case I32LT_U: binary<int32_t, numeric::ltU<int32_t>>(); break;
+        case I32GT_S: binary<int32_t, numeric::gtS<int32_t>>(); break;
+        case I32GT_U: binary<int32_t, numeric::gtU<int32_t>>(); break;
+        case I32LE_S: binary<int32_t, numeric::leS<int32_t>>(); break;
+        case I32LE_U: binary<int32_t, numeric::leU<int32_t>>(); break;
+        case I32GE_S: binary<int32_t, numeric::geS<int32_t>>(); break;
+        case I32GE_U: binary<int32_t, numeric::geU<int32_t>>(); break;
+        case I64EQZ: unary<int64_t, numeric::eqz<int64_t>>(); break;
+        case I64EQ: binary<int64_t, numeric::eq<int64_t>>(); break;
+        case I64NE: binary<int64_t, numeric::ne<int64_t>>(); break;
+        case I64LT_S: binary<int64_t, numeric::ltS<int64_t>>(); break;
+        case I64LT_U: binary<int64_t, numeric::ltU<int64_t>>(); break;
+        case I64GT_S: binary<int64_t, numeric::gtS<int64_t>>(); break;
+        case I64GT_U: binary<int64_t, numeric::gtU<int64_t>>(); break;
+        case I64LE_S: binary<int64_t, numeric::leS<int64_t>>(); break;
+        case I64LE_U: binary<int64_t, numeric::leU<int64_t>>(); break;
+        case I64GE_S: binary<int64_t, numeric::geS<int64_t>>(); break;
+        case I64GE_U: binary<int64_t, numeric::geU<int64_t>>(); break;
+        case F32EQ: binary<float32_t, numeric::eq<float32_t>>(); break;
+        case F32NE: binary<float32_t, numeric::ne<float32_t>>(); break;
+        case F32LT: binary<float32_t, numeric::lt<float32_t>>(); break;
+        case F32GT: binary<float32_t, numeric::gt<float32_t>>(); break;
+        case F32LE: binary<float32_t, numeric::le<float32_t>>(); break;
+        case F32GE: binary<float32_t, numeric::ge<float32_t>>(); break;
+        case F64EQ: binary<float64_t, numeric::eq<float64_t>>(); break;
+        case F64NE: binary<float64_t, numeric::ne<float64_t>>(); break;
+        case F64LT: binary<float64_t, numeric::lt<float64_t>>(); break;
+        case F64GT: binary<float64_t, numeric::gt<float64_t>>(); break;
+        case F64LE: binary<float64_t, numeric::le<float64_t>>(); break;
+        case F64GE: binary<float64_t, numeric::ge<float64_t>>(); break;
+        case I32CLZ: unary<int32_t, numeric::clz<int32_t>>(); break;
+        case I32CTZ: unary<int32_t, numeric::ctz<int32_t>>(); break;
+        case I32POPCNT: unary<int32_t, numeric::popcnt<int32_t>>(); break;
+        case I32ADD: binary<int32_t, numeric::add<int32_t>>(); break;
+        case I32SUB: binary<int32_t, numeric::sub<int32_t>>(); break;
+        case I32MUL: binary<int32_t, numeric::mul<int32_t>>(); break;
+        case I32DIV_S: binary<int32_t, numeric::divS<int32_t>>(); break;
+        case I32DIV_U: binary<int32_t, numeric::divU<int32_t>>(); break;
+        case I32REM_S: binary<int32_t, numeric::remS<int32_t>>(); break;
+        case I32REM_U: binary<int32_t, numeric::remU<int32_t>>(); break;
+        case I32AND: binary<int32_t, numeric::bitAnd<int32_t>>(); break;
+        case I32OR: binary<int32_t, numeric::bitOr<int32_t>>(); break;
+        case I32XOR: binary<int32_t, numeric::bitXor<int32_t>>(); break;
+        case I32SHL: binary<int32_t, numeric::shl<int32_t>>(); break;
+        case I32SHR_S: binary<int32_t, numeric::shrS<int32_t>>(); break;
+        case I32SHR_U: binary<int32_t, numeric::shrU<int32_t>>(); break;
+        case I32ROTL: binary<int32_t, numeric::rotl<int32_t>>(); break;
+        case I32ROTR: binary<int32_t, numeric::rotr<int32_t>>(); break;
+        case I64CLZ: unary<int64_t, numeric::clz<int64_t>>(); break;
+        case I64CTZ: unary<int64_t, numeric::ctz<int64_t>>(); break;
+        case I64POPCNT: unary<int64_t, numeric::popcnt<int64_t>>(); break;
+        case I64ADD: binary<int64_t, numeric::add<int64_t>>(); break;
+        case I64SUB: binary<int64_t, numeric::sub<int64_t>>(); break;
+        case I64MUL: binary<int64_t, numeric::mul<int64_t>>(); break;
+        case I64DIV_S: binary<int64_t, numeric::divS<int64_t>>(); break;
+        case I64DIV_U: binary<int64_t, numeric::divU<int64_t>>(); break;
+        case I64REM_S: binary<int64_t, numeric::remS<int64_t>>(); break;
+        case I64REM_U: binary<int64_t, numeric::remU<int64_t>>(); break;
+        case I64AND: binary<int64_t, numeric::bitAnd<int64_t>>(); break;
+        case I64OR: binary<int64_t, numeric::bitOr<int64_t>>(); break;
+        case I64XOR: binary<int64_t, numeric::bitXor<int64_t>>(); break;
+        case I64SHL: binary<int64_t, numeric::shl<int64_t>>(); break;
+        case I64SHR_S: binary<int64_t, numeric::shrS<int64_t>>(); break;
+        case I64SHR_U: binary<int64_t, numeric::shrU<int64_t>>(); break;
+        case I64ROTL: binary<int64_t, numeric::rotl<int64_t>>(); break;
+        case I64ROTR: binary<int64_t, numeric::rotr<int64_t>>(); break;
+        case F32ABS: unary<float32_t, numeric::abs<float32_t>>(); break;
+        case F32NEG: unary<float32_t, numeric::neg<float32_t>>(); break;
+        case F32CEIL: unary<float32_t, numeric::ceil<float32_t>>(); break;
+        case F32FLOOR: unary<float32_t, numeric::floor<float32_t>>(); break;
+        case F32TRUNC: unary<float32_t, numeric::trunc<float32_t>>(); break;
+        case F32NEAREST: unary<float32_t, numeric::nearest<float32_t>>(); break;
+        case F32SQRT: unary<float32_t, numeric::sqrt<float32_t>>(); break;
+        case F32ADD: binary<float32_t, numeric::fadd<float32_t>>(); break;
+        case F32SUB: binary<float32_t, numeric::fsub<float32_t>>(); break;
+        case F32MUL: binary<float32_t, numeric::fmul<float32_t>>(); break;
+        case F32DIV: binary<float32_t, numeric::fdiv<float32_t>>(); break;
+        case F32MIN: binary<float32_t, numeric::min<float32_t>>(); break;
+        case F32MAX: binary<float32_t, numeric::max<float32_t>>(); break;
+        case F32COPYSIGN: binary<float32_t, numeric::copysign<float32_t>>(); break;
+        case F64ABS: unary<float64_t, numeric::abs<float64_t>>(); break;
+        case F64NEG: unary<float64_t, numeric::neg<float64_t>>(); break;
+        case F64CEIL: unary<float64_t, numeric::ceil<float64_t>>(); break;
+        case F64FLOOR: unary<float64_t, numeric::floor<float64_t>>(); break;
+        case F64TRUNC: unary<float64_t, numeric::trunc<float64_t>>(); break;
+        case F64NEAREST: unary<float64_t, numeric::nearest<float64_t>>(); break;
+        case F64SQRT: unary<float64_t, numeric::sqrt<float64_t>>(); break;
+        case F64ADD: binary<float64_t, numeric::fadd<float64_t>>(); break;
+        case F64SUB: binary<float64_t, numeric::fsub<float64_t>>(); break;
+        case F64MUL: binary<float64_t, numeric::fmul<float64_t>>(); break;
+        case F64DIV: binary<float64_t, numeric::fdiv<float64_t>>(); break;
+        case F64MIN: binary<float64_t, numeric::min<float64_t>>(); break;
+        case F64MAX: binary<float64_t, numeric::max<float64_t>>(); break;
+        case F64COPYSIGN: binary<float64_t, numeric::copysign<float64_t>>(); break;
+        case I32WRAP_I64: unary<int64_t, numeric::convert<int32_t, int64_t>>(); break;
+        case I32TRUNC_F32_S: unary<float32_t, numeric::truncate<int32_t, float32_t>>(); break;
+        case I32TRUNC_F32_U: unary<float32_t, truncateUnsigned<int32_t, float32_t>>(); break;
+        case I32TRUNC_F64_S: unary<float64_t, numeric::truncate<int32_t, float64_t>>(); break;
+        case I32TRUNC_F64_U: unary<float64_t, truncateUnsigned<int32_t, float64_t>>(); break;
+        case I64EXTEND_I32_S: unary<int32_t, numeric::convert<int64_t, int32_t>>(); break;
+        case I64EXTEND_I32_U: unary<int32_t, extendUnsigned>(); break;
+        case I64TRUNC_F32_S: unary<float32_t, numeric::truncate<int64_t, float32_t>>(); break;
+        case I64TRUNC_F32_U: unary<float32_t, truncateUnsigned<int64_t, float32_t>>(); break;
+        case I64TRUNC_F64_S: unary<float64_t, numeric::truncate<int64_t, float64_t>>(); break;
+        case I64TRUNC_F64_U: unary<float64_t, truncateUnsigned<int64_t, float64_t>>(); break;
+        case F32CONVERT_I32_S: unary<int32_t, numeric::convert<float32_t, int32_t>>(); break;
+        case F32CONVERT_I32_U: unary<int32_t, convertUnsigned<float32_t, int32_t>>(); break;
+        case F32CONVERT_I64_S: unary<int64_t, numeric::convert<float32_t, int64_t>>(); break;
+        case F32CONVERT_I64_U: unary<int64_t, convertUnsigned<float32_t, int64_t>>(); break;
+        case F32DEMOTE_F64: unary<float64_t, numeric::convert<float32_t, float64_t>>(); break;
+        case F64CONVERT_I32_S: unary<int32_t, numeric::convert<float64_t, int32_t>>(); break;
+        case F64CONVERT_I32_U: unary<int32_t, convertUnsigned<float64_t, int32_t>>(); break;
+        case F64CONVERT_I64_S: unary<int64_t, numeric::convert<float64_t, int64_t>>(); break;
+        case F64CONVERT_I64_U: unary<int64_t, convertUnsigned<float64_t, int64_t>>(); break;
+        case F64PROMOTE_F32: unary<float32_t, numeric::convert<float64_t, float32_t>>(); break;
+        case I32REINTERPRET_F32: unary<float32_t, numeric::reinterpret<int32_t, float32_t>>(); break;
+        case I64REINTERPRET_F64: unary<float64_t, numeric::reinterpret<int64_t, float64_t>>(); break;
+        case F32REINTERPRET_I32: unary<int32_t, numeric::reinterpret<float32_t, int32_t>>(); break;
+        case F64REINTERPRET_I64: unary<int64_t, numeric::reinterpret<float64_t, int64_t>>(); break;
+        case I32EXTEND8_S: unary<int32_t, numeric::extendS<int32_t, int8_t>>(); break;
+        case I32EXTEND16_S: unary<int32_t, numeric::extendS<int32_t, int16_t>>(); break;
+        case I64EXTEND8_S: unary<int64_t, numeric::extendS<int64_t, int8_t>>(); break;
+        case I64EXTEND16_S: unary<int64_t, numeric::extendS<int64_t, int16_t>>(); break;
+        case I64EXTEND32_S: unary<int64_t, numeric::extendS<int64_t, int32_t>>(); break;
+        case MEMORY_BULK_OP:
+            performPrefixedOperation(bs.readUInt32());
+            break;
+        case SIMD_OP:
+            performSimdOperation(bs.readUInt32());
+            break;
+        default:
+            throw FunctionException("Invalid or unsupported instruction", byte);
+        }
+}
+
+// leaves the label depth levels out, keeping the values it carries on top of the stack
+void Function::branch(uint32_t depth, std::vector<Label> &labels) {
+    const Label label = labels[labels.size() - 1 - depth];
+    stack->removeRange(label.height, stack->size() - label.arity);
+    labels.resize(labels.size() - depth - (label.loop ? 0 : 1));
+    bs.setByteIndex(label.continuation);
+}
+
+void Function::call(uint32_t index) {
+    Function *func = &(*functions)[index];
+    (*func)(stack->size() - func->params.size());
+}
+
+void Function::callIndirect(uint32_t type, uint32_t table) {
+    call(indirectTarget(type, table));
+}
+
+// the element of the table the i32 on the stack picks, which has to be a function of the type
+uint32_t Function::indirectTarget(uint32_t type, uint32_t table) {
+    Table& elements = tables->at(table);
+    uint32_t element = stack->pop<int32_t>();
+    if (element >= elements.size()) {
+        throw FunctionException("undefined element");
+    }
+    uint32_t index = elements[element];
+    if (index == Table::NULL_ELEMENT) {
+        throw FunctionException("uninitialized element");
+    }
+    if ((*functions)[index].typeId != typeIds->at(type)) {
+        throw FunctionException("indirect call type mismatch");
+    }
+    return index;
+}
+
+// the instructions after the 0xFC prefix: saturating truncation, and the bulk memory operations
+// (https://github.com/WebAssembly/bulk-memory-operations/blob/master/proposals/bulk-memory-operations/Overview.md)
+// whose operands are unsigned, addresses and lengths up to 4 GiB
+void Function::performPrefixedOperation(uint32_t operation) {
+    switch (operation) {
+        case I32TRUNC_SAT_F32_S: unary<float32_t, numeric::truncateSaturated<int32_t, float32_t>>(); break;
+        case I32TRUNC_SAT_F32_U: unary<float32_t, truncateSaturatedUnsigned<int32_t, float32_t>>(); break;
+        case I32TRUNC_SAT_F64_S: unary<float64_t, numeric::truncateSaturated<int32_t, float64_t>>(); break;
+        case I32TRUNC_SAT_F64_U: unary<float64_t, truncateSaturatedUnsigned<int32_t, float64_t>>(); break;
+        case I64TRUNC_SAT_F32_S: unary<float32_t, numeric::truncateSaturated<int64_t, float32_t>>(); break;
+        case I64TRUNC_SAT_F32_U: unary<float32_t, truncateSaturatedUnsigned<int64_t, float32_t>>(); break;
+        case I64TRUNC_SAT_F64_S: unary<float64_t, numeric::truncateSaturated<int64_t, float64_t>>(); break;
+        case I64TRUNC_SAT_F64_U: unary<float64_t, truncateSaturatedUnsigned<int64_t, float64_t>>(); break;
+        case MEMORY_INIT:
+            {
+                uint32_t segment = bs.readUInt32();
+                uint32_t index = bs.readUInt32();
+                uint32_t length = stack->pop<int32_t>();
+                uint32_t source = stack->pop<int32_t>();
+                uint32_t destination = stack->pop<int32_t>();
+                memories->at(index).init(destination, datas->at(segment), source, length);
                 break;
             }
-        case I32TRUNC_F64_S:
+        case DATA_DROP:
             {
-                float64_t var = stack->pop<float64_t>();
-                stack->push(int32_t(std::trunc(var)));
+                // a dropped segment is an empty one: memory.init can only copy nothing from it
+                std::vector<uint8_t>().swap(datas->at(bs.readUInt32()));
                 break;
             }
-        case I32REINTERPRET_F32:
+        case MEMORY_COPY:
             {
-                float32_t var = stack->pop<float32_t>();
-                stack->push(int32_t(reinterpret_cast<int32_t&>(var)));
+                uint32_t destinationIndex = bs.readUInt32();
+                uint32_t sourceIndex = bs.readUInt32();
+                uint32_t length = stack->pop<int32_t>();
+                uint32_t source = stack->pop<int32_t>();
+                uint32_t destination = stack->pop<int32_t>();
+                memories->at(destinationIndex).copy(destination, memories->at(sourceIndex), source, length);
                 break;
             }
-        case I64TRUNC_F32_S:
+        case MEMORY_FILL:
             {
-                float32_t var = stack->pop<float32_t>();
-                stack->push(int64_t(std::trunc(var)));
+                uint32_t index = bs.readUInt32();
+                uint32_t length = stack->pop<int32_t>();
+                uint8_t value = stack->pop<int32_t>();
+                uint32_t destination = stack->pop<int32_t>();
+                memories->at(index).fill(destination, value, length);
                 break;
             }
-        case I64TRUNC_F64_S:
+        default:
+            throw FunctionException("Invalid or unsupported instruction", operation);
+    }
+}
+
+uint8_t Function::readLane(int lanes) {
+    uint8_t lane = bs.readByte();
+    if (lane >= lanes) {
+        throw FunctionException("Invalid lane index", lane);
+    }
+    return lane;
+}
+
+v128_t Function::readV128() {
+    v128_t value;
+    for (int i = 0; i < 16; ++i) {
+        value.bytes[i] = bs.readByte();
+    }
+    return value;
+}
+
+// the instructions after the 0xFD prefix, of the fixed-width SIMD proposal; the kernels are in simd.h
+void Function::performSimdOperation(uint32_t operation) {
+    switch (operation) {
+        case V128LOAD:
             {
-                float64_t var = stack->pop<float64_t>();
-                stack->push(int64_t(std::trunc(var)));
+                bs.readUInt32(); // alignment
+                uint32_t offset = bs.readUInt32();
+                stack->push((*memories)[0].load<v128_t>(stack->pop<int32_t>(), offset));
                 break;
             }
-        case I64REINTERPRET_F64:
+        case V128STORE:
             {
-                float64_t var = stack->pop<float64_t>();
-                stack->push(int64_t(reinterpret_cast<int32_t&>(var)));
+                auto value = stack->pop<v128_t>();
+                auto address = stack->pop<int32_t>();
+                bs.readUInt32(); // alignment
+                (*memories)[0].store(address, bs.readUInt32(), value);
                 break;
             }
-        case MEMORY_BULK_OP:
-            {
-                // opcodes from https://github.com/WebAssembly/bulk-memory-operations/blob/master/proposals/bulk-memory-operations/Overview.md
-                uint32_t operation = bs.readUInt32();
-                switch (operation)
-                {
-                    case 0x0A: // mem.copy
-                        {
-                            int32_t len = stack->pop<int32_t>();
-                            int32_t src = stack->pop<int32_t>();
-                            int32_t dst = stack->pop<int32_t>();
-                            if ((*memories)[dst].data()->size() < len) {
-                                (*memories)[dst].data()->resize(len);
-                            }
-                            std::copy((*memories)[src].data()->begin(), (*memories)[src].data()->begin() + len, (*memories)[dst].data()->begin());
-                            break;
-                        }
-                    case 0x0B: // mem.fill
-                        {
-                            uint32_t index = bs.readUInt32();
-                            int32_t length = stack->pop<int32_t>();
-                            int32_t value = stack->pop<int32_t>();
-                            int32_t offset = stack->pop<int32_t>();
-                            (*memories)[index].fill(offset, value, length);
-                            break;
-                        }
-                    default:
-                        std::cout << "Unknown memory bulk operation: " << operation << std::endl;
-                        break;
-                }
-            }
-        case BLOCK_END:
+        case V128CONST:
+            stack->push(readV128());
             break;
-        
+        case I8X16SHUFFLE:
+            {
+                v128_t indices = readV128();
+                v128_t right = stack->pop<v128_t>();
+                v128_t left = stack->pop<v128_t>();
+                stack->push(simd::shuffle(left, right, indices));
+                break;
+            }
+        case I8X16SWIZZLE: binary<v128_t, simd::swizzle>(); break;
+        case I8X16SPLAT: unary<int32_t, simd::splat<int8_t, int32_t>>(); break;
+        case I16X8SPLAT: unary<int32_t, simd::splat<int16_t, int32_t>>(); break;
+        case I32X4SPLAT: unary<int32_t, simd::splat<int32_t, int32_t>>(); break;
+        case I64X2SPLAT: unary<int64_t, simd::splat<int64_t, int64_t>>(); break;
+        case F32X4SPLAT: unary<float32_t, simd::splat<float32_t, float32_t>>(); break;
+        case F64X2SPLAT: unary<float64_t, simd::splat<float64_t, float64_t>>(); break;
+        case I8X16EXTRACT_LANE_S: extractLane<int8_t, int32_t>(); break;
+        case I8X16EXTRACT_LANE_U: extractLane<uint8_t, int32_t>(); break;
+        case I8X16REPLACE_LANE: replaceLane<int8_t, int32_t>(); break;
+        case I16X8EXTRACT_LANE_S: extractLane<int16_t, int32_t>(); break;
+        case I16X8EXTRACT_LANE_U: extractLane<uint16_t, int32_t>(); break;
+        case I16X8REPLACE_LANE: replaceLane<int16_t, int32_t>(); break;
+        case I32X4EXTRACT_LANE: extractLane<int32_t, int32_t>(); break;
+        case I32X4REPLACE_LANE: replaceLane<int32_t, int32_t>(); break;
+        case I64X2EXTRACT_LANE: extractLane<int64_t, int64_t>(); break;
+        case I64X2REPLACE_LANE: replaceLane<int64_t, int64_t>(); break;
+        case F32X4EXTRACT_LANE: extractLane<float32_t, float32_t>(); break;
+        case F32X4REPLACE_LANE: replaceLane<float32_t, float32_t>(); break;
+        case F64X2EXTRACT_LANE: extractLane<float64_t, float64_t>(); break;
+        case F64X2REPLACE_LANE: replaceLane<float64_t, float64_t>(); break;
+        case I8X16EQ: binary<v128_t, simd::eq<int8_t>>(); break;
+        case I8X16NE: binary<v128_t, simd::ne<int8_t>>(); break;
+        case I8X16LT_S: binary<v128_t, simd::ltS<int8_t>>(); break;
+        case I8X16LT_U: binary<v128_t, simd::ltU<int8_t>>(); break;
+        case I8X16GT_S: binary<v128_t, simd::gtS<int8_t>>(); break;
+        case I8X16GT_U: binary<v128_t, simd::gtU<int8_t>>(); break;
+        case I8X16LE_S: binary<v128_t, simd::leS<int8_t>>(); break;
+        case I8X16LE_U: binary<v128_t, simd::leU<int8_t>>(); break;
+        case I8X16GE_S: binary<v128_t, simd::geS<int8_t>>(); break;
+        case I8X16GE_U: binary<v128_t, simd::geU<int8_t>>(); break;
+        case I16X8EQ: binary<v128_t, simd::eq<int16_t>>(); break;
+        case I16X8NE: binary<v128_t, simd::ne<int16_t>>(); break;
+        case I16X8LT_S: binary<v128_t, simd::ltS<int16_t>>(); break;
+        case I16X8LT_U: binary<v128_t, simd::ltU<int16_t>>(); break;
+        case I16X8GT_S: binary<v128_t, simd::gtS<int16_t>>(); break;
+        case I16X8GT_U: binary<v128_t, simd::gtU<int16_t>>(); break;
+        case I16X8LE_S: binary<v128_t, simd::leS<int16_t>>(); break;
+        case I16X8LE_U: binary<v128_t, simd::leU<int16_t>>(); break;
+        case I16X8GE_S: binary<v128_t, simd::geS<int16_t>>(); break;
+        case I16X8GE_U: binary<v128_t, simd::geU<int16_t>>(); break;
+        case I32X4EQ: binary<v128_t, simd::eq<int32_t>>(); break;
+        case I32X4NE: binary<v128_t, simd::ne<int32_t>>(); break;
+        case I32X4LT_S: binary<v128_t, simd::ltS<int32_t>>(); break;
+        case I32X4LT_U: binary<v128_t, simd::ltU<int32_t>>(); break;
+        case I32X4GT_S: binary<v128_t, simd::gtS<int32_t>>(); break;
+        case I32X4GT_U: binary<v128_t, simd::gtU<int32_t>>(); break;
+        case I32X4LE_S: binary<v128_t, simd::leS<int32_t>>(); break;
+        case I32X4LE_U: binary<v128_t, simd::leU<int32_t>>(); break;
+        case I32X4GE_S: binary<v128_t, simd::geS<int32_t>>(); break;
+        case I32X4GE_U: binary<v128_t, simd::geU<int32_t>>(); break;
+        case F32X4EQ: binary<v128_t, simd::eq<float32_t>>(); break;
+        case F32X4NE: binary<v128_t, simd::ne<float32_t>>(); break;
+        case F32X4LT: binary<v128_t, simd::lt<float32_t>>(); break;
+        case F32X4GT: binary<v128_t, simd::gt<float32_t>>(); break;
+        case F32X4LE: binary<v128_t, simd::le<float32_t>>(); break;
+        case F32X4GE: binary<v128_t, simd::ge<float32_t>>(); break;
+        case F64X2EQ: binary<v128_t, simd::eq<float64_t>>(); break;
+        case F64X2NE: binary<v128_t, simd::ne<float64_t>>(); break;
+        case F64X2LT: binary<v128_t, simd::lt<float64_t>>(); break;
+        case F64X2GT: binary<v128_t, simd::gt<float64_t>>(); break;
+        case F64X2LE: binary<v128_t, simd::le<float64_t>>(); break;
+        case F64X2GE: binary<v128_t, simd::ge<float64_t>>(); break;
+        case V128NOT: unary<v128_t, simd::bitNot>(); break;
+        case V128AND: binary<v128_t, simd::bitAnd>(); break;
+        case V128ANDNOT: binary<v128_t, simd::bitAndNot>(); break;
+        case V128OR: binary<v128_t, simd::bitOr>(); break;
+        case V128XOR: binary<v128_t, simd::bitXor>(); break;
+        case V128BITSELECT:
+            {
+                v128_t mask = stack->pop<v128_t>();
+                v128_t right = stack->pop<v128_t>();
+                v128_t left = stack->pop<v128_t>();
+                stack->push(simd::bitselect(left, right, mask));
+                break;
+            }
+        case V128ANY_TRUE: unary<v128_t, simd::anyTrue>(); break;
+        case I8X16ABS: unary<v128_t, simd::abs<int8_t>>(); break;
+        case I8X16NEG: unary<v128_t, simd::neg<int8_t>>(); break;
+        case I8X16POPCNT: unary<v128_t, simd::popcnt>(); break;
+        case I8X16ALL_TRUE: unary<v128_t, simd::allTrue<int8_t>>(); break;
+        case I8X16BITMASK: unary<v128_t, simd::bitmask<int8_t>>(); break;
+        case I8X16SHL: binary<v128_t, simd::shl<int8_t>, int32_t>(); break;
+        case I8X16SHR_S: binary<v128_t, simd::shrS<int8_t>, int32_t>(); break;
+        case I8X16SHR_U: binary<v128_t, simd::shrU<int8_t>, int32_t>(); break;
+        case I8X16ADD: binary<v128_t, simd::add<int8_t>>(); break;
+        case I8X16ADD_SAT_S: binary<v128_t, simd::addSatS<int8_t>>(); break;
+        case I8X16ADD_SAT_U: binary<v128_t, simd::addSatU<int8_t>>(); break;
+        case I8X16SUB: binary<v128_t, simd::sub<int8_t>>(); break;
+        case I8X16SUB_SAT_S: binary<v128_t, simd::subSatS<int8_t>>(); break;
+        case I8X16SUB_SAT_U: binary<v128_t, simd::subSatU<int8_t>>(); break;
+        case I8X16MIN_S: binary<v128_t, simd::minS<int8_t>>(); break;
+        case I8X16MIN_U: binary<v128_t, simd::minU<int8_t>>(); break;
+        case I8X16MAX_S: binary<v128_t, simd::maxS<int8_t>>(); break;
+        case I8X16MAX_U: binary<v128_t, simd::maxU<int8_t>>(); break;
+        case I8X16AVGR_U: binary<v128_t, simd::avgrU<int8_t>>(); break;
+        case I16X8ABS: unary<v128_t, simd::abs<int16_t>>(); break;
+        case I16X8NEG: unary<v128_t, simd::neg<int16_t>>(); break;
+        case I16X8ALL_TRUE: unary<v128_t, simd::allTrue<int16_t>>(); break;
+        case I16X8BITMASK: unary<v128_t, simd::bitmask<int16_t>>(); break;
+        case I16X8SHL: binary<v128_t, simd::shl<int16_t>, int32_t>(); break;
+        case I16X8SHR_S: binary<v128_t, simd::shrS<int16_t>, int32_t>(); break;
+        case I16X8SHR_U: binary<v128_t, simd::shrU<int16_t>, int32_t>(); break;
+        case I16X8ADD: binary<v128_t, simd::add<int16_t>>(); break;
+        case I16X8ADD_SAT_S: binary<v128_t, simd::addSatS<int16_t>>(); break;
+        case I16X8ADD_SAT_U: binary<v128_t, simd::addSatU<int16_t>>(); break;
+        case I16X8SUB: binary<v128_t, simd::sub<int16_t>>(); break;
+        case I16X8SUB_SAT_S: binary<v128_t, simd::subSatS<int16_t>>(); break;
+        case I16X8SUB_SAT_U: binary<v128_t, simd::subSatU<int16_t>>(); break;
+        case I16X8MUL: binary<v128_t, simd::mul<int16_t>>(); break;
+        case I16X8MIN_S: binary<v128_t, simd::minS<int16_t>>(); break;
+        case I16X8MIN_U: binary<v128_t, simd::minU<int16_t>>(); break;
+        case I16X8MAX_S: binary<v128_t, simd::maxS<int16_t>>(); break;
+        case I16X8MAX_U: binary<v128_t, simd::maxU<int16_t>>(); break;
+        case I16X8AVGR_U: binary<v128_t, simd::avgrU<int16_t>>(); break;
+        case I32X4ABS: unary<v128_t, simd::abs<int32_t>>(); break;
+        case I32X4NEG: unary<v128_t, simd::neg<int32_t>>(); break;
+        case I32X4ALL_TRUE: unary<v128_t, simd::allTrue<int32_t>>(); break;
+        case I32X4BITMASK: unary<v128_t, simd::bitmask<int32_t>>(); break;
+        case I32X4SHL: binary<v128_t, simd::shl<int32_t>, int32_t>(); break;
+        case I32X4SHR_S: binary<v128_t, simd::shrS<int32_t>, int32_t>(); break;
+        case I32X4SHR_U: binary<v128_t, simd::shrU<int32_t>, int32_t>(); break;
+        case I32X4ADD: binary<v128_t, simd::add<int32_t>>(); break;
+        case I32X4SUB: binary<v128_t, simd::sub<int32_t>>(); break;
+        case I32X4MUL: binary<v128_t, simd::mul<int32_t>>(); break;
+        case I32X4MIN_S: binary<v128_t, simd::minS<int32_t>>(); break;
+        case I32X4MIN_U: binary<v128_t, simd::minU<int32_t>>(); break;
+        case I32X4MAX_S: binary<v128_t, simd::maxS<int32_t>>(); break;
+        case I32X4MAX_U: binary<v128_t, simd::maxU<int32_t>>(); break;
+        case I32X4DOT_I16X8_S: binary<v128_t, simd::dot>(); break;
+        case I64X2ABS: unary<v128_t, simd::abs<int64_t>>(); break;
+        case I64X2NEG: unary<v128_t, simd::neg<int64_t>>(); break;
+        case I64X2ALL_TRUE: unary<v128_t, simd::allTrue<int64_t>>(); break;
+        case I64X2BITMASK: unary<v128_t, simd::bitmask<int64_t>>(); break;
+        case I64X2SHL: binary<v128_t, simd::shl<int64_t>, int32_t>(); break;
+        case I64X2SHR_S: binary<v128_t, simd::shrS<int64_t>, int32_t>(); break;
+        case I64X2SHR_U: binary<v128_t, simd::shrU<int64_t>, int32_t>(); break;
+        case I64X2ADD: binary<v128_t, simd::add<int64_t>>(); break;
+        case I64X2SUB: binary<v128_t, simd::sub<int64_t>>(); break;
+        case I64X2MUL: binary<v128_t, simd::mul<int64_t>>(); break;
+        case I64X2EQ: binary<v128_t, simd::eq<int64_t>>(); break;
+        case I64X2NE: binary<v128_t, simd::ne<int64_t>>(); break;
+        case I64X2LT_S: binary<v128_t, simd::ltS<int64_t>>(); break;
+        case I64X2GT_S: binary<v128_t, simd::gtS<int64_t>>(); break;
+        case I64X2LE_S: binary<v128_t, simd::leS<int64_t>>(); break;
+        case I64X2GE_S: binary<v128_t, simd::geS<int64_t>>(); break;
+        case F32X4CEIL: unary<v128_t, simd::ceil<float32_t>>(); break;
+        case F32X4FLOOR: unary<v128_t, simd::floor<float32_t>>(); break;
+        case F32X4TRUNC: unary<v128_t, simd::trunc<float32_t>>(); break;
+        case F32X4NEAREST: unary<v128_t, simd::nearest<float32_t>>(); break;
+        case F32X4ABS: unary<v128_t, simd::fabs<float32_t>>(); break;
+        case F32X4NEG: unary<v128_t, simd::fneg<float32_t>>(); break;
+        case F32X4SQRT: unary<v128_t, simd::sqrt<float32_t>>(); break;
+        case F32X4ADD: binary<v128_t, simd::fadd<float32_t>>(); break;
+        case F32X4SUB: binary<v128_t, simd::fsub<float32_t>>(); break;
+        case F32X4MUL: binary<v128_t, simd::fmul<float32_t>>(); break;
+        case F32X4DIV: binary<v128_t, simd::fdiv<float32_t>>(); break;
+        case F32X4MIN: binary<v128_t, simd::min<float32_t>>(); break;
+        case F32X4MAX: binary<v128_t, simd::max<float32_t>>(); break;
+        case F32X4PMIN: binary<v128_t, simd::pmin<float32_t>>(); break;
+        case F32X4PMAX: binary<v128_t, simd::pmax<float32_t>>(); break;
+        case F64X2CEIL: unary<v128_t, simd::ceil<float64_t>>(); break;
+        case F64X2FLOOR: unary<v128_t, simd::floor<float64_t>>(); break;
+        case F64X2TRUNC: unary<v128_t, simd::trunc<float64_t>>(); break;
+        case F64X2NEAREST: unary<v128_t, simd::nearest<float64_t>>(); break;
+        case F64X2ABS: unary<v128_t, simd::fabs<float64_t>>(); break;
+        case F64X2NEG: unary<v128_t, simd::fneg<float64_t>>(); break;
+        case F64X2SQRT: unary<v128_t, simd::sqrt<float64_t>>(); break;
+        case F64X2ADD: binary<v128_t, simd::fadd<float64_t>>(); break;
+        case F64X2SUB: binary<v128_t, simd::fsub<float64_t>>(); break;
+        case F64X2MUL: binary<v128_t, simd::fmul<float64_t>>(); break;
+        case F64X2DIV: binary<v128_t, simd::fdiv<float64_t>>(); break;
+        case F64X2MIN: binary<v128_t, simd::min<float64_t>>(); break;
+        case F64X2MAX: binary<v128_t, simd::max<float64_t>>(); break;
+        case F64X2PMIN: binary<v128_t, simd::pmin<float64_t>>(); break;
+        case F64X2PMAX: binary<v128_t, simd::pmax<float64_t>>(); break;
+        case I32X4TRUNC_SAT_F32X4_S: unary<v128_t, simd::truncateSaturated<int32_t>>(); break;
+        case I32X4TRUNC_SAT_F32X4_U: unary<v128_t, simd::truncateSaturated<uint32_t>>(); break;
+        case F32X4CONVERT_I32X4_S: unary<v128_t, simd::convert<int32_t>>(); break;
+        case F32X4CONVERT_I32X4_U: unary<v128_t, simd::convert<uint32_t>>(); break;
         default:
-            throw FunctionException("Invalid or unsupported instruction", byte);
-        }
+            throw FunctionException("Invalid or unsupported SIMD instruction", operation);
+    }
 }
@@ -8,7 +8,11 @@
 #include "stack.h"
 #include "variabletype.h"
 #include "Memory.h"
-#include <stack>
+#include "Table.h"
+#include "host.h"
+#include "execution.h"
+#include "symbols.h"
+#include "simd.h"
 
 struct FunctionException : public std::exception{
     std::string s;
@@ -18,35 +22,42 @@ struct FunctionException : public std::exception{
     const char* what() const throw() { return s.c_str(); }
 };
 
-class GlobalVariable {
-public:
-    GlobalVariable(Variable var, bool isConstant) : value(var), is_constant(isConstant) {}
-    const bool is_constant;
-    Variable getVariable() { return value; }
-    void setVariable(Variable var) { if (is_constant) throw FunctionException("Cannot set constant variable"); value = var; }
-
-private:
-    Variable value;
+// A block, loop or if that is executing, or the body of the function itself: a branch to it continues
+// at continuation, with its arity values on top of the stack as it was when it was entered.
+struct Label {
+    int continuation;   // the byte after its end, for a loop the first one of its body
+    int height;         // below its parameters
+    uint32_t arity;     // its results, a loop's are its parameters
+    bool loop;          // a branch doesn't leave a loop, it runs it again
 };
 
-enum class blockType {
-    BLOCK,
-    LOOP,
-    IF,
+// what findJumps found for the instruction whose opcode is right in front of a byte of the body
+struct Jump {
+    int end = 0;    // block and if: the byte after their end
+    int next = 0;   // if: where a false condition continues; br_table: the index of its labels in branchTables
+    uint32_t params = 0;    // block, loop and if: the values of their type
+    uint32_t results = 0;
 };
 
 class Function {
 public:
-    Function(std::string name) : name(name) {}
-    Function(std::vector<VariableType> paramaterList, std::vector<VariableType> resultList, Stack *moduleStack,
-             std::vector<Function> *moduleFunctions, std::vector<GlobalVariable> *moduleGlobals, std::vector<Memory> *moduleMemories);
+    Function(std::string name, uint32_t typeId) : name(name), typeId(typeId) {}
+    Function(std::string name, uint32_t typeId, HostFunction hostFunction, Stack *moduleStack, std::vector<Memory> *moduleMemories)
+        : name(name), params(hostFunction.params), results(hostFunction.results), typeId(typeId), stack(moduleStack),
+          memories(moduleMemories), host(std::move(hostFunction)) {}
+    Function(std::vector<VariableType> paramaterList, std::vector<VariableType> resultList, uint32_t typeId, Stack *moduleStack,
+             std::vector<Function> *moduleFunctions, std::vector<std::shared_ptr<Global>> *moduleGlobals, std::vector<Memory> *moduleMemories,
+             std::vector<std::vector<uint8_t>> *moduleDatas, std::vector<Table> *moduleTables, std::vector<uint32_t> *moduleTypeIds,
+             const TypeTable *moduleSignatures, std::vector<Label> *moduleLabels);
     void setName(std::string functionName);
     std::string getName();
-    std::vector<VariableType> getParams() { return params; };
-    std::vector<VariableType> getResults() { return results; };
+    const std::vector<VariableType>& getParams() { return params; };
+    const std::vector<VariableType>& getResults() { return results; };
     void addLocalVars(VariableType varType, int count);
     void setBody(std::vector<uint8_t> functionBody);
     void operator()(int offset);
+    // the same call as one that suspends when fuel runs out, and resumes where it was
+    Execution run(int offset, Fuel& fuel);
 
 private:
     std::string name = "noName";
@@ -54,23 +65,77 @@ private:
     std::vector<VariableType> localVars;
     std::vector<VariableType> results;
     std::vector<uint8_t> body;
+    uint32_t typeId;    // functions with equal ids have equal signatures, call_indirect compares them
 
-    std::unordered_map<int, std::array<int, 2>> ifJumps;
-    std::unordered_map<int, int> blockJumps;
-    std::unordered_map<int, int> loopJumps;
-    std::stack<blockType> lastBlock;
-
-    std::vector<std::vector<Variable>> loopStarts;
-    std::vector<Variable> functionStart;
+    // by the byte after the opcode of each block, if and br_table, the rest unused; and the labels of
+    // every br_table: their count, the labels, the default one
+    std::vector<Jump> jumps;
+    std::vector<uint32_t> branchTables;
 
     int stackOffset = 0;
-    Stack *stack;
+    int labelBase = 0;          // in labels, the label of the body
+    Stack *stack = nullptr;     // none for an import the embedder didn't provide
     std::vector<Function> *functions;
-    std::vector<GlobalVariable> *globals;
+    std::vector<std::shared_ptr<Global>> *globals;     // by index, imported ones are shared
     std::vector<Memory> *memories;
+    std::vector<std::vector<uint8_t>> *datas;   // the bytes of the data segments, none once dropped
+    std::vector<Table> *tables;
+    std::vector<uint32_t> *typeIds;             // by type index
+    const TypeTable *signatures;                // by type id
+    std::vector<Label> *labels;                 // of all calls that run, shared as the stack is
     ByteStream bs;
+    HostFunction host;          // what an import calls, it has no body
 
-    void performOperation(uint8_t byte, std::vector<int> &jumpStack, std::vector<int> &ifStack);
-    bool jumpsCalculated = false;
+    // the locals pushed after the arguments at offset, and the label of the body
+    void enter(int offset);
+    void leave();
+    void performOperation(uint8_t byte, std::vector<Label> &labels);
+    void call(uint32_t index);
+    void callIndirect(uint32_t type, uint32_t table);
+    uint32_t indirectTarget(uint32_t type, uint32_t table);
+    void branch(uint32_t depth, std::vector<Label> &labels);
+    void readBlockType(Jump& jump);
+    void performPrefixedOperation(uint32_t operation);
+    void performSimdOperation(uint32_t operation);
+    // pops the operands of op, pushes its result; the right one of a binary op can have a type of
+    // its own, like the i32 shift count of a v128
+    template <typename T, auto op>
+    void unary() { stack->push(op(stack->pop<T>())); }
+    template <typename T, auto op, typename Right = T>
+    void binary() {
+        Right right = stack->pop<Right>();
+        T left = stack->pop<T>();
+        stack->push(op(left, right));
+    }
+    // the narrow loads and stores: Narrow in memory, sign- or zero-extended to T on the stack by
+    // its signedness, and T truncated to it when stored
+    template <typename Narrow, typename T>
+    void loadExtended() {
+        bs.readUInt32(); // alignment
+        uint32_t offset = bs.readUInt32();
+        stack->push(T((*memories)[0].load<Narrow>(stack->pop<int32_t>(), offset)));
+    }
+    template <typename Narrow, typename T>
+    void storeTruncated() {
+        auto value = stack->pop<T>();
+        auto address = stack->pop<int32_t>();
+        bs.readUInt32(); // alignment
+        (*memories)[0].store(address, bs.readUInt32(), Narrow(value));
+    }
+    // the lane index byte after extract_lane and replace_lane
+    uint8_t readLane(int lanes);
+    v128_t readV128();
+    template <typename L, typename T>
+    void extractLane() {
+        uint8_t lane = readLane(16 / sizeof(L));
+        stack->push(simd::extractLane<L, T>(stack->pop<v128_t>(), lane));
+    }
+    template <typename L, typename T>
+    void replaceLane() {
+        uint8_t lane = readLane(16 / sizeof(L));
+        T value = stack->pop<T>();
+        stack->push(simd::replaceLane<L, T>(stack->pop<v128_t>(), lane, value));
+    }
     void findJumps();
+    void skipImmediates(uint8_t byte);
 };
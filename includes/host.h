@@ -0,0 +1,140 @@
+#ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_HOST_H
+#define SEIS_JARNETHYS_MARTIJNSNOEKS_HOST_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Global.h"
+#include "Memory.h"
+#include "stack.h"
+#include "variabletype.h"
+
+// A function of the embedder that a module imports. It is called with its arguments where the call
+// left them on the stack, and replaces them with its result.
+struct HostFunction {
+    std::vector<VariableType> params;
+    std::vector<VariableType> results;
+    bool usesMemory = false;    // it gets the first memory of the module that calls it
+    void (*invoke)(void* target, Stack& stack, int offset, std::vector<Memory>* memories) = nullptr;
+    std::shared_ptr<void> target;   // the callable, invoke knows its type
+};
+
+namespace host {
+
+// the value type of a C++ type a host function takes or returns
+template <typename T> constexpr VariableType typeOf() {
+    static_assert(sizeof(T) == 0, "host functions take and return int32_t, int64_t, float, double and v128_t");
+    return VariableType::is_int32;
+}
+template <> constexpr VariableType typeOf<int32_t>() { return VariableType::is_int32; }
+template <> constexpr VariableType typeOf<int64_t>() { return VariableType::is_int64; }
+template <> constexpr VariableType typeOf<float32_t>() { return VariableType::isfloat32_t; }
+template <> constexpr VariableType typeOf<float64_t>() { return VariableType::isfloat64_t; }
+template <> constexpr VariableType typeOf<v128_t>() { return VariableType::isv128_t; }
+
+// makes the call, then puts its result, if any, where its arguments were
+template <typename R, typename Call>
+void complete(Stack& stack, int offset, Call call) {
+    if constexpr (std::is_void_v<R>) {
+        call();
+        stack.removeRange(offset, stack.size());
+    } else {
+        R result = call();
+        stack.removeRange(offset, stack.size());
+        stack.push(result);
+    }
+}
+
+// The signature of a lambda, a function object or a function, and how to call one from the stack.
+// A Memory& in front of the parameters isn't one of them, it's the memory of the caller.
+template <typename F>
+struct Signature : Signature<decltype(&F::operator())> {};
+
+template <typename R, typename... Args>
+struct Signature<R(Args...)> {
+    static constexpr bool usesMemory = false;
+    static std::vector<VariableType> params() { return { typeOf<std::decay_t<Args>>()... }; }
+    static std::vector<VariableType> results() {
+        if constexpr (std::is_void_v<R>) {
+            return {};
+        } else {
+            return { typeOf<R>() };
+        }
+    }
+
+    template <typename F>
+    static void invoke(void* target, Stack& stack, int offset, std::vector<Memory>*) {
+        F& f = *static_cast<F*>(target);
+        complete<R>(stack, offset, [&] {
+            return [&]<size_t... I>(std::index_sequence<I...>) {
+                return f(std::get<std::decay_t<Args>>(stack.at(offset + I))...);
+            }(std::index_sequence_for<Args...>());
+        });
+    }
+};
+
+template <typename R, typename... Args>
+struct Signature<R(Memory&, Args...)> : Signature<R(Args...)> {
+    static constexpr bool usesMemory = true;
+
+    template <typename F>
+    static void invoke(void* target, Stack& stack, int offset, std::vector<Memory>* memories) {
+        F& f = *static_cast<F*>(target);
+        Memory& memory = (*memories)[0];
+        complete<R>(stack, offset, [&] {
+            return [&]<size_t... I>(std::index_sequence<I...>) {
+                return f(memory, std::get<std::decay_t<Args>>(stack.at(offset + I))...);
+            }(std::index_sequence_for<Args...>());
+        });
+    }
+};
+
+template <typename C, typename R, typename... Args>
+struct Signature<R(C::*)(Args...)> : Signature<R(Args...)> {};
+template <typename C, typename R, typename... Args>
+struct Signature<R(C::*)(Args...) const> : Signature<R(Args...)> {};
+
+}
+
+// The host functions and globals an embedder gives a module, by the module and field name it imports
+// them by. They are looked up once, when the module is loaded; a call goes straight to the callable.
+class Imports {
+public:
+    // f is a function or anything callable with one signature, whose types follow from it
+    template <typename F>
+    void add(const std::string& module, const std::string& field, F f) {
+        using Callable = std::decay_t<F>;
+        using Types = host::Signature<std::remove_pointer_t<Callable>>;
+        HostFunction function;
+        function.params = Types::params();
+        function.results = Types::results();
+        function.usesMemory = Types::usesMemory;
+        function.target = std::make_shared<Callable>(std::move(f));
+        function.invoke = &Types::template invoke<Callable>;
+        functions[{ module, field }] = std::move(function);
+    }
+
+    // a global of the embedder or one another module exports, every module that imports it shares it
+    void addGlobal(const std::string& module, const std::string& field, std::shared_ptr<Global> global) {
+        globals[{ module, field }] = std::move(global);
+    }
+
+    // none if nothing was added by these names
+    const HostFunction* find(const std::string& module, const std::string& field) const {
+        auto function = functions.find({ module, field });
+        return function == functions.end() ? nullptr : &function->second;
+    }
+    std::shared_ptr<Global> findGlobal(const std::string& module, const std::string& field) const {
+        auto global = globals.find({ module, field });
+        return global == globals.end() ? nullptr : global->second;
+    }
+
+private:
+    std::map<std::pair<std::string, std::string>, HostFunction> functions;
+    std::map<std::pair<std::string, std::string>, std::shared_ptr<Global>> globals;
+};
+
+#endif
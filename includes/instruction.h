@@ -5,136 +5,59 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
+#include "Variable.h"
+#include "bytestream.h"
 #include "constants.h"
+#include "opcodes.h"
 
 // shamelessly inspired by https://github.com/TimGysen/GysenVanherckSEIS/blob/main/VM/VM/Instruction.h
 class InstructionNumber {
 
 public:
     enum class Section { TYPE=0x01, IMPORT=0x02, FUNCTION=0X03, TABLE=0x04, MEMORY=0x05, GLOBAL=0x06, EXPORT=0x07, START=0x08, ELEMENT=0x09, CODE=0x0a, DATA=0x0b, CUSTOM=0x00 };
-    enum class Type { NONE=0x00, I32=0x7f, I64=0x7e, F32=0x7d, F64=0x7c, FUNC=0x60 };
-
-    static uint8_t getOperation(const std::string& name) {
-        if ( name == "local.get" ) return constants::LOCALGET;
-        if ( name == "local.set" ) return constants::LOCALSET;
-        if ( name == "local.tee" ) return constants::LOCALTEE;
-
-        if ( name == "i32.add" ) return constants::I32ADD;
-        if ( name == "i32.sub" ) return constants::I32SUB;
-        if ( name == "i32.mul" ) return constants::I32MUL;
-        if ( name == "i32.div_s" ) return constants::I32DIV_S;
-        if ( name == "i32.div_u" ) return constants::I32DIV_U;
-        if ( name == "i32.const" ) return constants::I32CONST;
-
-        if ( name == "i32.eqz" ) return constants::I32EQZ;
-        if ( name == "i32.eq" ) return constants::I32EQ;
-        if ( name == "i32.ne" ) return constants::I32NE;
-        if ( name == "i32.lt_s" ) return constants::I32LT_S;
-        if ( name == "i32.lt_u" ) return constants::I32LT_U;
-        if ( name == "i32.gt_s" ) return constants::I32GT_S;
-        if ( name == "i32.gt_u" ) return constants::I32GT_U;
-        if ( name == "i32.le_s" ) return constants::I32LE_S;
-        if ( name == "i32.le_u" ) return constants::I32LE_U;
-        if ( name == "i32.ge_s" ) return constants::I32GE_S;
-        if ( name == "i32.ge_u" ) return constants::I32GE_U;
-
-        if (name == "i32.and") return constants::I32AND;
-        if (name == "i32.or") return constants::I32OR;
-        if (name == "i32.xor") return constants::I32XOR;
-        if (name == "i32.shl") return constants::I32SHL;
-        if (name == "i32.shr_s") return constants::I32SHR_S;
-        if (name == "i32.shr_u") return constants::I32SHR_U;
-
-        if (name == "i32.wrap_i64") return constants::I32WRAP_I64;
-        if (name == "i32.trunc_f32_s") return constants::I32TRUNC_F32_S;
-        if (name == "i32.reinterpret_f32") return constants::I32REINTERPRET_F32;
-
-        if ( name == "i64.add" ) return constants::I64ADD;
-        if ( name == "i64.sub" ) return constants::I64SUB;
-        if ( name == "i64.mul" ) return constants::I64MUL;
-        if ( name == "i64.const" ) return constants::I64CONST;
-
-        if (name == "f32.add") return constants::F32ADD;
-        if (name == "f32.sub") return constants::F32SUB;
-        if (name == "f32.mul") return constants::F32MUL;
-        if (name == "f32.const") return constants::F32CONST;
-
-        if (name == "f64.add") return constants::F64ADD;
-        if (name == "f64.sub") return constants::F64SUB;
-        if (name == "f64.mul") return constants::F64MUL;
-        if (name == "f64.const") return constants::F64CONST;
-
-        if (name == "i32.load") return constants::I32LOAD;
-        if (name == "i32.store") return constants::I32STORE;
-
-        if (name == "memory.size") return constants::MEMORYSIZE;
-        if (name == "memory.grow") return constants::MEMORYGROW;
-
-        if ( name == "if" ) return constants::IF;
-        if ( name == "else" ) return constants::ELSE;
-        if (name == "loop") return constants::LOOP;
-        if (name == "block") return constants::BLOCK;
-        if (name == "br_if") return constants::BR_IF;
-        if (name == "br") return constants::BR;
-        if ( name == "call" ) return constants::CALL;
-        if ( name == "end" ) return constants::BLOCK_END;
-        // TODO: support other operations!
-
-        printf("Unsupported operation: %s\n", name.c_str());
+    enum class Type { NONE=0x00, I32=0x7f, I64=0x7e, F32=0x7d, F64=0x7c, V128=0x7b, FUNC=0x60 };
+
+    // mnemonics are resolved through the perfect hash over opcodes.def, see opcodes.h
+    static const opcodes::OpcodeInfo* getInfo(std::string_view name) {
+        return opcodes::lookup(name);
+    }
+
+    static uint8_t getOperation(std::string_view name) {
+        const opcodes::OpcodeInfo* info = opcodes::lookup(name);
+        if (info != nullptr) return info->code;
+
+        printf("Unsupported operation: %.*s\n", (int)name.size(), name.data());
         return 0;
     }
 
-    static Type getType(const std::string& name) {
+    static Type getType(std::string_view name) {
         if ( name == "i32" ) return Type::I32;
         if ( name == "i64" ) return Type::I64;
         if ( name == "f32" ) return Type::F32;
         if ( name == "f64" ) return Type::F64;
+        if ( name == "v128" ) return Type::V128;
 
         return Type::NONE;
     }
 
-    static bool isCalculation( uint8_t op ) {
-        const std::vector<uint8_t> calcOPs = {
-                constants::I32ADD, constants::I32SUB, constants::I32MUL,
-                constants::I64ADD, constants::I64SUB, constants::I64MUL,
-                constants::F32ADD, constants::F32SUB, constants::F32MUL,
-                constants::F64ADD, constants::F64SUB, constants::F64MUL
-        };
-        for (uint8_t calcOP : calcOPs) {
-            if ( calcOP == op ) return true;
-        }
-        return false;
+    // binary numeric operation: takes 2 values of the result type from the stack (e.g., i32.add, f64.mul)
+    static bool isCalculation( const opcodes::OpcodeInfo* info ) {
+        return info->immediate == opcodes::Immediate::NONE && info->signature.isBinary();
     }
 
-    static bool isConst( uint8_t op ) {
-        const std::vector<uint8_t> constOPs = {
-                constants::I32CONST, constants::I64CONST, constants::F32CONST, constants::F64CONST
-        };
-        for (uint8_t constOP : constOPs) {
-            if ( constOP == op ) return true;
-        }
-        return false;
+    static bool isConst( const opcodes::OpcodeInfo* info ) {
+        return info->immediate == opcodes::Immediate::I32 || info->immediate == opcodes::Immediate::I64 ||
+               info->immediate == opcodes::Immediate::F32 || info->immediate == opcodes::Immediate::F64;
     }
 
-    static bool hasParameter( uint8_t op ) {
-        return !InstructionNumber::hasNoParameter(op);
+    static bool hasParameter( const opcodes::OpcodeInfo* info ) {
+        return !InstructionNumber::hasNoParameter(info);
     }
 
-    static bool hasNoParameter( uint8_t op ) {
-        const std::vector<uint8_t> noParamOPs = {
-                constants::BLOCK_END, constants::ELSE,
-                constants::I32ADD, constants::I32SUB, constants::I32MUL, constants::I32DIV_S,
-                constants::I32DIV_U, constants::I32EQZ, constants::I32EQ, constants::I32NE,
-                constants::I32LT_S, constants::I32LT_U, constants::I32GT_S, constants::I32GT_U,
-                constants::I32LE_S, constants::I32LE_U, constants::I32GE_S, constants::I32GE_U,
-                constants::I32AND, constants::I32OR, constants::I32XOR, constants::I32SHL,
-                constants::I32SHR_S, constants::I32SHR_U, constants::I32WRAP_I64,
-                constants::I32TRUNC_F32_S, constants::I32REINTERPRET_F32
-        };
-        for (uint8_t noParamOP : noParamOPs) {
-            if ( noParamOP == op ) return true;
-        }
-        return false;
+    static bool hasNoParameter( const opcodes::OpcodeInfo* info ) {
+        return info->immediate == opcodes::Immediate::NONE;
     }
 };
 
@@ -154,9 +77,32 @@ public:
 
     InstructionType type;
 
+    uint8_t prefix = 0; // e.g. MEMORY_BULK_OP, instruction_code is the sub-opcode then
     uint32_t instruction_code = (uint32_t) 0;
     uint32_t parameter = 0;
+    int64_t long_parameter = 0;
     float32_t float_parameter = 0.0;
+    float64_t double_parameter = 0.0;
+    v128_t v128_parameter = {}; // v128.const, and the lane indices of i8x16.shuffle
     std::vector<uint8_t> block_parameters;
+    std::vector<uint32_t> labels;   // of br_table, the default one last
 };
+
+// A block, loop or if with no parameters and one result at most: its block type is 0x40 or that
+// value type, otherwise it's the index of a function type, which never starts with those bytes.
+inline bool hasValueBlockType(const Instruction* block) {
+    return block->block_parameters.size() == 1 && block->block_parameters[0] >= 0x40 && block->block_parameters[0] < 0x80;
+}
+
+// The table entry of an instruction. The parser also emits value types as instructions without
+// parameter (e.g. a stray i32), their bytes collide with binary operations that are always parsed
+// as CALCULATION: those have no entry.
+inline const opcodes::OpcodeInfo* instructionInfo(const Instruction* instruction) {
+    const opcodes::OpcodeInfo* info = opcodes::byCode(instruction->prefix, instruction->instruction_code);
+    if (info != nullptr && instruction->type == InstructionType::INSTRUCTION_WITHOUT_PARAMETER &&
+        InstructionNumber::isCalculation(info)) {
+        return nullptr;
+    }
+    return info;
+}
 #endif // __INSTRUCTION_H__
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <charconv>
+#include <cmath>
 
 #include "lexer.h"
 
@@ -11,11 +13,17 @@
 Lexer::Lexer(std::string path) // : currentByteIndex{ new uint32_t(0) }
 {
     this->byteStream = new ByteStream{path};
+    this->rewind(reinterpret_cast<const char*>(byteStream->getBuffer()), byteStream->getTotalByteCount());
 }
 
 Lexer::Lexer(std::vector<uint8_t> stream) {
     this->byteStream = new ByteStream();
-    byteStream->readCharVector(stream);
+    byteStream->readCharVector(std::move(stream));
+    this->rewind(reinterpret_cast<const char*>(byteStream->getBuffer()), byteStream->getTotalByteCount());
+}
+
+Lexer::Lexer(const uint8_t* data, size_t size) {
+    this->rewind(reinterpret_cast<const char*>(data), size);
 }
 
 Lexer::~Lexer()
@@ -23,144 +31,253 @@ Lexer::~Lexer()
     delete this->byteStream;    
 }
 
+void Lexer::rewind(const char* source, size_t size)
+{
+    this->begin = source;
+    this->cursor = source;
+    this->end = source + size;
+    this->scanner = Scanner(this->cursor, this->end);
+    this->failed = false;
+    this->error = nullptr;
+    this->errorPosition = nullptr;
+}
 
 int Lexer::lex()
 {
     this->tokens = std::vector<Token>();
+    this->rewind(this->begin, this->end - this->begin);
+    this->replayed = 0;
 
-	while( !this->byteStream->atEnd() ) {
+    // on average a token (including its whitespace) takes more than 4 characters
+    this->tokens.reserve((end - cursor) / 4);
 
-        while( Character::isWhitespace( this->byteStream->peekByte() ) ) {
-            this->byteStream->seek(1);
-        }
+    Token token;
+    while (this->scan(token)) {
+        this->tokens.push_back(token);
+    }
+    return this->failed ? 1 : 0;
+}
+
+bool Lexer::next(Token& token)
+{
+    if (this->replayed < this->tokens.size()) {
+        token = this->tokens[this->replayed++];
+        return true;
+    }
+    return this->scan(token);
+}
+
+bool Lexer::scan(Token& token)
+{
+	while( true ) {
+
+        cursor = scanner.skipWhitespace(cursor);
 
         // if the file ends with a whitespace
-        if( this->byteStream->atEnd() ) {
-            break;
+        if( cursor == end ) {
+            return false;
         }
 
-        unsigned char nextChar = this->byteStream->peekByte();
+        unsigned char nextChar = *cursor;
 
         // first check for numeric, THEN alphaNumeric (or we'd always get alphaNumeric)
-        if( Character::isNumeric(nextChar) ) {
-            this->tokens.push_back( this->parseNumber() );
+        if( Character::isNumeric(nextChar) || this->isFloatKeyword(cursor) ) {
+            token = this->parseNumber();
+            return true;
         }
         else if ( Character::isWASMIdentifier(nextChar) ){
-            this->tokens.push_back( this->parseKeyword() );
+            token = this->parseKeyword();
+            return true;
         }
         else {
             switch (nextChar) {
-                case '"':
-                    this->tokens.push_back( this->parseString() );
-                    break;
+                case '"': {
+                    const char* start = cursor;
+                    if (!this->parseString(token)) {
+                        return this->fail("unterminated string", start);
+                    }
+                    return true;
+                }
                 case '(':
-                    this->tokens.emplace_back(TokenType::BRACKETS_OPEN, std::string(1, this->byteStream->readByte()) ) ;
-                    break;
+                    if (cursor + 1 < end && cursor[1] == ';') {
+                        const char* start = cursor;
+                        if (!this->parseBlockComment()) {
+                            return this->fail("unterminated block comment", start);
+                        }
+                        break;
+                    }
+                    token = Token(TokenType::BRACKETS_OPEN, std::string_view(cursor++, 1));
+                    return true;
                 case ')':
-                    this->tokens.emplace_back(TokenType::BRACKETS_CLOSED, std::string(1, this->byteStream->readByte()) ) ;
-                    break;
+                    token = Token(TokenType::BRACKETS_CLOSED, std::string_view(cursor++, 1));
+                    return true;
                 case ';':
                     this->parseComment();
                     break;
                 case '$':
-                    if (tokens.back().string_value == "local") {
-                        tokens.back().type = TokenType::VARIABLE;
-                    }
-                    tokens.push_back(this->parseVarName());
-                    break;
-                    case '=':
-                        this->tokens.emplace_back(TokenType::KEYWORD, std::string(1, this->byteStream->readByte()));
-                        break;
+                    token = this->parseVarName();
+                    return true;
+                case '=':
+                    token = Token(TokenType::KEYWORD, std::string_view(cursor++, 1));
+                    return true;
                 case '-':
-                    byteStream->seek(1);
-                    if (Character::isNumeric(byteStream->peekByte())) {
-                        byteStream->seek(-1);
-                        this->tokens.push_back( this->parseNumber() );
+                case '+':
+                    if (cursor + 1 < end && (Character::isNumeric(cursor[1]) || this->isFloatKeyword(cursor + 1))) {
+                        token = this->parseNumber();
+                        return true;
                     }
+                    ++cursor;
                     break;
                 default:
-                    std::cout << "Unknown character " << this->byteStream->peekByte() << " at byte " << this->byteStream->getCurrentByteIndex() << std::endl;
-                    this->tokens.emplace_back(TokenType::STRING, std::string(1, this->byteStream->readByte()) ) ;
-                    break;
+                    return this->fail("unexpected character", cursor);
             }
         }
 	}
-    return 0;
 }
 
-Token Lexer::parseKeyword() 
+// the rest of the source is skipped after an error
+bool Lexer::fail(const char* message, const char* position)
+{
+    this->failed = true;
+    this->error = message;
+    this->errorPosition = position;
+    this->cursor = this->end;
+    return false;
+}
+
+// inf and nan (with an optional payload, nan:0x200000) are numbers as well
+bool Lexer::isFloatKeyword(const char* position) const
 {
-    std::string val = "";
+    for (std::string_view keyword : { "inf", "nan" }) {
+        if (end - position >= 3 && std::string_view(position, 3) == keyword &&
+            (position + 3 == end || !Character::isWASMIdentifier(position[3]))) {
+            return true;
+        }
+    }
+    return false;
+}
 
-    while( Character::isWASMIdentifier(this->byteStream->peekByte()) ) {
-        val.append( 1, this->byteStream->readByte() );
+SourceLocation Lexer::locate(const char* position) const
+{
+    const char* stop = position != nullptr ? position : this->end;
+    SourceLocation location{ 1, 1 };
+    for (const char* c = this->begin; c < stop; ++c) {
+        if (*c == '\n') {
+            location.line++;
+            location.column = 1;
+        } else {
+            location.column++;
+        }
     }
+    return location;
+}
+
+Token Lexer::parseKeyword() 
+{
+    const char *start = cursor;
+    cursor = scanner.skipIdentifier(cursor);
 
-    return Token( TokenType::KEYWORD, val );
+    Token keyword( TokenType::KEYWORD, std::string_view(start, cursor - start) );
+    keyword.opcode = opcodes::lookupIndex(keyword.string_value);
+    return keyword;
 }
 
 Token Lexer::parseNumber()
 {
-    std::string val = "";
+    // https://webassembly.github.io/spec/core/text/values.html#integers
+    // a number runs until the next non-idchar: that covers signs, hex digits, exponents and '_'
+    const char *start = cursor;
+    cursor = scanner.skipIdChars(cursor);
+    std::string_view text(start, cursor - start);
+
+    std::string digits;
+    std::string_view number = text;
+    if (number.find('_') != std::string_view::npos) {
+        digits.reserve(number.size());
+        std::copy_if(number.begin(), number.end(), std::back_inserter(digits), [](char c) { return c != '_'; });
+        number = digits;
+    }
 
-    while( Character::isNumeric(this->byteStream->peekByte()) || this->byteStream->peekByte() == '.' || this->byteStream->peekByte() == 'x' ||
-            this->byteStream->peekByte() == '-' ) {
-        val.append( 1, this->byteStream->readByte() );
+    bool negative = number[0] == '-';
+    if (number[0] == '-' || number[0] == '+') {
+        number.remove_prefix(1);
     }
+    bool hex = number.size() > 2 && number[0] == '0' && (number[1] == 'x' || number[1] == 'X');
+    if (hex) {
+        number.remove_prefix(2);
+    }
+
+    bool isFloat = number.find('.') != std::string_view::npos || number == "inf" || number.starts_with("nan") ||
+                   (hex ? number.find_first_of("pP") : number.find_first_of("eE")) != std::string_view::npos;
 
-    if (val.find('.') != std::string::npos) {
-        return Token(TokenType::NUMBER, std::stod(val));
-    } else if (val.find('x') != std::string::npos) {
-        return Token(TokenType::NUMBER, (uint32_t)std::stoul(val, nullptr, 16));
+    if (isFloat) {
+        double value = 0.0;
+        if (number == "inf") {
+            value = INFINITY;
+        } else if (number.starts_with("nan")) {
+            value = NAN;
+        } else {
+            std::from_chars(number.data(), number.data() + number.size(), value,
+                            hex ? std::chars_format::hex : std::chars_format::general);
+        }
+        return Token(TokenType::NUMBER, text, negative ? -value : value);
     }
-    return Token( TokenType::NUMBER, (uint32_t)std::stoi(val) );
+
+    uint64_t value = 0;
+    std::from_chars(number.data(), number.data() + number.size(), value, hex ? 16 : 10);
+    return Token( TokenType::NUMBER, text, negative ? (uint64_t)(-(int64_t)value) : value );
 }
 
-Token Lexer::parseString() 
+bool Lexer::parseString(Token& token)
 {
-    std::string val = "";
     // first coming byte is a " (detected in ::lex), so skip that
-    this->byteStream->seek(1);
+    const char *start = cursor + 1;
+    const char *position = start;
 
-    while( this->byteStream->peekByte() != '"' ) {
-        val.append( 1, this->byteStream->readByte() );
+    while( (position = Scanner::findEither(position, end, '"', '\\')) < end && *position == '\\' ) {
+        // an escaped quote doesn't end the string
+        position += 2;
+    }
+    if (position >= end) {
+        return false;
     }
-    
-    // skip the final "
-    this->byteStream->seek(1);
 
-    return Token( TokenType::STRING, val );
+    token = Token( TokenType::STRING, std::string_view(start, position - start) );
+    // skip the final "
+    cursor = position + 1;
+    return true;
 }
 
-void Lexer::parseComment()
+bool Lexer::parseComment()
 {
     // https://webassembly.github.io/spec/core/text/lexical.html#comments
-    // two types of comments
-    // either it's a full line: starts with ;; and ends on \n
-    // OR it's between two brackets and semicolons (;  ;)
-
-    byteStream->seek(-1);
-    if (byteStream->readByte() == '(') {
-        // bracket comment
-        bool foundEnd = false;
-        while (!foundEnd) {
-            if (byteStream->readByte() == ';' && byteStream->peekByte() == ')') {
-                foundEnd = true;
+    // full line comment: starts with ;; and ends on \n
+    cursor = Scanner::findByte(cursor, end, '\n');
+    return true;
+}
+
+bool Lexer::parseBlockComment()
+{
+    // block comments are between (; and ;) and can be nested
+    int depth = 0;
+    while ((cursor = Scanner::findEither(cursor, end, '(', ';')) + 1 < end) {
+        if (cursor[0] == '(' && cursor[1] == ';') {
+            ++depth;
+            cursor += 2;
+        } else if (cursor[0] == ';' && cursor[1] == ')') {
+            cursor += 2;
+            if (--depth == 0) {
+                return true;
             }
-        }
-    } else {
-        // full line comment
-        while (byteStream->peekByte() != '\n') {
-            byteStream->seek(1);
+        } else {
+            ++cursor;
         }
     }
+    return false;
 }
 
 Token Lexer::parseVarName() {
-    std::string val;
-    while ( !Character::isWhitespace(byteStream->peekByte()) ) {
-        val += byteStream->readByte();
-    }
-    return Token(TokenType::VARIABLE, val);
+    const char *start = cursor++;
+    cursor = scanner.skipIdChars(cursor);
+    return Token(TokenType::VARIABLE, std::string_view(start, cursor - start));
 }
-
@@ -5,28 +5,61 @@
 
 #include "bytestream.h"
 #include "token.h"
+#include "scanner.h"
+
+// a position in the source, both counted from 1
+struct SourceLocation {
+    size_t line;
+    size_t column;
+};
 
 class Lexer
 {
 private:
-	ByteStream *byteStream;
+	ByteStream *byteStream = nullptr;  // owns the source, unless it was passed in as a pointer
+    const char *begin = nullptr;
+    const char *cursor = nullptr;
+    const char *end = nullptr;
+    Scanner scanner;
     std::vector<Token> tokens;
+    size_t replayed = 0;                // tokens of lex() next() already handed out
+    bool failed = false;
+    const char* error = nullptr;            // why it failed, and where
+    const char* errorPosition = nullptr;
+    void rewind(const char* source, size_t size);
+    bool scan(Token& token);
+    bool fail(const char* message, const char* position);
     Token parseKeyword();
     Token parseNumber();
-    Token parseString();
+    bool parseString(Token& token);
     Token parseVarName();
-    void parseComment();
+    bool isFloatKeyword(const char* position) const;
+    bool parseComment();
+    bool parseBlockComment();
 
 public:
 	Lexer(std::string path);
     Lexer(std::vector<uint8_t> stream);
+    // lexes the bytes where they are, without a copy: they have to outlive the Lexer and its tokens
+    Lexer(const uint8_t* data, size_t size);
     ~Lexer();
     
+    // all tokens at once, into getTokens()
     int lex();
+    // The next token, false at the end of the source (or when it can't be lexed any further). This
+    // is how the Parser reads: a token at a time, while it goes, so the source is never held as a
+    // list of tokens. After lex() the tokens come from that list.
+    bool next(Token& token);
 
     ByteStream* getByteStream(){ return this->byteStream; }
-    std::vector<Token> getTokens() { return this->tokens; }
+    // the tokens point into the source buffer, so they are only valid as long as the Lexer is
+    const std::vector<Token>& getTokens() const { return this->tokens; }
+    // where a position in the source buffer (e.g. the start of a token) is, nullptr for its end
+    SourceLocation locate(const char* position) const;
+    // why next() returned false before the end of the source, nullptr if it didn't; and where that was
+    const char* getError() const { return this->error; }
+    const char* getErrorPosition() const { return this->errorPosition; }
 
 };
 
-#endif // __LEXER_H__
\ No newline at end of file
+#endif // __LEXER_H__
@@ -1,72 +1,76 @@
 #include "module.h"
+#include <algorithm>
 #include <iostream>
 #include <cstdarg>
 using namespace constants;
 
-Module::Module(std::string filepath) : bytestr{filepath} {
-    parse();
+Module::Module(std::string filepath, const Imports& imports) : bytestr{filepath} {
+    parse(imports);
     if (startFunction > 0) {
         functions[startFunction](0);
     }
 }
 
-Module::Module(uint8_t *data, int size) : bytestr{data, size} {
-    parse();
+Module::Module(uint8_t *data, int size, const Imports& imports) : bytestr{data, size} {
+    parse(imports);
     if (startFunction > 0) {
         functions[startFunction](0);
     }
 }
 
-void Module::parse() {
+void Module::parse(const Imports& imports) {
     bytestr.seek(8);    // Magic and version number
     uint8_t section;
     while (!bytestr.atEnd() && bytestr.getRemainingByteCount() > 1) {
         section = bytestr.readByte();
+        uint32_t length = bytestr.readUInt32();
         switch (section) {
         case CUSTOM_SECTION:
-            std::cout << "Custom section" << std::endl;
+            bytestr.seek(length);
             break;
         case TYPE_SECTION:
-            bytestr.seek(1); // Count function types
-            readTypeSection(bytestr.readByte());
+            readTypeSection(length);
             break;
         case IMPORT_SECTION:
-            readImportSection(bytestr.readByte());
+            readImportSection(length, imports);
             break;
         case FUNCTION_SECTION:
-            readFunctionSection(bytestr.readByte());
+            readFunctionSection(length);
             break;
         case TABLE_SECTION:
-            readTableSection(bytestr.readByte());
+            readTableSection(length);
             break;
         case MEMORY_SECTION:
-            readMemorySection(bytestr.readByte());
+            readMemorySection(length);
             break;
         case GLOBAL_SECTION:
-            readGlobalSection(bytestr.readByte());
+            readGlobalSection(length);
             break;
         case EXPORT_SECTION:
-            readExportSection(bytestr.readByte());
+            readExportSection(length);
             break;
         case START_SECTION:
-            readStartSection(bytestr.readByte());
+            readStartSection(length);
             break;
         case ELEMENT_SECTION:
-            readElementSection(bytestr.readByte());
+            readElementSection(length);
             break;
         case CODE_SECTION:
-            readCodeSection(bytestr.readByte());
+            readCodeSection(length);
             break;
         case DATA_SECTION:
-            readDataSection(bytestr.readByte());
+            readDataSection(length);
             break;
         case DATACOUNT_SECTION:
-            readDataCountSection(bytestr.readByte());
+            readDataCountSection(length);
             break;
         default:
             throw ModuleException("Invalid file: not a valid section code", bytestr.getCurrentByteIndex());
         }
     }
+    if (!memoryUser.empty() && memories.empty()) {
+        throw ModuleException("Host function '" + memoryUser + "' takes a memory, the module has none");
+    }
 }
 
 std::vector<Function> Module::getFunctions() {
@@ -74,19 +78,47 @@ std::vector<Function> Module::getFunctions() {
 }
 
 void Module::operator()(std::string name, Stack vars) {
-    for (int i = 0; i < functions.size(); ++i) {
-        Function *func = &functions.at(i);
-        if (func->getName() == name) {
-            for (int i = 0; i < vars.size(); ++i) {
-                stack.push(vars.at(i));
-            }
-            (*func)(stack.size() - func->getParams().size());
-            return;
+    Function& func = prepare(name, vars);
+    func(stack.size() - func.getParams().size());
+}
+
+Execution Module::start(std::string name, Stack vars, uint64_t slice) {
+    Function& func = prepare(name, vars);
+    Execution execution = func.run(stack.size() - func.getParams().size(), fuel);
+    execution.fuel = &fuel;
+    execution.slice = std::max<uint64_t>(slice, 1);
+    return execution;
+}
+
+std::shared_ptr<Global> Module::getGlobal(const std::string& name) {
+    auto global = exportedGlobals.find(name);
+    if (global == exportedGlobals.end()) {
+        throw ModuleException("Global '" + name + "' not found");
+    }
+    return global->second;
+}
+
+Function& Module::find(const std::string& name) {
+    for (Function& func : functions) {
+        if (func.getName() == name) {
+            return func;
         }
     }
     throw ModuleException("Function '" + name + "' not found");
 }
 
+Function& Module::prepare(const std::string& name, Stack& vars) {
+    if (fuel.depth > 0) {
+        throw ModuleException("Module is running an execution that is suspended");
+    }
+    Function& func = find(name);
+    for (int i = 0; i < vars.size(); ++i) {
+        stack.push(vars.at(i));
+    }
+    lastCalled = &func;
+    return func;
+}
+
 void Module::printVariables(int amount) {
     for (int i = amount; i > 0; --i) {
         auto var = stack.at(stack.size() - i);
@@ -104,6 +136,9 @@ void Module::printVariables(int amount) {
         case 3:
             std::cout << std::get<float64_t>(var) << " ";
             break;
+        case 4:
+            std::cout << std::get<v128_t>(var) << " ";
+            break;
         default:
             break;
         }
@@ -111,6 +146,47 @@ void Module::printVariables(int amount) {
     std::cout << std::endl;
 }
 
+void Module::popResults(Variable* out, int amount) {
+    int first = stack.size() - amount;
+    for (int i = 0; i < amount; ++i) {
+        out[i] = stack.at(first + i);
+    }
+    stack.removeRange(first, stack.size());
+}
+
+void Module::popResults(int32_t* int32Output, int64_t* int64Output, float32_t* float32Output, float64_t* float64Output,
+                        v128_t* v128Output) {
+    if (lastCalled == nullptr) {
+        throw ModuleException("No function was called");
+    }
+    const std::vector<VariableType>& types = lastCalled->getResults();
+    int first = stack.size() - types.size();
+    for (int i = 0; i < types.size(); ++i) {
+        Variable& result = stack.at(first + i);
+        switch (types[i]) {
+            case VariableType::is_int32:
+                *int32Output++ = std::get<int32_t>(result);
+                break;
+            case VariableType::is_int64:
+                *int64Output++ = std::get<int64_t>(result);
+                break;
+            case VariableType::isfloat32_t:
+                *float32Output++ = std::get<float32_t>(result);
+                break;
+            case VariableType::isfloat64_t:
+                *float64Output++ = std::get<float64_t>(result);
+                break;
+            case VariableType::isv128_t:
+                if (v128Output == nullptr) {
+                    throw ModuleException("Function '" + lastCalled->getName() + "' returns a v128, there is no array for it");
+                }
+                *v128Output++ = std::get<v128_t>(result);
+                break;
+        }
+    }
+    stack.removeRange(first, stack.size());
+}
+
 std::vector<Variable> Module::getResults(int amount) {
     std::vector<Variable> results;
     for (int i = amount; i > 0; --i) {
@@ -133,6 +209,9 @@ VariableType Module::getVarType(uint8_t type) {
             case FLOAT64:
                 return VariableType::isfloat64_t;
                 break;
+            case V128:
+                return VariableType::isv128_t;
+                break;
             default:
                 throw ModuleException("Invalid file: not a valid parameter type", bytestr.getCurrentByteIndex());
                 break;
@@ -140,27 +219,31 @@ VariableType Module::getVarType(uint8_t type) {
 }
 
 void Module::readTypeSection(int length) {
-    while(bytestr.readByte() == 0x60) {  // Read a function type
+    uint32_t numTypes = bytestr.readUInt32();
+    for (int t = 0; t < numTypes; ++t) {
+        if (bytestr.readByte() != 0x60) {
+            throw ModuleException("Invalid file: not a valid function type", bytestr.getCurrentByteIndex());
+        }
         // Read the type of function parameters
-        int numParams = bytestr.readByte();
+        int numParams = bytestr.readUInt32();
         std::vector<VariableType> params;
         for (int i = 0; i < numParams; ++i) {
             params.push_back(getVarType(bytestr.readByte()));
         }
 
         // Read the type of function results
-        int numResults = bytestr.readByte();
+        int numResults = bytestr.readUInt32();
         std::vector<VariableType> results;
         for (int i = 0; i < numResults; ++i) {
             results.push_back(getVarType(bytestr.readByte()));
         }
+        typeIds.push_back(signatures.intern(params, results));
         functionTypes.push_back(params);
         functionTypes.push_back(results);
     }
-    bytestr.seek(-1);
 }
 
-void Module::readImportSection(int length) {
+void Module::readImportSection(int length, const Imports& imports) {
     uint32_t numImports = bytestr.readUInt32();
     for (int i = 0; i < numImports; ++i) {
         uint32_t stringLength = bytestr.readUInt32();
@@ -169,37 +252,80 @@ void Module::readImportSection(int length) {
         std::string fieldName = bytestr.readASCIIString(stringLength);
         uint32_t kind = bytestr.readUInt32();
         if (kind == 0) {
-            functions.emplace_back(fieldName);
+            uint32_t type = bytestr.readUInt32();
+            const HostFunction* host = imports.find(moduleName, fieldName);
+            if (host == nullptr) {
+                functions.emplace_back(fieldName, typeIds.at(type));
+                continue;
+            }
+            if (host->params != functionTypes.at(2 * type) || host->results != functionTypes.at(2 * type + 1)) {
+                throw ModuleException("Import '" + moduleName + "." + fieldName + "' has another type than the host function");
+            }
+            if (host->usesMemory) {
+                memoryUser = fieldName;
+            }
+            functions.emplace_back(fieldName, typeIds.at(type), *host, &stack, &memories);
+        } else if (kind == 1) {
+            tables.push_back(readTable());
+            tables.back().setName(fieldName);
         } else if (kind == 2) {
             if (bytestr.readUInt32()) {
                 // upper limit is set
-                int32_t init = bytestr.readInt32();
-                int32_t limit = bytestr.readInt32();
+                uint32_t init = bytestr.readUInt32();
+                uint32_t limit = bytestr.readUInt32();
                 memories.emplace_back(init, limit);
                 memories[0].setName(fieldName);
             } else {
                 // no upper limit
-                int32_t init = bytestr.readInt32();
+                uint32_t init = bytestr.readUInt32();
                 memories.emplace_back(init);
                 memories[0].setName(fieldName);
             }
+        } else if (kind == 3) {
+            Global declared = readGlobalType();
+            std::shared_ptr<Global> global = imports.findGlobal(moduleName, fieldName);
+            if (global == nullptr) {
+                throw ModuleException("Import '" + moduleName + "." + fieldName + "' is a global that isn't provided");
+            }
+            if (global->type != declared.type || global->isMutable != declared.isMutable) {
+                throw ModuleException("Import '" + moduleName + "." + fieldName + "' has another type than the global");
+            }
+            globals.push_back(global);
         }
 
     }
 }
 
 void Module::readFunctionSection(int length) {
-    int numFunctions = bytestr.readByte();
+    int numFunctions = bytestr.readUInt32();
     for (int i = 0; i < numFunctions; ++i) {
-        int signature = 2 * bytestr.readByte();
-        functions.emplace_back(Function(functionTypes[signature], functionTypes[signature + 1], &stack, &functions, &globals, &memories));
+        uint32_t type = bytestr.readUInt32();
+        functions.emplace_back(Function(functionTypes[2 * type], functionTypes[2 * type + 1], typeIds.at(type), &stack, &functions,
+                                        &globals, &memories, &datas, &tables, &typeIds, &signatures, &labels));
     }
 }
 
-void Module::readTableSection(int length) { std::cout << "table section" << std::endl; }
+// the element type and the limits of a table
+Table Module::readTable() {
+    if (bytestr.readByte() != FUNCREF) {
+        throw ModuleException("Invalid file: tables can only hold funcref", bytestr.getCurrentByteIndex());
+    }
+    if (bytestr.readByte()) {
+        uint32_t initial = bytestr.readUInt32();
+        return Table(initial, bytestr.readUInt32());
+    }
+    return Table(bytestr.readUInt32());
+}
+
+void Module::readTableSection(int length) {
+    int numTables = bytestr.readUInt32();
+    for (int i = 0; i < numTables; ++i) {
+        tables.push_back(readTable());
+    }
+}
 
 void Module::readMemorySection(int length) {
-    int numMemories = bytestr.readByte();
+    int numMemories = bytestr.readUInt32();
     for (int i = 0; i < numMemories; ++i) {
         if (bytestr.readByte()) {
             uint32_t initial = bytestr.readUInt32();
@@ -212,43 +338,97 @@ void Module::readMemorySection(int length) {
     }
 }
 
+// the value type and the mutability, the value is the zero of the type
+Global Module::readGlobalType() {
+    VariableType type = getVarType(bytestr.readByte());
+    uint8_t mutability = bytestr.readByte();
+    if (mutability > 1) {
+        throw ModuleException("Invalid file: not a valid global mutability", bytestr.getCurrentByteIndex());
+    }
+    switch (type) {
+        case VariableType::is_int64:
+            return Global(type, mutability, int64_t());
+        case VariableType::isfloat32_t:
+            return Global(type, mutability, float32_t());
+        case VariableType::isfloat64_t:
+            return Global(type, mutability, float64_t());
+        case VariableType::isv128_t:
+            return Global(type, mutability, v128_t{});
+        default:
+            return Global(type, mutability, int32_t());
+    }
+}
+
 void Module::readGlobalSection(int length) {
-    int numGlobals = bytestr.readByte();
+    int numGlobals = bytestr.readUInt32();
     for (int i = 0; i < numGlobals; ++i) {
-        bytestr.seek(1); // skip the type
-        bool isConst = bytestr.readByte() == 0;
+        auto global = std::make_shared<Global>(readGlobalType());
         switch (bytestr.readByte()) {
             case I32CONST:
-                globals.emplace_back(GlobalVariable(Variable(bytestr.readInt32()), isConst));
+                global->value = bytestr.readInt32();
                 break;
             case I64CONST:
-                globals.emplace_back(GlobalVariable(Variable(bytestr.readInt64()), isConst));
+                global->value = bytestr.readInt64();
                 break;
             case F32CONST:
-                globals.emplace_back(GlobalVariable(Variable(bytestr.readFloat32()), isConst));
+                global->value = bytestr.readFloat32();
                 break;
             case F64CONST:
-                globals.emplace_back(GlobalVariable(Variable(bytestr.readFloat64()), isConst));
+                global->value = bytestr.readFloat64();
                 break;
+            case SIMD_OP:
+                {
+                    if (bytestr.readUInt32() != V128CONST) {
+                        throw ModuleException("Invalid file: not a valid global type", bytestr.getCurrentByteIndex());
+                    }
+                    v128_t value;
+                    std::vector<uint8_t> bytes = bytestr.readBytes(16);
+                    std::copy(bytes.begin(), bytes.end(), value.bytes);
+                    global->value = value;
+                    break;
+                }
+            case GLOBALGET:
+                {
+                    // the value an imported global has now
+                    uint32_t index = bytestr.readUInt32();
+                    if (index >= globals.size()) {
+                        throw ModuleException("Invalid file: global " + std::to_string(index) + " doesn't exist yet",
+                                              bytestr.getCurrentByteIndex());
+                    }
+                    global->value = globals[index]->value;
+                    break;
+                }
             default:
                 throw ModuleException("Invalid file: not a valid global type", bytestr.getCurrentByteIndex());
         }
+        // the alternatives of a Variable are in the order of VariableType
+        if (global->value.index() != (size_t)global->type) {
+            throw ModuleException("Invalid file: the value of global " + std::to_string(globals.size()) + " has another type",
+                                  bytestr.getCurrentByteIndex());
+        }
+        globals.push_back(global);
         bytestr.seek(1); // skip the end of the global
     }
 }
 
 void Module::readExportSection(int length) {
-    int exports = bytestr.readByte();
+    int exports = bytestr.readUInt32();
     for (int i = 0; i < exports; ++i) {
-        auto name = bytestr.readASCIIString(bytestr.readByte());
+        auto name = bytestr.readASCIIString(bytestr.readUInt32());
         uint8_t kind = bytestr.readByte();
         switch (kind) {
             case 0x00: // function
                 functions[bytestr.readUInt32()].setName(name);
                 break;
+            case 0x01: // table
+                tables.at(bytestr.readUInt32()).setName(name);
+                break;
             case 0x02: // memory
                 memories[bytestr.readUInt32()].setName(name);
                 break;
+            case 0x03: // global
+                exportedGlobals[name] = globals.at(bytestr.readUInt32());
+                break;
             default:
                 throw ModuleException("Invalid file: not a valid export kind", bytestr.getCurrentByteIndex());
         }
@@ -259,33 +439,103 @@ void Module::readStartSection(int length) {
     startFunction = bytestr.readUInt32();
 }
 
-void Module::readElementSection(int length) { std::cout << "element section" << std::endl; }
+// an i32.const and the end of the expression
+uint32_t Module::readOffset(const char* segment) {
+    if (bytestr.readByte() != I32CONST) {
+        throw ModuleException(std::string("Invalid file: the offset of ") + segment + " has to be an i32.const", bytestr.getCurrentByteIndex());
+    }
+    uint32_t offset = bytestr.readInt32();
+    bytestr.seek(1); // end of the offset expression
+    return offset;
+}
+
+// Active segments are copied into their table. Without table.init and elem.drop the passive and
+// declarative ones have no use, they are read over.
+void Module::readElementSection(int length) {
+    int numSegments = bytestr.readUInt32();
+    for (int i = 0; i < numSegments; ++i) {
+        // bit 0: passive or declarative, bit 1: with a table index (active) or declarative (else),
+        // bit 2: the functions as expressions instead of indices
+        uint32_t flags = bytestr.readUInt32();
+        if (flags > 7) {
+            throw ModuleException("Invalid file: not a valid element segment", bytestr.getCurrentByteIndex());
+        }
+        bool active = (flags & 1) == 0;
+        uint32_t table = flags == 2 || flags == 6 ? bytestr.readUInt32() : 0;
+        uint32_t offset = active ? readOffset("an element segment") : 0;
+        if (flags != 0 && flags != 4 && bytestr.readByte() != ((flags & 4) ? FUNCREF : 0x00)) {
+            throw ModuleException("Invalid file: element segments can only hold functions", bytestr.getCurrentByteIndex());
+        }
+        std::vector<uint32_t> segment(bytestr.readUInt32());
+        for (auto& element : segment) {
+            if (!(flags & 4)) {
+                element = bytestr.readUInt32();
+                continue;
+            }
+            // ref.func f or ref.null func
+            uint8_t op = bytestr.readByte();
+            if (op == REF_FUNC) {
+                element = bytestr.readUInt32();
+            } else if (op == REF_NULL && bytestr.readByte() == FUNCREF) {
+                element = Table::NULL_ELEMENT;
+            } else {
+                throw ModuleException("Invalid file: not a valid element expression", bytestr.getCurrentByteIndex());
+            }
+            bytestr.seek(1); // end of the expression
+        }
+        for (uint32_t element : segment) {
+            if (element != Table::NULL_ELEMENT && element >= functions.size()) {
+                throw ModuleException("Invalid file: element segment with an unknown function", bytestr.getCurrentByteIndex());
+            }
+        }
+        if (active) {
+            tables.at(table).init(offset, segment);
+        }
+    }
+}
 
 void Module::readCodeSection(int length) {
-    int numFunctions = bytestr.readByte();
+    int numFunctions = bytestr.readUInt32();
     auto otherFuncs = functions.size() - numFunctions;
     for (int i = 0; i < numFunctions; ++i) {
-        int bodySize = bytestr.readByte() - 1;  // -1 for localVarType
-        int localVarTypes = bytestr.readByte();
+        int bodySize = bytestr.readUInt32();
+        int bodyEnd = bytestr.getCurrentByteIndex() + bodySize;
+        int localVarTypes = bytestr.readUInt32();
         for (int j = 0; j < localVarTypes; ++j) {
-            int typeCount = bytestr.readByte();
+            int typeCount = bytestr.readUInt32();
             functions[i + otherFuncs].addLocalVars(getVarType(bytestr.readByte()), typeCount);
-            bodySize -= 2;  // -2 for every local variable
         }
 
-        functions[i + otherFuncs].setBody(bytestr.readBytes(bodySize));
+        int bodyStart = bytestr.getCurrentByteIndex();
+        try {
+            functions[i + otherFuncs].setBody(bytestr.readBytes(bodyEnd - bodyStart));
+        } catch (const FunctionException& e) {
+            // a body that uses a global it can't
+            throw ModuleException(std::string("Invalid file: ") + e.what(), bodyStart);
+        }
     }
 }
 
 void Module::readDataSection(int length) {
-    int numSgements = bytestr.readUInt32();
-    for (int i = 0; i < numSgements; ++i) {
-        bytestr.seek(4); // flags and index is always zero according to current specification
+    int numSegments = bytestr.readUInt32();
+    for (int i = 0; i < numSegments; ++i) {
+        // 0: active in memory 0, 1: passive, 2: active with a memory index
+        uint32_t flags = bytestr.readUInt32();
+        if (flags > 2) {
+            throw ModuleException("Invalid file: not a valid data segment", bytestr.getCurrentByteIndex());
+        }
+        uint32_t memory = flags == 2 ? bytestr.readUInt32() : 0;
+        uint32_t offset = flags != 1 ? readOffset("a data segment") : 0;
         int segmentSize = bytestr.readUInt32();
-        for (int j = 0; j < segmentSize; ++j) {
-            memories[0].setMemory(j, Variable(int32_t(bytestr.readUInt32())));
+        std::vector<uint8_t> segment = bytestr.readBytes(segmentSize);
+        if (flags == 1) {
+            datas.push_back(std::move(segment));
+        } else {
+            // copied into the memory, then dropped: memory.init can't use an active segment
+            memories.at(memory).init(offset, segment, 0, segment.size());
+            datas.emplace_back();
         }
     }
 }
 
-void Module::readDataCountSection(int length) { bytestr.seek(1); /* data count */ }
+void Module::readDataCountSection(int length) { bytestr.readUInt32(); /* data count */ }
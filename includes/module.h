@@ -1,28 +1,68 @@
+#include <map>
+#include <memory>
+#include <tuple>
 #include "function.h"
+#include "symbols.h"
+
+template <typename Signature> class TypedFunc;
 
 class Module {
 public:
-    Module(std::string filepath);
-    Module(uint8_t *data, int size);
+    // the functions it imports are taken from imports, one that isn't there traps when it's called
+    Module(std::string filepath, const Imports& imports = Imports());
+    Module(uint8_t *data, int size, const Imports& imports = Imports());
     std::vector<Function> getFunctions();
     void operator()(std::string name, Stack vars);
+    // The same call, as an execution that runs slice instructions each time it's resumed. A module
+    // runs one execution at a time: it can't be called while one is suspended halfway.
+    Execution start(std::string name, Stack vars, uint64_t slice);
     void printVariables(int amount);
     std::vector<Variable> getResults(int amount);
+    // The results of the last call, taken off the stack into out with the first one first. Nothing is
+    // allocated, the stack keeps its room for the next call.
+    void popResults(Variable* out, int amount);
+    // the same, each result into the next element of the array of its type
+    void popResults(int32_t* int32Output, int64_t* int64Output, float32_t* float32Output, float64_t* float64Output,
+                    v128_t* v128Output = nullptr);
+    // The function called name as a C++ function of this signature, which is checked here once. Its
+    // results come back as they are, several as a std::tuple.
+    template <typename Signature>
+    TypedFunc<Signature> getTypedFunc(const std::string& name);
+    // The global exported as name. Another module that imports it, through Imports::addGlobal, shares
+    // it with this one.
+    std::shared_ptr<Global> getGlobal(const std::string& name);
 
 private:
+    template <typename Signature> friend class TypedFunc;
+
     ByteStream bytestr;
     Stack stack;
     std::vector<std::vector<VariableType>> functionTypes;
+    TypeTable signatures;           // the types without duplicates
+    std::vector<uint32_t> typeIds;  // by type index, the index of its signature
     std::vector<Function> functions;
-    std::vector<GlobalVariable> globals;
+    std::vector<std::shared_ptr<Global>> globals;       // imported ones first
+    std::map<std::string, std::shared_ptr<Global>> exportedGlobals;
     std::vector<Memory> memories;
+    std::vector<std::vector<uint8_t>> datas;    // passive data segments, active ones are empty
+    std::vector<Table> tables;
+    Fuel fuel;                      // of the execution that runs
+    std::vector<Label> labels;      // of the calls that run
+    Function* lastCalled = nullptr;
 
+    Function& find(const std::string& name);
+    // the function called name, with the arguments pushed for it
+    Function& prepare(const std::string& name, Stack& vars);
     VariableType getVarType(uint8_t type);
+    Table readTable();
+    Global readGlobalType();
+    uint32_t readOffset(const char* segment);
     int32_t startFunction = -1;
+    std::string memoryUser;     // an imported host function that takes a memory, the module has to have one
 
-    void parse();
+    void parse(const Imports& imports);
     void readTypeSection(int length);
-    void readImportSection(int length);
+    void readImportSection(int length, const Imports& imports);
     void readFunctionSection(int length);
     void readTableSection(int length);
     void readMemorySection(int length);
@@ -43,3 +83,70 @@ struct ModuleException : public std::exception
    ~ModuleException() throw () {}
    const char* what() const throw() { return s.c_str(); }
 };
+
+namespace typed {
+
+// the results of a function as the C++ type it returns: none, one, or a std::tuple of several
+template <typename R>
+struct Results {
+    static std::vector<VariableType> types() { return { host::typeOf<R>() }; }
+    static R take(Stack& stack) { return stack.pop<R>(); }
+};
+
+template <>
+struct Results<void> {
+    static std::vector<VariableType> types() { return {}; }
+    static void take(Stack&) {}
+};
+
+template <typename... Ts>
+struct Results<std::tuple<Ts...>> {
+    static std::vector<VariableType> types() { return { host::typeOf<Ts>()... }; }
+    static std::tuple<Ts...> take(Stack& stack) {
+        int first = stack.size() - sizeof...(Ts);
+        std::tuple<Ts...> results = [&]<size_t... I>(std::index_sequence<I...>) {
+            return std::tuple<Ts...>(std::get<Ts>(stack.at(first + I))...);
+        }(std::index_sequence_for<Ts...>());
+        stack.removeRange(first, stack.size());
+        return results;
+    }
+};
+
+}
+
+// A function of a module that is called as a C++ function: the arguments go onto the stack as they
+// are and the results come off it, without a lookup by name or a check of their types.
+template <typename R, typename... Args>
+class TypedFunc<R(Args...)> {
+public:
+    R operator()(Args... args) {
+        if (module->fuel.depth > 0) {
+            throw ModuleException("Module is running an execution that is suspended");
+        }
+        Stack& stack = module->stack;
+        int offset = stack.size();
+        (stack.push(args), ...);
+        module->lastCalled = function;
+        (*function)(offset);
+        return typed::Results<R>::take(stack);
+    }
+
+    static std::vector<VariableType> params() { return { host::typeOf<Args>()... }; }
+    static std::vector<VariableType> results() { return typed::Results<R>::types(); }
+
+private:
+    friend class Module;
+    TypedFunc(Module* module, Function* function) : module(module), function(function) {}
+
+    Module* module;
+    Function* function;
+};
+
+template <typename Signature>
+TypedFunc<Signature> Module::getTypedFunc(const std::string& name) {
+    Function& function = find(name);
+    if (function.getParams() != TypedFunc<Signature>::params() || function.getResults() != TypedFunc<Signature>::results()) {
+        throw ModuleException("Function '" + name + "' doesn't have the signature asked for");
+    }
+    return TypedFunc<Signature>(this, &function);
+}
@@ -0,0 +1,177 @@
+#ifndef __NUMERIC_H__
+#define __NUMERIC_H__
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <string>
+#include <type_traits>
+
+// The numeric instructions of WebAssembly as small functions, for the interpreter and anything
+// else that has to compute what an instruction does (constant folding). Integers are taken as the
+// signed types the interpreter keeps them in, the _u variants reinterpret them; arithmetic wraps.
+// Only division and the truncation of floats trap.
+
+// what a trapping instruction throws
+struct NumericException : public std::exception {
+    std::string s;
+    NumericException(std::string ss) : s(ss) {}
+    ~NumericException() throw () {}
+    const char* what() const throw() { return s.c_str(); }
+};
+
+namespace numeric {
+
+template <typename T> using Unsigned = std::make_unsigned_t<T>;
+template <typename T> using Signed = std::make_signed_t<T>;
+
+// shift counts are taken modulo the width
+template <typename T> constexpr Unsigned<T> shiftMask = sizeof(T) * 8 - 1;
+
+template <typename T> inline T add(T a, T b) { return (T)((Unsigned<T>)a + (Unsigned<T>)b); }
+template <typename T> inline T sub(T a, T b) { return (T)((Unsigned<T>)a - (Unsigned<T>)b); }
+template <typename T> inline T mul(T a, T b) { return (T)((Unsigned<T>)a * (Unsigned<T>)b); }
+
+template <typename T> inline T divS(T a, T b) {
+    if (b == 0) {
+        throw NumericException("integer divide by zero");
+    }
+    if ((Signed<T>)a == std::numeric_limits<Signed<T>>::min() && (Signed<T>)b == -1) {
+        throw NumericException("integer overflow");
+    }
+    return (T)((Signed<T>)a / (Signed<T>)b);
+}
+template <typename T> inline T divU(T a, T b) {
+    if (b == 0) {
+        throw NumericException("integer divide by zero");
+    }
+    return (T)((Unsigned<T>)a / (Unsigned<T>)b);
+}
+// the minimum modulo -1 is 0, not an overflow
+template <typename T> inline T remS(T a, T b) {
+    if (b == 0) {
+        throw NumericException("integer divide by zero");
+    }
+    return (Signed<T>)b == -1 ? 0 : (T)((Signed<T>)a % (Signed<T>)b);
+}
+template <typename T> inline T remU(T a, T b) {
+    if (b == 0) {
+        throw NumericException("integer divide by zero");
+    }
+    return (T)((Unsigned<T>)a % (Unsigned<T>)b);
+}
+
+template <typename T> inline T bitAnd(T a, T b) { return a & b; }
+template <typename T> inline T bitOr(T a, T b) { return a | b; }
+template <typename T> inline T bitXor(T a, T b) { return a ^ b; }
+template <typename T> inline T shl(T a, T b) { return (T)((Unsigned<T>)a << ((Unsigned<T>)b & shiftMask<T>)); }
+template <typename T> inline T shrS(T a, T b) { return (T)((Signed<T>)a >> ((Unsigned<T>)b & shiftMask<T>)); }
+template <typename T> inline T shrU(T a, T b) { return (T)((Unsigned<T>)a >> ((Unsigned<T>)b & shiftMask<T>)); }
+template <typename T> inline T rotl(T a, T b) { return (T)std::rotl((Unsigned<T>)a, (int)((Unsigned<T>)b & shiftMask<T>)); }
+template <typename T> inline T rotr(T a, T b) { return (T)std::rotr((Unsigned<T>)a, (int)((Unsigned<T>)b & shiftMask<T>)); }
+
+template <typename T> inline T clz(T a) { return std::countl_zero((Unsigned<T>)a); }
+template <typename T> inline T ctz(T a) { return std::countr_zero((Unsigned<T>)a); }
+template <typename T> inline T popcnt(T a) { return std::popcount((Unsigned<T>)a); }
+// extend8_s and co.: sign extends the lower bits of a
+template <typename T, typename Narrow> inline T extendS(T a) { return (T)(Narrow)a; }
+
+// comparisons give an i32, 0 or 1
+template <typename T> inline int32_t eqz(T a) { return a == 0; }
+template <typename T> inline int32_t eq(T a, T b) { return a == b; }
+template <typename T> inline int32_t ne(T a, T b) { return a != b; }
+template <typename T> inline int32_t ltS(T a, T b) { return (Signed<T>)a < (Signed<T>)b; }
+template <typename T> inline int32_t ltU(T a, T b) { return (Unsigned<T>)a < (Unsigned<T>)b; }
+template <typename T> inline int32_t gtS(T a, T b) { return (Signed<T>)a > (Signed<T>)b; }
+template <typename T> inline int32_t gtU(T a, T b) { return (Unsigned<T>)a > (Unsigned<T>)b; }
+template <typename T> inline int32_t leS(T a, T b) { return (Signed<T>)a <= (Signed<T>)b; }
+template <typename T> inline int32_t leU(T a, T b) { return (Unsigned<T>)a <= (Unsigned<T>)b; }
+template <typename T> inline int32_t geS(T a, T b) { return (Signed<T>)a >= (Signed<T>)b; }
+template <typename T> inline int32_t geU(T a, T b) { return (Unsigned<T>)a >= (Unsigned<T>)b; }
+
+// floats: eq, ne, lt, ... are false for NaN (ne true), as in C++
+template <typename F> inline int32_t lt(F a, F b) { return a < b; }
+template <typename F> inline int32_t gt(F a, F b) { return a > b; }
+template <typename F> inline int32_t le(F a, F b) { return a <= b; }
+template <typename F> inline int32_t ge(F a, F b) { return a >= b; }
+
+template <typename F> using Bits = std::conditional_t<sizeof(F) == 4, uint32_t, uint64_t>;
+template <typename F> constexpr Bits<F> signBit = (Bits<F>)1 << (sizeof(F) * 8 - 1);
+
+template <typename F> inline F fadd(F a, F b) { return a + b; }
+template <typename F> inline F fsub(F a, F b) { return a - b; }
+template <typename F> inline F fmul(F a, F b) { return a * b; }
+template <typename F> inline F fdiv(F a, F b) { return a / b; }
+// a NaN operand gives a NaN, and -0 is less than +0
+template <typename F> inline F min(F a, F b) {
+    if (a != a || b != b) {
+        return a + b;
+    }
+    if (a == b) {
+        return std::bit_cast<F>(std::bit_cast<Bits<F>>(a) | std::bit_cast<Bits<F>>(b));
+    }
+    return a < b ? a : b;
+}
+template <typename F> inline F max(F a, F b) {
+    if (a != a || b != b) {
+        return a + b;
+    }
+    if (a == b) {
+        return std::bit_cast<F>(std::bit_cast<Bits<F>>(a) & std::bit_cast<Bits<F>>(b));
+    }
+    return a > b ? a : b;
+}
+// abs, neg and copysign only touch the sign bit, NaNs included
+template <typename F> inline F abs(F a) { return std::bit_cast<F>(std::bit_cast<Bits<F>>(a) & ~signBit<F>); }
+template <typename F> inline F neg(F a) { return std::bit_cast<F>(std::bit_cast<Bits<F>>(a) ^ signBit<F>); }
+template <typename F> inline F copysign(F a, F b) {
+    return std::bit_cast<F>((std::bit_cast<Bits<F>>(a) & ~signBit<F>) | (std::bit_cast<Bits<F>>(b) & signBit<F>));
+}
+template <typename F> inline F ceil(F a) { return std::ceil(a); }
+template <typename F> inline F floor(F a) { return std::floor(a); }
+template <typename F> inline F trunc(F a) { return std::trunc(a); }
+// ties to even, the default rounding mode
+template <typename F> inline F nearest(F a) { return std::nearbyint(a); }
+template <typename F> inline F sqrt(F a) { return std::sqrt(a); }
+
+// the float range that truncates to an I: [low, high), both bounds are powers of two
+template <typename I, typename F> constexpr F truncHalf = F((uint64_t)1 << (sizeof(I) * 8 - 1));
+template <typename I, typename F> constexpr F truncLow = std::is_signed_v<I> ? -truncHalf<I, F> : F(0);
+template <typename I, typename F> constexpr F truncHigh = std::is_signed_v<I> ? truncHalf<I, F> : 2 * truncHalf<I, F>;
+
+// i32.trunc_f32_s and co.: I is the (un)signed integer type to convert to
+template <typename I, typename F> inline I truncate(F a) {
+    if (a != a) {
+        throw NumericException("invalid conversion to integer");
+    }
+    F truncated = std::trunc(a);
+    if (!(truncated >= truncLow<I, F> && truncated < truncHigh<I, F>)) {
+        throw NumericException("integer overflow");
+    }
+    return (I)truncated;
+}
+// i32.trunc_sat_f32_s and co.: NaN is 0, out of range clamps
+template <typename I, typename F> inline I truncateSaturated(F a) {
+    if (a != a) {
+        return 0;
+    }
+    F truncated = std::trunc(a);
+    if (truncated < truncLow<I, F>) {
+        return std::numeric_limits<I>::min();
+    }
+    if (truncated >= truncHigh<I, F>) {
+        return std::numeric_limits<I>::max();
+    }
+    return (I)truncated;
+}
+
+// static_casts between the types of the instruction, e.g. convert<float, uint32_t> for
+// f32.convert_i32_u; the interpreter stores the result in the signed type of its size
+template <typename To, typename From> inline To convert(From a) { return (To)a; }
+template <typename To, typename From> inline To reinterpret(From a) { return std::bit_cast<To>(a); }
+
+}
+
+#endif // __NUMERIC_H__
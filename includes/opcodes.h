@@ -0,0 +1,333 @@
+#ifndef __OPCODES_H__
+#define __OPCODES_H__
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include "constants.h"
+
+// Metadata of every instruction in opcodes.def, with a perfect hash from the text mnemonic to
+// its entry that is built at compile time. The Lexer resolves keywords once, the Parser and
+// Compiler read the immediate kind and signature from the same table.
+namespace opcodes {
+
+// What follows the opcode in the binary format
+enum class Immediate : uint8_t {
+    NONE,
+    BLOCKTYPE,      // block type: 0x40, a value type or a type index
+    LABEL,          // label index (br, br_if)
+    LABEL_TABLE,    // vector of label indices and a default label (br_table)
+    FUNCTION,       // function index
+    CALL_INDIRECT,  // type index and table index
+    LOCAL,
+    GLOBAL,
+    MEMARG8,        // alignment and offset, the number is the natural access size in bits
+    MEMARG16,
+    MEMARG32,
+    MEMARG64,
+    MEMARG128,
+    MEMORY,         // memory index
+    MEMORY_MEMORY,  // destination and source memory index
+    DATA,           // data segment index
+    DATA_MEMORY,    // data segment and memory index
+    I32,
+    I64,
+    F32,
+    F64,
+    V128,           // 16 bytes, v128.const
+    SHUFFLE,        // 16 lane indices into two vectors, i8x16.shuffle
+    LANE,           // a lane index byte (extract_lane, replace_lane)
+};
+
+// Operand and result types of an instruction. Instructions whose stack effect depends on their
+// immediates or on the context (calls, locals, control flow, drop, select) use NONE.
+struct Signature {
+    uint8_t params[3];
+    uint8_t paramCount;
+    uint8_t result;     // 0 when nothing is pushed
+
+    constexpr bool isBinary() const { return paramCount == 2 && params[0] == params[1] && params[0] == result; }
+    constexpr bool isUnary() const { return paramCount == 1 && params[0] == result; }
+};
+
+namespace signatures {
+    using namespace constants;
+    inline constexpr Signature NONE = { {}, 0, 0 };
+    inline constexpr Signature TO_I32 = { {}, 0, INT32 };
+    inline constexpr Signature TO_I64 = { {}, 0, INT64 };
+    inline constexpr Signature TO_F32 = { {}, 0, FLOAT32 };
+    inline constexpr Signature TO_F64 = { {}, 0, FLOAT64 };
+    inline constexpr Signature I32_TO_NONE = { { INT32 }, 1, 0 };
+    inline constexpr Signature I32_TO_I32 = { { INT32 }, 1, INT32 };
+    inline constexpr Signature I32_TO_I64 = { { INT32 }, 1, INT64 };
+    inline constexpr Signature I32_TO_F32 = { { INT32 }, 1, FLOAT32 };
+    inline constexpr Signature I32_TO_F64 = { { INT32 }, 1, FLOAT64 };
+    inline constexpr Signature I64_TO_I32 = { { INT64 }, 1, INT32 };
+    inline constexpr Signature I64_TO_I64 = { { INT64 }, 1, INT64 };
+    inline constexpr Signature I64_TO_F32 = { { INT64 }, 1, FLOAT32 };
+    inline constexpr Signature I64_TO_F64 = { { INT64 }, 1, FLOAT64 };
+    inline constexpr Signature F32_TO_I32 = { { FLOAT32 }, 1, INT32 };
+    inline constexpr Signature F32_TO_I64 = { { FLOAT32 }, 1, INT64 };
+    inline constexpr Signature F32_TO_F32 = { { FLOAT32 }, 1, FLOAT32 };
+    inline constexpr Signature F32_TO_F64 = { { FLOAT32 }, 1, FLOAT64 };
+    inline constexpr Signature F64_TO_I32 = { { FLOAT64 }, 1, INT32 };
+    inline constexpr Signature F64_TO_I64 = { { FLOAT64 }, 1, INT64 };
+    inline constexpr Signature F64_TO_F32 = { { FLOAT64 }, 1, FLOAT32 };
+    inline constexpr Signature F64_TO_F64 = { { FLOAT64 }, 1, FLOAT64 };
+    inline constexpr Signature I32_I32_TO_I32 = { { INT32, INT32 }, 2, INT32 };
+    inline constexpr Signature I64_I64_TO_I32 = { { INT64, INT64 }, 2, INT32 };
+    inline constexpr Signature I64_I64_TO_I64 = { { INT64, INT64 }, 2, INT64 };
+    inline constexpr Signature F32_F32_TO_I32 = { { FLOAT32, FLOAT32 }, 2, INT32 };
+    inline constexpr Signature F32_F32_TO_F32 = { { FLOAT32, FLOAT32 }, 2, FLOAT32 };
+    inline constexpr Signature F64_F64_TO_I32 = { { FLOAT64, FLOAT64 }, 2, INT32 };
+    inline constexpr Signature F64_F64_TO_F64 = { { FLOAT64, FLOAT64 }, 2, FLOAT64 };
+    inline constexpr Signature I32_I32_TO_NONE = { { INT32, INT32 }, 2, 0 };
+    inline constexpr Signature I32_I64_TO_NONE = { { INT32, INT64 }, 2, 0 };
+    inline constexpr Signature I32_F32_TO_NONE = { { INT32, FLOAT32 }, 2, 0 };
+    inline constexpr Signature I32_F64_TO_NONE = { { INT32, FLOAT64 }, 2, 0 };
+    inline constexpr Signature I32_I32_I32_TO_NONE = { { INT32, INT32, INT32 }, 3, 0 };
+    inline constexpr Signature TO_V128 = { {}, 0, V128 };
+    inline constexpr Signature I32_TO_V128 = { { INT32 }, 1, V128 };
+    inline constexpr Signature I64_TO_V128 = { { INT64 }, 1, V128 };
+    inline constexpr Signature F32_TO_V128 = { { FLOAT32 }, 1, V128 };
+    inline constexpr Signature F64_TO_V128 = { { FLOAT64 }, 1, V128 };
+    inline constexpr Signature V128_TO_I32 = { { V128 }, 1, INT32 };
+    inline constexpr Signature V128_TO_I64 = { { V128 }, 1, INT64 };
+    inline constexpr Signature V128_TO_F32 = { { V128 }, 1, FLOAT32 };
+    inline constexpr Signature V128_TO_F64 = { { V128 }, 1, FLOAT64 };
+    inline constexpr Signature V128_TO_V128 = { { V128 }, 1, V128 };
+    inline constexpr Signature V128_V128_TO_V128 = { { V128, V128 }, 2, V128 };
+    inline constexpr Signature V128_I32_TO_V128 = { { V128, INT32 }, 2, V128 };
+    inline constexpr Signature V128_I64_TO_V128 = { { V128, INT64 }, 2, V128 };
+    inline constexpr Signature V128_F32_TO_V128 = { { V128, FLOAT32 }, 2, V128 };
+    inline constexpr Signature V128_F64_TO_V128 = { { V128, FLOAT64 }, 2, V128 };
+    inline constexpr Signature V128_V128_V128_TO_V128 = { { V128, V128, V128 }, 3, V128 };
+    inline constexpr Signature I32_V128_TO_NONE = { { INT32, V128 }, 2, 0 };
+}
+
+struct OpcodeInfo {
+    std::string_view mnemonic;
+    uint8_t prefix;     // 0 for single byte opcodes
+    uint32_t code;
+    Immediate immediate;
+    Signature signature;
+};
+
+inline constexpr OpcodeInfo TABLE[] = {
+#define OPCODE(name, code, mnemonic, immediate, signature) \
+    { mnemonic, 0, code, Immediate::immediate, signatures::signature },
+#define PREFIXED_OPCODE(name, prefix, code, mnemonic, immediate, signature) \
+    { mnemonic, prefix, code, Immediate::immediate, signatures::signature },
+#include "opcodes.def"
+#undef OPCODE
+#undef PREFIXED_OPCODE
+};
+
+inline constexpr size_t COUNT = std::size(TABLE);
+inline constexpr uint16_t NOT_AN_OPCODE = 0xFFFF;
+
+// Word at a time hash of a mnemonic, computed once per keyword: the bucket and the slot are
+// both derived from it.
+constexpr uint64_t hash(std::string_view text) {
+    uint64_t h = text.size() * 0x9E3779B97F4A7C15ull;
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < 8; ++j) {
+            word |= (uint64_t)(uint8_t)text[i + j] << (8 * j);
+        }
+        h = (h ^ word) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    uint64_t tail = 0;
+    for (size_t j = 0; i + j < text.size(); ++j) {
+        tail |= (uint64_t)(uint8_t)text[i + j] << (8 * j);
+    }
+    h = (h ^ tail) * 0xC4CEB9FE1A85EC53ull;
+    return h ^ (h >> 29);
+}
+
+// "Hash and displace": the high half of the hash picks a bucket, every bucket stores a seed that
+// sends all of its mnemonics to distinct empty slots.
+struct PerfectHash {
+    static constexpr size_t BUCKETS = COUNT / 2 + 1;
+    static constexpr size_t SLOTS = std::bit_ceil(2 * COUNT);
+    std::array<uint16_t, BUCKETS> seeds{};
+    std::array<uint16_t, SLOTS> slots{};
+
+    static constexpr size_t bucket(uint64_t hash) {
+        return (hash >> 32) % BUCKETS;
+    }
+
+    static constexpr size_t slot(uint64_t hash, uint16_t seed) {
+        return ((hash + seed * 0x9E3779B97F4A7C15ull) * 0xBF58476D1CE4E5B9ull) >> (64 - std::countr_zero(SLOTS));
+    }
+};
+
+constexpr PerfectHash buildPerfectHash() {
+    PerfectHash table{};
+    table.slots.fill(NOT_AN_OPCODE);
+
+    // sort the opcodes by bucket (counting sort) ...
+    std::array<uint16_t, PerfectHash::BUCKETS + 1> bucketStart{};
+    std::array<uint16_t, COUNT> members{};
+    for (size_t i = 0; i < COUNT; ++i) {
+        ++bucketStart[PerfectHash::bucket(hash(TABLE[i].mnemonic)) + 1];
+    }
+    for (size_t b = 0; b < PerfectHash::BUCKETS; ++b) {
+        bucketStart[b + 1] += bucketStart[b];
+    }
+    std::array<uint16_t, PerfectHash::BUCKETS> filled{};
+    for (size_t i = 0; i < COUNT; ++i) {
+        size_t b = PerfectHash::bucket(hash(TABLE[i].mnemonic));
+        members[bucketStart[b] + filled[b]++] = i;
+    }
+
+    // ... and place the biggest buckets first, while there are still plenty of free slots
+    std::array<uint16_t, PerfectHash::BUCKETS> order{};
+    for (size_t b = 0; b < PerfectHash::BUCKETS; ++b) {
+        order[b] = b;
+    }
+    for (size_t i = 1; i < PerfectHash::BUCKETS; ++i) {
+        for (size_t j = i; j > 0 && filled[order[j]] > filled[order[j - 1]]; --j) {
+            std::swap(order[j], order[j - 1]);
+        }
+    }
+
+    for (uint16_t b : order) {
+        if (filled[b] == 0) {
+            break;
+        }
+        for (uint32_t seed = 1; ; ++seed) {
+            if (seed == NOT_AN_OPCODE) {
+                throw "opcodes: no perfect hash seed found";
+            }
+            std::array<uint16_t, COUNT> placed{};
+            bool fits = true;
+            for (size_t m = 0; m < filled[b] && fits; ++m) {
+                placed[m] = PerfectHash::slot(hash(TABLE[members[bucketStart[b] + m]].mnemonic), seed);
+                fits = table.slots[placed[m]] == NOT_AN_OPCODE;
+                for (size_t other = 0; other < m && fits; ++other) {
+                    fits = placed[other] != placed[m];
+                }
+            }
+            if (fits) {
+                for (size_t m = 0; m < filled[b]; ++m) {
+                    table.slots[placed[m]] = members[bucketStart[b] + m];
+                }
+                table.seeds[b] = seed;
+                break;
+            }
+        }
+    }
+    return table;
+}
+
+inline constexpr PerfectHash PERFECT_HASH = buildPerfectHash();
+
+// index into TABLE, or NOT_AN_OPCODE when the mnemonic isn't an instruction
+constexpr uint16_t lookupIndex(std::string_view mnemonic) {
+    uint64_t h = hash(mnemonic);
+    uint16_t index = PERFECT_HASH.slots[PerfectHash::slot(h, PERFECT_HASH.seeds[PerfectHash::bucket(h)])];
+    if (index == NOT_AN_OPCODE || TABLE[index].mnemonic != mnemonic) {
+        return NOT_AN_OPCODE;
+    }
+    return index;
+}
+
+constexpr const OpcodeInfo* lookup(std::string_view mnemonic) {
+    uint16_t index = lookupIndex(mnemonic);
+    return index == NOT_AN_OPCODE ? nullptr : &TABLE[index];
+}
+
+// the prefixes in opcodes.def, all of their sub-opcodes are below 256
+inline constexpr uint8_t PREFIXES[] = { constants::MEMORY_BULK_OP, constants::SIMD_OP };
+
+// CODE_INDEX[0] for single byte opcodes, CODE_INDEX[1 + i] for those after PREFIXES[i]
+constexpr std::array<std::array<uint16_t, 256>, 1 + std::size(PREFIXES)> buildCodeIndex() {
+    std::array<std::array<uint16_t, 256>, 1 + std::size(PREFIXES)> index{};
+    for (auto& codes : index) {
+        codes.fill(NOT_AN_OPCODE);
+    }
+    for (size_t i = 0; i < COUNT; ++i) {
+        size_t table = 0;
+        while (table < std::size(PREFIXES) && TABLE[i].prefix != 0 && PREFIXES[table] != TABLE[i].prefix) {
+            ++table;
+        }
+        if (table == std::size(PREFIXES) || TABLE[i].code >= 256) {
+            throw "opcodes: a prefix missing from PREFIXES or a sub-opcode above 255";
+        }
+        index[TABLE[i].prefix == 0 ? 0 : 1 + table][TABLE[i].code] = i;
+    }
+    return index;
+}
+
+inline constexpr std::array<std::array<uint16_t, 256>, 1 + std::size(PREFIXES)> CODE_INDEX = buildCodeIndex();
+
+// metadata of a single byte opcode, nullptr for prefixes and unknown opcodes
+constexpr const OpcodeInfo* byCode(uint8_t code) {
+    return CODE_INDEX[0][code] == NOT_AN_OPCODE ? nullptr : &TABLE[CODE_INDEX[0][code]];
+}
+
+constexpr const OpcodeInfo* byCode(uint8_t prefix, uint32_t code) {
+    if (code >= 256) {
+        return nullptr;
+    }
+    if (prefix == 0) {
+        return byCode((uint8_t)code);
+    }
+    for (size_t table = 0; table < std::size(PREFIXES); ++table) {
+        if (PREFIXES[table] == prefix) {
+            uint16_t index = CODE_INDEX[1 + table][code];
+            return index == NOT_AN_OPCODE ? nullptr : &TABLE[index];
+        }
+    }
+    return nullptr;
+}
+
+// log2 of the natural alignment of a memory access, which is what the binary format stores
+constexpr uint32_t naturalAlignment(Immediate immediate) {
+    switch (immediate) {
+        case Immediate::MEMARG8: return 0;
+        case Immediate::MEMARG16: return 1;
+        case Immediate::MEMARG32: return 2;
+        case Immediate::MEMARG64: return 3;
+        default: return 4;
+    }
+}
+
+constexpr bool isMemoryAccess(Immediate immediate) {
+    return immediate == Immediate::MEMARG8 || immediate == Immediate::MEMARG16 ||
+           immediate == Immediate::MEMARG32 || immediate == Immediate::MEMARG64 || immediate == Immediate::MEMARG128;
+}
+
+// the number of lanes of a SIMD instruction, from its shape: 4 for i32x4.add, 0 without a shape
+constexpr uint32_t laneCount(std::string_view mnemonic) {
+    size_t x = mnemonic.find('x');
+    size_t dot = mnemonic.find('.');
+    if (x == std::string_view::npos || dot == std::string_view::npos || x > dot || x == 0) {
+        return 0;
+    }
+    uint32_t count = 0;
+    for (size_t i = x + 1; i < dot; ++i) {
+        if (mnemonic[i] < '0' || mnemonic[i] > '9') {
+            return 0;
+        }
+        count = count * 10 + (mnemonic[i] - '0');
+    }
+    return count;
+}
+
+static_assert(TABLE[lookupIndex("i32.add")].code == constants::I32ADD);
+static_assert(TABLE[lookupIndex("memory.copy")].prefix == constants::MEMORY_BULK_OP);
+static_assert(byCode(constants::SIMD_OP, constants::I32X4ADD)->mnemonic == "i32x4.add");
+static_assert(laneCount("i16x8.extract_lane_s") == 8 && laneCount("i32.add") == 0);
+static_assert(lookupIndex("i32.addd") == NOT_AN_OPCODE && lookupIndex("module") == NOT_AN_OPCODE);
+
+}
+
+#endif // __OPCODES_H__
@@ -0,0 +1,1030 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "optimizer.h"
+#include "constants.h"
+#include "numeric.h"
+#include "ssa.h"
+
+using namespace constants;
+
+namespace {
+
+bool is(const Instruction* instruction, uint8_t code) {
+    const opcodes::OpcodeInfo* info = instructionInfo(instruction);
+    return info != nullptr && info->prefix == 0 && info->code == code;
+}
+
+bool isConstant(const Instruction* instruction) {
+    return instruction->type == InstructionType::CONST;
+}
+
+// the value of a constant, i32 and f32 in the low half of bits
+struct Value {
+    uint8_t type;
+    uint64_t bits;
+};
+
+Value valueOf(const Instruction* instruction) {
+    switch (instruction->instruction_code) {
+        case I32CONST: return { INT32, instruction->parameter };
+        case I64CONST: return { INT64, (uint64_t)instruction->long_parameter };
+        case F32CONST: return { FLOAT32, std::bit_cast<uint32_t>(instruction->float_parameter) };
+        default: return { FLOAT64, std::bit_cast<uint64_t>(instruction->double_parameter) };
+    }
+}
+
+Instruction* makeConstant(Arena* arena, Value value) {
+    Instruction* constant = arena->make<Instruction>(InstructionType::CONST);
+    switch (value.type) {
+        case INT32:
+            constant->instruction_code = I32CONST;
+            constant->parameter = (uint32_t)value.bits;
+            break;
+        case INT64:
+            constant->instruction_code = I64CONST;
+            constant->long_parameter = (int64_t)value.bits;
+            break;
+        case FLOAT32:
+            constant->instruction_code = F32CONST;
+            constant->float_parameter = std::bit_cast<float32_t>((uint32_t)value.bits);
+            break;
+        default:
+            constant->instruction_code = F64CONST;
+            constant->double_parameter = std::bit_cast<float64_t>(value.bits);
+            break;
+    }
+    return constant;
+}
+
+Instruction* makeInstruction(Arena* arena, InstructionType type, uint8_t code, uint32_t parameter = 0) {
+    Instruction* instruction = arena->make<Instruction>(type, code);
+    instruction->parameter = parameter;
+    return instruction;
+}
+
+// the same kernels the interpreter runs, except that a fold that would trap is left to the runtime
+template <typename T>
+bool integerBinary(uint8_t op, uint8_t base, T a, T b, T& result) {
+    typedef std::make_signed_t<T> S;
+    // the i64 opcodes are in the same order as the i32 ones: add, sub, mul, div_s, ...
+    switch (op - base) {
+        case I32ADD - I32ADD: result = numeric::add(a, b); return true;
+        case I32SUB - I32ADD: result = numeric::sub(a, b); return true;
+        case I32MUL - I32ADD: result = numeric::mul(a, b); return true;
+        case I32DIV_S - I32ADD:
+            if (b == 0 || ((S)a == std::numeric_limits<S>::min() && (S)b == -1)) return false;
+            result = numeric::divS(a, b);
+            return true;
+        case I32DIV_U - I32ADD:
+            if (b == 0) return false;
+            result = numeric::divU(a, b);
+            return true;
+        case I32REM_S - I32ADD:
+            if (b == 0) return false;
+            result = numeric::remS(a, b);
+            return true;
+        case I32REM_U - I32ADD:
+            if (b == 0) return false;
+            result = numeric::remU(a, b);
+            return true;
+        case I32AND - I32ADD: result = numeric::bitAnd(a, b); return true;
+        case I32OR - I32ADD: result = numeric::bitOr(a, b); return true;
+        case I32XOR - I32ADD: result = numeric::bitXor(a, b); return true;
+        case I32SHL - I32ADD: result = numeric::shl(a, b); return true;
+        case I32SHR_S - I32ADD: result = numeric::shrS(a, b); return true;
+        case I32SHR_U - I32ADD: result = numeric::shrU(a, b); return true;
+        case I32ROTL - I32ADD: result = numeric::rotl(a, b); return true;
+        case I32ROTR - I32ADD: result = numeric::rotr(a, b); return true;
+    }
+    return false;
+}
+
+template <typename T>
+bool integerCompare(uint8_t op, uint8_t base, T a, T b, uint32_t& result) {
+    // eq, ne, lt_s, lt_u, gt_s, gt_u, le_s, le_u, ge_s, ge_u
+    switch (op - base) {
+        case 0: result = numeric::eq(a, b); return true;
+        case 1: result = numeric::ne(a, b); return true;
+        case 2: result = numeric::ltS(a, b); return true;
+        case 3: result = numeric::ltU(a, b); return true;
+        case 4: result = numeric::gtS(a, b); return true;
+        case 5: result = numeric::gtU(a, b); return true;
+        case 6: result = numeric::leS(a, b); return true;
+        case 7: result = numeric::leU(a, b); return true;
+        case 8: result = numeric::geS(a, b); return true;
+        case 9: result = numeric::geU(a, b); return true;
+    }
+    return false;
+}
+
+template <typename F>
+bool floatBinary(uint8_t op, uint8_t base, F a, F b, F& result) {
+    // add, sub, mul, div; min, max and copysign are left to the runtime
+    switch (op - base) {
+        case 0: result = a + b; break;
+        case 1: result = a - b; break;
+        case 2: result = a * b; break;
+        case 3: result = a / b; break;
+        default: return false;
+    }
+    // the runtime decides which NaN comes out
+    return !std::isnan(result);
+}
+
+template <typename F>
+bool floatCompare(uint8_t op, uint8_t base, F a, F b, uint32_t& result) {
+    // eq, ne, lt, gt, le, ge
+    switch (op - base) {
+        case 0: result = a == b; return true;
+        case 1: result = a != b; return true;
+        case 2: result = a < b; return true;
+        case 3: result = a > b; return true;
+        case 4: result = a <= b; return true;
+        case 5: result = a >= b; return true;
+    }
+    return false;
+}
+
+bool foldBinary(uint8_t op, Value a, Value b, Value& result) {
+    if (a.type != b.type) {
+        return false;
+    }
+    uint32_t truth;
+    if (a.type == INT32) {
+        uint32_t value;
+        if (op >= I32ADD && op <= I32ROTR && integerBinary<uint32_t>(op, I32ADD, a.bits, b.bits, value)) {
+            result = { INT32, value };
+            return true;
+        }
+        if (op >= I32EQ && op <= I32GE_U && integerCompare<uint32_t>(op, I32EQ, a.bits, b.bits, truth)) {
+            result = { INT32, truth };
+            return true;
+        }
+    } else if (a.type == INT64) {
+        uint64_t value;
+        if (op >= I64ADD && op <= I64ROTR && integerBinary<uint64_t>(op, I64ADD, a.bits, b.bits, value)) {
+            result = { INT64, value };
+            return true;
+        }
+        if (op >= I64EQ && op <= I64GE_U && integerCompare<uint64_t>(op, I64EQ, a.bits, b.bits, truth)) {
+            result = { INT32, truth };
+            return true;
+        }
+    } else if (a.type == FLOAT32) {
+        float32_t x = std::bit_cast<float32_t>((uint32_t)a.bits), y = std::bit_cast<float32_t>((uint32_t)b.bits), value;
+        if (op >= F32ADD && op <= F32DIV && floatBinary(op, F32ADD, x, y, value)) {
+            result = { FLOAT32, std::bit_cast<uint32_t>(value) };
+            return true;
+        }
+        if (op >= F32EQ && op <= F32GE && floatCompare(op, F32EQ, x, y, truth)) {
+            result = { INT32, truth };
+            return true;
+        }
+    } else {
+        float64_t x = std::bit_cast<float64_t>(a.bits), y = std::bit_cast<float64_t>(b.bits), value;
+        if (op >= F64ADD && op <= F64DIV && floatBinary(op, F64ADD, x, y, value)) {
+            result = { FLOAT64, std::bit_cast<uint64_t>(value) };
+            return true;
+        }
+        if (op >= F64EQ && op <= F64GE && floatCompare(op, F64EQ, x, y, truth)) {
+            result = { INT32, truth };
+            return true;
+        }
+    }
+    return false;
+}
+
+bool foldUnary(uint8_t op, Value a, Value& result) {
+    uint8_t type = INT32;
+    switch (op) {
+        case I64EXTEND_I32_S: case I64EXTEND_I32_U: case I32EXTEND8_S: case I32EXTEND16_S:
+        case I32EQZ: case I32CLZ: case I32CTZ: case I32POPCNT:
+            break;
+        case I32WRAP_I64: case I64EQZ: case I64CLZ: case I64CTZ: case I64POPCNT:
+        case I64EXTEND8_S: case I64EXTEND16_S: case I64EXTEND32_S:
+            type = INT64;
+            break;
+        default:
+            return false;
+    }
+    if (a.type != type) {
+        return false;
+    }
+    uint32_t low = a.bits;
+    switch (op) {
+        case I32EQZ: result = { INT32, (uint64_t)numeric::eqz(low) }; return true;
+        case I64EQZ: result = { INT32, (uint64_t)numeric::eqz(a.bits) }; return true;
+        case I32CLZ: result = { INT32, numeric::clz(low) }; return true;
+        case I32CTZ: result = { INT32, numeric::ctz(low) }; return true;
+        case I32POPCNT: result = { INT32, numeric::popcnt(low) }; return true;
+        case I64CLZ: result = { INT64, numeric::clz(a.bits) }; return true;
+        case I64CTZ: result = { INT64, numeric::ctz(a.bits) }; return true;
+        case I64POPCNT: result = { INT64, numeric::popcnt(a.bits) }; return true;
+        case I32WRAP_I64: result = { INT32, low }; return true;
+        case I64EXTEND_I32_S: result = { INT64, (uint64_t)(int64_t)(int32_t)low }; return true;
+        case I64EXTEND_I32_U: result = { INT64, low }; return true;
+        case I32EXTEND8_S: result = { INT32, (uint32_t)numeric::extendS<int32_t, int8_t>(low) }; return true;
+        case I32EXTEND16_S: result = { INT32, (uint32_t)numeric::extendS<int32_t, int16_t>(low) }; return true;
+        case I64EXTEND8_S: result = { INT64, (uint64_t)numeric::extendS<int64_t, int8_t>(a.bits) }; return true;
+        case I64EXTEND16_S: result = { INT64, (uint64_t)numeric::extendS<int64_t, int16_t>(a.bits) }; return true;
+        case I64EXTEND32_S: result = { INT64, (uint64_t)numeric::extendS<int64_t, int32_t>(a.bits) }; return true;
+    }
+    return false;
+}
+
+bool isPowerOfTwo(Value value) {
+    uint64_t bits = value.type == INT32 ? (uint32_t)value.bits : value.bits;
+    return bits > 1 && std::has_single_bit(bits);
+}
+
+// instructions that end the straight-line code in front of them: nothing after them runs
+bool isUnconditionalJump(const Instruction* instruction) {
+    return is(instruction, BR) || is(instruction, BR_TABLE) || is(instruction, RETURN) || is(instruction, UNREACHABLE);
+}
+
+bool opensBlock(const Instruction* instruction) {
+    return is(instruction, BLOCK) || is(instruction, LOOP) || is(instruction, IF);
+}
+
+// the index of the end that closes the block, loop or if opened at body[opener]
+size_t matchingEnd(const std::vector<Instruction*>& body, size_t opener) {
+    int depth = 0;
+    for (size_t i = opener + 1; i < body.size(); ++i) {
+        if (opensBlock(body[i])) {
+            ++depth;
+        } else if (is(body[i], BLOCK_END) && depth-- == 0) {
+            return i;
+        }
+    }
+    return body.size();
+}
+
+bool isLocal(const Instruction* instruction, uint8_t code, uint32_t index) {
+    return instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER && is(instruction, code) &&
+           instruction->parameter == index;
+}
+
+bool isI32Constant(const Instruction* instruction) {
+    return isConstant(instruction) && instruction->instruction_code == I32CONST;
+}
+
+// How often a loop runs that starts with its counter at first, changes it by op with step and
+// repeats while compare(counter, limit) holds; 0 if that's more than maxTrips or unknown. Adding
+// and subtracting are solved exactly for counters that don't wrap around on the way, anything else
+// is simulated up to simulated iterations.
+uint32_t tripCount(uint8_t op, uint32_t first, uint32_t step, uint8_t compare, uint32_t limit, uint32_t maxTrips,
+                   uint32_t simulated) {
+    auto repeats = [&](uint32_t value) {
+        uint32_t truth = 0;
+        integerCompare<uint32_t>(compare, I32EQ, value, limit, truth);
+        return truth != 0;
+    };
+    if (op != I32ADD && op != I32SUB) {
+        uint32_t value = first;
+        for (uint32_t trips = 1; trips <= std::min(maxTrips, simulated); ++trips) {
+            if (!integerBinary<uint32_t>(op, I32ADD, value, step, value)) {
+                return 0;
+            }
+            if (!repeats(value)) {
+                return trips;
+            }
+        }
+        return 0;
+    }
+
+    // eq, ne, lt_s, lt_u, gt_s, gt_u, le_s, le_u, ge_s, ge_u: odd ones past ne are unsigned
+    bool isUnsigned = compare >= I32LT_S && (compare - I32LT_S) % 2 == 1;
+    auto exact = [&](uint32_t bits) { return isUnsigned ? (int64_t)bits : (int64_t)(int32_t)bits; };
+    int64_t low = isUnsigned ? 0 : INT32_MIN, high = isUnsigned ? UINT32_MAX : INT32_MAX;
+    int64_t delta = op == I32ADD ? (int64_t)(int32_t)step : -(int64_t)(int32_t)step;
+    int64_t start = exact(first), bound = exact(limit);
+
+    int64_t trips;
+    if (!repeats(first + (op == I32ADD ? step : -step))) {
+        trips = 1;
+    } else if (delta == 0 || compare == I32EQ) {
+        return 0;
+    } else if (compare == I32NE) {
+        if ((bound - start) % delta != 0 || (bound - start) / delta < 1) {
+            return 0;
+        }
+        trips = (bound - start) / delta;
+    } else {
+        // the first value past the limit, the condition holds on one side of it
+        bool below = compare == I32LT_S || compare == I32LT_U || compare == I32LE_S || compare == I32LE_U;
+        bool inclusive = compare == I32LE_S || compare == I32LE_U || compare == I32GE_S || compare == I32GE_U;
+        int64_t end = bound + (inclusive ? (below ? 1 : -1) : 0);
+        if ((delta > 0) != below) {
+            return 0;   // moves away from the limit
+        }
+        int64_t distance = below ? end - start : start - end;
+        int64_t magnitude = below ? delta : -delta;
+        trips = (distance + magnitude - 1) / magnitude;
+    }
+    int64_t last = start + trips * delta;
+    if (trips < 1 || trips > maxTrips || last < low || last > high) {
+        return 0;
+    }
+    return (uint32_t)trips;
+}
+
+bool isLocalAccess(const Instruction* instruction) {
+    return instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER &&
+           (is(instruction, LOCALGET) || is(instruction, LOCALSET) || is(instruction, LOCALTEE));
+}
+
+int countCalls(const std::vector<Instruction*>& body) {
+    return std::count_if(body.begin(), body.end(), [](const Instruction* instruction) { return is(instruction, CALL); });
+}
+
+uint8_t valueType(VariableType type) {
+    switch (type) {
+        case VariableType::is_int32: return INT32;
+        case VariableType::is_int64: return INT64;
+        case VariableType::isfloat32_t: return FLOAT32;
+        case VariableType::isv128_t: return V128;
+        default: return FLOAT64;
+    }
+}
+
+// value type per local index, parameters first
+std::vector<uint8_t> localTypesOf(const AST_Function* function) {
+    std::vector<uint8_t> types;
+    for (auto parameter : function->parameters) {
+        types.push_back(valueType(parameter));
+    }
+    types.insert(types.end(), function->locals.begin(), function->locals.end());
+    return types;
+}
+
+// whether a body branches to its function level, which an inlined body can only do to a block
+// around it
+bool branchesToFunction(const std::vector<Instruction*>& body) {
+    uint32_t nesting = 0;
+    for (auto instruction : body) {
+        if (opensBlock(instruction)) {
+            ++nesting;
+        } else if (is(instruction, BLOCK_END)) {
+            --nesting;
+        } else if (is(instruction, RETURN) || ((is(instruction, BR) || is(instruction, BR_IF)) && instruction->parameter == nesting)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+std::vector<bool> findRecursion(const std::vector<AST_Function*>& functions) {
+    size_t count = functions.size();
+    std::vector<std::vector<uint32_t>> callees(count);
+    for (size_t f = 0; f < count; ++f) {
+        if (functions[f]->body == nullptr) {
+            continue;
+        }
+        for (auto instruction : *functions[f]->body) {
+            if (is(instruction, CALL) && instruction->parameter < count) {
+                callees[f].push_back(instruction->parameter);
+            }
+        }
+    }
+
+    // Tarjan's strongly connected components, without recursion: a function is recursive when it
+    // calls itself or shares its component with others
+    std::vector<bool> recursive(count, false);
+    std::vector<int> order(count, -1), low(count, 0);
+    std::vector<bool> onStack(count, false);
+    std::vector<uint32_t> stack;
+    std::vector<std::pair<uint32_t, size_t>> path;  // function, its next callee to look at
+    int visited = 0;
+    auto visit = [&](uint32_t f) {
+        order[f] = low[f] = visited++;
+        stack.push_back(f);
+        onStack[f] = true;
+        path.emplace_back(f, 0);
+    };
+    for (uint32_t root = 0; root < count; ++root) {
+        if (order[root] != -1) {
+            continue;
+        }
+        visit(root);
+        while (!path.empty()) {
+            uint32_t f = path.back().first;
+            if (path.back().second < callees[f].size()) {
+                uint32_t g = callees[f][path.back().second++];
+                if (g == f) {
+                    recursive[f] = true;
+                } else if (order[g] == -1) {
+                    visit(g);
+                } else if (onStack[g]) {
+                    low[f] = std::min(low[f], order[g]);
+                }
+                continue;
+            }
+            path.pop_back();
+            if (!path.empty()) {
+                low[path.back().first] = std::min(low[path.back().first], low[f]);
+            }
+            if (low[f] == order[f]) {
+                bool cycle = stack.back() != f;
+                uint32_t member;
+                do {
+                    member = stack.back();
+                    stack.pop_back();
+                    onStack[member] = false;
+                    recursive[member] = recursive[member] || cycle;
+                } while (member != f);
+            }
+        }
+    }
+    return recursive;
+}
+
+void Inlining::prepare(const std::vector<AST_Function*>& functions) {
+    analyzed = &functions;
+    recursive = findRecursion(functions);
+}
+
+const AST_Function* Inlining::inlinable(uint32_t index, PassContext& context) const {
+    const auto& functions = *context.functions;
+    if (index >= functions.size() || recursive[index]) {
+        return nullptr;
+    }
+    const AST_Function* callee = functions[index];
+    if (callee->isImported || callee->body == nullptr || callee->body->empty() || callee->body->size() - 1 > maxSize ||
+        !is(callee->body->back(), BLOCK_END) || callee->results.size() > 1) {
+        return nullptr;
+    }
+    for (auto instruction : *callee->body) {
+        if (is(instruction, BR_TABLE)) {
+            return nullptr;
+        }
+    }
+    for (uint8_t type : localTypesOf(callee)) {
+        if (type == 0) {
+            return nullptr;
+        }
+    }
+    return callee;
+}
+
+int Inlining::expand(std::span<Instruction* const> from, int depth, uint32_t localBase, PassContext& context,
+                     std::vector<Instruction*>& to) {
+    int count = 0;
+    uint32_t nesting = 0;
+    for (Instruction* instruction : from) {
+        if (is(instruction, CALL) && depth < maxDepth) {
+            if (const AST_Function* callee = inlinable(instruction->parameter, context)) {
+                count += inlineCall(callee, depth + 1, context, to);
+                continue;
+            }
+        }
+        if (depth == 0) {
+            to.push_back(instruction);
+            continue;
+        }
+
+        // an inlined body: copies, with the locals renumbered and return as a branch to the block around it
+        if (opensBlock(instruction)) {
+            ++nesting;
+        } else if (is(instruction, BLOCK_END)) {
+            --nesting;
+        }
+        if (is(instruction, RETURN)) {
+            to.push_back(makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, BR, nesting));
+            continue;
+        }
+        Instruction* copy = context.arena->make<Instruction>(*instruction);
+        if (isLocalAccess(copy)) {
+            copy->parameter += localBase;
+        }
+        to.push_back(copy);
+    }
+    return count;
+}
+
+int Inlining::inlineCall(const AST_Function* callee, int depth, PassContext& context, std::vector<Instruction*>& to) {
+    std::vector<uint8_t> types = localTypesOf(callee);
+    uint32_t base = context.localTypes.size();
+    context.localTypes.insert(context.localTypes.end(), types.begin(), types.end());
+    context.function->locals.insert(context.function->locals.end(), types.begin(), types.end());
+
+    // the arguments are on the stack, the last one on top
+    for (size_t i = callee->parameters.size(); i-- > 0;) {
+        to.push_back(makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, base + i));
+    }
+    for (size_t i = callee->parameters.size(); i < types.size(); ++i) {
+        to.push_back(makeConstant(context.arena, { types[i], 0 }));
+        to.push_back(makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, base + i));
+    }
+
+    const std::vector<Instruction*>& body = *callee->body;
+    if (branchesToFunction(body)) {
+        // the end of the callee's body closes the block
+        Instruction* block = makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, BLOCK);
+        for (auto result : callee->results) {
+            block->block_parameters.push_back(valueType(result));
+        }
+        if (callee->results.empty()) {
+            block->block_parameters.push_back(0x40);    // void
+        }
+        to.push_back(block);
+        return 1 + expand(body, depth, base, context, to);
+    }
+    return 1 + expand(std::span(body).first(body.size() - 1), depth, base, context, to);
+}
+
+int Inlining::run(std::vector<Instruction*>& body, PassContext& context) {
+    if (maxSize == 0 || context.round > 0) {
+        return 0;
+    }
+    // without prepare() (a single function run on its own)
+    if (analyzed != context.functions || recursive.size() != context.functions->size()) {
+        prepare(*context.functions);
+    }
+    std::vector<Instruction*> expanded;
+    int count = expand(body, 0, 0, context, expanded);
+    inlined += count;
+    callsBefore += countCalls(body);
+    callsAfter += countCalls(expanded);
+    body = std::move(expanded);
+    return count;
+}
+
+std::string Inlining::details() const {
+    return std::to_string(inlined) + " inlined, calls " + std::to_string(callsBefore) + " -> " + std::to_string(callsAfter);
+}
+
+int ConstantPropagation::run(std::vector<Instruction*>& body, PassContext& context) {
+    // the locals stored to inside every block, loop and if (keyed by the index of its opening instruction)
+    std::unordered_map<size_t, std::unordered_set<uint32_t>> written;
+    std::vector<size_t> open;
+    for (size_t i = 0; i < body.size(); ++i) {
+        if (opensBlock(body[i])) {
+            open.push_back(i);
+            written[i];
+        } else if (is(body[i], BLOCK_END) && !open.empty()) {
+            open.pop_back();
+        } else if (is(body[i], LOCALSET) || is(body[i], LOCALTEE)) {
+            for (size_t opener : open) {
+                written[opener].insert(body[i]->parameter);
+            }
+        }
+    }
+
+    // local index -> the constant it holds at the current instruction
+    typedef std::unordered_map<uint32_t, Value> Known;
+    Known known;
+    for (size_t index = context.parameterCount; index < context.localTypes.size(); ++index) {
+        // a Value holds at most 64 bits, so v128 locals are never known
+        if (context.localTypes[index] != 0 && context.localTypes[index] != V128) {
+            known[index] = { context.localTypes[index], 0 };
+        }
+    }
+    auto without = [](Known state, const std::unordered_set<uint32_t>& locals) {
+        for (uint32_t local : locals) {
+            state.erase(local);
+        }
+        return state;
+    };
+
+    // the state when entering the enclosing blocks: whatever isn't stored to inside a block still
+    // holds that value at its end, where the branches out of the block join
+    std::vector<std::pair<size_t, Known>> entries;
+    int changes = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        Instruction* instruction = body[i];
+        if (instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER && is(instruction, LOCALGET)) {
+            auto value = known.find(instruction->parameter);
+            if (value != known.end()) {
+                body[i] = makeConstant(context.arena, value->second);
+                ++changes;
+            }
+        } else if (is(instruction, LOCALSET) || is(instruction, LOCALTEE)) {
+            if (i > 0 && isConstant(body[i - 1])) {
+                known[instruction->parameter] = valueOf(body[i - 1]);
+            } else {
+                known.erase(instruction->parameter);
+            }
+        } else if (opensBlock(instruction)) {
+            entries.emplace_back(i, known);
+            if (is(instruction, LOOP)) {
+                // the back edges come from anywhere in the loop
+                known = without(known, written[i]);
+            }
+        } else if (is(instruction, ELSE) && !entries.empty()) {
+            // the else branch is only reached from the if itself
+            known = entries.back().second;
+        } else if (is(instruction, BLOCK_END) && !entries.empty()) {
+            known = without(std::move(entries.back().second), written[entries.back().first]);
+            entries.pop_back();
+        }
+    }
+    return changes;
+}
+
+int ConstantFolding::run(std::vector<Instruction*>& body, PassContext& context) {
+    int changes = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        Instruction* instruction = body[out++] = body[i];
+        const opcodes::OpcodeInfo* info = instructionInfo(instruction);
+        if (info == nullptr || info->prefix != 0 || info->immediate != opcodes::Immediate::NONE) {
+            continue;
+        }
+
+        Value result;
+        if (info->signature.paramCount == 2 && out >= 3 && isConstant(body[out - 3]) && isConstant(body[out - 2]) &&
+            foldBinary(info->code, valueOf(body[out - 3]), valueOf(body[out - 2]), result)) {
+            out -= 3;
+            body[out++] = makeConstant(context.arena, result);
+            ++changes;
+        } else if (info->signature.paramCount == 1 && out >= 2 && isConstant(body[out - 2]) &&
+                   foldUnary(info->code, valueOf(body[out - 2]), result)) {
+            out -= 2;
+            body[out++] = makeConstant(context.arena, result);
+            ++changes;
+        }
+    }
+    body.resize(out);
+    return changes;
+}
+
+int AlgebraicIdentities::run(std::vector<Instruction*>& body, PassContext& context) {
+    int changes = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        Instruction* instruction = body[out++] = body[i];
+        if (instruction->type != InstructionType::CALCULATION || instruction->prefix != 0 || out < 2 || !isConstant(body[out - 2])) {
+            continue;
+        }
+        Value right = valueOf(body[out - 2]);
+        if (right.type != INT32 && right.type != INT64) {
+            continue;   // x + 0.0 isn't x for x = -0.0, x * 1.0 changes signalling NaNs
+        }
+        uint8_t base = right.type == INT32 ? I32ADD : I64ADD;
+        uint64_t allOnes = right.type == INT32 ? 0xFFFFFFFFull : ~0ull;
+        uint64_t bits = right.type == INT32 ? (uint32_t)right.bits : right.bits;
+        uint32_t op = instruction->instruction_code - base;
+
+        bool identity =
+            (bits == 0 && (op == I32ADD - I32ADD || op == I32SUB - I32ADD || op == I32OR - I32ADD ||
+                           op == I32XOR - I32ADD || op == I32SHL - I32ADD || op == I32SHR_S - I32ADD ||
+                           op == I32SHR_U - I32ADD || op == I32ROTL - I32ADD || op == I32ROTR - I32ADD)) ||
+            (bits == 1 && (op == I32MUL - I32ADD || op == I32DIV_S - I32ADD || op == I32DIV_U - I32ADD)) ||
+            (bits == allOnes && op == I32AND - I32ADD);
+        bool zero = bits == 0 && (op == I32MUL - I32ADD || op == I32AND - I32ADD);
+
+        if (identity) {
+            out -= 2;
+            ++changes;
+        } else if (zero) {
+            // the other operand may have side effects, so it is still computed
+            body[out - 2] = makeInstruction(context.arena, InstructionType::INSTRUCTION_WITHOUT_PARAMETER, DROP);
+            body[out - 1] = makeConstant(context.arena, { right.type, 0 });
+            ++changes;
+        }
+    }
+    body.resize(out);
+    return changes;
+}
+
+int StrengthReduction::run(std::vector<Instruction*>& body, PassContext& context) {
+    int changes = 0;
+    for (size_t i = 1; i < body.size(); ++i) {
+        Instruction* instruction = body[i];
+        if (instruction->type != InstructionType::CALCULATION || instruction->prefix != 0 || !isConstant(body[i - 1])) {
+            continue;
+        }
+        Value constant = valueOf(body[i - 1]);
+        if ((constant.type != INT32 && constant.type != INT64) || !isPowerOfTwo(constant)) {
+            continue;
+        }
+        uint64_t shift = std::countr_zero(constant.bits);
+        // the i64 forms are the same distance from their i32 ones: mul, div_u and rem_u, shl, shr_u and and
+        uint8_t offset = constant.type == INT64 ? I64ADD - I32ADD : 0;
+        switch (instruction->instruction_code - offset) {
+            case I32MUL:
+                body[i - 1] = makeConstant(context.arena, { constant.type, shift });
+                body[i] = makeInstruction(context.arena, InstructionType::CALCULATION, I32SHL + offset);
+                break;
+            case I32DIV_U:
+                body[i - 1] = makeConstant(context.arena, { constant.type, shift });
+                body[i] = makeInstruction(context.arena, InstructionType::CALCULATION, I32SHR_U + offset);
+                break;
+            case I32REM_U:
+                body[i - 1] = makeConstant(context.arena, { constant.type, constant.bits - 1 });
+                body[i] = makeInstruction(context.arena, InstructionType::CALCULATION, I32AND + offset);
+                break;
+            default:
+                continue;
+        }
+        ++changes;
+    }
+    return changes;
+}
+
+int RedundantLocals::run(std::vector<Instruction*>& body, PassContext& context) {
+    std::unordered_set<uint32_t> read;
+    for (auto instruction : body) {
+        if (instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER && is(instruction, LOCALGET)) {
+            read.insert(instruction->parameter);
+        }
+    }
+
+    int changes = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        Instruction* instruction = body[out++] = body[i];
+        Instruction* previous = out >= 2 ? body[out - 2] : nullptr;
+        bool withParameter = instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER;
+
+        if (withParameter && (is(instruction, LOCALSET) || is(instruction, LOCALTEE)) && !read.contains(instruction->parameter)) {
+            // nobody reads the local: the set only consumes the value, the tee does nothing
+            if (is(instruction, LOCALSET)) {
+                body[out - 1] = makeInstruction(context.arena, InstructionType::INSTRUCTION_WITHOUT_PARAMETER, DROP);
+            } else {
+                --out;
+            }
+            ++changes;
+        } else if (withParameter && is(instruction, LOCALGET) && previous != nullptr && is(previous, LOCALSET) &&
+                   previous->parameter == instruction->parameter) {
+            body[out - 2] = makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALTEE, instruction->parameter);
+            --out;
+            ++changes;
+        } else if (withParameter && is(instruction, LOCALSET) && previous != nullptr && is(previous, LOCALGET) &&
+                   previous->type == InstructionType::INSTRUCTION_WITH_PARAMETER && previous->parameter == instruction->parameter) {
+            out -= 2;
+            ++changes;
+        } else if (is(instruction, DROP) && previous != nullptr) {
+            if (is(previous, LOCALTEE)) {
+                body[out - 2] = makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, previous->parameter);
+                --out;
+                ++changes;
+            } else if (isConstant(previous) || (is(previous, LOCALGET) && previous->type == InstructionType::INSTRUCTION_WITH_PARAMETER)) {
+                out -= 2;
+                ++changes;
+            }
+        }
+    }
+    body.resize(out);
+    return changes;
+}
+
+int DeadCodeElimination::run(std::vector<Instruction*>& body, PassContext&) {
+    int changes = 0;
+    size_t out = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        Instruction* instruction = body[out++] = body[i];
+        if (!isUnconditionalJump(instruction)) {
+            continue;
+        }
+        // skip to the end (or else) of the enclosing block, including whole nested blocks
+        int depth = 0;
+        while (i + 1 < body.size()) {
+            Instruction* next = body[i + 1];
+            if (opensBlock(next)) {
+                ++depth;
+            } else if (is(next, BLOCK_END) || is(next, ELSE)) {
+                if (depth == 0) {
+                    break;
+                }
+                if (is(next, BLOCK_END)) {
+                    --depth;
+                }
+            }
+            ++i;
+            ++changes;
+        }
+    }
+    body.resize(out);
+    return changes;
+}
+
+int LoopUnrolling::run(std::vector<Instruction*>& body, PassContext& context) {
+    if (factor <= 1) {
+        return 0;
+    }
+    int changes = 0;
+    for (size_t loop = 0; loop < body.size(); ++loop) {
+        if (!is(body[loop], LOOP) || body[loop]->block_parameters != std::vector<uint8_t>{ 0x40 }) {
+            continue;
+        }
+        size_t end = matchingEnd(body, loop);
+        if (end == body.size() || end < loop + 8) {
+            continue;
+        }
+
+        // the end of the loop: [local.get $i T.const step op local.set $i local.get $i] or
+        // [local.get $i T.const step op local.tee $i], then i32.const limit compare br_if 0
+        Instruction* branch = body[end - 1];
+        Instruction* compare = body[end - 2];
+        if (!is(branch, BR_IF) || branch->parameter != 0 || !isI32Constant(body[end - 3]) ||
+            compare->instruction_code < I32EQ || compare->instruction_code > I32GE_U || !is(compare, compare->instruction_code)) {
+            continue;
+        }
+        bool teed = is(body[end - 4], LOCALTEE);
+        uint32_t counter = body[end - 4]->parameter;
+        size_t increment = teed ? end - 7 : end - 8;
+        if (increment <= loop || !isLocal(body[increment], LOCALGET, counter) || !isI32Constant(body[increment + 1]) ||
+            body[increment + 2]->type != InstructionType::CALCULATION || body[increment + 2]->prefix != 0 ||
+            body[increment + 2]->instruction_code < I32ADD || body[increment + 2]->instruction_code > I32ROTR ||
+            !isLocal(body[increment + 3], teed ? LOCALTEE : LOCALSET, counter) ||
+            (!teed && !isLocal(body[end - 4], LOCALGET, counter)) ||
+            counter >= context.localTypes.size() || context.localTypes[counter] != INT32) {
+            continue;
+        }
+
+        // the rest of the loop neither changes the counter nor leaves or repeats the loop
+        bool simple = true;
+        uint32_t nesting = 0;
+        for (size_t i = loop + 1; i < increment && simple; ++i) {
+            Instruction* instruction = body[i];
+            if (opensBlock(instruction)) {
+                simple = !is(instruction, LOOP);
+                ++nesting;
+            } else if (is(instruction, BLOCK_END)) {
+                --nesting;
+            } else if (is(instruction, BR) || is(instruction, BR_IF)) {
+                simple = instruction->parameter < nesting;
+            } else {
+                simple = !is(instruction, BR_TABLE) && !is(instruction, RETURN) &&
+                         !isLocal(instruction, LOCALSET, counter) && !isLocal(instruction, LOCALTEE, counter);
+            }
+        }
+        if (!simple) {
+            continue;
+        }
+
+        // the counter on entry: stored right in front of the loop, or the zero a declared local
+        // starts out with when nothing stores to it before a loop that runs once per call
+        uint32_t first;
+        if (loop >= 2 && isLocal(body[loop - 1], LOCALSET, counter) && isI32Constant(body[loop - 2])) {
+            first = body[loop - 2]->parameter;
+        } else {
+            bool stored = counter < context.parameterCount;
+            int depth = 0;
+            for (size_t i = 0; i < loop && !stored; ++i) {
+                depth += opensBlock(body[i]) ? 1 : is(body[i], BLOCK_END) ? -1 : 0;
+                stored = isLocal(body[i], LOCALSET, counter) || isLocal(body[i], LOCALTEE, counter);
+            }
+            if (stored || depth != 0) {
+                continue;
+            }
+            first = 0;
+        }
+
+        uint32_t trips = tripCount(body[increment + 2]->instruction_code, first, body[increment + 1]->parameter,
+                                   compare->instruction_code, body[end - 3]->parameter, MAX_TRIPS, maxSize);
+        if (trips == 0) {
+            continue;
+        }
+
+        // one iteration: the loop up to the increment, which stores with local.set
+        std::vector<Instruction*> iteration(body.begin() + loop + 1, body.begin() + increment + 3);
+        iteration.push_back(makeInstruction(context.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, counter));
+        auto copy = [&](std::vector<Instruction*>& to, size_t count) {
+            for (size_t n = 0; n < count; ++n) {
+                for (auto instruction : iteration) {
+                    to.push_back(context.arena->make<Instruction>(*instruction));
+                }
+            }
+        };
+
+        std::vector<Instruction*> unrolled;
+        size_t remainder = trips % factor;
+        if (trips * iteration.size() <= maxSize) {
+            copy(unrolled, trips);
+            ++complete;
+        } else if (trips >= (uint32_t)factor && (factor + remainder) * iteration.size() <= maxSize) {
+            copy(unrolled, remainder);
+            unrolled.push_back(body[loop]);
+            copy(unrolled, factor - 1);
+            unrolled.insert(unrolled.end(), body.begin() + loop + 1, body.begin() + end + 1);
+            ++partial;
+        } else {
+            continue;
+        }
+        body.erase(body.begin() + loop, body.begin() + end + 1);
+        body.insert(body.begin() + loop, unrolled.begin(), unrolled.end());
+        loop += unrolled.size() - 1;
+        ++changes;
+    }
+    return changes;
+}
+
+std::string LoopUnrolling::details() const {
+    return std::to_string(complete) + " completely, " + std::to_string(partial) + " by " + std::to_string(factor);
+}
+
+int SSAOptimization::run(std::vector<Instruction*>& body, PassContext& context) {
+    ssa::Graph graph(context.arena, context.function, *context.functions, context.localTypes);
+    if (!graph.build(body)) {
+        return 0;
+    }
+    int numberedNow = graph.numberValues();
+    int hoistedNow = graph.hoistInvariants();
+    int copiesNow = graph.propagateCopies() + graph.getCopies();
+
+    std::vector<Instruction*> linear;
+    std::vector<uint8_t> localTypes;
+    // without anything numbered or hoisted the round trip only pays off when the body got shorter
+    if (!graph.linearize(linear, localTypes) || (numberedNow + hoistedNow == 0 && linear.size() >= body.size())) {
+        return 0;
+    }
+    body = std::move(linear);
+    context.localTypes = std::move(localTypes);
+    context.function->locals.assign(context.localTypes.begin() + context.parameterCount, context.localTypes.end());
+
+    numbered += numberedNow;
+    hoisted += hoistedNow;
+    copies += copiesNow;
+    return std::max(1, numberedNow + hoistedNow + copiesNow);
+}
+
+std::string SSAOptimization::details() const {
+    return std::to_string(numbered) + " numbered, " + std::to_string(hoisted) + " hoisted, " +
+           std::to_string(copies) + " copies";
+}
+
+PassManager PassManager::createDefault(size_t inlineSize, int inlineDepth, int unrollFactor) {
+    PassManager manager;
+    manager.addPass(std::make_unique<Inlining>(inlineSize, inlineDepth));
+    manager.addPass(std::make_unique<ConstantPropagation>());
+    manager.addPass(std::make_unique<ConstantFolding>());
+    manager.addPass(std::make_unique<AlgebraicIdentities>());
+    manager.addPass(std::make_unique<StrengthReduction>());
+    manager.addPass(std::make_unique<DeadCodeElimination>());
+    manager.addPass(std::make_unique<LoopUnrolling>(unrollFactor));
+    manager.addPass(std::make_unique<SSAOptimization>());
+    manager.addPass(std::make_unique<RedundantLocals>());
+    return manager;
+}
+
+void PassManager::addPass(std::unique_ptr<Pass> pass) {
+    passes.push_back(std::move(pass));
+    statistics.emplace_back();
+}
+
+void PassManager::prepare(const std::vector<AST_Function*>& functions) {
+    for (auto& pass : passes) {
+        pass->prepare(functions);
+    }
+}
+
+void PassManager::run(AST_Function* function, const std::vector<AST_Function*>& functions, Arena* arena) {
+    std::vector<Instruction*>& body = *function->body;
+    size_t sizeBefore = body.size();
+    std::vector<Statistics> current(passes.size());
+
+    PassContext context{ arena, function, localTypesOf(function), function->parameters.size(), &functions };
+    for (int round = 0; round < MAX_ROUNDS; ++round) {
+        context.round = round;
+        int changes = 0;
+        for (size_t i = 0; i < passes.size(); ++i) {
+            auto start = std::chrono::steady_clock::now();
+            int passChanges = passes[i]->run(body, context);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            current[i].milliseconds += elapsed.count();
+            current[i].runs++;
+            current[i].changes += passChanges;
+            changes += passChanges;
+        }
+        if (changes == 0) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(*mutex);
+    for (size_t i = 0; i < passes.size(); ++i) {
+        statistics[i].milliseconds += current[i].milliseconds;
+        statistics[i].runs += current[i].runs;
+        statistics[i].changes += current[i].changes;
+    }
+    instructionsBefore += sizeBefore;
+    instructionsAfter += body.size();
+}
+
+void PassManager::report(std::ostream& output) const {
+    output << std::left << std::setw(24) << "pass" << std::right << std::setw(12) << "time (ms)"
+           << std::setw(8) << "runs" << std::setw(10) << "changes" << std::endl;
+    for (size_t i = 0; i < passes.size(); ++i) {
+        output << std::left << std::setw(24) << passes[i]->getName() << std::right << std::fixed << std::setprecision(3)
+               << std::setw(12) << statistics[i].milliseconds << std::setw(8) << statistics[i].runs
+               << std::setw(10) << statistics[i].changes;
+        std::string details = passes[i]->details();
+        if (!details.empty()) {
+            output << "  (" << details << ")";
+        }
+        output << std::endl;
+    }
+    output << "instructions: " << instructionsBefore << " -> " << instructionsAfter << std::endl;
+}
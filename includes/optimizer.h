@@ -0,0 +1,195 @@
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+#include "AST_Types.h"
+#include "arena.h"
+#include "instruction.h"
+
+// What a pass gets to see of the function it optimizes
+struct PassContext {
+    Arena* arena;
+    AST_Function* function;
+    std::vector<uint8_t> localTypes;    // value type per local index, parameters first (0 when unknown)
+    size_t parameterCount;
+    const std::vector<AST_Function*>* functions;   // all functions of the module, by index
+    int round = 0;                      // how often the PassManager went through the pipeline before
+};
+
+// An optimization over the Instruction stream of one function body. run() rewrites the body in
+// place and returns how many changes it made, the PassManager repeats the pipeline until no pass
+// changes anything anymore. The functions of a module may be optimized on several threads at once,
+// so run() only keeps statistics in the pass itself (atomically); what it needs to know about the
+// whole module it finds out in prepare(), which runs before any of the functions.
+class Pass {
+public:
+    virtual ~Pass() = default;
+    virtual const char* getName() const = 0;
+    virtual void prepare(const std::vector<AST_Function*>& /*functions*/) {}
+    virtual int run(std::vector<Instruction*>& body, PassContext& context) = 0;
+    // what the changes were, for passes that make more than one kind
+    virtual std::string details() const { return ""; }
+};
+
+// per function index: whether it is on a cycle of calls, i.e. calls itself directly or not
+std::vector<bool> findRecursion(const std::vector<AST_Function*>& functions);
+
+// Calls to small functions are replaced by the callee's body: the arguments are stored into fresh
+// locals of the caller, the callee's locals are renumbered behind the caller's (and zeroed, the
+// call may be in a loop) and branches to the callee's function level, return included, target a
+// block around the inlined body. Recursive callees and imports stay calls, calls in an inlined body
+// are inlined as well up to maxDepth. Only runs in the first round, so that the depth holds. The
+// Compiler optimizes callees before their callers, so it is their optimized body that gets inlined.
+class Inlining : public Pass {
+public:
+    static constexpr size_t DEFAULT_MAX_SIZE = 24;  // instructions in the callee's body
+    static constexpr int DEFAULT_MAX_DEPTH = 2;
+
+    explicit Inlining(size_t maxSize = DEFAULT_MAX_SIZE, int maxDepth = DEFAULT_MAX_DEPTH)
+        : maxSize(maxSize), maxDepth(maxDepth) {}
+
+    const char* getName() const override { return "inlining"; }
+    void prepare(const std::vector<AST_Function*>& functions) override;
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+    std::string details() const override;
+
+private:
+    size_t maxSize;
+    int maxDepth;
+    const std::vector<AST_Function*>* analyzed = nullptr;
+    std::vector<bool> recursive;    // per function index: on a cycle of calls
+    std::atomic<int> inlined = 0;
+    std::atomic<int> callsBefore = 0;
+    std::atomic<int> callsAfter = 0;
+
+    const AST_Function* inlinable(uint32_t index, PassContext& context) const;
+    // both return how many calls they inlined
+    int expand(std::span<Instruction* const> from, int depth, uint32_t localBase, PassContext& context,
+               std::vector<Instruction*>& to);
+    int inlineCall(const AST_Function* callee, int depth, PassContext& context, std::vector<Instruction*>& to);
+};
+
+// "local.get $x" becomes "T.const c" as long as $x is known to hold c: after a constant was stored
+// into it, or for declared locals before their first store (they start out as zero)
+class ConstantPropagation : public Pass {
+public:
+    const char* getName() const override { return "constant-propagation"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// evaluates operations on constant operands, e.g. "i32.const 2 i32.const 3 i32.mul" to "i32.const 6"
+class ConstantFolding : public Pass {
+public:
+    const char* getName() const override { return "constant-folding"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// x + 0, x - 0, x * 1, x | 0, x ^ 0, x & -1, x << 0, ... are x; x * 0 and x & 0 are 0
+class AlgebraicIdentities : public Pass {
+public:
+    const char* getName() const override { return "algebraic-identities"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// unsigned multiplication, division and remainder by a power of two become shifts and masks
+class StrengthReduction : public Pass {
+public:
+    const char* getName() const override { return "strength-reduction"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// local.set $x local.get $x is local.tee $x, local.get $x local.set $x does nothing, stores to
+// locals that are never read are dropped and values that are dropped right away aren't computed
+class RedundantLocals : public Pass {
+public:
+    const char* getName() const override { return "redundant-locals"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// removes the instructions after br, br_table, return and unreachable up to the end of the block
+class DeadCodeElimination : public Pass {
+public:
+    const char* getName() const override { return "dead-code-elimination"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+};
+
+// Loops that run a constant number of times lose their br_if: they are unrolled completely when the
+// copies stay within maxSize instructions, otherwise factor iterations go into one round of the loop
+// and the remaining ones in front of it. A loop qualifies when its counter holds a constant on
+// entry and is changed by a constant once, right in front of the condition at the end of the loop,
+// and when nothing else in it branches to the loop or further out. Inner loops go first, what
+// doesn't change in a loop is left to the ssa pass.
+class LoopUnrolling : public Pass {
+public:
+    static constexpr int DEFAULT_FACTOR = 4;
+    static constexpr size_t DEFAULT_MAX_SIZE = 64;  // instructions of unrolled code per loop
+    static constexpr uint32_t MAX_TRIPS = 1 << 16;  // loops running longer aren't unrolled
+
+    explicit LoopUnrolling(int factor = DEFAULT_FACTOR, size_t maxSize = DEFAULT_MAX_SIZE)
+        : factor(factor), maxSize(maxSize) {}
+
+    const char* getName() const override { return "loop-unrolling"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+    std::string details() const override;
+
+private:
+    int factor;
+    size_t maxSize;
+    std::atomic<int> complete = 0;
+    std::atomic<int> partial = 0;
+};
+
+// Global value numbering, loop invariant code motion and copy propagation on the SSA form of the
+// body (see ssa.h). The result replaces the body when it found something to improve, the locals
+// are renumbered then: parameters first, followed by whatever the linearized body needs.
+class SSAOptimization : public Pass {
+public:
+    const char* getName() const override { return "ssa"; }
+    int run(std::vector<Instruction*>& body, PassContext& context) override;
+    std::string details() const override;
+
+private:
+    std::atomic<int> numbered = 0;
+    std::atomic<int> hoisted = 0;
+    std::atomic<int> copies = 0;
+};
+
+class PassManager {
+public:
+    // the passes above, in an order where each one feeds the next; the thresholds are those of
+    // Inlining and LoopUnrolling, an inlining size of 0 or an unrolling factor of 1 turns them off
+    static PassManager createDefault(size_t inlineSize = Inlining::DEFAULT_MAX_SIZE,
+                                     int inlineDepth = Inlining::DEFAULT_MAX_DEPTH,
+                                     int unrollFactor = LoopUnrolling::DEFAULT_FACTOR);
+
+    void addPass(std::unique_ptr<Pass> pass);
+    // once per module, before its functions are run; run() itself may be called from several threads
+    void prepare(const std::vector<AST_Function*>& functions);
+    void run(AST_Function* function, const std::vector<AST_Function*>& functions, Arena* arena);
+
+    // time spent and changes made per pass over all functions run so far
+    void report(std::ostream& output) const;
+
+private:
+    struct Statistics {
+        double milliseconds = 0;
+        int runs = 0;
+        int changes = 0;
+    };
+
+    static constexpr int MAX_ROUNDS = 16;
+
+    std::vector<std::unique_ptr<Pass>> passes;
+    std::unique_ptr<std::mutex> mutex = std::make_unique<std::mutex>();   // for the statistics
+    std::vector<Statistics> statistics;
+    size_t instructionsBefore = 0;
+    size_t instructionsAfter = 0;
+};
+
+#endif // __OPTIMIZER_H__
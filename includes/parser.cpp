@@ -1,341 +1,1202 @@
 // Based on example on Toledo
 
-#include <iostream>
-#include <iomanip> // std::setw(), std::setfill()
-#include <vector>
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include "lexer.h"
 #include "parser.h"
 #include "instruction.h"
+#include "bytestream.h"
 
-using namespace std;
+namespace {
 
-void Parser::parseProper() {
-	std::vector<Token> tokens = this->lexer->getTokens();
+VariableType variableType(uint8_t type) {
+    switch (type) {
+        case constants::INT64:
+            return VariableType::is_int64;
+        case constants::FLOAT32:
+            return VariableType::isfloat32_t;
+        case constants::FLOAT64:
+            return VariableType::isfloat64_t;
+        case constants::V128:
+            return VariableType::isv128_t;
+        default:
+            return VariableType::is_int32;
+    }
+}
 
-	// Proper parser will map instructions to the main calculations and their operands, if applicable
+uint8_t valueType(VariableType type) {
+    switch (type) {
+        case VariableType::is_int64:
+            return constants::INT64;
+        case VariableType::isfloat32_t:
+            return constants::FLOAT32;
+        case VariableType::isfloat64_t:
+            return constants::FLOAT64;
+        case VariableType::isv128_t:
+            return constants::V128;
+        default:
+            return constants::INT32;
+    }
+}
 
-	std::vector<Instruction*> *output = nullptr;
+// the lane types of v128.const
+struct Shape {
+    std::string_view name;
+    uint32_t bits;
+    bool isFloat;
+};
 
-	int totalLenght = 0;
+constexpr Shape SHAPES[] = {
+    { "i8x16", 8, false }, { "i16x8", 16, false }, { "i32x4", 32, false }, { "i64x2", 64, false },
+    { "f32x4", 32, true }, { "f64x2", 64, true },
+};
 
-	// we only want to output the function body for now, to keep it simple
-	// HACK: assume that only starts with the first valid "operation" we get
-	// TODO: properly parse everything
-	bool HACK_inCodeBlock = false;
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
 
-	for ( int i = 0; i < tokens.size(); ++i ) {
-        //std::cout << "Token " << i << ": " << tokens[i].string_value << std::endl;
+void appendUtf8(std::string& text, uint32_t c) {
+    if (c < 0x80) {
+        text += (char)c;
+    } else if (c < 0x800) {
+        text += (char)(0xC0 | (c >> 6));
+        text += (char)(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        text += (char)(0xE0 | (c >> 12));
+        text += (char)(0x80 | ((c >> 6) & 0x3F));
+        text += (char)(0x80 | (c & 0x3F));
+    } else {
+        text += (char)(0xF0 | (c >> 18));
+        text += (char)(0x80 | ((c >> 12) & 0x3F));
+        text += (char)(0x80 | ((c >> 6) & 0x3F));
+        text += (char)(0x80 | (c & 0x3F));
+    }
+}
 
-		Token token = tokens[i];
+bool isBlock(const opcodes::OpcodeInfo* info) {
+    return info->prefix == 0 && (info->code == constants::BLOCK || info->code == constants::LOOP || info->code == constants::IF);
+}
 
-        if (token.string_value == "module") {
-            continue;
+bool isBlockEnd(const Token* token) {
+    const opcodes::OpcodeInfo* info = token->asOpcode();
+    return info != nullptr && info->prefix == 0 && (info->code == constants::BLOCK_END || info->code == constants::ELSE);
+}
+
+}
+
+void Parser::parseProper() {
+    if (atField("module")) {
+        skip(2);
+        optionalName();
+        while (!atClose()) {
+            parseField();
         }
+        expectClose();
+    } else {
+        // the fields of a module without the (module ...) around them
+        while (peek() != nullptr) {
+            parseField();
+        }
+    }
+    if (peek() != nullptr) {
+        error(peek(), "unexpected '" + std::string(peek()->string_value) + "' after the module");
+    }
+    finish();
+}
 
-        if (token.string_value == "local") {
-            if (tokens[i + 1].type == TokenType::KEYWORD) {
-                uint8_t type;
-                switch (InstructionNumber::getType(tokens[++i].string_value)) {
-                    case InstructionNumber::Type::I32:
-                        type = constants::INT32;
-                        break;
-                    case InstructionNumber::Type::I64:
-                        type = constants::INT64;
-                        break;
-                    case InstructionNumber::Type::F32:
-                        type = constants::FLOAT32;
-                        break;
-                    case InstructionNumber::Type::F64:
-                        type = constants::FLOAT64;
-                        break;
-                    default:
-                        std::cout << "Unknown local type: " << tokens[i].string_value << std::endl;
-                }
-                currentFunction->locals.insert(std::make_pair("", std::make_pair(currentFunction->locals.size(), type)));
-                continue;
+// tokens
+
+// nullptr at the end of the source, a source the lexer stopped in is an error
+const Token* Parser::peek(size_t ahead) {
+    while (peeked <= ahead) {
+        if (!lexer->next(lookahead[(first + peeked) % LOOKAHEAD])) {
+            if (lexer->getError() != nullptr) {
+                throw ParseError(lexer->locate(lexer->getErrorPosition()), lexer->getError());
             }
+            return nullptr;
         }
+        peeked++;
+    }
+    return &lookahead[(first + ahead) % LOOKAHEAD];
+}
 
-        if (token.string_value == "data") {
-            auto data = new AST_Data;
-            ++i;
-            data->type = InstructionNumber::getOperation(tokens[++i].string_value);
-            data->value = tokens[++i].uint32_value;
-            ++i;
-            data->data = tokens[++i].string_value;
-            datas.push_back(data);
-            continue;
+Token Parser::next() {
+    if (peek() == nullptr) {
+        error(nullptr, "unexpected end of input");
+    }
+    previous = lookahead[first];
+    first = (first + 1) % LOOKAHEAD;
+    peeked--;
+    if (hashing) {
+        fieldHash = hashToken(fieldHash, previous);
+    }
+    return previous;
+}
+
+// the token next() takes, without taking it
+const Token& Parser::current() {
+    const Token* token = peek();
+    if (token == nullptr) {
+        error(nullptr, "unexpected end of input");
+    }
+    return *token;
+}
+
+void Parser::skip(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        next();
+    }
+}
+
+bool Parser::atKeyword(std::string_view keyword) {
+    const Token* token = peek();
+    return token != nullptr && token->type == TokenType::KEYWORD && token->string_value == keyword;
+}
+
+bool Parser::atField(std::string_view keyword) {
+    const Token* open = peek();
+    const Token* token = peek(1);
+    return open != nullptr && open->type == TokenType::BRACKETS_OPEN &&
+           token != nullptr && token->type == TokenType::KEYWORD && token->string_value == keyword;
+}
+
+bool Parser::atClose() {
+    const Token* token = peek();
+    return token != nullptr && token->type == TokenType::BRACKETS_CLOSED;
+}
+
+bool Parser::atIndex() {
+    const Token* token = peek();
+    return token != nullptr && (token->type == TokenType::NUMBER || token->type == TokenType::VARIABLE);
+}
+
+void Parser::expectOpen() {
+    if (next().type != TokenType::BRACKETS_OPEN) {
+        error(&previous, "expected '('");
+    }
+}
+
+void Parser::expectClose() {
+    const Token& token = next();
+    if (token.type != TokenType::BRACKETS_CLOSED) {
+        error(&token, "expected ')' instead of '" + std::string(token.string_value) + "'");
+    }
+}
+
+void Parser::expectKeyword(std::string_view keyword) {
+    const Token& token = next();
+    if (token.type != TokenType::KEYWORD || token.string_value != keyword) {
+        error(&token, "expected '" + std::string(keyword) + "' instead of '" + std::string(token.string_value) + "'");
+    }
+}
+
+void Parser::error(const Token* token, const std::string& message) const {
+    throw ParseError(lexer->locate(token != nullptr ? token->string_value.data() : nullptr), message);
+}
+
+// names and values
+
+// the symbol of a $name if one comes next, NO_SYMBOL otherwise
+Symbol Parser::optionalName() {
+    const Token* token = peek();
+    if (token != nullptr && token->type == TokenType::VARIABLE) {
+        return symbols.intern(next().string_value);
+    }
+    return NO_SYMBOL;
+}
+
+void Parser::addName(SymbolTable& names, Symbol name, uint32_t index, const char* what) {
+    if (name != NO_SYMBOL && !names.bind(name, index)) {
+        error(&previous, std::string("duplicate ") + what + " " + std::string(symbols.name(name)));
+    }
+}
+
+// a name or an index below count
+uint32_t Parser::resolve(const SymbolTable& names, const Token& token, size_t count, const char* what) const {
+    if (token.type == TokenType::VARIABLE) {
+        uint32_t index = names.find(symbols.find(token.string_value));
+        if (index == SymbolTable::UNBOUND) {
+            error(&token, std::string("unknown ") + what + " " + std::string(token.string_value));
         }
+        return index;
+    }
+    if (token.type != TokenType::NUMBER || token.number_type != NumberType::INTEGER || token.string_value[0] == '-') {
+        error(&token, std::string("expected the name or index of a ") + what);
+    }
+    if (token.integer_value >= count) {
+        error(&token, std::string("unknown ") + what + " " + std::string(token.string_value));
+    }
+    return (uint32_t)token.integer_value;
+}
 
-        if (token.string_value == "memory") {
-            AST_Memory* memory;
-            // only one memory block allowed in current WA spec
-            if (memories.empty()) {
-                memory = new AST_Memory;
-            } else {
-                memory = memories[0];
+// the escapes of the text format decoded: \t \n \r \" \' \\, \hh and \u{h+}
+std::string Parser::parseString() {
+    const Token& token = next();
+    if (token.type != TokenType::STRING) {
+        error(&token, "expected a string");
+    }
+    std::string_view raw = token.string_value;
+    std::string text;
+    text.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            text += raw[i];
+            continue;
+        }
+        if (++i == raw.size()) {
+            error(&token, "unterminated escape in string");
+        }
+        switch (raw[i]) {
+            case 't': text += '\t'; break;
+            case 'n': text += '\n'; break;
+            case 'r': text += '\r'; break;
+            case '"': text += '"'; break;
+            case '\'': text += '\''; break;
+            case '\\': text += '\\'; break;
+            case 'u': {
+                size_t close = raw.find('}', i);
+                if (i + 1 >= raw.size() || raw[i + 1] != '{' || close == std::string_view::npos || close == i + 2) {
+                    error(&token, "invalid unicode escape in string");
+                }
+                uint32_t c = 0;
+                for (size_t j = i + 2; j < close; ++j) {
+                    int digit = hexDigit(raw[j]);
+                    if (digit < 0 || c > 0x10FFFF) {
+                        error(&token, "invalid unicode escape in string");
+                    }
+                    c = c * 16 + digit;
+                }
+                if (c > 0x10FFFF || (c >= 0xD800 && c < 0xE000)) {
+                    error(&token, "invalid unicode escape in string");
+                }
+                appendUtf8(text, c);
+                i = close;
+                break;
             }
-            if (tokens[i + 2].string_value == "export") {
-                memory->name = tokens[i + 3].string_value;
-                i += 5;
-            } else {
+            default: {
+                int high = hexDigit(raw[i]);
+                int low = i + 1 < raw.size() ? hexDigit(raw[i + 1]) : -1;
+                if (high < 0 || low < 0) {
+                    error(&token, "invalid escape in string");
+                }
+                text += (char)(high * 16 + low);
                 ++i;
             }
-            memory->initial_value = tokens[i].uint32_value;
-            ++i;
-            if (tokens[i].type == TokenType::NUMBER) {
-                memory->max_value = tokens[i].uint32_value;
-                i+=2;
+        }
+    }
+    return text;
+}
+
+uint32_t Parser::parseUInt32() {
+    const Token& token = next();
+    if (token.type != TokenType::NUMBER || token.number_type != NumberType::INTEGER || token.string_value[0] == '-' ||
+        token.integer_value > UINT32_MAX) {
+        error(&token, "expected an unsigned 32 bit integer");
+    }
+    return (uint32_t)token.integer_value;
+}
+
+uint8_t Parser::parseValueType() {
+    const Token& token = next();
+    InstructionNumber::Type type = InstructionNumber::getType(token.string_value);
+    if (token.type != TokenType::KEYWORD || type == InstructionNumber::Type::NONE) {
+        error(&token, "'" + std::string(token.string_value) + "' is not a value type");
+    }
+    return (uint8_t)type;
+}
+
+// (param ...)* (result ...)*, the names of parameters go into localNames
+void Parser::parseSignature(std::vector<VariableType>& parameters, std::vector<VariableType>& results, Scope* scope) {
+    while (atField("param")) {
+        skip(2);
+        if (peek() != nullptr && peek()->type == TokenType::VARIABLE) {
+            Symbol name = symbols.intern(next().string_value);
+            if (scope == nullptr) {
+                error(&previous, "parameters can only be named in functions");
             }
-            if (!memory->isImported) {
-                memories.push_back(memory);
+            addName(localNames, name, parameters.size(), "local");
+            parameters.push_back(variableType(parseValueType()));
+        } else {
+            while (!atClose()) {
+                parameters.push_back(variableType(parseValueType()));
             }
-            continue;
         }
+        expectClose();
+    }
+    while (atField("result")) {
+        skip(2);
+        while (!atClose()) {
+            results.push_back(variableType(parseValueType()));
+        }
+        expectClose();
+    }
+    if (atField("param")) {
+        error(peek(1), "parameters have to come before the results");
+    }
+}
 
-        if (token.string_value == "import") {
-            std::string module = tokens[i + 1].string_value;
-            std::string field = tokens[i + 2].string_value;
-            i += 3;
-            if (tokens[i + 1].string_value == "memory") {
-                auto memory = new AST_Memory;
-                memory->isImported = true;
-                memory->importModule = module;
-                memory->importField = field;
-                memories.push_back(memory);
-                continue;
-            } else if(tokens[i + 1].string_value == "func") {
-                auto func = new AST_Function;
-                func->isImported = true;
-                func->importModule = module;
-                func->importField = field;
-                currentFunction = func;
-                i++;
-                continue;
-            }
+// (type x)? followed by a signature, which has to match the type when both are there; the index of
+// the type, -1 without one
+int64_t Parser::parseTypeUse(std::vector<VariableType>& parameters, std::vector<VariableType>& results, Scope* scope) {
+    int64_t index = -1;
+    Token reference;
+    if (atField("type")) {
+        skip(2);
+        reference = next();
+        index = resolve(typeNames, reference, types.size(), "type");
+        expectClose();
+    }
+    bool inline_ = atField("param") || atField("result");
+    parseSignature(parameters, results, scope);
+    if (index >= 0) {
+        const AST_Type& type = types[index];
+        if (!inline_) {
+            parameters = type.parameters;
+            results = type.results;
+        } else if (parameters != type.parameters || results != type.results) {
+            error(&reference, "the signature doesn't match type " + std::string(reference.string_value));
+        }
+    }
+    if (scope != nullptr) {
+        scope->localCount = parameters.size();
+    }
+    return index;
+}
+
+void Parser::parseLimits(int& initial, int& maximum, const char* what) {
+    initial = parseUInt32();
+    if (peek() != nullptr && peek()->type == TokenType::NUMBER) {
+        Token token = current();
+        maximum = parseUInt32();
+        if (maximum < initial) {
+            error(&token, std::string("the maximum size of a ") + what + " is smaller than its initial size");
+        }
+    }
+}
+
+// inline (export "name") abbreviations, only one name per function, memory or global
+void Parser::parseExports(std::string& name) {
+    while (atField("export")) {
+        skip(2);
+        Token token = current();
+        std::string exported = parseString();
+        if (!name.empty()) {
+            error(&token, "only one export name per function, memory or global is supported");
+        }
+        name = exported;
+        expectClose();
+    }
+}
+
+// module fields
+
+// the tokens of a field that defines a function are what CompileCache knows the function by
+void Parser::parseField() {
+    size_t functionCount = module.functions.size();
+    hashing = true;
+    fieldHash = TOKEN_HASH_SEED;
+    parseFieldContents();
+    hashing = false;
+    if (module.functions.size() > functionCount) {
+        module.functions.back()->sourceHash = fieldHash;
+    }
+}
+
+void Parser::parseFieldContents() {
+    expectOpen();
+    const Token& keyword = next();
+    if (keyword.type == TokenType::KEYWORD) {
+        if (keyword.string_value == "type") return parseType();
+        if (keyword.string_value == "import") return parseImport();
+        if (keyword.string_value == "func") return parseFunction();
+        if (keyword.string_value == "memory") return parseMemory();
+        if (keyword.string_value == "global") return parseGlobal();
+        if (keyword.string_value == "table") return parseTable();
+        if (keyword.string_value == "elem") return parseElement();
+        if (keyword.string_value == "data") return parseData();
+        if (keyword.string_value == "export") return parseExport();
+        if (keyword.string_value == "start") {
+            error(&keyword, "start fields are not supported");
+        }
+    }
+    error(&keyword, "unknown module field '" + std::string(keyword.string_value) + "'");
+}
+
+void Parser::parseType() {
+    AST_Type type;
+    addName(typeNames, optionalName(), types.size(), "type");
+    expectOpen();
+    expectKeyword("func");
+    parseSignature(type.parameters, type.results, nullptr);
+    expectClose();
+    expectClose();
+    types.add(type);
+}
+
+// (import "module" "field" (func ...)), (import "module" "field" (memory ...)) and
+// (import "module" "field" (global ...))
+void Parser::parseImport() {
+    std::string importModule = parseString();
+    std::string importField = parseString();
+    expectOpen();
+    const Token& kind = next();
+    if (kind.string_value == "func") {
+        if (definedFunction) {
+            error(&kind, "imports have to come before the functions of the module");
+        }
+        AST_Function* function = arena->make<AST_Function>();
+        addName(functionNames, optionalName(), module.functions.size(), "function");
+        parseTypeUse(function->parameters, function->results, nullptr);
+        function->isImported = true;
+        function->importModule = importModule;
+        function->importField = importField;
+        module.functions.push_back(function);
+    } else if (kind.string_value == "memory") {
+        if (definedMemory) {
+            error(&kind, "imports have to come before the memories of the module");
+        }
+        AST_Memory* memory = arena->make<AST_Memory>();
+        addName(memoryNames, optionalName(), module.memories.size(), "memory");
+        parseLimits(memory->initial_value, memory->max_value, "memory");
+        memory->isImported = true;
+        memory->importModule = importModule;
+        memory->importField = importField;
+        module.memories.push_back(memory);
+    } else if (kind.string_value == "global") {
+        if (definedGlobal) {
+            error(&kind, "imports have to come before the globals of the module");
+        }
+        AST_Global* global = arena->make<AST_Global>();
+        addName(globalNames, optionalName(), module.globals.size(), "global");
+        parseGlobalType(global);
+        global->isImported = true;
+        global->importModule = importModule;
+        global->importField = importField;
+        module.globals.push_back(global);
+    } else {
+        error(&kind, "imports of '" + std::string(kind.string_value) + "' are not supported");
+    }
+    expectClose();
+    expectClose();
+}
+
+void Parser::parseFunction() {
+    Token start = previous;
+    AST_Function* function = arena->make<AST_Function>();
+    uint32_t index = module.functions.size();
+    addName(functionNames, optionalName(), index, "function");
+    parseExports(function->name);
+
+    if (atField("import")) {
+        if (definedFunction) {
+            error(peek(1), "imports have to come before the functions of the module");
+        }
+        skip(2);
+        function->importModule = parseString();
+        function->importField = parseString();
+        expectClose();
+        parseTypeUse(function->parameters, function->results, nullptr);
+        expectClose();
+        function->isImported = true;
+        module.functions.push_back(function);
+        return;
+    }
+    definedFunction = true;
+    module.functions.push_back(function);
+
+    Scope scope{ function, arena->make<std::vector<Instruction*>>() };
+    localNames.clear();
+    parseTypeUse(function->parameters, function->results, &scope);
+    while (atField("local")) {
+        skip(2);
+        Symbol name = optionalName();
+        do {
+            addName(localNames, name, scope.localCount++, "local");
+            function->locals.push_back(parseValueType());
+        } while (name == NO_SYMBOL && !atClose());
+        expectClose();
+    }
+
+    scope.labels.push_back(NO_SYMBOL);  // the function body is a block as well
+    parseInstructions(scope);
+    expectClose();
+    if (scope.labels.size() != 1) {
+        error(&start, "unclosed block in function");
+    }
+    scope.body->push_back(arena->make<Instruction>(InstructionType::INSTRUCTION_WITHOUT_PARAMETER, constants::BLOCK_END));
+    function->body = scope.body;
+}
+
+// (memory $m? (export "name")* (import "module" "field")? limits) or, instead of the limits,
+// (data "..."*) for a memory just large enough for the data
+void Parser::parseMemory() {
+    AST_Memory* memory = arena->make<AST_Memory>();
+    uint32_t index = module.memories.size();
+    addName(memoryNames, optionalName(), index, "memory");
+    parseExports(memory->name);
+    if (atField("import")) {
+        if (definedMemory) {
+            error(peek(1), "imports have to come before the memories of the module");
+        }
+        skip(2);
+        memory->isImported = true;
+        memory->importModule = parseString();
+        memory->importField = parseString();
+        expectClose();
+        parseLimits(memory->initial_value, memory->max_value, "memory");
+    } else if (atField("data")) {
+        definedMemory = true;
+        skip(2);
+        AST_Data* data = arena->make<AST_Data>();
+        data->type = constants::I32CONST;
+        data->value = 0;
+        data->memory = index;
+        while (!atClose()) {
+            data->data += parseString();
+        }
+        expectClose();
+        memory->initial_value = memory->max_value = (data->data.size() + 0xFFFF) / 0x10000;
+        module.datas.push_back(data);
+    } else {
+        definedMemory = true;
+        parseLimits(memory->initial_value, memory->max_value, "memory");
+    }
+    expectClose();
+    module.memories.push_back(memory);
+}
+
+// a value type, or (mut type) for a global that global.set can change
+void Parser::parseGlobalType(AST_Global* global) {
+    if (atField("mut")) {
+        skip(2);
+        global->isMutable = true;
+        global->type = parseValueType();
+        expectClose();
+    } else {
+        global->type = parseValueType();
+    }
+}
+
+// (global $g? (export "name")* (import "module" "field")? type) or, instead of the import, a constant
+// instruction of its type after it, which is the value the global starts with
+void Parser::parseGlobal() {
+    AST_Global* global = arena->make<AST_Global>();
+    addName(globalNames, optionalName(), module.globals.size(), "global");
+    parseExports(global->name);
+    if (atField("import")) {
+        if (definedGlobal) {
+            error(peek(1), "imports have to come before the globals of the module");
+        }
+        skip(2);
+        global->isImported = true;
+        global->importModule = parseString();
+        global->importField = parseString();
+        expectClose();
+        parseGlobalType(global);
+    } else {
+        definedGlobal = true;
+        parseGlobalType(global);
+        const Token* start = peek();
+        std::vector<Instruction*> value;
+        Scope scope{ nullptr, &value };
+        if (start == nullptr || start->type != TokenType::BRACKETS_OPEN) {
+            error(start, "expected the value of the global");
+        }
+        parseFoldedInstruction(scope);
+        static const uint8_t CONSTS[] = { constants::I32CONST, constants::I64CONST, constants::F32CONST, constants::F64CONST };
+        static const uint8_t TYPES[] = { constants::INT32, constants::INT64, constants::FLOAT32, constants::FLOAT64 };
+        Instruction* constant = value.size() == 1 ? value[0] : nullptr;
+        bool matches = false;
+        for (int i = 0; i < 4 && constant != nullptr; ++i) {
+            matches |= global->type == TYPES[i] && constant->prefix == 0 && constant->instruction_code == CONSTS[i];
         }
+        if (constant != nullptr && global->type == constants::V128) {
+            matches = constant->prefix == constants::SIMD_OP && constant->instruction_code == constants::V128CONST;
+        }
+        if (!matches) {
+            error(start, "the value of a global has to be a constant of its type");
+        }
+        global->value = constant;
+    }
+    expectClose();
+    module.globals.push_back(global);
+}
+
+// (table $t? limits funcref), or (table $t? funcref (elem f*)) for a table that holds just those
+// functions; tables are neither imported nor exported
+void Parser::parseTable() {
+    AST_Table* table = arena->make<AST_Table>();
+    uint32_t index = module.tables.size();
+    addName(tableNames, optionalName(), index, "table");
+    if (atField("export") || atField("import")) {
+        error(peek(1), "imported and exported tables are not supported");
+    }
+    if (atKeyword("funcref")) {
+        next();
+        expectOpen();
+        expectKeyword("elem");
+        AST_Element* element = arena->make<AST_Element>();
+        element->table = index;
+        while (!atClose()) {
+            addElementReference(element);
+        }
+        expectClose();
+        table->initial_value = table->max_value = element->functions.size();
+        module.elements.push_back(element);
+    } else {
+        parseLimits(table->initial_value, table->max_value, "table");
+        expectKeyword("funcref");
+    }
+    expectClose();
+    module.tables.push_back(table);
+}
 
-        if (token.string_value == "func") {
-            if (currentFunction != nullptr) {
-                if (!currentFunction->isImported) {
-                    output->push_back(new Instruction(InstructionType::INSTRUCTION_WITHOUT_PARAMETER, constants::BLOCK_END));
-                    currentFunction->body = output;
-                    functions.push_back(currentFunction);
-                    output = new std::vector<Instruction*>();
-                    currentFunction = new AST_Function;
-                } else {
-                    functions.push_back(currentFunction);
-                    output = new std::vector<Instruction*>();
-                    currentFunction = new AST_Function;
+// (elem $e? (table t)? offset func? f*), the offset as in a data segment; only active segments,
+// without table.init nothing could use the others
+void Parser::parseElement() {
+    Token start = previous;
+    AST_Element* element = arena->make<AST_Element>();
+    optionalName();
+    if (atField("table")) {
+        skip(2);
+        element->table = resolve(tableNames, next(), module.tables.size(), "table");
+        expectClose();
+    } else if (atIndex()) {
+        element->table = resolve(tableNames, next(), module.tables.size(), "table");
+    }
+    if (atField("offset")) {
+        skip(2);
+        if (peek() != nullptr && peek()->type == TokenType::BRACKETS_OPEN) {
+            expectOpen();
+            element->offset = parseOffset("element");
+            expectClose();
+        } else {
+            element->offset = parseOffset("element");
+        }
+        expectClose();
+    } else if (peek() != nullptr && peek()->type == TokenType::BRACKETS_OPEN) {
+        expectOpen();
+        element->offset = parseOffset("element");
+        expectClose();
+    } else {
+        error(peek(), "passive and declarative element segments are not supported");
+    }
+    if (atKeyword("func")) {
+        next();
+    }
+    while (!atClose()) {
+        addElementReference(element);
+    }
+    expectClose();
+    if (element->table >= module.tables.size()) {
+        error(&start, "element segment for a table that doesn't exist");
+    }
+    module.elements.push_back(element);
+}
+
+void Parser::addElementReference(AST_Element* element) {
+    const Token& token = next();
+    if (token.type != TokenType::NUMBER && token.type != TokenType::VARIABLE) {
+        error(&token, "expected the name or index of a function");
+    }
+    elementReferences.push_back({ element, element->functions.size(), token });
+    element->functions.push_back(0);
+}
+
+// (data $d? (memory m)? offset "..."*), the offset either (offset instruction) or the instruction
+// folded; without memory and offset the segment is passive
+void Parser::parseData() {
+    Token start = previous;
+    AST_Data* data = arena->make<AST_Data>();
+    data->type = constants::I32CONST;
+    addName(dataNames, optionalName(), module.datas.size(), "data segment");
+    bool memory = true;
+    if (atField("memory")) {
+        skip(2);
+        data->memory = resolve(memoryNames, next(), module.memories.size(), "memory");
+        expectClose();
+    } else if (atIndex()) {
+        data->memory = resolve(memoryNames, next(), module.memories.size(), "memory");
+    } else {
+        memory = false;
+    }
+    if (atField("offset")) {
+        skip(2);
+        if (peek() != nullptr && peek()->type == TokenType::BRACKETS_OPEN) {
+            expectOpen();
+            data->value = parseOffset("data");
+            expectClose();
+        } else {
+            data->value = parseOffset("data");
+        }
+        expectClose();
+    } else if (peek() != nullptr && peek()->type == TokenType::BRACKETS_OPEN) {
+        expectOpen();
+        data->value = parseOffset("data");
+        expectClose();
+    } else if (memory) {
+        error(peek(), "expected the offset of the data segment");
+    } else {
+        data->passive = true;
+    }
+    while (!atClose()) {
+        data->data += parseString();
+    }
+    expectClose();
+    if (!data->passive && data->memory >= module.memories.size()) {
+        error(&start, "data segment for a memory that doesn't exist");
+    }
+    module.datas.push_back(data);
+}
+
+uint32_t Parser::parseOffset(const char* segment) {
+    const Token& token = next();
+    const opcodes::OpcodeInfo* info = token.asOpcode();
+    if (info == nullptr || info->prefix != 0 || info->code != constants::I32CONST) {
+        error(&token, std::string("the offset of a ") + segment + " segment has to be an i32.const");
+    }
+    return parseInteger32(next());
+}
+
+// (export "name" (func f)), (export "name" (memory m)) and (export "name" (global g))
+void Parser::parseExport() {
+    std::string name = parseString();
+    expectOpen();
+    const Token& kind = next();
+    if (kind.string_value != "func" && kind.string_value != "memory" && kind.string_value != "global") {
+        error(&kind, "exports of '" + std::string(kind.string_value) + "' are not supported");
+    }
+    const Token& target = next();
+    expectClose();
+    expectClose();
+    exports.push_back({ name, kind, target });
+}
+
+// everything that refers to something which may come later in the module
+void Parser::finish() {
+    module.types = types.getTypes();
+    for (const Reference& reference : references) {
+        switch (reference.kind) {
+            case Reference::Kind::FUNCTION:
+                reference.instruction->parameter = resolve(functionNames, reference.target, module.functions.size(), "function");
+                break;
+            case Reference::Kind::DATA:
+                reference.instruction->parameter = resolve(dataNames, reference.target, module.datas.size(), "data segment");
+                break;
+            case Reference::Kind::GLOBAL: {
+                uint32_t index = resolve(globalNames, reference.target, module.globals.size(), "global");
+                if (reference.instruction->instruction_code == constants::GLOBALSET && !module.globals[index]->isMutable) {
+                    error(&reference.target, "global " + std::string(reference.target.string_value) + " is immutable");
                 }
-            } else {
-                currentFunction = new AST_Function;
-                output = new std::vector<Instruction*>;
+                reference.instruction->parameter = index;
+                break;
             }
-            continue;
         }
-        if (token.string_value == "export") {
-            i++;
-            if (currentFunction != nullptr) {
-                currentFunction->name = tokens[i].string_value;
+    }
+    for (const ElementReference& reference : elementReferences) {
+        reference.element->functions[reference.slot] = resolve(functionNames, reference.target, module.functions.size(), "function");
+    }
+    if (!indirectCalls.empty() && module.tables.empty()) {
+        error(&indirectCalls[0], "call_indirect without a table");
+    }
+    for (const Export& exported : exports) {
+        std::string* name;
+        if (exported.kind.string_value == "func") {
+            name = &module.functions[resolve(functionNames, exported.target, module.functions.size(), "function")]->name;
+        } else if (exported.kind.string_value == "global") {
+            name = &module.globals[resolve(globalNames, exported.target, module.globals.size(), "global")]->name;
+        } else {
+            name = &module.memories[resolve(memoryNames, exported.target, module.memories.size(), "memory")]->name;
+        }
+        if (!name->empty()) {
+            error(&exported.target, "only one export name per function, memory or global is supported");
+        }
+        *name = exported.name;
+    }
+}
+
+// instructions
+
+// up to the ')' of the enclosing expression, or the end or else of the enclosing block
+void Parser::parseInstructions(Scope& scope) {
+    while (const Token* token = peek()) {
+        if (token->type == TokenType::BRACKETS_OPEN) {
+            parseFoldedInstruction(scope);
+        } else if (token->type == TokenType::BRACKETS_CLOSED || isBlockEnd(token)) {
+            return;
+        } else {
+            parsePlainInstruction(scope);
+        }
+    }
+}
+
+void Parser::parsePlainInstruction(Scope& scope) {
+    Token token = current();
+    const opcodes::OpcodeInfo* info = parseOpcode();
+    Instruction* instruction = makeInstruction(info);
+    if (!isBlock(info)) {
+        parseImmediates(token, info, instruction, scope);
+        scope.body->push_back(instruction);
+        return;
+    }
+
+    Symbol label = optionalName();
+    parseBlockType(instruction);
+    scope.body->push_back(instruction);
+    scope.labels.push_back(label);
+    parseInstructions(scope);
+    if (info->code == constants::IF && atKeyword("else")) {
+        scope.body->push_back(makeInstruction(parseOpcode()));
+        checkLabel(label);
+        parseInstructions(scope);
+    }
+    if (!atKeyword("end")) {
+        error(peek(), "expected 'end' of the " + std::string(info->mnemonic) + " at line " +
+                      std::to_string(lexer->locate(token.string_value.data()).line));
+    }
+    scope.body->push_back(makeInstruction(parseOpcode()));
+    checkLabel(label);
+    scope.labels.pop_back();
+}
+
+// (instruction immediates folded-operands*), the operands come first in the body; the blocks are
+// (block label? type instructions*) and (if label? type folded-condition* (then ...) (else ...)?)
+void Parser::parseFoldedInstruction(Scope& scope) {
+    expectOpen();
+    Token token = current();
+    const opcodes::OpcodeInfo* info = parseOpcode();
+    Instruction* instruction = makeInstruction(info);
+    if (!isBlock(info)) {
+        parseImmediates(token, info, instruction, scope);
+        while (!atClose()) {
+            if (peek() == nullptr || peek()->type != TokenType::BRACKETS_OPEN) {
+                error(peek(), "expected a folded instruction or ')'");
             }
-            continue;
+            parseFoldedInstruction(scope);
         }
-        if (token.string_value == "param") {
-            i++;
-            while (tokens[i].string_value != ")") {
-                switch(InstructionNumber::getType(tokens[i].string_value)) {
-                    case InstructionNumber::Type::I32:
-                        currentFunction->parameters.push_back(VariableType::is_int32);
-                        break;
-                    case InstructionNumber::Type::I64:
-                        currentFunction->parameters.push_back(VariableType::is_int64);
-                        break;
-                    case InstructionNumber::Type::F32:
-                        currentFunction->parameters.push_back(VariableType::isfloat32_t);
-                        break;
-                    case InstructionNumber::Type::F64:
-                        currentFunction->parameters.push_back(VariableType::isfloat64_t);
-                        break;
-                    default:
-                        std::cout << "Unknown parameter type: " << tokens[i].string_value << std::endl;
-                        break;
-                }
-                i++;
+        expectClose();
+        scope.body->push_back(instruction);
+        return;
+    }
+
+    Symbol label = optionalName();
+    parseBlockType(instruction);
+    if (info->code == constants::IF) {
+        while (peek() != nullptr && peek()->type == TokenType::BRACKETS_OPEN && !atField("then")) {
+            parseFoldedInstruction(scope);
+        }
+        scope.body->push_back(instruction);
+        scope.labels.push_back(label);
+        if (!atField("then")) {
+            error(peek(), "expected (then ...) in if");
+        }
+        skip(2);
+        parseInstructions(scope);
+        expectClose();
+        if (atField("else")) {
+            skip(1);
+            scope.body->push_back(makeInstruction(parseOpcode()));
+            parseInstructions(scope);
+            expectClose();
+        }
+    } else {
+        scope.body->push_back(instruction);
+        scope.labels.push_back(label);
+        parseInstructions(scope);
+    }
+    expectClose();
+    scope.labels.pop_back();
+    scope.body->push_back(arena->make<Instruction>(InstructionType::INSTRUCTION_WITHOUT_PARAMETER, constants::BLOCK_END));
+}
+
+const opcodes::OpcodeInfo* Parser::parseOpcode() {
+    const Token& token = next();
+    const opcodes::OpcodeInfo* info = token.asOpcode();
+    if (token.type != TokenType::KEYWORD || info == nullptr) {
+        error(&token, "unknown instruction '" + std::string(token.string_value) + "'");
+    }
+    return info;
+}
+
+Instruction* Parser::makeInstruction(const opcodes::OpcodeInfo* info) {
+    InstructionType type;
+    if (InstructionNumber::isCalculation(info)) {
+        type = InstructionType::CALCULATION;
+    } else if (InstructionNumber::isConst(info)) {
+        type = InstructionType::CONST;
+    } else if (InstructionNumber::hasParameter(info)) {
+        type = InstructionType::INSTRUCTION_WITH_PARAMETER;
+    } else {
+        type = InstructionType::INSTRUCTION_WITHOUT_PARAMETER;
+    }
+    Instruction* instruction = arena->make<Instruction>(type, info->code);
+    instruction->prefix = info->prefix;
+    return instruction;
+}
+
+// A type use like that of a function. Without parameters and with one result at most the block type
+// is 0x40 or the value type, otherwise the index of the type, as the s33 the binary format has.
+void Parser::parseBlockType(Instruction* block) {
+    std::vector<VariableType> parameters, results;
+    int64_t index = parseTypeUse(parameters, results, nullptr);
+    if (index < 0 && parameters.empty() && results.size() <= 1) {
+        block->block_parameters.push_back(results.empty() ? 0x40 : valueType(results[0]));
+        return;
+    }
+    if (index < 0) {
+        index = types.intern(parameters, results);
+    }
+    uint8_t bytes[10];
+    block->block_parameters.assign(bytes, bytes + ByteStream::encodeInt64(index, bytes));
+}
+
+// the label after an end or else has to be that of its block
+void Parser::checkLabel(Symbol label) {
+    const Token* token = peek();
+    if (token != nullptr && token->type == TokenType::VARIABLE) {
+        if (symbols.find(token->string_value) != label || label == NO_SYMBOL) {
+            error(token, "label " + std::string(token->string_value) + " doesn't match the block's " +
+                         (label == NO_SYMBOL ? std::string("(none)") : std::string(symbols.name(label))));
+        }
+        next();
+    }
+}
+
+void Parser::parseImmediates(const Token& token, const opcodes::OpcodeInfo* info, Instruction* instruction, Scope& scope) {
+    switch (info->immediate) {
+        case opcodes::Immediate::NONE:
+            if (info->prefix == 0 && info->code == constants::SELECT && atField("result")) {
+                error(peek(1), "select with a type is not supported");
             }
-            continue;
+            break;
+        case opcodes::Immediate::BLOCKTYPE:
+            break;
+        case opcodes::Immediate::LABEL:
+            instruction->parameter = parseLabel(scope);
+            break;
+        case opcodes::Immediate::LABEL_TABLE:
+            // the labels, at least the default one, which is the last
+            do {
+                instruction->labels.push_back(parseLabel(scope));
+            } while (atIndex());
+            break;
+        case opcodes::Immediate::FUNCTION:
+            addReference(instruction, Reference::Kind::FUNCTION);
+            break;
+        case opcodes::Immediate::CALL_INDIRECT: {
+            indirectCalls.push_back(token);
+            if (atIndex()) {
+                parseTableIndex();
+            }
+            std::vector<VariableType> parameters, results;
+            int64_t index = parseTypeUse(parameters, results, nullptr);
+            if (index < 0) {
+                // the first type of the module with this signature, a new one if there is none
+                index = types.intern(parameters, results);
+            }
+            instruction->parameter = index;
+            break;
         }
-        if (token.string_value == "result") {
-            i++;
-            while (tokens[i].string_value != ")") {
-                switch(InstructionNumber::getType(tokens[i].string_value)) {
-                    case InstructionNumber::Type::I32:
-                        currentFunction->results.push_back(VariableType::is_int32);
-                        break;
-                    case InstructionNumber::Type::I64:
-                        currentFunction->results.push_back(VariableType::is_int64);
-                        break;
-                    case InstructionNumber::Type::F32:
-                        currentFunction->results.push_back(VariableType::isfloat32_t);
-                        break;
-                    case InstructionNumber::Type::F64:
-                        currentFunction->results.push_back(VariableType::isfloat64_t);
-                        break;
-                    default:
-                        std::cout << "Unknown result type: " << tokens[i].string_value << std::endl;
+        case opcodes::Immediate::LOCAL:
+            instruction->parameter = parseLocal(scope);
+            break;
+        case opcodes::Immediate::GLOBAL:
+            addReference(instruction, Reference::Kind::GLOBAL);
+            break;
+        case opcodes::Immediate::MEMARG8:
+        case opcodes::Immediate::MEMARG16:
+        case opcodes::Immediate::MEMARG32:
+        case opcodes::Immediate::MEMARG64:
+        case opcodes::Immediate::MEMARG128:
+            if (atIndex()) {
+                parseMemoryIndex();
+            }
+            // offset=N and align=N, the alignment is always written as the natural one
+            while (atKeyword("offset") || atKeyword("align")) {
+                bool offset = atKeyword("offset");
+                next();
+                expectKeyword("=");
+                uint32_t value = parseUInt32();
+                if (offset) {
+                    instruction->parameter = value;
+                } else if (value == 0 || (value & (value - 1)) != 0) {
+                    error(&previous, "the alignment has to be a power of two");
                 }
-                i++;
             }
-            continue;
+            break;
+        case opcodes::Immediate::MEMORY:
+            if (atIndex()) {
+                parseMemoryIndex();
+            }
+            break;
+        case opcodes::Immediate::MEMORY_MEMORY:
+            if (atIndex()) {
+                parseMemoryIndex();
+                parseMemoryIndex();
+            }
+            break;
+        case opcodes::Immediate::DATA_MEMORY:
+            if (peek(1) != nullptr && (peek(1)->type == TokenType::NUMBER || peek(1)->type == TokenType::VARIABLE)) {
+                parseMemoryIndex();
+            }
+            addReference(instruction, Reference::Kind::DATA);
+            break;
+        case opcodes::Immediate::DATA:
+            addReference(instruction, Reference::Kind::DATA);
+            break;
+        case opcodes::Immediate::I32:
+            instruction->parameter = parseInteger32(next());
+            break;
+        case opcodes::Immediate::I64: {
+            const Token& value = next();
+            if (value.type != TokenType::NUMBER || value.number_type != NumberType::INTEGER) {
+                error(&value, "expected an integer");
+            }
+            instruction->long_parameter = (int64_t)value.integer_value;
+            break;
         }
+        case opcodes::Immediate::F32:
+        case opcodes::Immediate::F64: {
+            const Token& value = next();
+            if (value.type != TokenType::NUMBER) {
+                error(&value, "expected a number");
+            }
+            if (info->immediate == opcodes::Immediate::F32) {
+                instruction->float_parameter = value.asDouble();
+            } else {
+                instruction->double_parameter = value.asDouble();
+            }
+            break;
+        }
+        case opcodes::Immediate::V128:
+            parseV128(instruction);
+            break;
+        case opcodes::Immediate::SHUFFLE:
+            for (int i = 0; i < 16; ++i) {
+                instruction->v128_parameter.bytes[i] = parseLaneIndex(32);
+            }
+            break;
+        case opcodes::Immediate::LANE:
+            instruction->parameter = parseLaneIndex(opcodes::laneCount(info->mnemonic));
+            break;
+    }
+}
 
-		switch ( token.type ) {
-            case TokenType::KEYWORD: {
-                uint8_t op = InstructionNumber::getOperation(token.string_value);
-
-                if (op != 0) {
-                    HACK_inCodeBlock = true;
-
-                    if (InstructionNumber::isCalculation(op)) {
-                        Instruction *instruction = instruction = new Instruction(InstructionType::CALCULATION);
-                        instruction->instruction_code = (int) op;
-                        output->push_back(instruction);
-                    } else if (InstructionNumber::isConst(op)) {
-                        Instruction *instruction = instruction = new Instruction(InstructionType::CONST);
-                        instruction->instruction_code = (int) op;
-                        Token parameter = tokens[++i]; // parameter MUST be next behind this
-                        if (op == constants::I32CONST) {
-                            instruction->parameter = parameter.uint32_value;
-                        } else if (op == constants::F32CONST) {
-                            instruction->float_parameter = parameter.double_value;
-                        }
-
-                        output->push_back(instruction);
-                    } else if (InstructionNumber::hasParameter(op)) {
-                        Instruction *instruction = instruction = new Instruction(
-                                InstructionType::INSTRUCTION_WITH_PARAMETER);
-                        instruction->instruction_code = (int) op;
-                        if (op == constants::I32STORE || op == constants::I32LOAD) {
-                            if (tokens[i + 1].string_value == "offset") {
-                                i += 3;
-                                instruction->parameter = tokens[i].uint32_value;
-                            } else {
-                                instruction->parameter = 0;
-                            }
-                        } else if(op == constants::MEMORYSIZE || op == constants::MEMORYGROW) {
-                            instruction->parameter = 0; // only one block of memory in the current WA spec
-                        } else if(op == constants::IF || op == constants::LOOP || op == constants::BLOCK) {
-                            if (tokens[i + 1].string_value == "(" && tokens[i + 2].string_value == "result") {
-                                i += 3;
-                                while (tokens[i].string_value != ")") {
-                                    switch(InstructionNumber::getType(tokens[i].string_value)) {
-                                        case InstructionNumber::Type::I32:
-                                            instruction->block_parameters.push_back(constants::INT32);
-                                            break;
-                                        case InstructionNumber::Type::I64:
-                                            instruction->block_parameters.push_back(constants::INT64);
-                                            break;
-                                        case InstructionNumber::Type::F32:
-                                            instruction->block_parameters.push_back(constants::FLOAT32);
-                                            break;
-                                        case InstructionNumber::Type::F64:
-                                            instruction->block_parameters.push_back(constants::FLOAT64);
-                                            break;
-                                        default:
-                                            std::cout << "Unknown result type: " << tokens[i].string_value << std::endl;
-                                    }
-                                    i++;
-                                }
-                            } else {
-                                instruction->block_parameters.push_back(0x40); // void
-                            }
-                        } else {
-                            Token parameter = tokens[++i]; // parameter MUST be next behind this
-                            if (parameter.type == TokenType::VARIABLE) {
-                                instruction->parameter = currentFunction->locals[parameter.string_value].first;
-                            } else {
-                                instruction->parameter = parameter.uint32_value;
-                            }
-                        }
-
-                        output->push_back(instruction);
-                    } else if (InstructionNumber::hasNoParameter(op)) {
-                        Instruction *instruction = instruction = new Instruction(
-                                InstructionType::INSTRUCTION_WITHOUT_PARAMETER);
-                        instruction->instruction_code = (int) op;
-                        output->push_back(instruction);
-                    } else {
-                        std::cout << "Parser::ParseProper : unsupported operation found : " << op << std::endl;
-                    }
-
-                }
-                // KEYWORD is either an instruction or a type (e.g., i32.add or just i32)
-                else {
-                    if (HACK_inCodeBlock) {
-                        InstructionNumber::Type type = InstructionNumber::getType(token.string_value);
-
-                        if (type != InstructionNumber::Type::NONE) {
-                            // Types are always without parameter
-                            Instruction *instruction = instruction = new Instruction(
-                                    InstructionType::INSTRUCTION_WITHOUT_PARAMETER);
-                            instruction->instruction_code = (int) type;
-                            output->push_back(instruction);
-                        }
-                    }
-                }
-                break;
+// the shape, then a number per lane: v128.const i32x4 1 2 3 4
+void Parser::parseV128(Instruction* instruction) {
+    const Token& token = next();
+    const Shape* shape = nullptr;
+    for (const Shape& known : SHAPES) {
+        if (token.type == TokenType::KEYWORD && token.string_value == known.name) {
+            shape = &known;
+        }
+    }
+    if (shape == nullptr) {
+        error(&token, "expected the shape of the v128 (i8x16, i16x8, i32x4, i64x2, f32x4 or f64x2)");
+    }
+    uint32_t bits = shape->bits;
+    bool isFloat = shape->isFloat;
+    for (uint32_t i = 0; i < 128 / bits; ++i) {
+        const Token& value = next();
+        uint8_t* lane = instruction->v128_parameter.bytes + i * bits / 8;
+        if (isFloat) {
+            if (value.type != TokenType::NUMBER) {
+                error(&value, "expected a number");
             }
-            case TokenType::VARIABLE: {
-                if (!currentFunction->locals.contains(tokens[i + 1].string_value)) {
-                    uint8_t type = 0;
-                    if (tokens[i + 2].string_value == "i32") type = constants::INT32;
-                    else if (tokens[i + 2].string_value == "i64") type = constants::INT64;
-                    else if (tokens[i + 2].string_value == "f32") type = constants::FLOAT32;
-                    else if (tokens[i + 2].string_value == "f64") type = constants::FLOAT64;
-                    currentFunction->locals.insert(
-                                            std::make_pair(tokens[i + 1].string_value,
-                                            std::make_pair(currentFunction->parameters.size() + currentFunction->locals.size(), type)));
-                }
-                i += 2;
-                break;
+            if (bits == 32) {
+                float number = value.asDouble();
+                std::memcpy(lane, &number, 4);
+            } else {
+                double number = value.asDouble();
+                std::memcpy(lane, &number, 8);
             }
-            case TokenType::BRACKETS_OPEN:
-                {
-                    auto next = tokens[i + 1].string_value;
-                    if (next == "loop" || next == "block") {
-                        openBlocks++;
-                    }
-                    break;
-                }
-            case TokenType::BRACKETS_CLOSED:
-                if (openBlocks > 0) {
-                    openBlocks--;
-                    output->push_back(new Instruction(InstructionType::INSTRUCTION_WITHOUT_PARAMETER, constants::BLOCK_END));
-                }
-                break;
-            default: {
-                if (!HACK_inCodeBlock) {
-                    continue;
-                } else {
-                    std::cout << "Parser::ParseProper : unsupported TokenType found : " << (int) token.type << " for " << token.uint32_value << " OR " << token.string_value << std::endl;
-                }
+            continue;
+        }
+        if (value.type != TokenType::NUMBER || value.number_type != NumberType::INTEGER) {
+            error(&value, "expected an integer");
+        }
+        // the lanes take signed and unsigned numbers alike, -128 to 255 for i8x16
+        bool negative = value.string_value[0] == '-';
+        if (bits < 64 && ((negative && (int64_t)value.integer_value < -(int64_t(1) << (bits - 1))) ||
+                          (!negative && value.integer_value >= (uint64_t(1) << bits)))) {
+            error(&value, "the number doesn't fit into a lane of " + std::to_string(bits) + " bits");
+        }
+        std::memcpy(lane, &value.integer_value, bits / 8);
+    }
+}
+
+// a lane index below count
+uint8_t Parser::parseLaneIndex(uint32_t count) {
+    const Token& token = next();
+    if (token.type != TokenType::NUMBER || token.number_type != NumberType::INTEGER || token.string_value[0] == '-' ||
+        token.integer_value >= count) {
+        error(&token, "expected a lane index below " + std::to_string(count));
+    }
+    return (uint8_t)token.integer_value;
+}
+
+// the depth of the label, counted from the innermost block
+uint32_t Parser::parseLabel(Scope& scope) {
+    const Token& token = next();
+    if (token.type == TokenType::VARIABLE) {
+        Symbol label = symbols.find(token.string_value);
+        for (size_t depth = 0; label != NO_SYMBOL && depth < scope.labels.size(); ++depth) {
+            if (scope.labels[scope.labels.size() - 1 - depth] == label) {
+                return depth;
             }
-		}
-	}
-    if (currentFunction != nullptr) {
-        if (!currentFunction->isImported) {
-            output->push_back(new Instruction(InstructionType::INSTRUCTION_WITHOUT_PARAMETER, constants::BLOCK_END));
-            currentFunction->body = output;
-            functions.push_back(currentFunction);
-        } else {
-            functions.push_back(currentFunction);
         }
+        error(&token, "unknown label " + std::string(token.string_value));
+    }
+    if (token.type != TokenType::NUMBER || token.number_type != NumberType::INTEGER || token.string_value[0] == '-' ||
+        token.integer_value >= scope.labels.size()) {
+        error(&token, "invalid label '" + std::string(token.string_value) + "'");
+    }
+    return (uint32_t)token.integer_value;
+}
+
+uint32_t Parser::parseLocal(Scope& scope) {
+    const Token& token = next();
+    return resolve(localNames, token, scope.localCount, "local");
+}
+
+// there is one memory an instruction can use, index 0
+void Parser::parseMemoryIndex() {
+    const Token& token = next();
+    if (resolve(memoryNames, token, module.memories.size(), "memory") != 0) {
+        error(&token, "instructions can only use memory 0");
+    }
+}
+
+void Parser::parseTableIndex() {
+    const Token& token = next();
+    if (resolve(tableNames, token, module.tables.size(), "table") != 0) {
+        error(&token, "instructions can only use table 0");
+    }
+}
+
+void Parser::addReference(Instruction* instruction, Reference::Kind kind) {
+    static const char* WHAT[] = { "function", "data segment", "global" };
+    const Token& token = next();
+    if (token.type != TokenType::NUMBER && token.type != TokenType::VARIABLE) {
+        error(&token, std::string("expected the name or index of a ") + WHAT[(int)kind]);
+    }
+    references.push_back({ instruction, token, kind });
+}
+
+// i32 constants are written signed or unsigned, -2147483648 to 4294967295
+uint32_t Parser::parseInteger32(const Token& token) const {
+    if (token.type != TokenType::NUMBER || token.number_type != NumberType::INTEGER) {
+        error(&token, "expected an integer");
+    }
+    bool negative = token.string_value[0] == '-';
+    if ((negative && (int64_t)token.integer_value < INT32_MIN) || (!negative && token.integer_value > UINT32_MAX)) {
+        error(&token, "the constant " + std::string(token.string_value) + " is out of range for i32");
     }
-/*
-	for ( auto instruction : output ) {
-		std::cout << "Instruction " << (int) instruction->type << " for operation " << instruction->instruction_code << " with potential parameter " << instruction->parameter << std::endl;
-	}
-*/
+    return (uint32_t)token.integer_value;
 }
@@ -3,28 +3,164 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "lexer.h"
 #include "AST_Types.h"
+#include "arena.h"
+#include "symbols.h"
 
+// what parseProper() throws for text that isn't a module it can read, the message starts with
+// "line:column: "
+class ParseError : public std::runtime_error {
+public:
+    ParseError(SourceLocation location, const std::string& message)
+        : std::runtime_error(std::to_string(location.line) + ":" + std::to_string(location.column) + ": " + message),
+          location(location) {}
+
+    SourceLocation location;
+};
+
+// Recursive descent over the S-expressions of the text format, one pass over the tokens, which it
+// pulls from the Lexer as it goes: besides the module it builds, it holds a few tokens. Folded
+// instructions are emitted in the order the binary format has them (operands first), names of
+// locals, labels, functions, memories, globals, tables and data segments are interned and resolved
+// to indices on the way; calls, elements and references to data segments or globals further down
+// the module are patched once it was read.
 class Parser {
 private:
+    // the function whose body is parsed
+    struct Scope {
+        AST_Function* function;
+        std::vector<Instruction*>* body;
+        uint32_t localCount = 0;          // parameters included
+        std::vector<Symbol> labels = {};  // innermost last, NO_SYMBOL without a name
+    };
+
+    // an index that can only be checked, or a name that can only be resolved, at the end of the module
+    struct Reference {
+        enum class Kind { FUNCTION, DATA, GLOBAL };
+
+        Instruction* instruction;
+        Token target;
+        Kind kind;
+    };
+
+    // a function in an element segment, which may be defined further down
+    struct ElementReference {
+        AST_Element* element;
+        size_t slot;
+        Token target;
+    };
+
+    struct Export {
+        std::string name;
+        Token kind;     // func, memory or global
+        Token target;
+    };
+
+    // enough to tell a field or an instruction by its first tokens
+    static constexpr size_t LOOKAHEAD = 4;
+
     Lexer *lexer;
-    std::vector<AST_Function*> functions;
-    std::vector<AST_Memory*> memories;
-    std::vector<AST_Data*> datas;
-    AST_Function* currentFunction = nullptr;
-    int openBlocks = 0;
+    Arena *arena;
+    std::array<Token, LOOKAHEAD> lookahead;     // a ring of the tokens peeked at
+    size_t first = 0;
+    size_t peeked = 0;
+    Token previous;                             // the last one next() returned, for errors
+    bool hashing = false;                       // next() adds the tokens to fieldHash
+    uint64_t fieldHash = 0;
+    AST_Module module;
+    Interner symbols;
+    SymbolTable typeNames;
+    SymbolTable functionNames;
+    SymbolTable memoryNames;
+    SymbolTable globalNames;
+    SymbolTable tableNames;
+    SymbolTable dataNames;
+    SymbolTable localNames;         // of the function being parsed, its parameters included
+    TypeTable types;
+    std::vector<Reference> references;
+    std::vector<ElementReference> elementReferences;
+    std::vector<Token> indirectCalls;   // they need a table, which may be defined further down
+    std::vector<Export> exports;
+    bool definedFunction = false;   // imports of functions have to come before their definitions
+    bool definedMemory = false;
+    bool definedGlobal = false;
+
+    const Token* peek(size_t ahead = 0);
+    Token next();
+    const Token& current();
+    void skip(size_t count);
+    bool atKeyword(std::string_view keyword);
+    // "(" followed by the keyword
+    bool atField(std::string_view keyword);
+    bool atClose();
+    bool atIndex();
+    void expectOpen();
+    void expectClose();
+    void expectKeyword(std::string_view keyword);
+    [[noreturn]] void error(const Token* token, const std::string& message) const;
+
+    Symbol optionalName();
+    void addName(SymbolTable& names, Symbol name, uint32_t index, const char* what);
+    uint32_t resolve(const SymbolTable& names, const Token& token, size_t count, const char* what) const;
+    std::string parseString();
+    uint32_t parseUInt32();
+    uint8_t parseValueType();
+    void parseSignature(std::vector<VariableType>& parameters, std::vector<VariableType>& results, Scope* scope);
+    int64_t parseTypeUse(std::vector<VariableType>& parameters, std::vector<VariableType>& results, Scope* scope);
+    void parseLimits(int& initial, int& maximum, const char* what);
+    void parseExports(std::string& name);
+    void parseGlobalType(AST_Global* global);
+
+    void parseField();
+    void parseFieldContents();
+    void parseType();
+    void parseImport();
+    void parseFunction();
+    void parseMemory();
+    void parseGlobal();
+    void parseTable();
+    void parseElement();
+    void parseData();
+    void parseExport();
+    uint32_t parseOffset(const char* segment);
+    void addElementReference(AST_Element* element);
+    void finish();
+
+    void parseInstructions(Scope& scope);
+    void parsePlainInstruction(Scope& scope);
+    void parseFoldedInstruction(Scope& scope);
+    const opcodes::OpcodeInfo* parseOpcode();
+    Instruction* makeInstruction(const opcodes::OpcodeInfo* info);
+    void parseBlockType(Instruction* block);
+    void checkLabel(Symbol label);
+    void parseImmediates(const Token& token, const opcodes::OpcodeInfo* info, Instruction* instruction, Scope& scope);
+    uint32_t parseLabel(Scope& scope);
+    uint32_t parseLocal(Scope& scope);
+    void parseMemoryIndex();
+    void parseTableIndex();
+    void addReference(Instruction* instruction, Reference::Kind kind);
+    uint32_t parseInteger32(const Token& token) const;
+    void parseV128(Instruction* instruction);
+    uint8_t parseLaneIndex(uint32_t count);
 
 public:
-	Parser(Lexer *lexer) : lexer(lexer) {}
+	Parser(Lexer *lexer, Arena *arena) : lexer(lexer), arena(arena) {}
     ~Parser() {}
-    
+
+    // throws a ParseError, with the line and column of the token it stopped at
     void parseProper();
-    std::vector<AST_Function*> getFunctions() { return functions; }
-    std::vector<AST_Memory*> getMemories() { return memories; }
-    std::vector<AST_Data*> getDatas() { return datas; }
+    const AST_Module& getModule() const { return module; }
+    std::vector<AST_Function*> getFunctions() { return module.functions; }
+    std::vector<AST_Memory*> getMemories() { return module.memories; }
+    std::vector<AST_Data*> getDatas() { return module.datas; }
 
 };
 
-#endif // __PARSER_H__
\ No newline at end of file
+#endif // __PARSER_H__
@@ -0,0 +1,192 @@
+#ifndef __SCANNER_H__
+#define __SCANNER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "token.h"
+
+// SCANNER_SCALAR forces the byte by byte versions, e.g. to compare against them
+#if !defined(SCANNER_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>
+#define SCANNER_AVX2
+#elif !defined(SCANNER_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>
+#define SCANNER_SSE2
+#endif
+
+// Bulk versions of the Character tests for the Lexer. The source is classified 64 bytes at a time
+// into one bit mask per character class, after which skipping whitespace, a keyword or a name is
+// a shift and a count of trailing zeros: every byte is looked at once, not once per test.
+// With SSE2 (every x86-64) a block is classified 16 bytes at a time, with AVX2 (-mavx2) 32 bytes,
+// without either (or with SCANNER_SCALAR) the Character tests are used byte by byte.
+// The block at the end of the source is copied into a zero padded buffer first, zero bytes are in
+// none of the classes, so nothing is ever read past the end.
+class Scanner {
+
+#if defined(SCANNER_AVX2)
+    typedef __m256i Vector;
+    static constexpr int VECTOR_SIZE = 32;
+    static Vector load(const char* position) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(position)); }
+    static Vector splat(char byte) { return _mm256_set1_epi8(byte); }
+    static Vector equals(Vector a, char byte) { return _mm256_cmpeq_epi8(a, splat(byte)); }
+    static Vector either(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+    static Vector bits(Vector a, char byte) { return _mm256_and_si256(a, splat(byte)); }
+    static Vector but(Vector a, Vector b) { return _mm256_andnot_si256(b, a); }
+    // unsigned lo <= byte <= hi
+    static Vector inRange(Vector a, char lo, char hi) {
+        Vector offset = _mm256_sub_epi8(a, splat(lo));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, splat(hi - lo)), offset);
+    }
+    static uint64_t mask(Vector a) { return (uint32_t)_mm256_movemask_epi8(a); }
+#elif defined(SCANNER_SSE2)
+    typedef __m128i Vector;
+    static constexpr int VECTOR_SIZE = 16;
+    static Vector load(const char* position) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(position)); }
+    static Vector splat(char byte) { return _mm_set1_epi8(byte); }
+    static Vector equals(Vector a, char byte) { return _mm_cmpeq_epi8(a, splat(byte)); }
+    static Vector either(Vector a, Vector b) { return _mm_or_si128(a, b); }
+    static Vector bits(Vector a, char byte) { return _mm_and_si128(a, splat(byte)); }
+    static Vector but(Vector a, Vector b) { return _mm_andnot_si128(b, a); }
+    static Vector inRange(Vector a, char lo, char hi) {
+        Vector offset = _mm_sub_epi8(a, splat(lo));
+        return _mm_cmpeq_epi8(_mm_min_epu8(offset, splat(hi - lo)), offset);
+    }
+    static uint64_t mask(Vector a) { return (uint32_t)_mm_movemask_epi8(a); }
+#endif
+
+#if defined(SCANNER_AVX2) || defined(SCANNER_SSE2)
+    static Vector whitespace(Vector a) {
+        return either(either(equals(a, ' '), equals(a, '\n')), either(equals(a, '\t'), equals(a, '\r')));
+    }
+
+    // [a-zA-Z0-9._]: setting bit 5 turns upper case into lower case and nothing else into a letter
+    static Vector identifier(Vector a) {
+        Vector letter = inRange(either(a, splat(0x20)), 'a', 'z');
+        Vector digit = inRange(a, '0', '9');
+        return either(either(letter, digit), either(equals(a, '.'), equals(a, '_')));
+    }
+
+    // printable ASCII except " , ; ( ) [ ] { }; clearing bit 5 maps { } onto [ ]
+    static Vector idChar(Vector a) {
+        Vector folded = bits(a, (char)0xDF);
+        Vector excluded = either(either(equals(a, '"'), equals(a, ',')), either(equals(a, ';'), inRange(a, '(', ')')));
+        excluded = either(excluded, either(equals(folded, '['), equals(folded, ']')));
+        return but(inRange(a, '!', '~'), excluded);
+    }
+#endif
+
+public:
+    static constexpr int BLOCK_SIZE = 64;
+
+    Scanner() = default;
+    Scanner(const char* begin, const char* end) : begin(begin), end(end) {}
+
+    const char* skipWhitespace(const char* position) { return skip<&Masks::whitespace>(position); }
+    const char* skipIdentifier(const char* position) { return skip<&Masks::identifier>(position); }
+    const char* skipIdChars(const char* position) { return skip<&Masks::idChar>(position); }
+
+    // first a or b, e.g. the end of a string or an escape in it; these runs are long and rare
+    // enough that they don't go through the classified blocks
+    static const char* findEither(const char* position, const char* end, char a, char b) {
+#if defined(SCANNER_AVX2) || defined(SCANNER_SSE2)
+        while (end - position >= VECTOR_SIZE) {
+            Vector data = load(position);
+            uint64_t found = mask(either(equals(data, a), equals(data, b)));
+            if (found != 0) {
+                return position + __builtin_ctzll(found);
+            }
+            position += VECTOR_SIZE;
+        }
+#endif
+        while (position < end && *position != a && *position != b) {
+            ++position;
+        }
+        return position;
+    }
+
+    // single bytes are what memchr is best at, the C library has vector versions for every CPU
+    static const char* findByte(const char* position, const char* end, char byte) {
+        const void* found = std::memchr(position, byte, end - position);
+        return found == nullptr ? end : static_cast<const char*>(found);
+    }
+
+    static const char* name() {
+#if defined(SCANNER_AVX2)
+        return "avx2";
+#elif defined(SCANNER_SSE2)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+private:
+    struct Masks {
+        uint64_t whitespace = 0;
+        uint64_t identifier = 0;
+        uint64_t idChar = 0;
+    };
+
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    const char* block = nullptr;    // start of the classified block, a multiple of BLOCK_SIZE after begin
+    Masks masks;
+
+    // first byte at or after position that is not in the class (or end)
+    template <uint64_t Masks::*CLASS>
+    const char* skip(const char* position) {
+#if defined(SCANNER_AVX2) || defined(SCANNER_SSE2)
+        while (position < end) {
+            if (position < block || position >= block + BLOCK_SIZE) {
+                classify(begin + ((position - begin) & ~(ptrdiff_t)(BLOCK_SIZE - 1)));
+            }
+            uint64_t stop = ~(masks.*CLASS) >> (position - block);
+            if (stop != 0) {
+                return position + __builtin_ctzll(stop);
+            }
+            position = block + BLOCK_SIZE;
+        }
+        return end;
+#else
+        // without vectors classifying whole blocks costs more than testing byte by byte
+        while (position < end && inClass<CLASS>(*position)) {
+            ++position;
+        }
+        return position;
+#endif
+    }
+
+    template <uint64_t Masks::*CLASS>
+    static bool inClass(unsigned char byte) {
+        if constexpr (CLASS == &Masks::whitespace) {
+            return Character::isWhitespace(byte);
+        } else if constexpr (CLASS == &Masks::identifier) {
+            return Character::isWASMIdentifier(byte);
+        } else {
+            return Character::isIdChar(byte);
+        }
+    }
+
+#if defined(SCANNER_AVX2) || defined(SCANNER_SSE2)
+    void classify(const char* start) {
+        block = start;
+        const char* data = start;
+        char padded[BLOCK_SIZE] = {};
+        if (end - start < BLOCK_SIZE) {
+            std::memcpy(padded, start, end - start);
+            data = padded;
+        }
+
+        masks = Masks();
+        for (int i = 0; i < BLOCK_SIZE; i += VECTOR_SIZE) {
+            Vector vector = load(data + i);
+            masks.whitespace |= mask(whitespace(vector)) << i;
+            masks.identifier |= mask(identifier(vector)) << i;
+            masks.idChar |= mask(idChar(vector)) << i;
+        }
+    }
+#endif
+};
+
+#endif // __SCANNER_H__
@@ -0,0 +1,742 @@
+#ifndef __SIMD_H__
+#define __SIMD_H__
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include "Variable.h"
+#include "numeric.h"
+
+// The SSE versions of the kernels below are compiled in on x86-64 unless SIMD_SCALAR is defined,
+// SSSE3 and SSE4.1 ones when the compiler targets them (-mssse3, -msse4.1, -march=native).
+#if defined(__SSE2__) && !defined(SIMD_SCALAR)
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#if defined(__SSSE3__)
+#define SIMD_SSSE3 1
+#include <tmmintrin.h>
+#endif
+#if defined(__SSE4_1__)
+#define SIMD_SSE41 1
+#include <smmintrin.h>
+#endif
+#endif
+
+// The instructions of the fixed-width SIMD proposal
+// (https://github.com/WebAssembly/simd/blob/main/proposals/simd/SIMD.md) as functions of v128_t.
+// The template argument is the lane type, a signed integer or a float: i16x8.add is add<int16_t>,
+// the _u variants reinterpret the lanes like numeric.h does. simd::scalar has every kernel as a
+// loop over the lanes, the others use SSE where it has an instruction with the same semantics and
+// fall back to the loop otherwise. Comparisons give lanes of all ones or zeros.
+namespace simd {
+
+template <typename L> constexpr int lanes = 16 / sizeof(L);
+
+// the integer type of a lane's size, for masks and bit patterns
+template <typename L> using Integer =
+    std::conditional_t<sizeof(L) == 1, int8_t, std::conditional_t<sizeof(L) == 2, int16_t,
+    std::conditional_t<sizeof(L) == 4, int32_t, int64_t>>>;
+
+template <typename L> inline L lane(const v128_t& v, int i) {
+    L value;
+    std::memcpy(&value, v.bytes + i * sizeof(L), sizeof(L));
+    return value;
+}
+template <typename L> inline void setLane(v128_t& v, int i, L value) {
+    std::memcpy(v.bytes + i * sizeof(L), &value, sizeof(L));
+}
+
+namespace scalar {
+
+template <typename L, typename Op> inline v128_t map(v128_t a, Op op) {
+    v128_t result;
+    for (int i = 0; i < lanes<L>; ++i) {
+        setLane<L>(result, i, op(lane<L>(a, i)));
+    }
+    return result;
+}
+template <typename L, typename Op> inline v128_t zip(v128_t a, v128_t b, Op op) {
+    v128_t result;
+    for (int i = 0; i < lanes<L>; ++i) {
+        setLane<L>(result, i, op(lane<L>(a, i), lane<L>(b, i)));
+    }
+    return result;
+}
+// op is a numeric.h comparison, 0 or 1
+template <typename L, typename Op> inline v128_t compare(v128_t a, v128_t b, Op op) {
+    v128_t result;
+    for (int i = 0; i < lanes<L>; ++i) {
+        setLane<Integer<L>>(result, i, op(lane<L>(a, i), lane<L>(b, i)) ? -1 : 0);
+    }
+    return result;
+}
+
+template <typename L> inline v128_t add(v128_t a, v128_t b) { return zip<L>(a, b, numeric::add<L>); }
+template <typename L> inline v128_t sub(v128_t a, v128_t b) { return zip<L>(a, b, numeric::sub<L>); }
+template <typename L> inline v128_t mul(v128_t a, v128_t b) { return zip<L>(a, b, numeric::mul<L>); }
+template <typename L> inline v128_t neg(v128_t a) { return map<L>(a, [](L x) { return numeric::sub<L>(0, x); }); }
+// the minimum stays the minimum
+template <typename L> inline v128_t abs(v128_t a) { return map<L>(a, [](L x) { return x < 0 ? numeric::sub<L>(0, x) : x; }); }
+
+template <typename L> inline L saturate(int64_t x) {
+    return x < std::numeric_limits<L>::min() ? std::numeric_limits<L>::min() :
+           x > std::numeric_limits<L>::max() ? std::numeric_limits<L>::max() : (L)x;
+}
+template <typename L> inline v128_t addSatS(v128_t a, v128_t b) { return zip<L>(a, b, [](L x, L y) { return saturate<L>((int64_t)x + y); }); }
+template <typename L> inline v128_t subSatS(v128_t a, v128_t b) { return zip<L>(a, b, [](L x, L y) { return saturate<L>((int64_t)x - y); }); }
+template <typename L> inline v128_t addSatU(v128_t a, v128_t b) {
+    using U = numeric::Unsigned<L>;
+    return zip<U>(a, b, [](U x, U y) { return (U)std::min<int64_t>((int64_t)x + y, std::numeric_limits<U>::max()); });
+}
+template <typename L> inline v128_t subSatU(v128_t a, v128_t b) {
+    using U = numeric::Unsigned<L>;
+    return zip<U>(a, b, [](U x, U y) { return (U)(x > y ? x - y : 0); });
+}
+template <typename L> inline v128_t minS(v128_t a, v128_t b) { return zip<L>(a, b, [](L x, L y) { return x < y ? x : y; }); }
+template <typename L> inline v128_t maxS(v128_t a, v128_t b) { return zip<L>(a, b, [](L x, L y) { return x > y ? x : y; }); }
+template <typename L> inline v128_t minU(v128_t a, v128_t b) { return minS<numeric::Unsigned<L>>(a, b); }
+template <typename L> inline v128_t maxU(v128_t a, v128_t b) { return maxS<numeric::Unsigned<L>>(a, b); }
+// rounds up: (a + b + 1) / 2 without overflow
+template <typename L> inline v128_t avgrU(v128_t a, v128_t b) {
+    using U = numeric::Unsigned<L>;
+    return zip<U>(a, b, [](U x, U y) { return (U)(((uint32_t)x + y + 1) >> 1); });
+}
+
+template <typename L> inline v128_t eq(v128_t a, v128_t b) { return compare<L>(a, b, numeric::eq<L>); }
+template <typename L> inline v128_t ne(v128_t a, v128_t b) { return compare<L>(a, b, numeric::ne<L>); }
+template <typename L> inline v128_t ltS(v128_t a, v128_t b) { return compare<L>(a, b, numeric::ltS<L>); }
+template <typename L> inline v128_t ltU(v128_t a, v128_t b) { return compare<L>(a, b, numeric::ltU<L>); }
+template <typename L> inline v128_t gtS(v128_t a, v128_t b) { return compare<L>(a, b, numeric::gtS<L>); }
+template <typename L> inline v128_t gtU(v128_t a, v128_t b) { return compare<L>(a, b, numeric::gtU<L>); }
+template <typename L> inline v128_t leS(v128_t a, v128_t b) { return compare<L>(a, b, numeric::leS<L>); }
+template <typename L> inline v128_t leU(v128_t a, v128_t b) { return compare<L>(a, b, numeric::leU<L>); }
+template <typename L> inline v128_t geS(v128_t a, v128_t b) { return compare<L>(a, b, numeric::geS<L>); }
+template <typename L> inline v128_t geU(v128_t a, v128_t b) { return compare<L>(a, b, numeric::geU<L>); }
+template <typename F> inline v128_t lt(v128_t a, v128_t b) { return compare<F>(a, b, numeric::lt<F>); }
+template <typename F> inline v128_t gt(v128_t a, v128_t b) { return compare<F>(a, b, numeric::gt<F>); }
+template <typename F> inline v128_t le(v128_t a, v128_t b) { return compare<F>(a, b, numeric::le<F>); }
+template <typename F> inline v128_t ge(v128_t a, v128_t b) { return compare<F>(a, b, numeric::ge<F>); }
+
+// the count is taken modulo the lane width
+template <typename L> inline v128_t shl(v128_t a, int32_t count) { return map<L>(a, [=](L x) { return numeric::shl<L>(x, (L)count); }); }
+template <typename L> inline v128_t shrS(v128_t a, int32_t count) { return map<L>(a, [=](L x) { return numeric::shrS<L>(x, (L)count); }); }
+template <typename L> inline v128_t shrU(v128_t a, int32_t count) { return map<L>(a, [=](L x) { return numeric::shrU<L>(x, (L)count); }); }
+
+inline v128_t bitNot(v128_t a) { return map<int64_t>(a, [](int64_t x) { return ~x; }); }
+inline v128_t bitAnd(v128_t a, v128_t b) { return zip<int64_t>(a, b, numeric::bitAnd<int64_t>); }
+inline v128_t bitOr(v128_t a, v128_t b) { return zip<int64_t>(a, b, numeric::bitOr<int64_t>); }
+inline v128_t bitXor(v128_t a, v128_t b) { return zip<int64_t>(a, b, numeric::bitXor<int64_t>); }
+inline v128_t bitAndNot(v128_t a, v128_t b) { return zip<int64_t>(a, b, [](int64_t x, int64_t y) { return x & ~y; }); }
+// the bits of a where mask is set, those of b elsewhere
+inline v128_t bitselect(v128_t a, v128_t b, v128_t mask) { return bitOr(bitAnd(a, mask), bitAndNot(b, mask)); }
+
+inline int32_t anyTrue(v128_t a) { return lane<uint64_t>(a, 0) != 0 || lane<uint64_t>(a, 1) != 0; }
+template <typename L> inline int32_t allTrue(v128_t a) {
+    for (int i = 0; i < lanes<L>; ++i) {
+        if (lane<L>(a, i) == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+// the sign bits of the lanes, lane 0 in bit 0
+template <typename L> inline int32_t bitmask(v128_t a) {
+    int32_t mask = 0;
+    for (int i = 0; i < lanes<L>; ++i) {
+        mask |= (lane<L>(a, i) < 0) << i;
+    }
+    return mask;
+}
+
+inline v128_t popcnt(v128_t a) { return map<uint8_t>(a, [](uint8_t x) { return (uint8_t)std::popcount(x); }); }
+// i32x4.dot_i16x8_s: the sums of the products of neighbouring lanes
+inline v128_t dot(v128_t a, v128_t b) {
+    v128_t result;
+    for (int i = 0; i < 4; ++i) {
+        int32_t low = (int32_t)lane<int16_t>(a, 2 * i) * lane<int16_t>(b, 2 * i);
+        int32_t high = (int32_t)lane<int16_t>(a, 2 * i + 1) * lane<int16_t>(b, 2 * i + 1);
+        setLane<int32_t>(result, i, numeric::add<int32_t>(low, high));
+    }
+    return result;
+}
+// lane i of the result is lane indices[i] of a and b, 0 for indices out of range
+inline v128_t swizzle(v128_t a, v128_t indices) {
+    v128_t result;
+    for (int i = 0; i < 16; ++i) {
+        result.bytes[i] = indices.bytes[i] < 16 ? a.bytes[indices.bytes[i]] : 0;
+    }
+    return result;
+}
+
+template <typename F> inline v128_t fadd(v128_t a, v128_t b) { return zip<F>(a, b, numeric::fadd<F>); }
+template <typename F> inline v128_t fsub(v128_t a, v128_t b) { return zip<F>(a, b, numeric::fsub<F>); }
+template <typename F> inline v128_t fmul(v128_t a, v128_t b) { return zip<F>(a, b, numeric::fmul<F>); }
+template <typename F> inline v128_t fdiv(v128_t a, v128_t b) { return zip<F>(a, b, numeric::fdiv<F>); }
+template <typename F> inline v128_t min(v128_t a, v128_t b) { return zip<F>(a, b, numeric::min<F>); }
+template <typename F> inline v128_t max(v128_t a, v128_t b) { return zip<F>(a, b, numeric::max<F>); }
+// pseudo-minimum and maximum: b < a ? b : a, like std::min
+template <typename F> inline v128_t pmin(v128_t a, v128_t b) { return zip<F>(a, b, [](F x, F y) { return y < x ? y : x; }); }
+template <typename F> inline v128_t pmax(v128_t a, v128_t b) { return zip<F>(a, b, [](F x, F y) { return x < y ? y : x; }); }
+template <typename F> inline v128_t fabs(v128_t a) { return map<F>(a, numeric::abs<F>); }
+template <typename F> inline v128_t fneg(v128_t a) { return map<F>(a, numeric::neg<F>); }
+template <typename F> inline v128_t sqrt(v128_t a) { return map<F>(a, numeric::sqrt<F>); }
+template <typename F> inline v128_t ceil(v128_t a) { return map<F>(a, numeric::ceil<F>); }
+template <typename F> inline v128_t floor(v128_t a) { return map<F>(a, numeric::floor<F>); }
+template <typename F> inline v128_t trunc(v128_t a) { return map<F>(a, numeric::trunc<F>); }
+template <typename F> inline v128_t nearest(v128_t a) { return map<F>(a, numeric::nearest<F>); }
+
+// i32x4.trunc_sat_f32x4_s and _u, I is int32_t or uint32_t
+template <typename I> inline v128_t truncateSaturated(v128_t a) {
+    v128_t result;
+    for (int i = 0; i < 4; ++i) {
+        setLane<I>(result, i, numeric::truncateSaturated<I, float>(lane<float>(a, i)));
+    }
+    return result;
+}
+// f32x4.convert_i32x4_s and _u
+template <typename I> inline v128_t convert(v128_t a) {
+    v128_t result;
+    for (int i = 0; i < 4; ++i) {
+        setLane<float>(result, i, (float)lane<I>(a, i));
+    }
+    return result;
+}
+
+}
+
+#ifdef SIMD_SSE2
+inline __m128i load(v128_t v) { return _mm_load_si128(reinterpret_cast<const __m128i*>(v.bytes)); }
+inline __m128 loadFloats(v128_t v) { return _mm_castsi128_ps(load(v)); }
+inline __m128d loadDoubles(v128_t v) { return _mm_castsi128_pd(load(v)); }
+inline v128_t store(__m128i x) {
+    v128_t v;
+    _mm_store_si128(reinterpret_cast<__m128i*>(v.bytes), x);
+    return v;
+}
+inline v128_t store(__m128 x) { return store(_mm_castps_si128(x)); }
+inline v128_t store(__m128d x) { return store(_mm_castpd_si128(x)); }
+
+// the minimum of the lane type in every lane: xor with it turns unsigned order into signed order
+template <typename L> inline __m128i signBits() {
+    if constexpr (sizeof(L) == 1) return _mm_set1_epi8(INT8_MIN);
+    else if constexpr (sizeof(L) == 2) return _mm_set1_epi16(INT16_MIN);
+    else return _mm_set1_epi32(INT32_MIN);
+}
+inline __m128i allOnes() { return _mm_set1_epi32(-1); }
+#endif
+
+template <typename L> inline v128_t add(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_add_epi8(load(a), load(b)));
+    else if constexpr (sizeof(L) == 2) return store(_mm_add_epi16(load(a), load(b)));
+    else if constexpr (sizeof(L) == 4) return store(_mm_add_epi32(load(a), load(b)));
+    else return store(_mm_add_epi64(load(a), load(b)));
+#else
+    return scalar::add<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t sub(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_sub_epi8(load(a), load(b)));
+    else if constexpr (sizeof(L) == 2) return store(_mm_sub_epi16(load(a), load(b)));
+    else if constexpr (sizeof(L) == 4) return store(_mm_sub_epi32(load(a), load(b)));
+    else return store(_mm_sub_epi64(load(a), load(b)));
+#else
+    return scalar::sub<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t mul(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 2) return store(_mm_mullo_epi16(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (sizeof(L) == 4) return store(_mm_mullo_epi32(load(a), load(b)));
+#endif
+    return scalar::mul<L>(a, b);
+}
+template <typename L> inline v128_t neg(v128_t a) {
+#ifdef SIMD_SSE2
+    return sub<L>(v128_t{}, a);
+#else
+    return scalar::neg<L>(a);
+#endif
+}
+template <typename L> inline v128_t abs(v128_t a) {
+#ifdef SIMD_SSSE3
+    if constexpr (sizeof(L) == 1) return store(_mm_abs_epi8(load(a)));
+    if constexpr (sizeof(L) == 2) return store(_mm_abs_epi16(load(a)));
+    if constexpr (sizeof(L) == 4) return store(_mm_abs_epi32(load(a)));
+#endif
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 4) {
+        __m128i sign = _mm_srai_epi32(load(a), 31);
+        return store(_mm_sub_epi32(_mm_xor_si128(load(a), sign), sign));
+    }
+#endif
+    return scalar::abs<L>(a);
+}
+
+template <typename L> inline v128_t addSatS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_adds_epi8(load(a), load(b)));
+    else return store(_mm_adds_epi16(load(a), load(b)));
+#else
+    return scalar::addSatS<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t addSatU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_adds_epu8(load(a), load(b)));
+    else return store(_mm_adds_epu16(load(a), load(b)));
+#else
+    return scalar::addSatU<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t subSatS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_subs_epi8(load(a), load(b)));
+    else return store(_mm_subs_epi16(load(a), load(b)));
+#else
+    return scalar::subSatS<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t subSatU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_subs_epu8(load(a), load(b)));
+    else return store(_mm_subs_epu16(load(a), load(b)));
+#else
+    return scalar::subSatU<L>(a, b);
+#endif
+}
+
+template <typename L> inline v128_t minS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 2) return store(_mm_min_epi16(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (sizeof(L) == 1) return store(_mm_min_epi8(load(a), load(b)));
+    if constexpr (sizeof(L) == 4) return store(_mm_min_epi32(load(a), load(b)));
+#endif
+    return scalar::minS<L>(a, b);
+}
+template <typename L> inline v128_t maxS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 2) return store(_mm_max_epi16(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (sizeof(L) == 1) return store(_mm_max_epi8(load(a), load(b)));
+    if constexpr (sizeof(L) == 4) return store(_mm_max_epi32(load(a), load(b)));
+#endif
+    return scalar::maxS<L>(a, b);
+}
+template <typename L> inline v128_t minU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_min_epu8(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (sizeof(L) == 2) return store(_mm_min_epu16(load(a), load(b)));
+    if constexpr (sizeof(L) == 4) return store(_mm_min_epu32(load(a), load(b)));
+#endif
+    return scalar::minU<L>(a, b);
+}
+template <typename L> inline v128_t maxU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_max_epu8(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (sizeof(L) == 2) return store(_mm_max_epu16(load(a), load(b)));
+    if constexpr (sizeof(L) == 4) return store(_mm_max_epu32(load(a), load(b)));
+#endif
+    return scalar::maxU<L>(a, b);
+}
+template <typename L> inline v128_t avgrU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_avg_epu8(load(a), load(b)));
+    else return store(_mm_avg_epu16(load(a), load(b)));
+#else
+    return scalar::avgrU<L>(a, b);
+#endif
+}
+
+template <typename L> inline v128_t eq(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (std::is_same_v<L, float>) return store(_mm_cmpeq_ps(loadFloats(a), loadFloats(b)));
+    else if constexpr (std::is_same_v<L, double>) return store(_mm_cmpeq_pd(loadDoubles(a), loadDoubles(b)));
+    else if constexpr (sizeof(L) == 1) return store(_mm_cmpeq_epi8(load(a), load(b)));
+    else if constexpr (sizeof(L) == 2) return store(_mm_cmpeq_epi16(load(a), load(b)));
+    else if constexpr (sizeof(L) == 4) return store(_mm_cmpeq_epi32(load(a), load(b)));
+#endif
+#ifdef SIMD_SSE41
+    if constexpr (std::is_same_v<L, int64_t>) return store(_mm_cmpeq_epi64(load(a), load(b)));
+#endif
+    return scalar::eq<L>(a, b);
+}
+template <typename L> inline v128_t ne(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (std::is_same_v<L, float>) return store(_mm_cmpneq_ps(loadFloats(a), loadFloats(b)));
+    else if constexpr (std::is_same_v<L, double>) return store(_mm_cmpneq_pd(loadDoubles(a), loadDoubles(b)));
+    else return store(_mm_xor_si128(load(eq<L>(a, b)), allOnes()));
+#else
+    return scalar::ne<L>(a, b);
+#endif
+}
+template <typename L> inline v128_t gtS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return store(_mm_cmpgt_epi8(load(a), load(b)));
+    else if constexpr (sizeof(L) == 2) return store(_mm_cmpgt_epi16(load(a), load(b)));
+    else if constexpr (sizeof(L) == 4) return store(_mm_cmpgt_epi32(load(a), load(b)));
+#endif
+    return scalar::gtS<L>(a, b);
+}
+template <typename L> inline v128_t ltS(v128_t a, v128_t b) { return gtS<L>(b, a); }
+template <typename L> inline v128_t leS(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) < 8) return store(_mm_xor_si128(load(gtS<L>(a, b)), allOnes()));
+#endif
+    return scalar::leS<L>(a, b);
+}
+template <typename L> inline v128_t geS(v128_t a, v128_t b) { return leS<L>(b, a); }
+template <typename L> inline v128_t gtU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) < 8) {
+        return gtS<L>(store(_mm_xor_si128(load(a), signBits<L>())), store(_mm_xor_si128(load(b), signBits<L>())));
+    }
+#endif
+    return scalar::gtU<L>(a, b);
+}
+template <typename L> inline v128_t ltU(v128_t a, v128_t b) { return gtU<L>(b, a); }
+template <typename L> inline v128_t leU(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) < 8) return store(_mm_xor_si128(load(gtU<L>(a, b)), allOnes()));
+#endif
+    return scalar::leU<L>(a, b);
+}
+template <typename L> inline v128_t geU(v128_t a, v128_t b) { return leU<L>(b, a); }
+template <typename F> inline v128_t lt(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_cmplt_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_cmplt_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::lt<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t gt(v128_t a, v128_t b) { return lt<F>(b, a); }
+template <typename F> inline v128_t le(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_cmple_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_cmple_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::le<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t ge(v128_t a, v128_t b) { return le<F>(b, a); }
+
+template <typename L> inline v128_t shl(v128_t a, int32_t count) {
+#ifdef SIMD_SSE2
+    __m128i bits = _mm_cvtsi32_si128(count & (sizeof(L) * 8 - 1));
+    if constexpr (sizeof(L) == 1) {
+        // shift the 16 bit lanes, then clear what moved in from the byte below
+        __m128i mask = _mm_set1_epi8((uint8_t)(0xFF << (count & 7)));
+        return store(_mm_and_si128(_mm_sll_epi16(load(a), bits), mask));
+    }
+    else if constexpr (sizeof(L) == 2) return store(_mm_sll_epi16(load(a), bits));
+    else if constexpr (sizeof(L) == 4) return store(_mm_sll_epi32(load(a), bits));
+    else return store(_mm_sll_epi64(load(a), bits));
+#else
+    return scalar::shl<L>(a, count);
+#endif
+}
+template <typename L> inline v128_t shrU(v128_t a, int32_t count) {
+#ifdef SIMD_SSE2
+    __m128i bits = _mm_cvtsi32_si128(count & (sizeof(L) * 8 - 1));
+    if constexpr (sizeof(L) == 1) {
+        __m128i mask = _mm_set1_epi8((uint8_t)(0xFF >> (count & 7)));
+        return store(_mm_and_si128(_mm_srl_epi16(load(a), bits), mask));
+    }
+    else if constexpr (sizeof(L) == 2) return store(_mm_srl_epi16(load(a), bits));
+    else if constexpr (sizeof(L) == 4) return store(_mm_srl_epi32(load(a), bits));
+    else return store(_mm_srl_epi64(load(a), bits));
+#else
+    return scalar::shrU<L>(a, count);
+#endif
+}
+template <typename L> inline v128_t shrS(v128_t a, int32_t count) {
+#ifdef SIMD_SSE2
+    __m128i bits = _mm_cvtsi32_si128(count & (sizeof(L) * 8 - 1));
+    if constexpr (sizeof(L) == 2) return store(_mm_sra_epi16(load(a), bits));
+    if constexpr (sizeof(L) == 4) return store(_mm_sra_epi32(load(a), bits));
+#endif
+    return scalar::shrS<L>(a, count);
+}
+
+inline v128_t bitNot(v128_t a) {
+#ifdef SIMD_SSE2
+    return store(_mm_xor_si128(load(a), allOnes()));
+#else
+    return scalar::bitNot(a);
+#endif
+}
+inline v128_t bitAnd(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    return store(_mm_and_si128(load(a), load(b)));
+#else
+    return scalar::bitAnd(a, b);
+#endif
+}
+inline v128_t bitOr(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    return store(_mm_or_si128(load(a), load(b)));
+#else
+    return scalar::bitOr(a, b);
+#endif
+}
+inline v128_t bitXor(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    return store(_mm_xor_si128(load(a), load(b)));
+#else
+    return scalar::bitXor(a, b);
+#endif
+}
+inline v128_t bitAndNot(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    return store(_mm_andnot_si128(load(b), load(a)));
+#else
+    return scalar::bitAndNot(a, b);
+#endif
+}
+inline v128_t bitselect(v128_t a, v128_t b, v128_t mask) {
+#ifdef SIMD_SSE2
+    return store(_mm_or_si128(_mm_and_si128(load(a), load(mask)), _mm_andnot_si128(load(mask), load(b))));
+#else
+    return scalar::bitselect(a, b, mask);
+#endif
+}
+
+inline int32_t anyTrue(v128_t a) {
+#ifdef SIMD_SSE2
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(load(a), _mm_setzero_si128())) != 0xFFFF;
+#else
+    return scalar::anyTrue(a);
+#endif
+}
+template <typename L> inline int32_t allTrue(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) < 8) return _mm_movemask_epi8(load(eq<L>(a, v128_t{}))) == 0;
+#endif
+    return scalar::allTrue<L>(a);
+}
+template <typename L> inline int32_t bitmask(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(L) == 1) return _mm_movemask_epi8(load(a));
+    // packing saturates, which keeps the sign
+    else if constexpr (sizeof(L) == 2) return _mm_movemask_epi8(_mm_packs_epi16(load(a), _mm_setzero_si128()));
+    else if constexpr (sizeof(L) == 4) return _mm_movemask_ps(loadFloats(a));
+    else return _mm_movemask_pd(loadDoubles(a));
+#else
+    return scalar::bitmask<L>(a);
+#endif
+}
+
+inline v128_t popcnt(v128_t a) {
+#ifdef SIMD_SSSE3
+    // the counts of both nibbles looked up in a table of 16
+    const __m128i counts = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i x = load(a);
+    return store(_mm_add_epi8(_mm_shuffle_epi8(counts, _mm_and_si128(x, low)),
+                              _mm_shuffle_epi8(counts, _mm_and_si128(_mm_srli_epi16(x, 4), low))));
+#else
+    return scalar::popcnt(a);
+#endif
+}
+inline v128_t dot(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    return store(_mm_madd_epi16(load(a), load(b)));
+#else
+    return scalar::dot(a, b);
+#endif
+}
+inline v128_t swizzle(v128_t a, v128_t indices) {
+#ifdef SIMD_SSSE3
+    // pshufb gives 0 for indices with the top bit set: saturate everything above 15 into those
+    return store(_mm_shuffle_epi8(load(a), _mm_adds_epu8(load(indices), _mm_set1_epi8(0x70))));
+#else
+    return scalar::swizzle(a, indices);
+#endif
+}
+// i8x16.shuffle: lane i of the result is byte indices[i] of a and b together, indices are below 32
+inline v128_t shuffle(v128_t a, v128_t b, const v128_t& indices) {
+    v128_t result;
+    for (int i = 0; i < 16; ++i) {
+        uint8_t index = indices.bytes[i] & 31;
+        result.bytes[i] = index < 16 ? a.bytes[index] : b.bytes[index - 16];
+    }
+    return result;
+}
+
+template <typename F> inline v128_t fadd(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_add_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_add_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::fadd<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t fsub(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_sub_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_sub_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::fsub<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t fmul(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_mul_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_mul_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::fmul<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t fdiv(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_div_ps(loadFloats(a), loadFloats(b)));
+    else return store(_mm_div_pd(loadDoubles(a), loadDoubles(b)));
+#else
+    return scalar::fdiv<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t sqrt(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_sqrt_ps(loadFloats(a)));
+    else return store(_mm_sqrt_pd(loadDoubles(a)));
+#else
+    return scalar::sqrt<F>(a);
+#endif
+}
+// minps and maxps give their second operand for NaNs and for -0 against +0: taking both orders
+// and combining them gets -0 < +0 right, lanes with a NaN are the canonical NaN
+template <typename F> inline v128_t min(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) {
+        __m128 x = loadFloats(a), y = loadFloats(b);
+        __m128 nan = _mm_cmpunord_ps(x, y);
+        __m128 smaller = _mm_or_ps(_mm_min_ps(x, y), _mm_min_ps(y, x));
+        return store(_mm_or_ps(_mm_andnot_ps(nan, smaller), _mm_and_ps(nan, _mm_set1_ps(std::numeric_limits<float>::quiet_NaN()))));
+    } else {
+        __m128d x = loadDoubles(a), y = loadDoubles(b);
+        __m128d nan = _mm_cmpunord_pd(x, y);
+        __m128d smaller = _mm_or_pd(_mm_min_pd(x, y), _mm_min_pd(y, x));
+        return store(_mm_or_pd(_mm_andnot_pd(nan, smaller), _mm_and_pd(nan, _mm_set1_pd(std::numeric_limits<double>::quiet_NaN()))));
+    }
+#else
+    return scalar::min<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t max(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) {
+        __m128 x = loadFloats(a), y = loadFloats(b);
+        __m128 nan = _mm_cmpunord_ps(x, y);
+        __m128 larger = _mm_and_ps(_mm_max_ps(x, y), _mm_max_ps(y, x));
+        return store(_mm_or_ps(_mm_andnot_ps(nan, larger), _mm_and_ps(nan, _mm_set1_ps(std::numeric_limits<float>::quiet_NaN()))));
+    } else {
+        __m128d x = loadDoubles(a), y = loadDoubles(b);
+        __m128d nan = _mm_cmpunord_pd(x, y);
+        __m128d larger = _mm_and_pd(_mm_max_pd(x, y), _mm_max_pd(y, x));
+        return store(_mm_or_pd(_mm_andnot_pd(nan, larger), _mm_and_pd(nan, _mm_set1_pd(std::numeric_limits<double>::quiet_NaN()))));
+    }
+#else
+    return scalar::max<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t pmin(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_min_ps(loadFloats(b), loadFloats(a)));
+    else return store(_mm_min_pd(loadDoubles(b), loadDoubles(a)));
+#else
+    return scalar::pmin<F>(a, b);
+#endif
+}
+template <typename F> inline v128_t pmax(v128_t a, v128_t b) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_max_ps(loadFloats(b), loadFloats(a)));
+    else return store(_mm_max_pd(loadDoubles(b), loadDoubles(a)));
+#else
+    return scalar::pmax<F>(a, b);
+#endif
+}
+// abs and neg only touch the sign bits
+template <typename F> inline v128_t fabs(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_and_si128(load(a), _mm_set1_epi32(INT32_MAX)));
+    else return store(_mm_and_si128(load(a), _mm_set1_epi64x(INT64_MAX)));
+#else
+    return scalar::fabs<F>(a);
+#endif
+}
+template <typename F> inline v128_t fneg(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (sizeof(F) == 4) return store(_mm_xor_si128(load(a), _mm_set1_epi32(INT32_MIN)));
+    else return store(_mm_xor_si128(load(a), _mm_set1_epi64x(INT64_MIN)));
+#else
+    return scalar::fneg<F>(a);
+#endif
+}
+
+#ifdef SIMD_SSE41
+template <typename F, int mode> inline v128_t round(v128_t a) {
+    if constexpr (sizeof(F) == 4) return store(_mm_round_ps(loadFloats(a), mode | _MM_FROUND_NO_EXC));
+    else return store(_mm_round_pd(loadDoubles(a), mode | _MM_FROUND_NO_EXC));
+}
+template <typename F> inline v128_t ceil(v128_t a) { return round<F, _MM_FROUND_TO_POS_INF>(a); }
+template <typename F> inline v128_t floor(v128_t a) { return round<F, _MM_FROUND_TO_NEG_INF>(a); }
+template <typename F> inline v128_t trunc(v128_t a) { return round<F, _MM_FROUND_TO_ZERO>(a); }
+template <typename F> inline v128_t nearest(v128_t a) { return round<F, _MM_FROUND_TO_NEAREST_INT>(a); }
+#else
+template <typename F> inline v128_t ceil(v128_t a) { return scalar::ceil<F>(a); }
+template <typename F> inline v128_t floor(v128_t a) { return scalar::floor<F>(a); }
+template <typename F> inline v128_t trunc(v128_t a) { return scalar::trunc<F>(a); }
+template <typename F> inline v128_t nearest(v128_t a) { return scalar::nearest<F>(a); }
+#endif
+
+template <typename I> inline v128_t truncateSaturated(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (std::is_signed_v<I>) {
+        // NaNs become 0, cvttps2dq gives INT32_MIN for everything out of range, which the lanes
+        // from 2^31 up turn into INT32_MAX
+        __m128 x = loadFloats(a);
+        x = _mm_and_ps(x, _mm_cmpeq_ps(x, x));
+        __m128i above = _mm_castps_si128(_mm_cmpge_ps(x, _mm_set1_ps(2147483648.0f)));
+        return store(_mm_xor_si128(_mm_cvttps_epi32(x), above));
+    }
+#endif
+    return scalar::truncateSaturated<I>(a);
+}
+template <typename I> inline v128_t convert(v128_t a) {
+#ifdef SIMD_SSE2
+    if constexpr (std::is_signed_v<I>) return store(_mm_cvtepi32_ps(load(a)));
+#endif
+    return scalar::convert<I>(a);
+}
+
+// splat, extract_lane and replace_lane: T is the type of the scalar on the stack, L that of the
+// lanes, e.g. extractLane<uint8_t, int32_t> for i8x16.extract_lane_u
+template <typename L, typename T> inline v128_t splat(T value) {
+    v128_t result;
+    for (int i = 0; i < lanes<L>; ++i) {
+        setLane<L>(result, i, (L)value);
+    }
+    return result;
+}
+template <typename L, typename T> inline T extractLane(v128_t a, int index) { return (T)lane<L>(a, index); }
+template <typename L, typename T> inline v128_t replaceLane(v128_t a, int index, T value) {
+    setLane<L>(a, index, (L)value);
+    return a;
+}
+
+}
+
+#endif // __SIMD_H__
@@ -0,0 +1,1406 @@
+#include <algorithm>
+#include <bit>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ssa.h"
+#include "constants.h"
+
+using namespace constants;
+
+namespace ssa {
+
+namespace {
+
+uint8_t valueType(VariableType type) {
+    switch (type) {
+        case VariableType::is_int32: return INT32;
+        case VariableType::is_int64: return INT64;
+        case VariableType::isfloat32_t: return FLOAT32;
+        case VariableType::isv128_t: return V128;
+        default: return FLOAT64;
+    }
+}
+
+bool isConstant(const Value* value) {
+    return value->kind == Value::Kind::OPERATION && InstructionNumber::isConst(value->info);
+}
+
+// the bits of a constant, i32 and f32 in the low half
+uint64_t constantBits(const Instruction* instruction) {
+    switch (instruction->instruction_code) {
+        case I32CONST: return instruction->parameter;
+        case I64CONST: return (uint64_t)instruction->long_parameter;
+        case F32CONST: return std::bit_cast<uint32_t>(instruction->float_parameter);
+        default: return std::bit_cast<uint64_t>(instruction->double_parameter);
+    }
+}
+
+// the result only depends on the operands: no locals, globals, memory or calls involved
+bool isPure(const opcodes::OpcodeInfo* info) {
+    if (info->prefix != 0) {
+        return false;
+    }
+    return info->code == SELECT || InstructionNumber::isConst(info) ||
+           (info->immediate == opcodes::Immediate::NONE && info->signature.result != 0);
+}
+
+// division by zero and truncation of NaN or out of range floats trap
+bool isTrapping(const opcodes::OpcodeInfo* info) {
+    switch (info->code) {
+        case I32DIV_S: case I32DIV_U: case I32REM_S: case I32REM_U:
+        case I64DIV_S: case I64DIV_U: case I64REM_S: case I64REM_U:
+        case I32TRUNC_F32_S: case I32TRUNC_F32_U: case I32TRUNC_F64_S: case I32TRUNC_F64_U:
+        case I64TRUNC_F32_S: case I64TRUNC_F32_U: case I64TRUNC_F64_S: case I64TRUNC_F64_U:
+            return true;
+    }
+    return false;
+}
+
+// pure and can't trap either: may run anywhere its operands are available, as often as it likes
+bool isMovable(const Value* value) {
+    return value->kind == Value::Kind::OPERATION && isPure(value->info) && !isTrapping(value->info);
+}
+
+bool isCommutative(const opcodes::OpcodeInfo* info) {
+    switch (info->code) {
+        case I32ADD: case I32MUL: case I32AND: case I32OR: case I32XOR: case I32EQ: case I32NE:
+        case I64ADD: case I64MUL: case I64AND: case I64OR: case I64XOR: case I64EQ: case I64NE:
+            return true;
+    }
+    return false;
+}
+
+Value* resolve(Value* value) {
+    while (value->replacement != nullptr) {
+        value = value->replacement;
+    }
+    return value;
+}
+
+Instruction* makeInstruction(Arena* arena, InstructionType type, uint8_t code, uint32_t parameter = 0) {
+    Instruction* instruction = arena->make<Instruction>(type, code);
+    instruction->parameter = parameter;
+    return instruction;
+}
+
+// the body of a function, block, loop or if while it is being built
+struct Frame {
+    uint8_t opcode;         // BLOCK, LOOP, IF, or BLOCK_END for the function itself
+    Block* target;          // where a branch to its label goes: the header of a loop, the end otherwise
+    Block* end;             // the block that starts after its end instruction
+    Block* branch;          // IF: the block that ends with the if instruction
+    size_t height;          // of the value stack when it was entered
+    size_t loop;            // LOOP: index in Graph::loops
+    bool hasElse;
+};
+
+}
+
+Graph::Graph(Arena* arena, const AST_Function* function, const std::vector<AST_Function*>& functions,
+             const std::vector<uint8_t>& localTypes)
+    : arena(arena), function(function), functions(functions), localTypes(localTypes) {}
+
+Value* Graph::makeValue(Value::Kind kind, uint8_t type, Block* block) {
+    Value* value = &values.emplace_back();
+    value->kind = kind;
+    value->type = type;
+    value->id = values.size() - 1;
+    value->block = block;
+    return value;
+}
+
+Block* Graph::makeBlock() {
+    Block* block = &blocks.emplace_back();
+    block->id = blocks.size() - 1;
+    return block;
+}
+
+void Graph::start(Block* block) {
+    block->layout = layout.size();
+    layout.push_back(block);
+}
+
+void Graph::addOperand(Value* user, Value* operand) {
+    user->operands.push_back(operand);
+    operand->users.push_back(user);
+}
+
+void Graph::replace(Value* value, Value* by) {
+    for (Value* user : value->users) {
+        *std::find(user->operands.begin(), user->operands.end(), value) = by;
+        by->users.push_back(user);
+    }
+    value->users.clear();
+    value->replacement = by;
+}
+
+// drops the operands of a value without users, operations stay in their block until it is compacted
+void Graph::remove(Value* value) {
+    for (Value* operand : value->operands) {
+        auto& users = operand->users;
+        users.erase(std::find(users.begin(), users.end(), value));
+    }
+    value->operands.clear();
+    value->removed = true;
+    if (value->kind == Value::Kind::PHI) {
+        auto& phis = value->block->phis;
+        phis.erase(std::find(phis.begin(), phis.end(), value));
+    }
+}
+
+void Graph::link(Block* from, Block* to, size_t resultCount) {
+    if (to->sealed || resultCount != to->results.size()) {
+        failed = true;
+    }
+    from->successors.push_back(to);
+    to->predecessors.push_back(from);
+}
+
+// all predecessors are known: the phis created in the meantime get their operands
+void Graph::seal(Block* block) {
+    auto incomplete = std::move(block->incompletePhis);
+    block->incompletePhis.clear();
+    for (auto& [index, phi] : incomplete) {
+        addPhiOperands(index, phi);
+    }
+    block->sealed = true;
+}
+
+// a block stores to a handful of locals at most, a linear search beats hashing them
+void Graph::writeLocal(uint32_t index, Block* block, Value* value) {
+    for (auto& definition : block->definitions) {
+        if (definition.first == index) {
+            definition.second = value;
+            return;
+        }
+    }
+    block->definitions.emplace_back(index, value);
+}
+
+Value* Graph::readLocal(uint32_t index, Block* block) {
+    for (auto& definition : block->definitions) {
+        if (definition.first == index) {
+            return resolve(definition.second);
+        }
+    }
+    return readLocalRecursive(index, block);
+}
+
+Value* Graph::readLocalRecursive(uint32_t index, Block* block) {
+    uint8_t type = localTypes[index];
+    Value* value;
+    if (!block->sealed) {
+        value = makeValue(Value::Kind::PHI, type, block);
+        block->phis.push_back(value);
+        block->incompletePhis.emplace_back(index, value);
+    } else if (block->predecessors.size() == 1) {
+        value = readLocal(index, block->predecessors[0]);
+    } else if (block->predecessors.empty()) {
+        // only the entry has no predecessors: a declared local is zero before its first store; there
+        // is no constant for a v128 zero, functions that read one are left as they are
+        if (block != entry || type == V128) {
+            failed = true;
+        }
+        Instruction* zero = arena->make<Instruction>(InstructionType::CONST,
+            type == INT32 ? I32CONST : type == INT64 ? I64CONST : type == FLOAT32 ? F32CONST : F64CONST);
+        value = makeValue(Value::Kind::OPERATION, type, entry);
+        value->instruction = zero;
+        value->info = instructionInfo(zero);
+        value->implicitZero = true;
+        entry->operations.insert(entry->operations.begin(), value);
+    } else {
+        value = makeValue(Value::Kind::PHI, type, block);
+        block->phis.push_back(value);
+        writeLocal(index, block, value);
+        value = addPhiOperands(index, value);
+    }
+    // removing trivial phis on the way may have replaced it already
+    value = resolve(value);
+    writeLocal(index, block, value);
+    return value;
+}
+
+Value* Graph::addPhiOperands(uint32_t index, Value* phi) {
+    filling.push_back(phi);
+    for (Block* predecessor : phi->block->predecessors) {
+        addOperand(phi, readLocal(index, predecessor));
+    }
+    filling.pop_back();
+    return removeTrivialPhi(phi);
+}
+
+// a phi that merges a single value (besides itself) is that value
+Value* Graph::removeTrivialPhi(Value* phi) {
+    Value* same = nullptr;
+    for (Value* operand : phi->operands) {
+        if (operand == same || operand == phi) {
+            continue;
+        }
+        if (same != nullptr) {
+            return phi;
+        }
+        same = operand;
+    }
+    if (same == nullptr) {
+        failed = true;      // only reachable through itself
+        return phi;
+    }
+
+    std::vector<Value*> users;
+    for (Value* user : phi->users) {
+        if (user != phi) {
+            users.push_back(user);
+        }
+    }
+    remove(phi);
+    replace(phi, same);
+    for (Value* user : users) {
+        if (user->kind == Value::Kind::PHI && !user->removed && user->block->sealed &&
+            std::find(filling.begin(), filling.end(), user) == filling.end()) {
+            removeTrivialPhi(user);
+        }
+    }
+    return resolve(same);
+}
+
+int Graph::removeTrivialPhis() {
+    int removed = 0;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (Block* block : layout) {
+            for (size_t i = 0; i < block->phis.size();) {
+                if (removeTrivialPhi(block->phis[i]) != block->phis[i]) {
+                    ++removed;
+                    changed = true;
+                } else {
+                    ++i;
+                }
+            }
+        }
+    }
+    return removed;
+}
+
+bool Graph::build(const std::vector<Instruction*>& body) {
+    entry = makeBlock();
+    entry->sealed = true;
+    start(entry);
+    for (uint32_t i = 0; i < function->parameters.size(); ++i) {
+        Value* parameter = makeValue(Value::Kind::PARAMETER, localTypes[i], entry);
+        parameter->local = i;
+        parameters.push_back(parameter);
+        writeLocal(i, entry, parameter);
+    }
+    std::vector<uint8_t> functionResults;
+    for (auto result : function->results) {
+        functionResults.push_back(valueType(result));
+    }
+
+    std::vector<Frame> frames = { { BLOCK_END, nullptr, nullptr, nullptr, 0, 0, false } };
+    std::vector<Value*> stack;
+    Block* current = entry;
+    bool reachable = true;
+    int skipped = 0;    // blocks opened in unreachable code
+
+    // the top count values of the stack, bottom first
+    auto top = [&](size_t count) {
+        std::vector<Value*> taken;
+        if (stack.size() < frames.back().height + count) {
+            failed = true;
+            return taken;
+        }
+        for (size_t i = stack.size() - count; i < stack.size(); ++i) {
+            taken.push_back(resolve(stack[i]));
+        }
+        return taken;
+    };
+    auto operation = [&](Instruction* instruction, const opcodes::OpcodeInfo* info, size_t operandCount, uint8_t type) {
+        std::vector<Value*> operands = top(operandCount);
+        if (failed) {
+            return;
+        }
+        stack.resize(stack.size() - operandCount);
+        Value* value = makeValue(Value::Kind::OPERATION, type, current);
+        value->instruction = instruction;
+        value->info = info;
+        for (Value* operand : operands) {
+            addOperand(value, operand);
+        }
+        current->operations.push_back(value);
+        if (type != 0) {
+            stack.push_back(value);
+        }
+    };
+    auto control = [&](Instruction* instruction, const opcodes::OpcodeInfo* info, const std::vector<Value*>& operands) {
+        Value* value = makeValue(Value::Kind::CONTROL, 0, current);
+        value->instruction = instruction;
+        value->info = info;
+        for (Value* operand : operands) {
+            addOperand(value, operand);
+        }
+        current->control = value;
+    };
+    // after br, return and unreachable nothing runs up to the next else or end
+    auto unreachableFrom = [&]() {
+        Block* dead = makeBlock();
+        dead->sealed = true;
+        start(dead);
+        current = dead;
+        reachable = false;
+    };
+
+    for (size_t i = 0; i < body.size() && !failed; ++i) {
+        Instruction* instruction = body[i];
+        const opcodes::OpcodeInfo* info = instructionInfo(instruction);
+        if (info == nullptr) {
+            return false;
+        }
+        uint32_t code = info->prefix == 0 ? info->code : 0xFFFFFFFF;
+        if (!reachable) {
+            if (code == BLOCK || code == LOOP || code == IF) {
+                ++skipped;
+                continue;
+            }
+            if (code != BLOCK_END && code != ELSE) {
+                continue;
+            }
+            if (skipped > 0) {
+                skipped -= code == BLOCK_END;
+                continue;
+            }
+        }
+
+        switch (code) {
+            case NOP:
+                break;
+            case LOCALGET:
+            case LOCALSET:
+            case LOCALTEE: {
+                uint32_t index = instruction->parameter;
+                if (index >= localTypes.size() || localTypes[index] == 0) {
+                    return false;
+                }
+                if (code == LOCALGET) {
+                    stack.push_back(readLocal(index, current));
+                    break;
+                }
+                std::vector<Value*> value = top(1);
+                if (failed || value[0]->type != localTypes[index]) {
+                    return false;
+                }
+                if (code == LOCALSET) {
+                    stack.pop_back();
+                }
+                if (i > 0 && instructionInfo(body[i - 1]) == opcodes::byCode(0, LOCALGET)) {
+                    ++copies;
+                }
+                writeLocal(index, current, value[0]);
+                break;
+            }
+            case DROP:
+                top(1);
+                if (!failed) {
+                    stack.pop_back();
+                }
+                break;
+            case SELECT:
+                if (stack.size() < frames.back().height + 3) {
+                    return false;
+                }
+                operation(instruction, info, 3, resolve(stack[stack.size() - 3])->type);
+                break;
+            case CALL: {
+                if (instruction->parameter >= functions.size()) {
+                    return false;
+                }
+                const AST_Function* callee = functions[instruction->parameter];
+                if (callee->results.size() > 1) {
+                    return false;
+                }
+                operation(instruction, info, callee->parameters.size(),
+                          callee->results.empty() ? 0 : valueType(callee->results[0]));
+                break;
+            }
+            case CALL_INDIRECT:
+            case GLOBALGET:
+            case GLOBALSET:
+            case BR_TABLE:
+                return false;
+            case BLOCK:
+            case LOOP:
+            case IF: {
+                if (!hasValueBlockType(instruction)) {
+                    return false;   // parameters, or more than one result
+                }
+                std::vector<uint8_t> types;
+                for (uint8_t type : instruction->block_parameters) {
+                    if (type != 0x40) {
+                        types.push_back(type);
+                    }
+                }
+                std::vector<Value*> condition;
+                if (code == IF) {
+                    condition = top(1);
+                    if (failed) {
+                        return false;
+                    }
+                    stack.pop_back();
+                }
+                control(instruction, info, condition);
+
+                Block* end = makeBlock();
+                for (uint8_t type : types) {
+                    end->results.push_back(makeValue(Value::Kind::RESULT, type, end));
+                }
+                Block* next = makeBlock();
+                link(current, next, 0);
+                Frame frame = { (uint8_t)code, end, end, current, stack.size(), 0, false };
+                if (code == LOOP) {
+                    if (!types.empty()) {
+                        return false;   // the results of a loop come from falling through its end only
+                    }
+                    frame.target = next;
+                    frame.loop = loops.size();
+                    loops.push_back({ current, next, 0, 0 });
+                } else {
+                    seal(next);
+                }
+                frames.push_back(frame);
+                start(next);
+                current = next;
+                if (code == LOOP) {
+                    loops.back().first = next->layout;
+                }
+                break;
+            }
+            case ELSE: {
+                Frame& frame = frames.back();
+                if (frame.opcode != IF || frame.hasElse) {
+                    return false;
+                }
+                size_t count = frame.end->results.size();
+                std::vector<Value*> results;
+                if (reachable) {
+                    if (stack.size() != frame.height + count) {
+                        return false;
+                    }
+                    results = top(count);
+                    link(current, frame.end, count);
+                }
+                control(instruction, info, results);
+                stack.resize(frame.height);
+                frame.hasElse = true;
+
+                Block* otherwise = makeBlock();
+                link(frame.branch, otherwise, 0);
+                seal(otherwise);
+                start(otherwise);
+                current = otherwise;
+                reachable = true;
+                break;
+            }
+            case BLOCK_END: {
+                Frame frame = frames.back();
+                size_t count = frame.opcode == BLOCK_END ? functionResults.size() : frame.end->results.size();
+                std::vector<Value*> results;
+                if (reachable) {
+                    if (stack.size() != frame.height + count) {
+                        return false;
+                    }
+                    results = top(count);
+                }
+                control(instruction, info, results);
+                frames.pop_back();
+                if (frame.opcode == BLOCK_END) {
+                    if (i + 1 != body.size()) {
+                        return false;
+                    }
+                    break;
+                }
+
+                if (reachable) {
+                    link(current, frame.end, count);
+                }
+                if (frame.opcode == IF && !frame.hasElse) {
+                    if (count != 0) {
+                        return false;
+                    }
+                    link(frame.branch, frame.end, 0);
+                }
+                if (frame.opcode == LOOP) {
+                    seal(frame.target);
+                    loops[frame.loop].last = current->layout;
+                }
+                seal(frame.end);
+                stack.resize(frame.height);
+                start(frame.end);
+                current = frame.end;
+                // nothing reaches the end of a loop that only branches back, or of a block nobody leaves
+                reachable = !frame.end->predecessors.empty();
+                if (reachable) {
+                    for (Value* result : frame.end->results) {
+                        stack.push_back(result);
+                    }
+                }
+                break;
+            }
+            case BR:
+            case BR_IF: {
+                uint32_t depth = instruction->parameter;
+                if (depth >= frames.size()) {
+                    return false;
+                }
+                Frame& frame = frames[frames.size() - 1 - depth];
+                if (code == BR_IF) {
+                    // the values a br_if passes on stay on the stack when it falls through: not supported
+                    if (frame.opcode == BLOCK_END || (frame.opcode != LOOP && !frame.end->results.empty())) {
+                        return false;
+                    }
+                    std::vector<Value*> condition = top(1);
+                    if (failed) {
+                        return false;
+                    }
+                    stack.pop_back();
+                    control(instruction, info, condition);
+                    link(current, frame.target, 0);
+                    Block* next = makeBlock();
+                    link(current, next, 0);
+                    seal(next);
+                    start(next);
+                    current = next;
+                    break;
+                }
+                size_t count = frame.opcode == BLOCK_END ? functionResults.size() :
+                               frame.opcode == LOOP ? 0 : frame.end->results.size();
+                std::vector<Value*> values = top(count);
+                if (failed) {
+                    return false;
+                }
+                control(instruction, info, values);
+                if (frame.opcode != BLOCK_END) {
+                    link(current, frame.target, count);
+                }
+                unreachableFrom();
+                break;
+            }
+            case RETURN: {
+                std::vector<Value*> values = top(functionResults.size());
+                if (failed) {
+                    return false;
+                }
+                control(instruction, info, values);
+                unreachableFrom();
+                break;
+            }
+            case UNREACHABLE:
+                control(instruction, info, {});
+                unreachableFrom();
+                break;
+            default:
+                operation(instruction, info, info->signature.paramCount, info->signature.result);
+                break;
+        }
+    }
+    if (failed || !frames.empty()) {
+        return false;
+    }
+    removeTrivialPhis();
+    return !failed;
+}
+
+void Graph::computeDominators() {
+    // Cooper, Harvey and Kennedy: iterate to a fixed point, every dominator comes earlier in the layout
+    for (Block* block : layout) {
+        block->dominator = nullptr;
+    }
+    entry->dominator = entry;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (Block* block : layout) {
+            if (block == entry) {
+                continue;
+            }
+            Block* dominator = nullptr;
+            for (Block* predecessor : block->predecessors) {
+                if (predecessor->dominator == nullptr) {
+                    continue;
+                }
+                if (dominator == nullptr) {
+                    dominator = predecessor;
+                    continue;
+                }
+                Block* a = predecessor;
+                Block* b = dominator;
+                while (a != b) {
+                    while (a->layout > b->layout) {
+                        a = a->dominator;
+                    }
+                    while (b->layout > a->layout) {
+                        b = b->dominator;
+                    }
+                }
+                dominator = a;
+            }
+            if (dominator != block->dominator) {
+                block->dominator = dominator;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool Graph::dominates(const Block* a, const Block* b) const {
+    while (b != nullptr && b != a && b != entry) {
+        b = b->dominator;
+    }
+    return b == a;
+}
+
+int Graph::numberValues() {
+    computeDominators();
+
+    // opcode and operands (at most three): constants by value, everything else by identity
+    struct Key {
+        uint64_t words[7] = {};
+        bool operator==(const Key& other) const {
+            return std::equal(std::begin(words), std::end(words), std::begin(other.words));
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            uint64_t h = 0;
+            for (uint64_t word : key.words) {
+                h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+            }
+            return h ^ (h >> 29);
+        }
+    };
+    // key -> the values computing it so far
+    std::unordered_map<Key, std::vector<Value*>, KeyHash> computed;
+
+    int numbered = 0;
+    for (Block* block : layout) {
+        if (block->dominator == nullptr) {
+            continue;
+        }
+        for (size_t i = 0; i < block->operations.size();) {
+            Value* value = block->operations[i];
+            if (value->kind != Value::Kind::OPERATION || !isPure(value->info) || isConstant(value)
+                || value->operands.size() > 3) {
+                ++i;
+                continue;
+            }
+            std::pair<uint64_t, uint64_t> operands[3];
+            for (size_t o = 0; o < value->operands.size(); ++o) {
+                Value* operand = value->operands[o];
+                if (isConstant(operand)) {
+                    operands[o] = { operand->type, constantBits(operand->instruction) };
+                } else {
+                    operands[o] = { 0x100, operand->id };
+                }
+            }
+            if (isCommutative(value->info) && operands[1] < operands[0]) {
+                std::swap(operands[0], operands[1]);
+            }
+            Key key;
+            key.words[0] = value->info->code;
+            for (size_t o = 0; o < value->operands.size(); ++o) {
+                key.words[1 + 2 * o] = operands[o].first;
+                key.words[2 + 2 * o] = operands[o].second;
+            }
+
+            auto& candidates = computed[key];
+            auto equal = std::find_if(candidates.begin(), candidates.end(), [&](const Value* candidate) {
+                return dominates(candidate->block, block);
+            });
+            if (equal == candidates.end()) {
+                candidates.push_back(value);
+                ++i;
+                continue;
+            }
+            replace(value, *equal);
+            remove(value);
+            block->operations.erase(block->operations.begin() + i);
+            ++numbered;
+        }
+    }
+    return numbered;
+}
+
+int Graph::hoistInvariants() {
+    int hoisted = 0;
+    // inner loops first, what moves out of them may move further out of the enclosing ones
+    for (auto loop = loops.rbegin(); loop != loops.rend(); ++loop) {
+        auto inside = [&](const Value* value) {
+            return value->block->layout >= loop->first && value->block->layout <= loop->last;
+        };
+        for (uint32_t position = loop->first; position <= loop->last; ++position) {
+            Block* block = layout[position];
+            for (size_t i = 0; i < block->operations.size();) {
+                Value* value = block->operations[i];
+                bool invariant = isMovable(value) && !isConstant(value) &&
+                    std::none_of(value->users.begin(), value->users.end(), [](const Value* user) {
+                        return user->kind == Value::Kind::PHI;
+                    }) &&
+                    std::all_of(value->operands.begin(), value->operands.end(), [&](const Value* operand) {
+                        return isConstant(operand) || !inside(operand);
+                    });
+                if (!invariant) {
+                    ++i;
+                    continue;
+                }
+                block->operations.erase(block->operations.begin() + i);
+                value->block = loop->preheader;
+                loop->preheader->operations.push_back(value);
+                ++hoisted;
+            }
+        }
+    }
+    return hoisted;
+}
+
+int Graph::propagateCopies() {
+    return removeTrivialPhis();
+}
+
+// removes the pure values nothing with an effect depends on, including cycles of phis
+void Graph::eliminateDeadValues() {
+    std::vector<uint8_t> live(values.size(), 0);
+    std::vector<Value*> work;
+    for (Block* block : layout) {
+        for (Value* operation : block->operations) {
+            if (!isMovable(operation)) {
+                work.push_back(operation);
+            }
+        }
+        work.push_back(block->control);
+    }
+    while (!work.empty()) {
+        Value* value = work.back();
+        work.pop_back();
+        if (!live[value->id]) {
+            live[value->id] = 1;
+            work.insert(work.end(), value->operands.begin(), value->operands.end());
+        }
+    }
+    for (Block* block : layout) {
+        std::vector<Value*> phis = block->phis;
+        for (Value* phi : phis) {
+            if (!live[phi->id]) {
+                remove(phi);
+            }
+        }
+        for (Value* operation : block->operations) {
+            if (!live[operation->id]) {
+                remove(operation);
+            }
+        }
+        std::erase_if(block->operations, [](const Value* value) { return value->removed; });
+    }
+}
+
+// Leaves SSA form. The phis and their operands are joined into webs that share a local, where two
+// values of a web are alive at the same time a COPY splits one of them off. Everything else is
+// kept on the stack where its single user is the next to take it, or recomputed right in front of
+// its user if that is free (constants, pure operations on locals), or goes through a local.
+class Linearizer {
+public:
+    explicit Linearizer(Graph& graph) : graph(graph) {}
+
+    bool run(std::vector<Instruction*>& body, std::vector<uint8_t>& localTypes);
+
+private:
+    static constexpr int MAX_SPLIT_ROUNDS = 8;
+    static constexpr size_t NO_BEGIN = SIZE_MAX;
+
+    Graph& graph;
+    size_t parameterCount = 0;
+
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> webSize;
+    std::vector<uint8_t> floating;
+    std::vector<uint8_t> stacked;
+    std::vector<int64_t> position;
+    std::unordered_set<const Value*> split;
+
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> webLocal;
+    std::vector<uint32_t> localOf;
+    std::vector<int64_t> definedAt;
+    std::vector<uint32_t> pendingUses;
+    std::vector<std::vector<std::pair<uint32_t, size_t>>> freeLocals;   // per type: local, freed at
+    std::vector<Instruction*> out;
+    std::unordered_map<size_t, std::vector<Instruction*>> inserted;     // in front of out[index]
+
+    // a value on the stack: its slot takes the local.set if it has to be spilled after all, code
+    // it needs underneath goes in front of begin
+    struct Pending {
+        Value* value;
+        size_t slot;
+        size_t begin;
+    };
+    std::vector<Pending> stack;
+    bool failed = false;
+
+    uint32_t find(uint32_t id) {
+        while (parent[id] != id) {
+            id = parent[id] = parent[parent[id]];
+        }
+        return id;
+    }
+    void unite(const Value* a, const Value* b) {
+        uint32_t x = find(a->id), y = find(b->id);
+        if (x != y) {
+            parent[y] = x;
+            webSize[x] += webSize[y];
+        }
+    }
+    bool inWeb(const Value* value) {
+        return value->kind == Value::Kind::PHI || webSize[find(value->id)] > 1;
+    }
+    bool hasLocal(const Value* value) {
+        return !isConstant(value) && !floating[value->id] && !stacked[value->id];
+    }
+    bool isBlockLocal(const Value* value) {
+        return !inWeb(value) && value->kind != Value::Kind::PARAMETER &&
+               std::all_of(value->users.begin(), value->users.end(), [&](const Value* user) {
+                   return user->block == value->block;
+               });
+    }
+    // where a floating value is really used: at its first user that isn't floating
+    int64_t usePosition(const Value* user) {
+        while (floating[user->id]) {
+            user = user->users[0];
+        }
+        return position[user->id];
+    }
+
+    void buildWebs();
+    void classify();
+    bool resolveInterferences();
+    bool splitOperand(Value* value);
+    bool splitResult(Value* phi);
+    bool assignWebLocals();
+
+    void emitBlock(Block* block);
+    void emitDefinition(Value* value);
+    void define(Value* value, size_t begin);
+    size_t emitOperands(Value* user);
+    void emitValue(Value* value, std::vector<Instruction*>& target);
+    bool canMove(const Value* value, size_t index);
+    void spill(size_t entry);
+    uint32_t allocate(Value* value, size_t index);
+};
+
+void Linearizer::buildWebs() {
+    size_t count = graph.values.size();
+    parent.resize(count);
+    webSize.assign(count, 1);
+    for (uint32_t id = 0; id < count; ++id) {
+        parent[id] = id;
+    }
+    for (Block* block : graph.layout) {
+        for (Value* phi : block->phis) {
+            for (Value* operand : phi->operands) {
+                unite(phi, operand);
+            }
+        }
+    }
+}
+
+void Linearizer::classify() {
+    size_t count = graph.values.size();
+    floating.assign(count, 0);
+    stacked.assign(count, 0);
+    position.assign(count, -1);
+    for (Value* parameter : graph.parameters) {
+        position[parameter->id] = -2;
+    }
+    for (Block* block : graph.layout) {
+        int64_t size = block->operations.size();
+        for (int64_t i = 0; i < size; ++i) {
+            position[block->operations[i]->id] = i;
+        }
+        position[block->control->id] = size;
+        for (size_t i = 0; i < block->copies.size(); ++i) {
+            position[block->copies[i]->id] = size + 1 + i;
+        }
+    }
+
+    auto singleUserNext = [](const Value* value) {
+        if (value->users.size() != 1) {
+            return false;
+        }
+        const Value* user = value->users[0];
+        return user->block == value->block &&
+               (user->kind == Value::Kind::OPERATION || user->kind == Value::Kind::CONTROL);
+    };
+    for (Block* block : graph.layout) {
+        if (block->results.size() == 1) {
+            Value* result = block->results[0];
+            stacked[result->id] = !inWeb(result) && singleUserNext(result);
+        }
+        for (Value* value : block->operations) {
+            if (value->kind != Value::Kind::OPERATION || isConstant(value) || inWeb(value) || !singleUserNext(value)) {
+                continue;
+            }
+            floating[value->id] = isMovable(value) &&
+                std::all_of(value->operands.begin(), value->operands.end(), [&](const Value* operand) {
+                    return isConstant(operand) || floating[operand->id] || hasLocal(operand);
+                });
+            stacked[value->id] = !floating[value->id];
+        }
+    }
+}
+
+// Values of a web share a local, so no two of them may be alive at the same time. Liveness is
+// computed per block over the web members only, a use by a phi counts at the end of the
+// corresponding predecessor.
+bool Linearizer::resolveInterferences() {
+    std::vector<const Value*> members;
+    std::vector<int64_t> memberOf(graph.values.size(), -1);
+    auto consider = [&](const Value* value) {
+        if (inWeb(value)) {
+            memberOf[value->id] = members.size();
+            members.push_back(value);
+        }
+    };
+    for (Value* parameter : graph.parameters) {
+        consider(parameter);
+    }
+    for (Block* block : graph.layout) {
+        for (Value* value : block->phis) consider(value);
+        for (Value* value : block->results) consider(value);
+        for (Value* value : block->operations) consider(value);
+        for (Value* value : block->copies) consider(value);
+    }
+    if (members.empty()) {
+        return true;
+    }
+
+    size_t words = (members.size() + 63) / 64;
+    size_t blockCount = graph.layout.size();
+    typedef std::vector<uint64_t> Set;
+    std::vector<Set> upward(blockCount, Set(words)), defined(blockCount, Set(words)), phiOut(blockCount, Set(words));
+    std::vector<Set> liveIn(blockCount, Set(words)), liveOut(blockCount, Set(words));
+    std::vector<std::vector<std::pair<int64_t, uint32_t>>> uses(blockCount), definitions(blockCount);
+    auto set = [](Set& s, size_t bit) { s[bit / 64] |= 1ull << (bit % 64); };
+    auto test = [](const Set& s, size_t bit) { return (s[bit / 64] >> (bit % 64)) & 1; };
+
+    for (size_t m = 0; m < members.size(); ++m) {
+        const Value* member = members[m];
+        uint32_t at = member->block->layout;
+        definitions[at].emplace_back(position[member->id], m);
+        set(defined[at], m);
+        for (const Value* user : member->users) {
+            if (user->kind == Value::Kind::PHI) {
+                const auto& predecessors = user->block->predecessors;
+                for (size_t k = 0; k < user->operands.size(); ++k) {
+                    if (user->operands[k] == member) {
+                        set(phiOut[predecessors[k]->layout], m);
+                    }
+                }
+            } else if (!isConstant(member)) {
+                uses[user->block->layout].emplace_back(usePosition(user), m);
+                if (user->block != member->block) {
+                    set(upward[user->block->layout], m);
+                }
+            }
+        }
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t b = blockCount; b-- > 0;) {
+            Block* block = graph.layout[b];
+            Set out = phiOut[b];
+            for (Block* successor : block->successors) {
+                for (size_t w = 0; w < words; ++w) {
+                    out[w] |= liveIn[successor->layout][w];
+                }
+            }
+            Set in(words);
+            for (size_t w = 0; w < words; ++w) {
+                in[w] = upward[b][w] | (out[w] & ~defined[b][w]);
+            }
+            if (in != liveIn[b] || out != liveOut[b]) {
+                liveIn[b] = std::move(in);
+                liveOut[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<std::vector<uint32_t>> webMembers(graph.values.size());
+    for (size_t m = 0; m < members.size(); ++m) {
+        webMembers[find(members[m]->id)].push_back(m);
+    }
+
+    std::vector<std::pair<Value*, Value*>> conflicts;
+    for (size_t b = 0; b < blockCount; ++b) {
+        Set live = liveOut[b];
+        auto& blockUses = uses[b];
+        auto& blockDefinitions = definitions[b];
+        auto later = [](const std::pair<int64_t, uint32_t>& x, const std::pair<int64_t, uint32_t>& y) {
+            return x.first > y.first;
+        };
+        std::sort(blockUses.begin(), blockUses.end(), later);
+        std::sort(blockDefinitions.begin(), blockDefinitions.end(), later);
+        auto check = [&](uint32_t m) {
+            for (uint32_t other : webMembers[find(members[m]->id)]) {
+                if (other != m && test(live, other)) {
+                    conflicts.emplace_back(const_cast<Value*>(members[m]), const_cast<Value*>(members[other]));
+                }
+            }
+        };
+
+        size_t u = 0, d = 0;
+        while (d < blockDefinitions.size() && blockDefinitions[d].first >= 0) {
+            int64_t at = blockDefinitions[d].first;
+            while (u < blockUses.size() && blockUses[u].first > at) {
+                set(live, blockUses[u++].second);
+            }
+            for (; d < blockDefinitions.size() && blockDefinitions[d].first == at; ++d) {
+                check(blockDefinitions[d].second);
+                live[blockDefinitions[d].second / 64] &= ~(1ull << (blockDefinitions[d].second % 64));
+            }
+        }
+        for (; u < blockUses.size(); ++u) {
+            set(live, blockUses[u].second);
+        }
+        // phis, results and parameters are all defined at the start of the block
+        for (; d < blockDefinitions.size(); ++d) {
+            check(blockDefinitions[d].second);
+        }
+    }
+    if (conflicts.empty()) {
+        return true;
+    }
+
+    split.clear();
+    for (auto [defined, alive] : conflicts) {
+        if (split.contains(defined) || split.contains(alive)) {
+            continue;
+        }
+        bool done;
+        if (defined->kind != Value::Kind::PHI && defined->kind != Value::Kind::COPY) {
+            done = splitOperand(defined);
+        } else if (alive->kind != Value::Kind::PHI && alive->kind != Value::Kind::COPY) {
+            done = splitOperand(alive);
+        } else if (defined->kind == Value::Kind::PHI) {
+            done = splitResult(defined);
+        } else if (alive->kind == Value::Kind::PHI) {
+            done = splitResult(alive);
+        } else {
+            done = false;
+        }
+        if (!done) {
+            failed = true;
+            return false;
+        }
+    }
+    return false;
+}
+
+// a value that is an operand of phis is copied into their local at the end of the predecessors
+bool Linearizer::splitOperand(Value* value) {
+    split.insert(value);
+    std::vector<Value*> users = value->users;
+    bool changed = false;
+    for (Value* user : users) {
+        if (user->kind != Value::Kind::PHI) {
+            continue;
+        }
+        for (size_t k = 0; k < user->operands.size(); ++k) {
+            if (user->operands[k] != value) {
+                continue;
+            }
+            Block* predecessor = user->block->predecessors[k];
+            Value* copy = graph.makeValue(Value::Kind::COPY, value->type, predecessor);
+            graph.addOperand(copy, value);
+            user->operands[k] = copy;
+            copy->users.push_back(user);
+            value->users.erase(std::find(value->users.begin(), value->users.end(), user));
+            predecessor->copies.push_back(copy);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// everything but other phis reads the phi from a copy made right at the start of its block
+bool Linearizer::splitResult(Value* phi) {
+    split.insert(phi);
+    std::vector<Value*> users;
+    for (Value* user : phi->users) {
+        if (user->kind != Value::Kind::PHI) {
+            users.push_back(user);
+        }
+    }
+    if (users.empty()) {
+        return false;
+    }
+    Value* copy = graph.makeValue(Value::Kind::COPY, phi->type, phi->block);
+    for (Value* user : users) {
+        *std::find(user->operands.begin(), user->operands.end(), phi) = copy;
+        copy->users.push_back(user);
+        phi->users.erase(std::find(phi->users.begin(), phi->users.end(), user));
+    }
+    graph.addOperand(copy, phi);
+    phi->block->operations.insert(phi->block->operations.begin(), copy);
+    return true;
+}
+
+bool Linearizer::assignWebLocals() {
+    webLocal.assign(graph.values.size(), Value::NO_LOCAL);
+    for (Value* parameter : graph.parameters) {
+        if (!inWeb(parameter)) {
+            continue;
+        }
+        uint32_t& local = webLocal[find(parameter->id)];
+        if (local != Value::NO_LOCAL) {
+            return false;
+        }
+        local = parameter->local;
+    }
+    for (Block* block : graph.layout) {
+        for (auto list : { &block->phis, &block->results, &block->operations, &block->copies }) {
+            for (Value* value : *list) {
+                if (!inWeb(value)) {
+                    continue;
+                }
+                uint32_t& local = webLocal[find(value->id)];
+                if (local == Value::NO_LOCAL) {
+                    local = types.size();
+                    types.push_back(value->type);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool Linearizer::run(std::vector<Instruction*>& body, std::vector<uint8_t>& localTypes) {
+    parameterCount = graph.parameters.size();
+    graph.eliminateDeadValues();
+    for (int round = 0;; ++round) {
+        buildWebs();
+        classify();
+        if (resolveInterferences()) {
+            break;
+        }
+        if (failed || round == MAX_SPLIT_ROUNDS) {
+            return false;
+        }
+    }
+
+    types.assign(graph.localTypes.begin(), graph.localTypes.begin() + parameterCount);
+    if (!assignWebLocals()) {
+        return false;
+    }
+    localOf.assign(graph.values.size(), Value::NO_LOCAL);
+    definedAt.assign(graph.values.size(), -1);
+    pendingUses.assign(graph.values.size(), 0);
+    freeLocals.assign(256, {});
+    for (Block* block : graph.layout) {
+        emitBlock(block);
+        if (failed || !stack.empty()) {
+            return false;
+        }
+    }
+
+    body.clear();
+    for (size_t i = 0; i < out.size(); ++i) {
+        auto code = inserted.find(i);
+        if (code != inserted.end()) {
+            body.insert(body.end(), code->second.begin(), code->second.end());
+        }
+        if (out[i] != nullptr) {
+            body.push_back(out[i]);
+        }
+    }
+    localTypes = std::move(types);
+    return true;
+}
+
+void Linearizer::emitBlock(Block* block) {
+    // the results of the construct that just ended are on the stack, the last one on top
+    for (auto result = block->results.rbegin(); result != block->results.rend(); ++result) {
+        define(*result, NO_BEGIN);
+    }
+    for (Value* value : block->operations) {
+        emitDefinition(value);
+    }
+    emitOperands(block->control);
+    for (Value* copy : block->copies) {
+        emitDefinition(copy);
+    }
+    out.push_back(block->control->instruction);
+}
+
+void Linearizer::emitDefinition(Value* value) {
+    if (value->kind == Value::Kind::COPY) {
+        emitValue(value->operands[0], out);
+        define(value, NO_BEGIN);
+        return;
+    }
+    if (floating[value->id] || (isConstant(value) && !inWeb(value))) {
+        return;     // emitted where it is used
+    }
+    if (value->implicitZero && webLocal[find(value->id)] >= parameterCount) {
+        return;     // the local is zero already
+    }
+    size_t begin = emitOperands(value);
+    out.push_back(isConstant(value) ? graph.arena->make<Instruction>(*value->instruction) : value->instruction);
+    define(value, begin);
+}
+
+void Linearizer::define(Value* value, size_t begin) {
+    if (value->type == 0) {
+        return;
+    }
+    uint32_t local;
+    if (inWeb(value)) {
+        local = webLocal[find(value->id)];
+    } else if (value->users.empty()) {
+        out.push_back(makeInstruction(graph.arena, InstructionType::INSTRUCTION_WITHOUT_PARAMETER, DROP));
+        return;
+    } else if (stacked[value->id]) {
+        stack.push_back({ value, out.size(), begin });
+        out.push_back(nullptr);
+        return;
+    } else {
+        local = allocate(value, out.size());
+    }
+    definedAt[value->id] = out.size();
+    out.push_back(makeInstruction(graph.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, local));
+}
+
+// Puts the operands of a user on the stack and returns where the code computing them begins.
+// Stacked operands must be right on top of the stack in order, whatever comes in front of one of
+// them is inserted in front of the code computing it (if it is available there already).
+size_t Linearizer::emitOperands(Value* user) {
+    const auto& operands = user->operands;
+    auto pending = [&](const Value* value) {
+        return std::find_if(stack.begin(), stack.end(), [&](const Pending& entry) { return entry.value == value; });
+    };
+
+    std::vector<size_t> onStack;
+    for (size_t i = 0; i < operands.size(); ++i) {
+        if (pending(operands[i]) != stack.end()) {
+            onStack.push_back(i);
+        }
+    }
+    bool ordered = stack.size() >= onStack.size();
+    for (size_t k = 0; ordered && k < onStack.size(); ++k) {
+        ordered = stack[stack.size() - onStack.size() + k].value == operands[onStack[k]];
+    }
+    // the stacked operand each of the others has to go in front of
+    std::vector<size_t> before(operands.size(), NO_BEGIN);
+    for (size_t i = 0, k = 0; ordered && i < operands.size(); ++i) {
+        if (k < onStack.size() && onStack[k] == i) {
+            ++k;
+        } else if (k < onStack.size()) {
+            before[i] = stack[stack.size() - onStack.size() + k].begin;
+            ordered = before[i] != NO_BEGIN && canMove(operands[i], before[i]);
+        }
+    }
+    if (!ordered) {
+        for (size_t i : onStack) {
+            spill(pending(operands[i]) - stack.begin());
+        }
+        onStack.clear();
+        before.assign(operands.size(), NO_BEGIN);
+    }
+
+    size_t begin = onStack.empty() ? out.size() : stack[stack.size() - onStack.size()].begin;
+    std::unordered_map<size_t, std::vector<Instruction*>> code;
+    for (size_t i = 0, k = 0; i < operands.size(); ++i) {
+        if (k < onStack.size() && onStack[k] == i) {
+            ++k;
+        } else if (before[i] != NO_BEGIN) {
+            emitValue(operands[i], code[before[i]]);
+        } else {
+            emitValue(operands[i], out);
+        }
+    }
+    for (auto& [index, instructions] : code) {
+        auto& target = inserted[index];
+        target.insert(target.begin(), instructions.begin(), instructions.end());
+    }
+    stack.resize(stack.size() - onStack.size());
+    return begin;
+}
+
+void Linearizer::emitValue(Value* value, std::vector<Instruction*>& target) {
+    if (isConstant(value)) {
+        target.push_back(graph.arena->make<Instruction>(*value->instruction));
+        return;
+    }
+    if (floating[value->id]) {
+        for (Value* operand : value->operands) {
+            emitValue(operand, target);
+        }
+        target.push_back(value->instruction);
+        return;
+    }
+    uint32_t local = inWeb(value) ? webLocal[find(value->id)] :
+                     value->kind == Value::Kind::PARAMETER ? value->local : localOf[value->id];
+    if (local == Value::NO_LOCAL) {
+        failed = true;
+        return;
+    }
+    target.push_back(makeInstruction(graph.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALGET, local));
+    if (localOf[value->id] != Value::NO_LOCAL && pendingUses[value->id] > 0 && --pendingUses[value->id] == 0 &&
+        isBlockLocal(value)) {
+        freeLocals[value->type].emplace_back(local, out.size());
+    }
+}
+
+// a value read at index (earlier than where it is used) has to be in its local already there
+bool Linearizer::canMove(const Value* value, size_t index) {
+    if (isConstant(value)) {
+        return true;
+    }
+    if (floating[value->id]) {
+        return std::all_of(value->operands.begin(), value->operands.end(), [&](const Value* operand) {
+            return canMove(operand, index);
+        });
+    }
+    return definedAt[value->id] < (int64_t)index;
+}
+
+void Linearizer::spill(size_t entry) {
+    Pending pending = stack[entry];
+    stack.erase(stack.begin() + entry);
+    uint32_t local = allocate(pending.value, pending.slot);
+    definedAt[pending.value->id] = pending.slot;
+    out[pending.slot] = makeInstruction(graph.arena, InstructionType::INSTRUCTION_WITH_PARAMETER, LOCALSET, local);
+}
+
+// a local for a value that isn't in a web, stored at index: one freed before that if it never
+// leaves its block
+uint32_t Linearizer::allocate(Value* value, size_t index) {
+    pendingUses[value->id] = value->users.size();
+    if (isBlockLocal(value)) {
+        auto& locals = freeLocals[value->type];
+        for (auto local = locals.begin(); local != locals.end(); ++local) {
+            if (local->second < index) {
+                localOf[value->id] = local->first;
+                locals.erase(local);
+                return localOf[value->id];
+            }
+        }
+    }
+    localOf[value->id] = types.size();
+    types.push_back(value->type);
+    return localOf[value->id];
+}
+
+bool Graph::linearize(std::vector<Instruction*>& body, std::vector<uint8_t>& localTypes) {
+    return Linearizer(*this).run(body, localTypes);
+}
+
+}
@@ -0,0 +1,136 @@
+#ifndef __SSA_H__
+#define __SSA_H__
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+#include <vector>
+#include "AST_Types.h"
+#include "arena.h"
+#include "instruction.h"
+
+// Static single assignment form of a function body, for the optimizations that need more than a
+// peephole. The straight-line code between two control instructions is a Block, everything an
+// instruction computes is a Value and locals are resolved to the Values stored into them, with
+// phis where control flow joins. The control instructions themselves stay as they are:
+// linearize() puts the Values back in between them, on the stack where the order allows and in
+// locals where it doesn't.
+namespace ssa {
+
+struct Block;
+
+struct Value {
+    static constexpr uint32_t NO_LOCAL = 0xFFFFFFFF;
+
+    enum class Kind : uint8_t {
+        PARAMETER,  // a parameter of the function, lives in its local
+        PHI,        // the value of a local where control flow joins, one operand per predecessor
+        RESULT,     // a result of a block, loop or if: on the stack after its end
+        OPERATION,  // anything an instruction computes
+        CONTROL,    // the control instruction at the end of a block, with what it takes from the stack
+        COPY,       // added when leaving SSA form: the operand, copied into another local
+    };
+
+    Kind kind;
+    uint8_t type = 0;               // value type, 0 when nothing is pushed
+    uint32_t id = 0;
+    Block* block = nullptr;
+    Instruction* instruction = nullptr;     // OPERATION and CONTROL
+    const opcodes::OpcodeInfo* info = nullptr;
+    std::vector<Value*> operands;
+    std::vector<Value*> users;      // once for every operand that refers to this value
+    Value* replacement = nullptr;   // set when the value was replaced by an equal one
+    uint32_t local = NO_LOCAL;      // PARAMETER
+    bool implicitZero = false;      // the zero a declared local holds before its first store
+    bool removed = false;
+};
+
+struct Block {
+    uint32_t id = 0;
+    uint32_t layout = 0;                // position in the function body
+    std::vector<Value*> phis;
+    std::vector<Value*> results;        // RESULT values, bottom of the stack first
+    std::vector<Value*> operations;     // in the order they are emitted
+    std::vector<Value*> copies;         // COPY values emitted right before the control instruction
+    Value* control = nullptr;
+    std::vector<Block*> predecessors;
+    std::vector<Block*> successors;
+    Block* dominator = nullptr;
+
+    // construction: the current value of every local stored to in this block
+    bool sealed = false;
+    std::vector<std::pair<uint32_t, Value*>> definitions;
+    std::vector<std::pair<uint32_t, Value*>> incompletePhis;
+};
+
+// A loop construct: the header is the block right after the loop instruction, the preheader the
+// block in front of it and the body every block from the header up to the loop's end.
+struct Loop {
+    Block* preheader;
+    Block* header;
+    uint32_t first;
+    uint32_t last;
+};
+
+class Graph {
+public:
+    Graph(Arena* arena, const AST_Function* function, const std::vector<AST_Function*>& functions,
+          const std::vector<uint8_t>& localTypes);
+
+    // false when the body uses something the graph can't represent (the body is left alone then)
+    bool build(const std::vector<Instruction*>& body);
+
+    // global value numbering: pure operations equal to one that dominates them are replaced by it
+    int numberValues();
+    // loop invariant code motion: pure operations on values from outside a loop move in front of it
+    int hoistInvariants();
+    // phis of a single value (copies between locals) are replaced by that value
+    int propagateCopies();
+
+    // writes the optimized body and the types of all its locals, parameters first
+    bool linearize(std::vector<Instruction*>& body, std::vector<uint8_t>& localTypes);
+
+    // local to local copies in the original body, they don't survive the round trip through SSA form
+    int getCopies() const { return copies; }
+
+private:
+    friend class Linearizer;
+
+    Arena* arena;
+    const AST_Function* function;
+    const std::vector<AST_Function*>& functions;
+    std::vector<uint8_t> localTypes;
+    std::deque<Value> values;       // a deque so that the pointers into it stay valid
+    std::deque<Block> blocks;
+    std::vector<Block*> layout;
+    std::vector<Loop> loops;
+    std::vector<Value*> parameters;
+    std::vector<Value*> filling;    // phis that are getting their operands right now
+    Block* entry = nullptr;
+    int copies = 0;
+    bool failed = false;
+
+    Value* makeValue(Value::Kind kind, uint8_t type, Block* block);
+    Block* makeBlock();
+    void start(Block* block);
+    void addOperand(Value* user, Value* operand);
+    void replace(Value* value, Value* by);
+    void remove(Value* value);
+    void link(Block* from, Block* to, size_t resultCount);
+    void seal(Block* block);
+
+    void writeLocal(uint32_t index, Block* block, Value* value);
+    Value* readLocal(uint32_t index, Block* block);
+    Value* readLocalRecursive(uint32_t index, Block* block);
+    Value* addPhiOperands(uint32_t index, Value* phi);
+    Value* removeTrivialPhi(Value* phi);
+    int removeTrivialPhis();
+
+    void computeDominators();
+    bool dominates(const Block* a, const Block* b) const;
+    void eliminateDeadValues();
+};
+
+}
+
+#endif // __SSA_H__
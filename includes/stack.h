@@ -1,3 +1,6 @@
+#ifndef SEIS_JARNETHYS_MARTIJNSNOEKS_STACK_H
+#define SEIS_JARNETHYS_MARTIJNSNOEKS_STACK_H
+
 #include <vector>
 #include <variant>
 #include "Variable.h"
@@ -25,4 +28,6 @@ public:
     void printAll();
     void removeRange(int start, int end);
     std::vector<Variable> data() { return vector; }
-};
\ No newline at end of file
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <functional>
+#include "symbols.h"
+
+Interner::Interner() : names(1), hashes(1), slots(64, NO_SYMBOL) {}
+
+Symbol Interner::intern(std::string_view text) {
+    size_t hash = std::hash<std::string_view>{}(text);
+    size_t slot = probe(text, hash);
+    if (slots[slot] != NO_SYMBOL) {
+        return slots[slot];
+    }
+    Symbol symbol = names.size();
+    names.push_back(text);
+    hashes.push_back(hash);
+    slots[slot] = symbol;
+    // at most half full, so that probing stays short
+    if (names.size() * 2 > slots.size()) {
+        grow();
+    }
+    return symbol;
+}
+
+Symbol Interner::find(std::string_view text) const {
+    return slots[probe(text, std::hash<std::string_view>{}(text))];
+}
+
+size_t Interner::probe(std::string_view text, size_t hash) const {
+    size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        Symbol symbol = slots[slot];
+        if (symbol == NO_SYMBOL || (hashes[symbol] == hash && names[symbol] == text)) {
+            return slot;
+        }
+    }
+}
+
+void Interner::grow() {
+    slots.assign(slots.size() * 2, NO_SYMBOL);
+    size_t mask = slots.size() - 1;
+    for (Symbol symbol = 1; symbol < names.size(); ++symbol) {
+        size_t slot = hashes[symbol] & mask;
+        while (slots[slot] != NO_SYMBOL) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = symbol;
+    }
+}
+
+bool SymbolTable::bind(Symbol symbol, uint32_t index) {
+    if (symbol >= indices.size()) {
+        indices.resize(std::max<size_t>(symbol + 1, indices.size() * 2), UNBOUND);
+    }
+    if (indices[symbol] != UNBOUND) {
+        return false;
+    }
+    indices[symbol] = index;
+    bound.push_back(symbol);
+    return true;
+}
+
+void SymbolTable::clear() {
+    for (Symbol symbol : bound) {
+        indices[symbol] = UNBOUND;
+    }
+    bound.clear();
+}
+
+uint32_t TypeTable::intern(const std::vector<VariableType>& parameters, const std::vector<VariableType>& results) {
+    uint64_t key = hash(parameters, results);
+    // equal types the module declared twice share a hash, the first one counts
+    uint32_t first = UINT32_MAX;
+    auto [begin, end] = byHash.equal_range(key);
+    for (auto found = begin; found != end; ++found) {
+        const AST_Type& type = types[found->second];
+        if (found->second < first && type.parameters == parameters && type.results == results) {
+            first = found->second;
+        }
+    }
+    return first != UINT32_MAX ? first : add({ parameters, results });
+}
+
+uint32_t TypeTable::add(const AST_Type& type) {
+    uint32_t index = types.size();
+    types.push_back(type);
+    byHash.emplace(hash(type.parameters, type.results), index);
+    return index;
+}
+
+// FNV-1a over the value types, with the number of parameters in front so that (i32) -> () and
+// () -> (i32) differ
+uint64_t TypeTable::hash(const std::vector<VariableType>& parameters, const std::vector<VariableType>& results) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto combine = [&hash](uint64_t value) { hash = (hash ^ value) * 0x100000001B3ull; };
+    combine(parameters.size());
+    for (VariableType type : parameters) {
+        combine((uint64_t)type + 1);
+    }
+    for (VariableType type : results) {
+        combine((uint64_t)type + 1);
+    }
+    return hash;
+}
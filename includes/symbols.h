@@ -0,0 +1,72 @@
+#ifndef __SYMBOLS_H__
+#define __SYMBOLS_H__
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "AST_Types.h"
+
+// Identifiers ($names) as small integers. The Parser interns a name once where it reads it, what
+// the name stands for is then an index into a SymbolTable: no more hashing or comparing of text.
+typedef uint32_t Symbol;
+inline constexpr Symbol NO_SYMBOL = 0;
+
+// The text is not copied, it has to outlive the Interner (the source of the Lexer does).
+class Interner {
+public:
+    Interner();
+
+    Symbol intern(std::string_view text);
+    // NO_SYMBOL for text that was never interned
+    Symbol find(std::string_view text) const;
+    std::string_view name(Symbol symbol) const { return names[symbol]; }
+    size_t size() const { return names.size() - 1; }
+
+private:
+    std::vector<std::string_view> names;    // by symbol, NO_SYMBOL's is empty
+    std::vector<size_t> hashes;             // by symbol
+    std::vector<Symbol> slots;              // open addressing, a power of two of them, NO_SYMBOL if free
+
+    // the slot text is in, or the free one it goes into
+    size_t probe(std::string_view text, size_t hash) const;
+    void grow();
+};
+
+// What the symbols of one kind of name (functions, the locals of a function, ...) stand for: an
+// index in their index space. clear() only resets the symbols that were bound, so that one table
+// can be used for the locals of every function in turn.
+class SymbolTable {
+public:
+    static constexpr uint32_t UNBOUND = UINT32_MAX;
+
+    // false when the symbol was bound already
+    bool bind(Symbol symbol, uint32_t index);
+    uint32_t find(Symbol symbol) const { return symbol < indices.size() ? indices[symbol] : UNBOUND; }
+    void clear();
+
+private:
+    std::vector<uint32_t> indices;  // by symbol
+    std::vector<Symbol> bound;
+};
+
+// Function types by index, equal signatures are found through a hash of them
+class TypeTable {
+public:
+    // the index of the first type with this signature, a new one if there is none yet
+    uint32_t intern(const std::vector<VariableType>& parameters, const std::vector<VariableType>& results);
+    // a new type even if there is an equal one, for the types a module declares: they keep their index
+    uint32_t add(const AST_Type& type);
+
+    size_t size() const { return types.size(); }
+    const AST_Type& operator[](size_t index) const { return types[index]; }
+    const std::vector<AST_Type>& getTypes() const { return types; }
+
+private:
+    std::vector<AST_Type> types;
+    std::unordered_multimap<uint64_t, uint32_t> byHash;
+
+    static uint64_t hash(const std::vector<VariableType>& parameters, const std::vector<VariableType>& results);
+};
+
+#endif // __SYMBOLS_H__
@@ -0,0 +1,35 @@
+#ifndef __TESTING_H__
+#define __TESTING_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "lexer.h"
+#include "parser.h"
+#include "compiler.h"
+
+// What the tests compile their modules in the text format with: the binary the Compiler writes,
+// with its default passes or without any. The source is lexed in place as the Parser reads it.
+// edit, if given, changes the parsed module before it is compiled, e.g. into one the Parser
+// wouldn't give.
+inline std::vector<uint8_t> compile(const std::string& source, bool optimize = true,
+                                    void (*edit)(const AST_Module&) = nullptr) {
+    Lexer lexer = Lexer{reinterpret_cast<const uint8_t*>(source.data()), source.size()};
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
+    parser.parseProper();
+    if (edit != nullptr) {
+        edit(parser.getModule());
+    }
+    Compiler compiler = Compiler(parser.getModule(), &arena);
+    if (!optimize) {
+        compiler.getPassManager() = PassManager();
+    }
+    ByteStream* output = compiler.compile();
+    std::vector<uint8_t> binary(output->getTotalByteCount());
+    std::memcpy(binary.data(), output->getBuffer(), binary.size());
+    return binary;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t workers) {
+    for (size_t i = 0; i < workers; ++i) {
+        threads.emplace_back(&ThreadPool::work, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    available.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+size_t ThreadPool::defaultWorkers() {
+    unsigned cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+void ThreadPool::submit(std::function<void(size_t)> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+        pending++;
+    }
+    available.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (pending > 0) {
+        if (!tasks.empty()) {
+            runNext(lock, size());
+        } else {
+            finished.wait(lock);
+        }
+    }
+    if (failure) {
+        std::exception_ptr thrown = failure;
+        failure = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void ThreadPool::work(size_t index) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        available.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) {
+            return;
+        }
+        runNext(lock, index);
+    }
+}
+
+// called and returns with the lock held, the task itself runs without it
+void ThreadPool::runNext(std::unique_lock<std::mutex>& lock, size_t index) {
+    std::function<void(size_t)> task = std::move(tasks.front());
+    tasks.pop_front();
+    lock.unlock();
+    std::exception_ptr thrown;
+    try {
+        task(index);
+    } catch (...) {
+        thrown = std::current_exception();
+    }
+    lock.lock();
+    if (thrown && !failure) {
+        failure = thrown;
+    }
+    if (--pending == 0) {
+        finished.notify_all();
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads for work that splits into tasks, like the function bodies of a module. A task
+// gets the index of the thread it runs on, so it can keep state per thread (an Arena, say) without
+// locking: the workers are 0 to size() - 1 and size() is the thread in wait(), which runs tasks as
+// well. Tasks may submit more tasks. Without workers (a single core, or a build without threads)
+// wait() runs all of them. One thread at a time may wait() on a pool.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t workers = defaultWorkers());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // the threads besides the one in wait() that is there on every core
+    static size_t defaultWorkers();
+
+    size_t size() const { return threads.size(); }
+    void submit(std::function<void(size_t)> task);
+    // returns once every task submitted so far, and those they submitted, finished; rethrows the
+    // first exception a task threw
+    void wait();
+
+private:
+    std::vector<std::thread> threads;
+    std::deque<std::function<void(size_t)>> tasks;
+    std::mutex mutex;
+    std::condition_variable available;  // a task was submitted, or the pool stops
+    std::condition_variable finished;   // nothing is pending anymore
+    size_t pending = 0;                 // submitted and not finished yet
+    bool stopping = false;
+    std::exception_ptr failure;
+
+    void work(size_t index);
+    void runNext(std::unique_lock<std::mutex>& lock, size_t index);
+};
+
+#endif // __THREADPOOL_H__
@@ -1,8 +1,13 @@
 // Based on example on Toledo
 
+#ifndef __TOKEN_H__
+#define __TOKEN_H__
+
 #include "bytestream.h"
 #include <cstdint>
 #include <algorithm>
+#include <string_view>
+#include "opcodes.h"
 
 class Character {
     
@@ -30,29 +35,62 @@ class Character {
         static bool isNumeric(unsigned char candidate) {
             return (candidate >= '0' && candidate <= '9');
         }
+
+        // https://webassembly.github.io/spec/core/text/values.html#text-idchar
+        static bool isIdChar(unsigned char candidate) {
+            return candidate > ' ' && candidate < 0x7F &&
+                candidate != '"' && candidate != ',' && candidate != ';' &&
+                candidate != '(' && candidate != ')' && candidate != '[' && candidate != ']' &&
+                candidate != '{' && candidate != '}';
+        }
 };
 
-// TODO: support more number types than just uint32_t
 enum class TokenType { BRACKETS_OPEN, BRACKETS_CLOSED, KEYWORD, STRING, NUMBER, VARIABLE };
+enum class NumberType : uint8_t { NONE, INTEGER, FLOAT };
 
+// Tokens don't own their text: string_value is a view into the source buffer of the Lexer, which
+// has to outlive the tokens. Numbers carry their parsed value next to the text, keywords that are
+// instructions their index in opcodes::TABLE.
 class Token {
 public:
-    Token(TokenType type, std::string string_value) : type( type ), string_value( string_value ) {}
-    Token(TokenType type, uint32_t uint32_value) : type( type ), uint32_value( uint32_value ) {}
-    Token(TokenType type, double double_value) : type( type ), double_value( double_value ) {}
-
-    ~Token(){};
+    Token() : type( TokenType::KEYWORD ), integer_value( 0 ) {}
+    Token(TokenType type, std::string_view string_value) : type( type ), string_value( string_value ), integer_value( 0 ) {}
+    Token(TokenType type, std::string_view string_value, uint64_t integer_value)
+        : type( type ), number_type( NumberType::INTEGER ), string_value( string_value ), integer_value( integer_value ) {}
+    Token(TokenType type, std::string_view string_value, double double_value)
+        : type( type ), number_type( NumberType::FLOAT ), string_value( string_value ), double_value( double_value ) {}
 
     TokenType type;
+    NumberType number_type = NumberType::NONE;
+    uint16_t opcode = opcodes::NOT_AN_OPCODE;
+    std::string_view string_value;
+    union {
+        uint64_t integer_value;
+        double double_value;
+    };
 
-    // union was messing seriously with ability to store in std::vector<Token>, complaining about copy ctor
-    // if extending with more types, should probably have a union or inheritance approach!
-    // union {
-    //     std::string string_value;
-    //     uint32_t uint32_value;
-    // };
-
-    std::string string_value;
-    uint32_t uint32_value;
-    double double_value;
+    int64_t asInteger() const { return number_type == NumberType::FLOAT ? (int64_t)double_value : (int64_t)integer_value; }
+    double asDouble() const { return number_type == NumberType::FLOAT ? double_value : (double)(int64_t)integer_value; }
+    const opcodes::OpcodeInfo* asOpcode() const { return opcode == opcodes::NOT_AN_OPCODE ? nullptr : &opcodes::TABLE[opcode]; }
 };
+
+// FNV-1a over the type and text of tokens, e.g. of everything that defines a function: source that
+// differs only in whitespace and comments hashes the same
+inline constexpr uint64_t TOKEN_HASH_SEED = 0xCBF29CE484222325ull;
+
+inline uint64_t hashToken(uint64_t hash, const Token& token) {
+    auto combine = [&hash](const void* data, size_t size) {
+        auto bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+        }
+    };
+    uint64_t type = (uint64_t)token.type;
+    uint64_t size = token.string_value.size();
+    combine(&type, sizeof(type));
+    combine(&size, sizeof(size));
+    combine(token.string_value.data(), token.string_value.size());
+    return hash;
+}
+
+#endif // __TOKEN_H__
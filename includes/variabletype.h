@@ -1,6 +1,6 @@
 #ifndef _VariableType_
 #define _VariableType_
 
-enum class VariableType { is_int32, is_int64, isfloat32_t, isfloat64_t };
+enum class VariableType { is_int32, is_int64, isfloat32_t, isfloat64_t, isv128_t };
 
 #endif
@@ -1,8 +1,259 @@
 #include "../includes/bytestream.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <random>
+#include <stdexcept>
 
-int main() {
-    ByteStream bs("./number");
+// the decoders as they were, one readByte() per byte: what the new ones are checked and timed against
+int64_t referenceInt64(ByteStream& stream) {
+    int64_t result{0};
+    int shift{0};
+    uint8_t byte;
+    do
+    {
+        byte = stream.readByte();
+        result |= ((int64_t)(byte & 0b0111'1111) << shift);
+        shift += 7;
+    } while ((byte & 0b1000'0000) != 0);
+
+    if ((shift < 64) && ((byte & 0b0100'0000) == 0b0100'0000)) {
+        result |= ((int64_t)~0 << shift);
+    }
+    return result;
+}
+
+uint64_t referenceUInt64(ByteStream& stream) {
+    uint64_t result{0};
+    int shift{0};
+    while (true) {
+        uint8_t byte = stream.readByte();
+        result |= ((uint64_t)(byte & 0b0111'1111) << shift);
+        if ((byte & 0b1000'0000) == 0) {
+            break;
+        }
+        shift += 7;
+    }
+    return result;
+}
+
+// unsigned LEB128 of a 64 bit value, encodeUInt32() only takes 32 bits
+int encodeUInt64(uint64_t value, uint8_t* out) {
+    int count = 0;
+    do {
+        out[count++] = (value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+    } while (value != 0);
+    return count;
+}
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        if (++failures <= 10) {
+            std::cout << "FAILED: " << what << std::endl;
+        }
+    }
+}
+
+template <typename Read>
+bool throwsOutOfRange(std::vector<uint8_t> bytes, Read read) {
+    ByteStream stream(bytes);
+    try {
+        read(stream);
+    } catch (const std::out_of_range&) {
+        return true;
+    }
+    return false;
+}
+
+// the 32 bit values from first to last, signed and unsigned, a block of them per stream
+void check32(uint64_t first, uint64_t last) {
+    const uint64_t block = 1 << 20;
+    std::vector<uint8_t> unsignedBytes(block * 5), signedBytes(block * 5);
+    for (; first < last; first += block) {
+        int unsignedSize = 0, signedSize = 0;
+        for (uint64_t value = first; value < first + block; ++value) {
+            unsignedSize += ByteStream::encodeUInt32((uint32_t)value, unsignedBytes.data() + unsignedSize);
+            signedSize += ByteStream::encodeInt64((int32_t)(uint32_t)value, signedBytes.data() + signedSize);
+        }
+        ByteStream unsignedStream(unsignedBytes.data(), unsignedSize);
+        ByteStream signedStream(signedBytes.data(), signedSize);
+        for (uint64_t value = first; value < first + block; ++value) {
+            uint32_t decoded = unsignedStream.readUInt32();
+            int32_t decodedSigned = signedStream.readInt32();
+            if (decoded != (uint32_t)value || decodedSigned != (int32_t)(uint32_t)value) {
+                check(false, "32 bit value " + std::to_string(value));
+            }
+        }
+        check(unsignedStream.atEnd() && signedStream.atEnd(), "32 bit block " + std::to_string(first));
+    }
+}
+
+// every bit boundary and its neighbours, and random values of every length, for 64 bits and the
+// lower 32 bits of them
+void check64() {
+    std::vector<uint64_t> values;
+    for (int bit = 0; bit < 64; ++bit) {
+        for (int64_t delta = -2; delta <= 2; ++delta) {
+            values.push_back((1ull << bit) + delta);
+            values.push_back(-(1ull << bit) + delta);
+        }
+    }
+    std::mt19937_64 random(64);
+    for (int i = 0; i < 1'000'000; ++i) {
+        values.push_back(random() >> (random() % 64));
+        values.push_back(-(random() >> (random() % 64)));
+    }
+
+    std::vector<uint8_t> unsignedBytes(values.size() * 15), signedBytes(values.size() * 15);
+    int unsignedSize = 0, signedSize = 0;
+    for (uint64_t value : values) {
+        unsignedSize += encodeUInt64(value, unsignedBytes.data() + unsignedSize);
+        unsignedSize += ByteStream::encodeUInt32((uint32_t)value, unsignedBytes.data() + unsignedSize);
+        signedSize += ByteStream::encodeInt64((int64_t)value, signedBytes.data() + signedSize);
+        signedSize += ByteStream::encodeInt64((int32_t)value, signedBytes.data() + signedSize);
+    }
+    ByteStream unsignedStream(unsignedBytes.data(), unsignedSize);
+    ByteStream signedStream(signedBytes.data(), signedSize);
+    for (uint64_t value : values) {
+        if (unsignedStream.readUInt64() != value || unsignedStream.readUInt32() != (uint32_t)value) {
+            check(false, "unsigned value " + std::to_string(value));
+        }
+        if (signedStream.readInt64() != (int64_t)value || signedStream.readInt32() != (int32_t)value) {
+            check(false, "signed value " + std::to_string((int64_t)value));
+        }
+    }
+}
+
+// numbers of every length at the end of the stream, where there are fewer than 8 bytes to load
+void checkEnd() {
+    for (int length = 1; length <= 10; ++length) {
+        uint64_t value = length == 10 ? ~0ull : (1ull << (7 * length - 1));
+        uint8_t encoded[10];
+        int size = encodeUInt64(value, encoded);
+        for (int before = 0; before < 10; ++before) {
+            std::vector<uint8_t> bytes(before, 0x7f);
+            bytes.insert(bytes.end(), encoded, encoded + size);
+            ByteStream stream(bytes);
+            stream.seek(before);
+            check(stream.readUInt64() == value && stream.atEnd(), "at the end, length " + std::to_string(length));
+            stream.setByteIndex(before);
+            ByteStream reference(bytes);
+            reference.seek(before);
+            check(stream.readInt64() == referenceInt64(reference), "signed at the end, length " + std::to_string(length));
+
+            // without its last byte
+            bytes.pop_back();
+            check(throwsOutOfRange(bytes, [before](ByteStream& s) { s.seek(before); s.readUInt64(); }),
+                  "truncated, length " + std::to_string(length));
+        }
+    }
+}
+
+// a file read into a stream is in its buffer, not only reserved: bytes written after it follow it
+void checkFile() {
+    const std::string path = "./stream.wasm";
+    std::vector<uint8_t> bytes = { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0xe5, 0x8e, 0x26 };
+    std::ofstream(path, std::ios::binary).write((const char*)bytes.data(), bytes.size());
+    ByteStream constructed(path);
+    ByteStream read;
+    read.readFile(path);
+    std::remove(path.c_str());
+    for (ByteStream* stream : { &constructed, &read }) {
+        stream->seek(8);
+        check(stream->readUInt32() == 624485 && stream->atEnd(), "read from a file");
+        stream->writeByte(0x2a);
+        std::vector<uint8_t> buffer(stream->getBuffer(), stream->getBuffer() + stream->getTotalByteCount());
+        bytes.push_back(0x2a);
+        check(buffer == bytes, "written after a file");
+        bytes.pop_back();
+    }
+}
+
+void checkMalformed() {
+    // padded with continuation bytes is fine as long as the length allows it
+    ByteStream padded(std::vector<uint8_t>{ 0x80, 0x80, 0x80, 0x80, 0x00, 0xff, 0x7f });
+    check(padded.readUInt32() == 0 && padded.readInt32() == -1, "padded numbers");
+
+    std::vector<uint8_t> long32{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0, 0, 0, 0 };
+    check(throwsOutOfRange(long32, [](ByteStream& s) { s.readUInt32(); }), "unsigned 32 bit of 6 bytes");
+    check(throwsOutOfRange(long32, [](ByteStream& s) { s.readInt32(); }), "signed 32 bit of 6 bytes");
+    std::vector<uint8_t> long64(10, 0x80);
+    long64.push_back(0x00);
+    check(throwsOutOfRange(long64, [](ByteStream& s) { s.readUInt64(); }), "unsigned 64 bit of 11 bytes");
+    check(throwsOutOfRange(long64, [](ByteStream& s) { s.readInt64(); }), "signed 64 bit of 11 bytes");
+    check(throwsOutOfRange(std::vector<uint8_t>{}, [](ByteStream& s) { s.readUInt32(); }), "empty stream");
+}
+
+// decodes the numbers of the stream again and again, returns nanoseconds per number
+template <typename Read>
+double measure(std::vector<uint8_t>& bytes, size_t count, Read read) {
+    ByteStream stream(bytes);
+    uint64_t sum = 0;
+    const int rounds = 20;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        stream.setByteIndex(0);
+        for (size_t i = 0; i < count; ++i) {
+            sum += read(stream);
+        }
+    }
+    auto time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (sum == 42) {
+        std::cout << std::endl;
+    }
+    return time / (rounds * count);
+}
+
+// lengths as in code sections: mostly indices and small constants of a byte, some offsets and
+// larger constants; and numbers of several bytes only
+void benchmark() {
+    std::mt19937_64 random(41);
+    for (bool mixed : { true, false }) {
+        const size_t count = 1'000'000;
+        std::vector<uint8_t> unsignedBytes(count * 10), signedBytes(count * 10);
+        int unsignedSize = 0, signedSize = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int bits = mixed ? (random() % 100 < 80 ? 6 : 6 + random() % 26) : 8 + random() % 48;
+            uint64_t value = random() & ((1ull << bits) - 1);
+            unsignedSize += ByteStream::encodeUInt32((uint32_t)value, unsignedBytes.data() + unsignedSize);
+            signedSize += ByteStream::encodeInt64(random() % 2 ? -(int64_t)value : value, signedBytes.data() + signedSize);
+        }
+        unsignedBytes.resize(unsignedSize);
+        signedBytes.resize(signedSize);
+
+        std::cout << (mixed ? "mostly 1 byte:" : "2 to 8 bytes: ") << std::fixed;
+        std::cout.precision(2);
+        std::cout << " unsigned " << measure(unsignedBytes, count, referenceUInt64) << " -> "
+                  << measure(unsignedBytes, count, [](ByteStream& s) { return s.readUInt32(); }) << " ns,";
+        std::cout << " signed " << measure(signedBytes, count, referenceInt64) << " -> "
+                  << measure(signedBytes, count, [](ByteStream& s) { return s.readInt64(); }) << " ns" << std::endl;
+    }
+}
+
+// "./main.out all" checks every 32 bit value (minutes), by default those of up to 24 bits, as
+// unsigned and signed (both signs), and random ones of every length
+int main(int argc, char** argv) {
+    std::ifstream file("./number", std::ios::binary);
+    ByteStream bs(std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {}));
     std::cout << bs.readInt64() << std::endl;
-    return 0;
-}
\ No newline at end of file
+
+    checkMalformed();
+    checkEnd();
+    checkFile();
+    check64();
+    if (argc > 1 && std::string(argv[1]) == "all") {
+        check32(0, 1ull << 32);
+    } else {
+        check32(0, 1ull << 24);
+        check32((1ull << 32) - (1ull << 24), 1ull << 32);
+    }
+    std::cout << (failures == 0 ? "all values decoded" : std::to_string(failures) + " failures") << std::endl;
+
+    benchmark();
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+
+// Compiles a generated module of many functions, then the same module with one function edited,
+// both through one CompileCache, and checks the second one against a compilation without cache.
+// Then a module again with a global and a type in front of the ones its function refers to by name,
+// which the same tokens of the function encode with other indices, and one whose function takes its
+// signature from a type that changes, which the tokens of the function don't show at all.
+
+std::string generate(int functions, int edited) {
+    std::string source = "(module\n";
+    for (int i = 0; i < functions; ++i) {
+        source += "  (func ";
+        if (i == functions - 1) {
+            source += "(export \"last\") ";
+        }
+        source += "(param i32) (result i32) (local $t i32)\n";
+        source += "    local.get 0\n";
+        source += "    i32.const " + std::to_string(i == edited ? 1000 : i * 7 + 1) + "\n";
+        source += "    i32.mul\n";
+        source += "    local.set $t\n";
+        source += "    i32.const 3\n";
+        source += "    i32.const 4\n";
+        source += "    i32.add\n";
+        source += "    local.get $t\n";
+        source += "    i32.add\n";
+        if (i > 0 && i % 4 != 0) {
+            source += "    call " + std::to_string(i - 1) + "\n";
+        }
+        source += "  )\n";
+    }
+    return source + ")\n";
+}
+
+// the function uses a global, a type and a block type that the TypeTable interns, all by name
+std::string indexed(const std::string& inFront) {
+    return "(module\n" + inFront + R"(
+  (global $g i32 (i32.const 5))
+  (type $t (func (param i32) (result i32)))
+  (table 1 funcref)
+  (elem (i32.const 0) $id)
+  (func $id (param i32) (result i32) (local.get 0))
+  (func (export "last") (param i32) (result i32)
+    (global.get $g)
+    (call_indirect (type $t) (local.get 0) (i32.const 0))
+    (block (param i32 i32) (result i32 i32))
+    (i32.add))
+)
+)";
+}
+
+// local 1 is a declared local with one parameter, the second parameter with two
+std::string retyped(const std::string& params) {
+    return "(module\n  (type $t (func (param " + params + R"() (result i32)))
+  (func (export "f") (type $t) (local i32) (local.get 1))
+)
+)";
+}
+
+struct Result {
+    std::vector<uint8_t> binary;
+    double milliseconds;
+};
+
+Result compile(const std::string& source, CompileCache* cache) {
+    auto start = std::chrono::steady_clock::now();
+    Lexer lexer = Lexer{reinterpret_cast<const uint8_t*>(source.data()), source.size()};
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
+    parser.parseProper();
+
+    Compiler compiler = Compiler(parser.getModule(), &arena);
+    if (cache != nullptr) {
+        cache->prepare(parser.getFunctions());
+        compiler.setCache(cache);
+    }
+    ByteStream* output = compiler.compile();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> binary(output->getTotalByteCount());
+    std::memcpy(binary.data(), output->getBuffer(), binary.size());
+    return { binary, elapsed.count() };
+}
+
+int32_t run(std::vector<uint8_t>& binary) {
+    Module module(binary.data(), binary.size());
+    Stack arguments;
+    arguments.push(5);
+    module("last", arguments);
+    return std::get<int32_t>(module.getResults(1)[0]);
+}
+
+int main(int argc, char** argv) {
+    int functions = argc > 1 ? std::stoi(argv[1]) : 2000;
+    std::string original = generate(functions, -1);
+    std::string edited = generate(functions, functions / 2);
+
+    CompileCache cache;
+    Result cold = compile(original, &cache);
+    size_t missesBefore = cache.getMisses();
+    Result warm = compile(edited, &cache);
+    Result fresh = compile(edited, nullptr);
+
+    std::cout << "functions:     " << functions << ", " << cache.size() << " cache entries" << std::endl;
+    std::cout << "cold:          " << cold.milliseconds << " ms" << std::endl;
+    std::cout << "one edited:    " << warm.milliseconds << " ms, " << cache.getMisses() - missesBefore
+              << " functions compiled" << std::endl;
+    std::cout << "without cache: " << fresh.milliseconds << " ms" << std::endl;
+
+    if (warm.binary != fresh.binary) {
+        std::cout << "the module from the cache differs from the one compiled without" << std::endl;
+        return 1;
+    }
+    int32_t result = run(warm.binary);
+    if (result != run(fresh.binary)) {
+        std::cout << "results differ" << std::endl;
+        return 1;
+    }
+    std::cout << "same module, result " << result << ", " << fresh.milliseconds / warm.milliseconds
+              << "x faster" << std::endl;
+
+    CompileCache shifted;
+    compile(indexed(""), &shifted);
+    std::string inFront = "  (global $h i32 (i32.const 9))\n  (type $u (func (param i64)))\n";
+    Result moved = compile(indexed(inFront), &shifted);
+    Result uncached = compile(indexed(inFront), nullptr);
+    if (moved.binary != uncached.binary || run(moved.binary) != 10) {
+        std::cout << "the cache kept indices of a global or type that moved" << std::endl;
+        return 1;
+    }
+    std::cout << "a global and a type in front: same module as without the cache" << std::endl;
+
+    CompileCache signatures;
+    compile(retyped("i32"), &signatures);
+    Result changed = compile(retyped("i32 i32"), &signatures);
+    Result plain = compile(retyped("i32 i32"), nullptr);
+    Module module(changed.binary.data(), changed.binary.size());
+    Stack arguments;
+    arguments.push(1);
+    arguments.push(42);
+    module("f", arguments);
+    if (changed.binary != plain.binary || std::get<int32_t>(module.getResults(1)[0]) != 42) {
+        std::cout << "the cache kept a function whose type changed" << std::endl;
+        return 1;
+    }
+    std::cout << "a type that changed: same module as without the cache" << std::endl;
+    return 0;
+}
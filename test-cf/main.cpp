@@ -1,4 +1,5 @@
 #include "../includes/module.h"
+#include <cstring>
 #include <iostream>
 #include <time.h>
 #include "../includes/lexer.h"
@@ -16,28 +17,29 @@ extern "C" {
     }
 }
 
+// the same module mostly comes in again with a function edited, the others are taken from here
+CompileCache cache;
+
 int compile(uint8_t *data, int size, char *name, int32_t *int32Input, int64_t *int64Input, float32_t *float32Input, float64_t *float64Input,
                 int32_t *int32Output, int64_t *int64Output, float32_t *float32Output, float64_t *float64Output, uint8_t *output, int *outputSize) {
-    std::vector<uint8_t> chars;
-    for (int i = 0; i < size; i++) {
-        chars.push_back(data[i]);
-    }
-	Lexer lexer = Lexer{chars};
+    // the parser pulls the tokens from the lexer, which reads the input where it is
+    Lexer lexer = Lexer{data, (size_t)size};
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
 
-    int err = lexer.lex();
-
-    Parser parser = Parser(&lexer);
+    try {
+        parser.parseProper();
+    } catch (const ParseError& error) {
+        std::cout << "Parse error: " << error.what() << std::endl;
+        return -4;
+    }
 
-    parser.parseProper();
-    
-    Compiler compiler = Compiler(parser.getFunctions(), parser.getMemories(), parser.getDatas());
+    Compiler compiler = Compiler(parser.getModule(), &arena);
+    cache.prepare(parser.getFunctions());
+    compiler.setCache(&cache);
     auto compiledOutput = compiler.compile();
 
-    uint8_t *outputbuffer = (uint8_t *)malloc(compiledOutput->getTotalByteCount());
-    compiledOutput->setByteIndex(0);
-    for (int i = 0; i < compiledOutput->getTotalByteCount(); i++) {
-        output[i] = compiledOutput->readByte();
-    }
+    std::memcpy(output, compiledOutput->getBuffer(), compiledOutput->getTotalByteCount());
     *outputSize = compiledOutput->getTotalByteCount();
 
     useModule(compiledOutput->getBuffer(), compiledOutput->getTotalByteCount(), name, int32Input, int64Input, float32Input, float64Input,
@@ -98,23 +100,7 @@ int useModule(uint8_t *data, int size, char *name, int32_t *int32Input, int64_t
     }
 
     module(name, vars);
-    auto results = module.getResults(funcs[choice].getResults().size());
-    for (int i = 0; i < results.size(); i++) {
-        switch (funcs[choice].getResults()[i]) {
-            case VariableType::is_int32:
-                int32Output[i] = std::get<int32_t>(results[i]);
-                std::cout << "int32Output[" << i << "] = " << int32Output[i] << std::endl;
-                break;
-            case VariableType::is_int64:
-                int64Output[i] = std::get<int64_t>(results[i]);
-                break;
-            case VariableType::isfloat32_t:
-                float32Output[i] = std::get<float32_t>(results[i]);
-                break;
-            case VariableType::isfloat64_t:
-                float64Output[i] = std::get<float64_t>(results[i]);
-                break;
-        }
-    }
+    // each result into the next element of the output array of its type
+    module.popResults(int32Output, int64Output, float32Output, float64Output);
     return 0;
 }
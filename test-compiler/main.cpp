@@ -19,16 +19,19 @@ int main() {
 
     std::cout << "DONE LEXING " << std::endl;
 
-    Parser parser = Parser(&lexer);
+    // all AST and Instruction nodes live in the arena and are freed together at the end of main
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
 
     parser.parseProper();
 
     std::cout << "DONE PARSING " << std::endl;
 
-    Compiler compiler = Compiler(parser.getFunctions(), parser.getMemories(), parser.getDatas());
+    Compiler compiler = Compiler(parser.getModule(), &arena);
     compiler.compile();
     compiler.writeFile("output.wasm");
 
     std::cout << "DONE COMPILING " << std::endl;
+    compiler.getPassManager().report(std::cout);
 }
 
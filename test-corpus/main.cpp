@@ -0,0 +1,118 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Runs every line of the manifests test-workload writes next to its modules: against its .wasm in a
+// Module, and against its .wat through the Lexer, Parser and Compiler, plain and optimized. All three
+// have to give the result the generator computed.
+//
+// usage: ./main.out PREFIX...      e.g. ../test-workload/corpus/small for small.{wat,wasm,txt}
+
+std::string readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("can't open " + path);
+    }
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// a manifest line: "loop_3 i32 7 -> 4950007", the arguments all of the one type
+struct Entry {
+    std::string function;
+    std::string type;
+    std::vector<std::string> arguments;
+    std::string expected;
+};
+
+std::vector<Entry> readManifest(const std::string& path) {
+    std::vector<Entry> entries;
+    std::istringstream lines(readFile(path));
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line);
+        Entry entry;
+        words >> entry.function >> entry.type;
+        for (std::string word; words >> word && word != "->";) {
+            entry.arguments.push_back(word);
+        }
+        words >> entry.expected;
+        if (!entry.function.empty()) {
+            entries.push_back(entry);
+        }
+    }
+    return entries;
+}
+
+// the result as the generator writes it
+std::string run(Module& module, const Entry& entry) {
+    Stack stack;
+    for (const std::string& argument : entry.arguments) {
+        if (entry.type == "i32") {
+            stack.push(int32_t(std::stol(argument)));
+        } else if (entry.type == "i64") {
+            stack.push(int64_t(std::stoll(argument)));
+        } else {
+            stack.push(float64_t(std::stod(argument)));
+        }
+    }
+    module(entry.function, stack);
+    Variable result = module.getResults(1)[0];
+    std::ostringstream text;
+    text.precision(17);
+    if (entry.type == "i32") {
+        text << std::get<int32_t>(result);
+    } else if (entry.type == "i64") {
+        text << std::get<int64_t>(result);
+    } else {
+        text << std::get<float64_t>(result);
+    }
+    return text.str();
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string prefix = argv[i];
+        std::vector<Entry> entries = readManifest(prefix + ".txt");
+        std::string wasm = readFile(prefix + ".wasm");
+        std::string wat = readFile(prefix + ".wat");
+
+        int failedBefore = failed;
+        std::vector<std::pair<std::string, std::vector<uint8_t>>> binaries;
+        binaries.emplace_back("wasm", std::vector<uint8_t>(wasm.begin(), wasm.end()));
+        binaries.emplace_back("wat", compile(wat, false));
+        binaries.emplace_back("wat optimized", compile(wat, true));
+        for (auto& [path, binary] : binaries) {
+            Module module(binary.data(), binary.size());
+            for (const Entry& entry : entries) {
+                std::string result = run(module, entry);
+                if (result != entry.expected) {
+                    std::cout << prefix << " (" << path << "): " << entry.function << " returned " << result
+                              << ", expected " << entry.expected << std::endl;
+                    failed++;
+                }
+            }
+        }
+        if (failed == failedBefore) {
+            std::cout << prefix << ": " << entries.size() << " entries, right from the wasm and the wat, plain and optimized"
+                      << std::endl;
+        }
+    }
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include <chrono>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Calls that run in slices: an execution gives the same results as the call that runs at once, several
+// of them run side by side on this one thread, a trap deep in their calls comes out of resume(), and
+// one that is dropped halfway leaves its module usable. A coroutine of the embedder awaits executions
+// that an event loop runs. Last the time the slices cost over the call run at once.
+
+const char* SOURCE = R"(
+(module
+  (import "env" "tick" (func $tick))
+  (table 1 funcref)
+  (elem (i32.const 0) $fib)
+  (type $unary (func (param i32) (result i32)))
+
+  ;; the odd calls go through the table
+  (func $fib (export "fib") (param i32) (result i32)
+    (if (result i32) (i32.lt_s (local.get 0) (i32.const 2))
+      (then (local.get 0))
+      (else (i32.add
+        (call $fib (i32.sub (local.get 0) (i32.const 1)))
+        (call_indirect (type $unary) (i32.sub (local.get 0) (i32.const 2)) (i32.const 0))))))
+
+  (func (export "sum") (param $n i32) (result i64) (local $sum i64)
+    (block $done
+      (loop $next
+        (br_if $done (i32.eqz (local.get $n)))
+        (local.set $sum (i64.add (local.get $sum) (i64.extend_i32_u (local.get $n))))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (call $tick)
+        (br $next)))
+    (local.get $sum))
+
+  (func $fail (param i32) (result i32)
+    (if (i32.eqz (local.get 0)) (then unreachable))
+    (call $fail (i32.sub (local.get 0) (i32.const 1))))
+  (func (export "fail") (param i32) (result i32) (call $fail (local.get 0)))
+)
+)";
+
+int failed = 0;
+int ticks = 0;
+
+void check(bool right, const std::string& what) {
+    if (!right) {
+        std::cout << what << std::endl;
+        failed++;
+    }
+}
+
+Stack stackOf(std::vector<Variable> values) {
+    return Stack(&values);
+}
+
+Variable call(Module& module, const std::string& name, std::vector<Variable> arguments) {
+    module(name, Stack(&arguments));
+    return module.getResults(1)[0];
+}
+
+// the result of an execution run to its end, and how many slices that took
+Variable runSliced(Module& module, const std::string& name, std::vector<Variable> arguments, uint64_t slice, int& slices) {
+    Execution execution = module.start(name, Stack(&arguments), slice);
+    slices = 1;
+    while (!execution.resume()) {
+        slices++;
+    }
+    return module.getResults(1)[0];
+}
+
+// A coroutine of the embedder that suspends on executions only: the event loop resumes those one slice
+// at a time, the task goes on inside the slice its execution returns in.
+struct Task {
+    struct promise_type {
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+struct EventLoop {
+    std::deque<Execution*> running;
+
+    void run() {
+        while (!running.empty()) {
+            Execution* execution = running.front();
+            running.pop_front();
+            // one that is done may be gone already, the coroutine that awaited it went on
+            if (!execution->resume()) {
+                running.push_back(execution);
+            }
+        }
+    }
+};
+
+Task request(EventLoop& loop, Module& module, int32_t n, std::vector<int32_t>& answers) {
+    std::vector<Variable> arguments = { n };
+    Execution execution = module.start("fib", Stack(&arguments), 500);
+    loop.running.push_back(&execution);
+    co_await execution;
+    answers.push_back(std::get<int32_t>(module.getResults(1)[0]));
+
+    Execution trap = module.start("fail", stackOf({ int32_t(3) }), 500);
+    loop.running.push_back(&trap);
+    try {
+        co_await trap;
+        answers.push_back(0);
+    } catch (const FunctionException& e) {
+        answers.push_back(-1);
+    }
+}
+
+int main() {
+    Imports imports;
+    imports.add("env", "tick", [] { ticks++; });
+
+    for (bool optimize : { false, true }) {
+        std::string mode = optimize ? "optimized: " : "interpreted: ";
+        std::vector<uint8_t> binary = compile(SOURCE, optimize);
+        Module module(binary.data(), binary.size(), imports);
+
+        int slices = 0;
+        int32_t fib = std::get<int32_t>(runSliced(module, "fib", { int32_t(15) }, 100, slices));
+        check(fib == 610 && fib == std::get<int32_t>(call(module, "fib", { int32_t(15) })), mode + "fib in slices");
+        check(slices > 100, mode + "fib ran in " + std::to_string(slices) + " slices");
+        ticks = 0;
+        int64_t sum = std::get<int64_t>(runSliced(module, "sum", { int32_t(1000) }, 64, slices));
+        check(sum == 500500 && ticks == 1000, mode + "sum in slices");
+
+        // a slice of one instruction runs
+        check(std::get<int32_t>(runSliced(module, "fib", { int32_t(6) }, 1, slices)) == 8, mode + "slices of one");
+
+        // a trap many calls deep
+        Execution trap = module.start("fail", stackOf({ int32_t(50) }), 10);
+        try {
+            while (!trap.resume()) {
+            }
+            check(false, mode + "the trap didn't come out of resume()");
+        } catch (const FunctionException& e) {
+            check(std::string(e.what()) == "unreachable", mode + "trapped with " + e.what());
+        }
+        check(std::get<int32_t>(call(module, "fib", { int32_t(10) })) == 55, mode + "fib after a trap");
+
+        // a second execution of the module can't start while one is suspended halfway, dropping it ends it
+        {
+            Execution first = module.start("fib", stackOf({ int32_t(20) }), 50);
+            first.resume();
+            try {
+                module.start("fib", stackOf({ int32_t(1) }), 50);
+                check(false, mode + "a second execution started");
+            } catch (const ModuleException&) {
+            }
+        }
+        check(std::get<int32_t>(call(module, "fib", { int32_t(10) })) == 55, mode + "fib after a dropped execution");
+    }
+
+    // executions of several modules side by side, each with its own result
+    std::vector<uint8_t> binary = compile(SOURCE, true);
+    std::deque<Module> modules;    // a module doesn't move, its functions point into it
+    std::vector<Execution> executions;
+    for (int i = 0; i < 4; ++i) {
+        modules.emplace_back(binary.data(), binary.size(), imports);
+    }
+    for (int i = 0; i < 4; ++i) {
+        executions.push_back(modules[i].start("fib", stackOf({ int32_t(12 + i) }), 200));
+    }
+    int unfinished = 0;
+    for (bool busy = true; busy;) {
+        busy = false;
+        for (Execution& execution : executions) {
+            if (!execution.done() && !execution.resume()) {
+                busy = true;
+                unfinished++;
+            }
+        }
+    }
+    const int32_t FIBS[] = { 144, 233, 377, 610 };
+    for (int i = 0; i < 4; ++i) {
+        check(std::get<int32_t>(modules[i].getResults(1)[0]) == FIBS[i], "side by side: fib " + std::to_string(12 + i));
+    }
+    check(unfinished > 4, "side by side: they didn't take turns");
+
+    // coroutines of the embedder that await them
+    EventLoop loop;
+    std::vector<int32_t> answers[2];
+    Module first(binary.data(), binary.size(), imports);
+    Module second(binary.data(), binary.size(), imports);
+    request(loop, first, 18, answers[0]);
+    request(loop, second, 8, answers[1]);
+    loop.run();
+    check(answers[0] == std::vector<int32_t>{ 2584, -1 } && answers[1] == std::vector<int32_t>{ 21, -1 },
+          "awaited executions gave the wrong answers");
+
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "executions in slices gave the results of calls, side by side and awaited" << std::endl;
+
+    Module module(binary.data(), binary.size(), imports);
+    auto start = std::chrono::steady_clock::now();
+    call(module, "fib", { int32_t(25) });
+    auto middle = std::chrono::steady_clock::now();
+    int slices = 0;
+    runSliced(module, "fib", { int32_t(25) }, 10000, slices);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "fib(25) called: " << std::chrono::duration<double, std::milli>(middle - start).count() << " ms, in "
+              << slices << " slices of 10000: " << std::chrono::duration<double, std::milli>(end - middle).count() << " ms"
+              << std::endl;
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Globals of every type: a stack pointer in memory as compiled C code keeps one, constants, globals
+// the embedder gives and sets, and a mutable global one module exports and another imports, which
+// both change. A global.set of an immutable global is refused by the parser and, in a binary, when
+// the module is loaded, as are imports of globals that are missing or of another type. Last the time
+// of a loop that moves the stack pointer.
+
+const char* SOURCE = R"(
+(module
+  (import "env" "base" (global $base i32))
+  (import "env" "scale" (global $scale (mut f64)))
+  (memory 1)
+  (global $sp (export "sp") (mut i32) (i32.const 4096))
+  (global $big i64 (i64.const 4294967296))
+  (global $half f32 (f32.const 0.5))
+  (global $counter (export "counter") (mut i32) (i32.const 0))
+
+  ;; a frame of 16 bytes on the stack in memory for each call, its argument kept in it
+  (func $frame (export "frame") (param i32) (result i32) (local $fp i32)
+    (global.set $sp (local.tee $fp (i32.sub (global.get $sp) (i32.const 16))))
+    (i32.store (local.get $fp) (local.get 0))
+    (if (i32.gt_s (local.get 0) (i32.const 0))
+      (then (drop (call $frame (i32.sub (local.get 0) (i32.const 1))))))
+    (i32.load (local.get $fp))
+    (global.set $sp (i32.add (local.get $fp) (i32.const 16))))
+
+  (func (export "count") (result i32)
+    (global.set $counter (i32.add (global.get $counter) (i32.const 1)))
+    (global.get $counter))
+  (func (export "constants") (result i64)
+    (i64.add (global.get $big) (i64.extend_i32_s (global.get $base))))
+  (func (export "halved") (param f32) (result f32) (f32.mul (local.get 0) (global.get $half)))
+  (func (export "scaled") (param f64) (result f64) (f64.mul (local.get 0) (global.get $scale)))
+  (func (export "setScale") (param f64) (global.set $scale (local.get 0)))
+
+  (func (export "spin") (param $n i32) (result i32)
+    (block $done
+      (loop $next
+        (br_if $done (i32.eqz (local.get $n)))
+        (global.set $sp (i32.sub (global.get $sp) (i32.const 16)))
+        (global.set $sp (i32.add (global.get $sp) (i32.const 16)))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (br $next)))
+    (global.get $sp))
+)
+)";
+
+const char* IMPORTER = R"(
+(module
+  (import "a" "counter" (global $counter (mut i32)))
+  (func (export "bump") (result i32)
+    (global.set $counter (i32.add (global.get $counter) (i32.const 10)))
+    (global.get $counter))
+)
+)";
+
+int failed = 0;
+
+// a binary the parser wouldn't write: global.set of an immutable global
+void immutable(const AST_Module& module) {
+    for (AST_Global* global : module.globals) {
+        global->isMutable = false;
+    }
+}
+
+void check(bool right, const std::string& what) {
+    if (!right) {
+        std::cout << what << std::endl;
+        failed++;
+    }
+}
+
+// the message of the ParseError the source gives, empty without one
+std::string parseError(const std::string& source) {
+    try {
+        compile(source, false);
+        return "";
+    } catch (const ParseError& e) {
+        return e.what();
+    }
+}
+
+bool refused(std::vector<uint8_t> binary, const Imports& imports) {
+    try {
+        Module module(binary.data(), binary.size(), imports);
+        return false;
+    } catch (const ModuleException&) {
+        return true;
+    }
+}
+
+int main() {
+    auto scale = std::make_shared<Global>(VariableType::isfloat64_t, true, 2.0);
+    Imports imports;
+    imports.addGlobal("env", "base", std::make_shared<Global>(VariableType::is_int32, false, int32_t(-6)));
+    imports.addGlobal("env", "scale", scale);
+
+    for (bool optimize : { false, true }) {
+        std::string mode = optimize ? "optimized: " : "interpreted: ";
+        std::vector<uint8_t> binary = compile(SOURCE, optimize);
+        std::deque<Module> modules;     // a module doesn't move, its functions point into it
+        Module& module = modules.emplace_back(binary.data(), binary.size(), imports);
+
+        auto frame = module.getTypedFunc<int32_t(int32_t)>("frame");
+        std::shared_ptr<Global> sp = module.getGlobal("sp");
+        check(frame(10) == 10 && std::get<int32_t>(sp->value) == 4096, mode + "frames on the stack in memory");
+
+        check(module.getTypedFunc<int64_t()>("constants")() == 4294967290, mode + "constants");
+        check(module.getTypedFunc<float32_t(float32_t)>("halved")(3.0f) == 1.5f, mode + "f32 constant");
+
+        // the embedder's global, set on both sides
+        scale->value = 3.0;
+        auto scaled = module.getTypedFunc<float64_t(float64_t)>("scaled");
+        check(scaled(1.5) == 4.5, mode + "a global the embedder set");
+        module.getTypedFunc<void(float64_t)>("setScale")(0.25);
+        check(std::get<float64_t>(scale->value) == 0.25 && scaled(8.0) == 2.0, mode + "a global the module set");
+
+        // the counter of one module, imported by two others
+        auto count = module.getTypedFunc<int32_t()>("count");
+        check(count() == 1 && count() == 2, mode + "counter");
+        std::vector<uint8_t> importer = compile(IMPORTER, optimize);
+        Imports shared;
+        shared.addGlobal("a", "counter", module.getGlobal("counter"));
+        Module& first = modules.emplace_back(importer.data(), importer.size(), shared);
+        Module& second = modules.emplace_back(importer.data(), importer.size(), shared);
+        auto bumpFirst = first.getTypedFunc<int32_t()>("bump");
+        auto bumpSecond = second.getTypedFunc<int32_t()>("bump");
+        check(bumpFirst() == 12 && bumpSecond() == 22 && count() == 23 && bumpFirst() == 33,
+              mode + "a counter shared by three modules");
+
+        try {
+            module.getGlobal("counted");
+            check(false, mode + "a global that isn't exported was found");
+        } catch (const ModuleException&) {
+        }
+    }
+
+    // refused by the parser
+    check(parseError("(module (global $g i32 (i32.const 1)) (func (global.set $g (i32.const 2))))").find("immutable") !=
+              std::string::npos,
+          "global.set of an immutable global was parsed");
+    check(parseError("(module (func (global.set $g (i32.const 2))) (global $g i32 (i32.const 1)))").find("immutable") !=
+              std::string::npos,
+          "global.set of an immutable global further down was parsed");
+    check(!parseError("(module (global i32 (i64.const 1)))").empty(), "a value of another type was parsed");
+    check(!parseError("(module (global i32 (i32.add (i32.const 1) (i32.const 2))))").empty(), "a value that isn't constant was parsed");
+    check(!parseError("(module (global i32 (i32.const 1)) (import \"a\" \"b\" (global i32)))").empty(),
+          "an import after a global was parsed");
+
+    // refused when loaded
+    Imports constant;
+    constant.addGlobal("a", "counter", std::make_shared<Global>(VariableType::is_int32, false, int32_t(0)));
+    check(refused(compile(IMPORTER, false, immutable), constant), "a binary that sets an immutable global was loaded");
+    std::vector<uint8_t> binary = compile(SOURCE, false);
+    check(refused(binary, Imports()), "a module was loaded without its globals");
+    Imports wrong = imports;
+    wrong.addGlobal("env", "base", std::make_shared<Global>(VariableType::is_int64, false, int64_t(-6)));
+    check(refused(binary, wrong), "a global of another type was imported");
+    wrong = imports;
+    wrong.addGlobal("env", "scale", std::make_shared<Global>(VariableType::isfloat64_t, false, 2.0));
+    check(refused(binary, wrong), "an immutable global was imported as a mutable one");
+
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "globals read and set, shared between modules and the embedder; immutable ones refused" << std::endl;
+
+    binary = compile(SOURCE, true);
+    Module module(binary.data(), binary.size(), imports);
+    auto spin = module.getTypedFunc<int32_t(int32_t)>("spin");
+    const int ITERATIONS = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    int32_t sp = spin(ITERATIONS);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "1M x moving the stack pointer: " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms (" << sp << ")" << std::endl;
+    return 0;
+}
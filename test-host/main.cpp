@@ -0,0 +1,159 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Host functions a module imports: lambdas, a plain function and an object with state, each with the
+// types deduced from its C++ signature; one that reads the memory of the module that calls it; one in
+// a table, called through call_indirect. Imports of the wrong type are refused when the module is
+// loaded, ones that aren't provided trap when called. Last the time of a loop of host calls. The
+// exports are named apart from the imports, a module finds a function by either name.
+
+const char* SOURCE = R"(
+(module
+  (import "env" "add" (func $add (param i32 i32) (result i32)))
+  (import "env" "scale" (func $scale (param f64) (result f64)))
+  (import "env" "wide" (func $wide (param i64 f32) (result i64)))
+  (import "env" "count" (func $count))
+  (import "env" "total" (func $total (result i32)))
+  (import "env" "print" (func $print (param i32 i32)))
+  (import "env" "missing" (func $missing (param i32) (result i32)))
+  (memory 1)
+  (data (i32.const 16) "hello, host")
+  (table 1 funcref)
+  (elem (i32.const 0) $add)
+  (type $binary (func (param i32 i32) (result i32)))
+
+  (func (export "call_add") (param i32 i32) (result i32) (call $add (local.get 0) (local.get 1)))
+  (func (export "call_scale") (param f64) (result f64) (f64.add (call $scale (local.get 0)) (f64.const 1)))
+  (func (export "call_wide") (result i64) (call $wide (i64.const 40) (f32.const 2.5)))
+  (func (export "counted") (param $n i32) (result i32)
+    (block $done
+      (loop $next
+        (br_if $done (i32.eqz (local.get $n)))
+        (call $count)
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (br $next)))
+    (call $total))
+  (func (export "call_print") (call $print (i32.const 16) (i32.const 11)))
+  (func (export "indirect") (param i32 i32) (result i32)
+    (call_indirect (type $binary) (local.get 0) (local.get 1) (i32.const 0)))
+  (func (export "call_missing") (result i32) (call $missing (i32.const 1)))
+
+  ;; sums add(i, i) over i below n
+  (func (export "calls") (param $n i32) (result i32) (local $sum i32)
+    (block $done
+      (loop $next
+        (br_if $done (i32.eqz (local.get $n)))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (local.set $sum (i32.add (local.get $sum) (call $add (local.get $n) (local.get $n))))
+        (br $next)))
+    (local.get $sum))
+)
+)";
+
+int64_t wide(int64_t value, float32_t half) {
+    return value + (int64_t)(half * 2);
+}
+
+struct Counter {
+    int32_t calls = 0;
+    void operator()() { calls++; }
+};
+
+int failed = 0;
+
+Variable call(Module& module, const std::string& name, std::vector<Variable> arguments = {}) {
+    module(name, Stack(&arguments));
+    return module.getResults(1)[0];
+}
+
+void check(bool right, const std::string& what) {
+    if (!right) {
+        std::cout << what << std::endl;
+        failed++;
+    }
+}
+
+int main() {
+    // the lambdas hold the counter by reference, a copy would count for itself
+    Counter counter;
+    std::string printed;
+    Imports imports;
+    imports.add("env", "add", [](int32_t a, int32_t b) { return a + b; });
+    imports.add("env", "scale", [factor = 2.5](float64_t value) { return value * factor; });
+    imports.add("env", "wide", wide);
+    imports.add("env", "count", [&counter] { counter(); });
+    imports.add("env", "total", [&counter] { return counter.calls; });
+    imports.add("env", "print", [&printed](Memory& memory, int32_t address, int32_t length) {
+        printed.assign((const char*)memory.data() + address, length);
+    });
+
+    for (bool optimize : { false, true }) {
+        std::string mode = optimize ? "optimized: " : "interpreted: ";
+        std::vector<uint8_t> binary = compile(SOURCE, optimize);
+        Module module(binary.data(), binary.size(), imports);
+        counter.calls = 0;
+        printed.clear();
+
+        check(std::get<int32_t>(call(module, "call_add", { int32_t(40), int32_t(2) })) == 42, mode + "add");
+        check(std::get<float64_t>(call(module, "call_scale", { float64_t(4) })) == 11, mode + "scale");
+        check(std::get<int64_t>(call(module, "call_wide")) == 45, mode + "wide");
+        check(std::get<int32_t>(call(module, "counted", { int32_t(7) })) == 7, mode + "counted");
+        std::vector<Variable> none;
+        module("call_print", Stack(&none));
+        check(printed == "hello, host", mode + "print read '" + printed + "'");
+        check(std::get<int32_t>(call(module, "indirect", { int32_t(5), int32_t(6) })) == 11, mode + "call_indirect of a host function");
+        try {
+            call(module, "call_missing");
+            check(false, mode + "a missing import didn't trap");
+        } catch (const FunctionException&) {
+        }
+        check(std::get<int32_t>(call(module, "call_add", { int32_t(1), int32_t(2) })) == 3, mode + "add after a trap");
+    }
+
+    // the same names with other types, or a memory the module doesn't have
+    std::vector<uint8_t> binary = compile(SOURCE, false);
+    Imports wrong = imports;
+    wrong.add("env", "add", [](int64_t a, int64_t b) { return a + b; });
+    try {
+        Module module(binary.data(), binary.size(), wrong);
+        check(false, "an import of another type was accepted");
+    } catch (const ModuleException&) {
+    }
+    wrong = imports;
+    wrong.add("env", "count", [] { return int32_t(0); });
+    try {
+        Module module(binary.data(), binary.size(), wrong);
+        check(false, "an import with a result too many was accepted");
+    } catch (const ModuleException&) {
+    }
+    std::vector<uint8_t> memoryless = compile(R"((module (import "env" "print" (func (param i32 i32)))))", false);
+    try {
+        Module module(memoryless.data(), memoryless.size(), imports);
+        check(false, "a host function that takes a memory was accepted without one");
+    } catch (const ModuleException&) {
+    }
+
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "host functions called, interpreted and optimized; imports of the wrong type refused" << std::endl;
+
+    binary = compile(SOURCE, true);
+    Module module(binary.data(), binary.size(), imports);
+    auto start = std::chrono::steady_clock::now();
+    int32_t sum = std::get<int32_t>(call(module, "calls", { int32_t(1000000) }));
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "1M host calls: " << std::chrono::duration<double, std::milli>(end - start).count() << " ms (" << sum << ")"
+              << std::endl;
+    return 0;
+}
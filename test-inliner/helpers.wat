@@ -0,0 +1,61 @@
+(module
+  ;; 0: x * x
+  (func (param i32) (result i32)
+    local.get 0
+    local.get 0
+    i32.mul
+  )
+  ;; 1: x mod 1000
+  (func (param i32) (result i32)
+    local.get 0
+    i32.const 1000
+    i32.rem_u
+  )
+  ;; 2: square(a) ^ (b * 31), calls another helper
+  (func (param i32 i32) (result i32) (local $t i32)
+    local.get 0
+    call 0
+    local.set $t
+    local.get 1
+    i32.const 31
+    i32.mul
+    local.get $t
+    i32.xor
+  )
+  ;; 3: |x|
+  (func (param i32) (result i32)
+    local.get 0
+    i32.const 0
+    i32.lt_s
+    if (result i32)
+      i32.const 0
+      local.get 0
+      i32.sub
+    else
+      local.get 0
+    end
+  )
+  (func (export "kernel") (param i32) (result i32) (local $i i32) (local $acc i32)
+    (loop
+      local.get $acc
+      local.get $i
+      call 2
+      call 1
+      i32.const 500
+      local.get $i
+      i32.sub
+      call 3
+      i32.add
+      local.set $acc
+      local.get $i
+      i32.const 1
+      i32.add
+      local.set $i
+      local.get $i
+      local.get 0
+      i32.lt_s
+      br_if 0
+    )
+    local.get $acc
+  )
+)
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+
+// Compiles helpers.wat with the default passes, once without and once with inlining, runs both on
+// the interpreter and compares the calls left in the module, run time and result.
+
+struct Result {
+    int calls;
+    double milliseconds;
+    int32_t value;
+};
+
+Result compileAndRun(bool inlining, int32_t iterations) {
+    Lexer lexer = Lexer{"./helpers.wat"};
+    lexer.lex();
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
+    parser.parseProper();
+
+    Compiler compiler = Compiler(parser.getFunctions(), parser.getMemories(), parser.getDatas(), &arena);
+    if (!inlining) {
+        compiler.getPassManager() = PassManager::createDefault(0, 0);
+    }
+    ByteStream* output = compiler.compile();
+    if (inlining) {
+        compiler.getPassManager().report(std::cout);
+    }
+
+    // the bodies are optimized in place
+    int calls = 0;
+    for (auto function : parser.getFunctions()) {
+        for (auto instruction : *function->body) {
+            calls += instruction->type == InstructionType::INSTRUCTION_WITH_PARAMETER &&
+                     instruction->instruction_code == constants::CALL;
+        }
+    }
+
+    Module module(output->getBuffer(), output->getTotalByteCount());
+    Stack arguments;
+    arguments.push(iterations);
+    auto start = std::chrono::steady_clock::now();
+    module("kernel", arguments);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    return { calls, elapsed.count(), std::get<int32_t>(module.getResults(1)[0]) };
+}
+
+int main(int argc, char** argv) {
+    int32_t iterations = argc > 1 ? std::stoi(argv[1]) : 20000;
+
+    Result called = compileAndRun(false, iterations);
+    Result inlined = compileAndRun(true, iterations);
+
+    std::cout << "without inlining: " << called.calls << " calls, " << called.milliseconds << " ms" << std::endl;
+    std::cout << "with inlining:    " << inlined.calls << " calls, " << inlined.milliseconds << " ms" << std::endl;
+    if (called.value != inlined.value) {
+        std::cout << "results differ: " << called.value << " != " << inlined.value << std::endl;
+        return 1;
+    }
+    std::cout << "result " << inlined.value << " in both, " << called.milliseconds / inlined.milliseconds
+              << "x faster" << std::endl;
+    return 0;
+}
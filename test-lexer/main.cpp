@@ -0,0 +1,127 @@
+#include "../includes/lexer.h"
+#include "../includes/scanner.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+// Checks the Scanner against the byte by byte Character tests, then measures the Lexer in MB/s.
+// usage: ./main.out [file.wat ...] (default: the large workload of ../test-workload)
+
+// every start position, in order and (to test reclassifying earlier blocks) backwards
+template <typename Scan, typename Reference>
+int compare(const char* name, const std::string& text, Scan scan, Reference reference) {
+    int errors = 0;
+    const char* end = text.data() + text.size();
+    Scanner scanner(text.data(), end);
+    for (size_t i = 0; i < 2 * text.size(); ++i) {
+        const char* position = text.data() + (i < text.size() ? i : 2 * text.size() - 1 - i);
+        if (scan(scanner, position, end) != reference(position, end)) {
+            if (errors++ < 5) {
+                std::cout << name << " differs at offset " << position - text.data() << std::endl;
+            }
+        }
+    }
+    return errors;
+}
+
+int checkScanner() {
+    // runs of every character class, so that all block positions see every kind of boundary
+    std::mt19937 random(42);
+    const std::string alphabet[] = { " \t\r\n", "abcxyzABCXYZ019._", "$!#%&*+-/:<=>?@^`|~'\\", "\",;()[]{}", "\x7f\x80\xe9\xff" };
+    std::string text;
+    while (text.size() < (1 << 16) + 13) {
+        const std::string& characters = alphabet[random() % std::size(alphabet)];
+        for (int length = random() % 40; length > 0; --length) {
+            text += characters[random() % characters.size()];
+        }
+    }
+
+    int errors = 0;
+    errors += compare("skipWhitespace", text,
+        [](Scanner& scanner, const char* position, const char*) { return scanner.skipWhitespace(position); }, [](const char* position, const char* end) {
+        while (position < end && Character::isWhitespace(*position)) ++position;
+        return position;
+    });
+    errors += compare("skipIdentifier", text,
+        [](Scanner& scanner, const char* position, const char*) { return scanner.skipIdentifier(position); }, [](const char* position, const char* end) {
+        while (position < end && Character::isWASMIdentifier(*position)) ++position;
+        return position;
+    });
+    errors += compare("skipIdChars", text,
+        [](Scanner& scanner, const char* position, const char*) { return scanner.skipIdChars(position); }, [](const char* position, const char* end) {
+        while (position < end && Character::isIdChar(*position)) ++position;
+        return position;
+    });
+    errors += compare("findEither", text,
+        [](Scanner&, const char* position, const char* end) { return Scanner::findEither(position, end, '"', '\\'); },
+        [](const char* position, const char* end) {
+            while (position < end && *position != '"' && *position != '\\') ++position;
+            return position;
+        });
+    return errors;
+}
+
+// the Scanner alone: alternating whitespace and token runs over the whole file, like the Lexer does
+double scannerThroughput(const std::vector<uint8_t>& source) {
+    const char* begin = reinterpret_cast<const char*>(source.data());
+    const char* end = begin + source.size();
+    size_t runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    Scanner scanner(begin, end);
+    for (const char* position = begin; position < end; ++runs) {
+        position = scanner.skipWhitespace(position);
+        const char* next = scanner.skipIdChars(position);
+        position = next == position ? next + 1 : next;
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return runs > 0 ? source.size() / seconds.count() / (1024 * 1024) : 0;
+}
+
+int main(int argc, char** argv) {
+    std::cout << "scanner: " << Scanner::name() << std::endl;
+    int errors = checkScanner();
+    if (errors > 0) {
+        std::cout << errors << " scanner mismatches" << std::endl;
+        return 1;
+    }
+    std::cout << "scanner matches the Character tests" << std::endl;
+
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        files.push_back("../test-workload/corpus/large.wat");
+    }
+
+    for (const auto& file : files) {
+        std::ifstream input(file, std::ios::binary);
+        if (!input) {
+            std::cout << "can't open " << file << std::endl;
+            return 1;
+        }
+        std::vector<uint8_t> source((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+        const int runs = 10;
+        double best = 0, bestScanner = 0;
+        size_t tokens = 0;
+        for (int run = 0; run < runs; ++run) {
+            Lexer lexer(source);
+            auto start = std::chrono::steady_clock::now();
+            if (lexer.lex() != 0) {
+                std::cout << "lexing " << file << " failed" << std::endl;
+                return 1;
+            }
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            tokens = lexer.getTokens().size();
+            double megabytesPerSecond = source.size() / seconds.count() / (1024 * 1024);
+            best = std::max(best, megabytesPerSecond);
+            bestScanner = std::max(bestScanner, scannerThroughput(source));
+        }
+        std::cout << file << ": " << source.size() << " bytes, " << tokens << " tokens, "
+                  << "lexer " << best << " MB/s, scanner " << bestScanner << " MB/s (best of " << runs << ")" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// memory.copy, memory.fill, memory.init and data.drop on the bytes of a memory: overlapping
+// copies, passive segments, and accesses out of bounds that trap before anything was written. The
+// narrow loads and stores extend and truncate what they move.
+
+const char* SOURCE = R"(
+(module
+  (memory 1 2)
+  (data (i32.const 0) "\01\02\03\04\05\06\07\08")
+  (data $hello "hello world")
+  (func (export "fill") (param i32 i32 i32)
+    (memory.fill (local.get 0) (local.get 1) (local.get 2)))
+  (func (export "copy") (param i32 i32 i32)
+    (memory.copy (local.get 0) (local.get 1) (local.get 2)))
+  (func (export "init") (param i32 i32 i32)
+    (memory.init $hello (local.get 0) (local.get 1) (local.get 2)))
+  (func (export "drop")
+    (data.drop $hello))
+  (func (export "load") (param i32) (result i32)
+    (i32.load (local.get 0)))
+  (func (export "store") (param i32 i32)
+    (i32.store offset=4 (local.get 0) (local.get 1)))
+  (func (export "load8_s") (param i32) (result i32) (i32.load8_s (local.get 0)))
+  (func (export "load8_u") (param i32) (result i32) (i32.load8_u (local.get 0)))
+  (func (export "load16_s") (param i32) (result i32) (i32.load16_s (local.get 0)))
+  (func (export "load16_u") (param i32) (result i32) (i32.load16_u offset=2 (local.get 0)))
+  (func (export "store8") (param i32 i32) (i32.store8 (local.get 0) (local.get 1)))
+  (func (export "store16") (param i32 i32) (i32.store16 (local.get 0) (local.get 1)))
+  ;; the upper half of the i64 a narrow load gave
+  (func (export "high8_s") (param i32) (result i32)
+    (i32.wrap_i64 (i64.shr_u (i64.load8_s (local.get 0)) (i64.const 32))))
+  (func (export "high8_u") (param i32) (result i32)
+    (i32.wrap_i64 (i64.shr_u (i64.load8_u (local.get 0)) (i64.const 32))))
+  (func (export "high16_s") (param i32) (result i32)
+    (i32.wrap_i64 (i64.shr_u (i64.load16_s (local.get 0)) (i64.const 32))))
+  (func (export "high16_u") (param i32) (result i32)
+    (i32.wrap_i64 (i64.shr_u (i64.load16_u (local.get 0)) (i64.const 32))))
+  (func (export "high32_s") (param i32) (result i32)
+    (i32.wrap_i64 (i64.shr_u (i64.load32_s (local.get 0)) (i64.const 32))))
+  (func (export "low32_u") (param i32) (result i32)
+    (i32.wrap_i64 (i64.load32_u (local.get 0))))
+  (func (export "store64") (param i32 i32)
+    (i64.store8 (local.get 0) (i64.extend_i32_s (local.get 1)))
+    (i64.store16 offset=1 (local.get 0) (i64.extend_i32_s (local.get 1)))
+    (i64.store32 offset=3 (local.get 0) (i64.extend_i32_s (local.get 1))))
+  (func (export "grow") (param i32) (result i32)
+    (memory.grow (local.get 0)))
+  (func (export "size") (result i32)
+    (memory.size))
+)
+)";
+
+const char* LARGE = R"(
+(module
+  (memory 1024)
+  (func (export "fill") (param i32 i32 i32)
+    (memory.fill (local.get 0) (local.get 1) (local.get 2)))
+  (func (export "load") (param i32) (result i32)
+    (i32.load (local.get 0)))
+)
+)";
+
+int failures = 0;
+
+int32_t call(Module& module, const std::string& name, std::vector<int32_t> arguments, bool result = true) {
+    Stack stack;
+    for (int32_t argument : arguments) {
+        stack.push(argument);
+    }
+    module(name, stack);
+    return result ? std::get<int32_t>(module.getResults(1)[0]) : 0;
+}
+
+void expect(Module& module, const std::string& name, std::vector<int32_t> arguments, int32_t expected) {
+    int32_t result = call(module, name, arguments);
+    if (result != expected) {
+        std::cout << name << " returned " << result << ", expected " << expected << std::endl;
+        failures++;
+    }
+}
+
+void expectTrap(Module& module, const std::string& name, std::vector<int32_t> arguments) {
+    try {
+        call(module, name, arguments, false);
+    } catch (const MemoryException&) {
+        return;
+    }
+    std::cout << name << " didn't trap" << std::endl;
+    failures++;
+}
+
+int main() {
+    std::vector<uint8_t> binary = compile(SOURCE);
+    Module module(binary.data(), binary.size());
+
+    // the active segment is in memory, overlapping copies in both directions
+    expect(module, "load", { 0 }, 0x04030201);
+    call(module, "copy", { 2, 0, 6 }, false);
+    expect(module, "load", { 0 }, 0x02010201);
+    expect(module, "load", { 4 }, 0x06050403);
+    call(module, "copy", { 0, 2, 6 }, false);
+    expect(module, "load", { 0 }, 0x04030201);
+    expect(module, "load", { 4 }, 0x06050605);
+
+    call(module, "fill", { 100, 0xAB, 8 }, false);
+    expect(module, "load", { 100 }, (int32_t)0xABABABAB);
+    expect(module, "load", { 106 }, 0x0000ABAB);
+
+    // "world" out of the passive segment, nothing more once it was dropped
+    call(module, "init", { 200, 6, 5 }, false);
+    expect(module, "load", { 200 }, 0x6C726F77);
+    expectTrap(module, "init", { 200, 6, 6 });
+    call(module, "drop", {}, false);
+    expectTrap(module, "init", { 200, 0, 1 });
+    call(module, "init", { 200, 0, 0 }, false);
+
+    int32_t end = 65536;
+
+    // narrow: 0x80 and 0x8180 are negative when signed
+    call(module, "store", { 296, (int32_t)0x80818081 }, false);
+    expect(module, "load8_s", { 300 }, -127);
+    expect(module, "load8_u", { 300 }, 0x81);
+    expect(module, "load16_s", { 300 }, (int32_t)0xFFFF8081);
+    expect(module, "load16_u", { 300 }, 0x8081);
+    expect(module, "high8_s", { 300 }, -1);
+    expect(module, "high8_u", { 300 }, 0);
+    expect(module, "high16_s", { 300 }, -1);
+    expect(module, "high16_u", { 300 }, 0);
+    expect(module, "high32_s", { 300 }, -1);
+    expect(module, "low32_u", { 300 }, (int32_t)0x80818081);
+    call(module, "store8", { 300, 0x1234 }, false);
+    expect(module, "load", { 300 }, (int32_t)0x80818034);
+    call(module, "store16", { 302, 0x12345678 }, false);
+    expect(module, "load", { 300 }, 0x56788034);
+    call(module, "store64", { 400, 0x11223344 }, false);
+    expect(module, "load", { 400 }, 0x44334444);
+    expect(module, "load", { 404 }, 0x00112233);
+    expectTrap(module, "load16_s", { end - 1 });
+    expectTrap(module, "store8", { end, 1 });
+
+    // out of bounds, a partial fill or copy would change the last bytes
+    expectTrap(module, "fill", { end - 2, 0xFF, 3 });
+    expectTrap(module, "copy", { end - 2, 0, 3 });
+    expectTrap(module, "copy", { 0, end - 2, 3 });
+    expect(module, "load", { end - 4 }, 0);
+    expectTrap(module, "load", { end - 3 });
+    expectTrap(module, "store", { end - 7, 1 });
+    expectTrap(module, "store", { -1, 1 });
+    call(module, "fill", { end, 0, 0 }, false);
+    expectTrap(module, "fill", { end + 1, 0, 0 });
+
+    expect(module, "size", {}, 1);
+    expect(module, "grow", { 1 }, 1);
+    expect(module, "grow", { 1 }, -1);
+    expect(module, "size", {}, 2);
+    call(module, "store", { end - 4, 42 }, false);
+    expect(module, "load", { end }, 42);
+
+    // all of 64 MiB in one memset
+    std::vector<uint8_t> large = compile(LARGE);
+    Module largeModule(large.data(), large.size());
+    auto start = std::chrono::steady_clock::now();
+    call(largeModule, "fill", { 0, 0x5A, 1024 * 65536 }, false);
+    auto time = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    expect(largeModule, "load", { 1024 * 65536 - 4 }, 0x5A5A5A5A);
+
+    if (failures > 0) {
+        return 1;
+    }
+    std::cout << "bulk memory operations correct, 64 MiB filled in " << (int)time << " us" << std::endl;
+    return 0;
+}
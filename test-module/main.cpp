@@ -44,6 +44,9 @@ int chooseFunction(std::vector<Function> &funcs) {
                 case VariableType::isfloat64_t:
                     std::cout << "f64 ";
                     break;
+                case VariableType::isv128_t:
+                    std::cout << "v128 ";
+                    break;
             }
         }
         std::cout << "\tresults: ";
@@ -61,6 +64,9 @@ int chooseFunction(std::vector<Function> &funcs) {
                 case VariableType::isfloat64_t:
                     std::cout << "f64 ";
                     break;
+                case VariableType::isv128_t:
+                    std::cout << "v128 ";
+                    break;
             }
         }
 
@@ -0,0 +1,183 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Functions with more than one result and blocks, loops and ifs with parameters and results, also
+// where a branch carries several values out; a block type whose index takes two bytes. The results
+// go straight into arrays of their type. Once a module has run, calling it again allocates nothing.
+
+// the block type index of $pair needs a second byte of its s33: types 0 to 63 take one
+std::string types() {
+    std::string declared;
+    for (int i = 0; i < 70; ++i) {
+        declared += "(type (func))\n";
+    }
+    return declared;
+}
+
+const std::string SOURCE = "(module\n" + types() + R"(
+  (type $pair (func (param i32) (result i32 i32)))
+
+  (func $swap (param i32 i32) (result i32 i32) (local.get 1) (local.get 0))
+  (func $divmod (export "divmod") (param i32 i32) (result i32 i32)
+    (i32.div_s (local.get 0) (local.get 1))
+    (i32.rem_s (local.get 0) (local.get 1)))
+  (func (export "mixed") (param i32) (result i32 i64 f64 f32)
+    (local.get 0)
+    (i64.extend_i32_s (i32.mul (local.get 0) (i32.const 2)))
+    (f64.convert_i32_s (i32.mul (local.get 0) (i32.const 3)))
+    (f32.const 0.5))
+
+  (func (export "swapped") (param i32 i32) (result i32)
+    (call $swap (local.get 0) (local.get 1))
+    (i32.sub))
+
+  ;; the block takes its operands from the stack
+  (func (export "blockParams") (param i32 i32) (result i32)
+    (local.get 0) (local.get 1)
+    (block (param i32 i32) (result i32)
+      (i32.add)))
+
+  ;; a loop whose parameter is the running sum: branching back passes it on
+  (func (export "loopParams") (param $n i32) (result i32)
+    (i32.const 0)
+    (loop $next (param i32) (result i32)
+      (i32.add (local.get $n))
+      (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+      (br_if $next (local.get $n))))
+
+  ;; both branches get the parameter, and give two results
+  (func (export "ifParams") (param i32) (result i32)
+    (i32.const 10)
+    (if (param i32) (result i32 i32) (local.get 0)
+      (then (i32.const 1))
+      (else (i32.const 2)))
+    (i32.mul))
+
+  ;; a branch with two values out of a block, what is below them goes
+  (func (export "branchValues") (param i32) (result i32)
+    (block $out (result i32 i32)
+      (i32.const 99)
+      (i32.const 7) (i32.const 8)
+      (br_if $out (local.get 0))
+      (drop) (drop) (drop)
+      (i32.const 1) (i32.const 2))
+    (i32.sub))
+
+  (func (export "typed") (param i32) (result i32)
+    (local.get 0)
+    (block (type $pair)
+      (i32.const 5))
+    (i32.mul))
+
+  (func (export "stack") (result i32 i32 i32)
+    (call $divmod (i32.const 17) (i32.const 5))
+    (call $swap (i32.const 3) (i32.const 4))
+    (drop))
+
+  ;; calls, blocks and loops with parameters, for counting allocations
+  (func (export "steady") (result i32 i64) (local $i i32)
+    (i32.const 0)
+    (loop $next (param i32) (result i32)
+      (call $swap (i32.const 1))
+      (i32.add)
+      (br_if $next (i32.lt_s (local.tee $i (i32.add (local.get $i) (i32.const 1))) (i32.const 50))))
+    (i64.const 5))
+)
+)";
+
+// allocations since the start, for the steady state
+size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* memory = std::malloc(size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+int failed = 0;
+
+void check(bool right, const std::string& what) {
+    if (!right) {
+        std::cout << what << std::endl;
+        failed++;
+    }
+}
+
+int32_t call(Module& module, const std::string& name, std::vector<Variable> arguments) {
+    module(name, Stack(&arguments));
+    int32_t result;
+    module.popResults(&result, nullptr, nullptr, nullptr);
+    return result;
+}
+
+int main() {
+    for (bool optimize : { false, true }) {
+        std::string mode = optimize ? "optimized: " : "interpreted: ";
+        std::vector<uint8_t> binary = compile(SOURCE, optimize);
+        Module module(binary.data(), binary.size());
+
+        std::vector<Variable> arguments = { int32_t(17), int32_t(5) };
+        module("divmod", Stack(&arguments));
+        int32_t quotientRemainder[2];
+        module.popResults(quotientRemainder, nullptr, nullptr, nullptr);
+        check(quotientRemainder[0] == 3 && quotientRemainder[1] == 2, mode + "divmod");
+
+        arguments = { int32_t(7) };
+        module("mixed", Stack(&arguments));
+        int32_t i32;
+        int64_t i64;
+        float32_t f32;
+        float64_t f64;
+        module.popResults(&i32, &i64, &f32, &f64);
+        check(i32 == 7 && i64 == 14 && f64 == 21 && f32 == 0.5f, mode + "mixed results");
+
+        check(call(module, "swapped", { int32_t(3), int32_t(10) }) == 7, mode + "swapped");
+        check(call(module, "blockParams", { int32_t(3), int32_t(4) }) == 7, mode + "block parameters");
+        check(call(module, "loopParams", { int32_t(10) }) == 55, mode + "loop parameters");
+        check(call(module, "ifParams", { int32_t(1) }) == 10 && call(module, "ifParams", { int32_t(0) }) == 20,
+              mode + "if parameters");
+        check(call(module, "branchValues", { int32_t(1) }) == -1 && call(module, "branchValues", { int32_t(0) }) == -1,
+              mode + "values of a branch");
+        check(call(module, "typed", { int32_t(6) }) == 30, mode + "block of a type index");
+
+        std::vector<Variable> none;
+        module("stack", Stack(&none));
+        Variable results[3];
+        module.popResults(results, 3);
+        check(std::get<int32_t>(results[0]) == 3 && std::get<int32_t>(results[1]) == 2 && std::get<int32_t>(results[2]) == 4,
+              mode + "results of calls in a row");
+
+        // warmed up, the stack and the labels have their room
+        module("steady", Stack(&none));
+        module.popResults(&i32, &i64, nullptr, nullptr);
+        size_t before = allocations;
+        for (int i = 0; i < 1000; ++i) {
+            module("steady", Stack(&none));
+            module.popResults(&i32, &i64, nullptr, nullptr);
+        }
+        size_t made = allocations - before;
+        check(i32 == 50 && i64 == 5, mode + "steady results");
+        check(made == 0, mode + std::to_string(made) + " allocations in 1000 calls");
+    }
+
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "multiple results and block parameters right, interpreted and optimized; no allocations per call" << std::endl;
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+#include "../includes/numeric.h"
+
+// Every case is a function of its own that computes one expression from constants, run on the
+// interpreter as it is and after the optimizer folded what it can: both have to give the bits
+// the spec asks for. Floats are compared by their bits (reinterpreted) or through a comparison.
+
+struct Case {
+    const char* type;
+    const char* expression;
+    int64_t expected;
+};
+
+const Case CASES[] = {
+    { "i32", "(i32.lt_u (i32.const -1) (i32.const 1))", 0 },
+    { "i32", "(i32.lt_s (i32.const -1) (i32.const 1))", 1 },
+    { "i32", "(i32.ge_u (i32.const -1) (i32.const 0))", 1 },
+    { "i32", "(i32.div_u (i32.const -2) (i32.const 2))", 0x7FFFFFFF },
+    { "i32", "(i32.div_s (i32.const -7) (i32.const 2))", -3 },
+    { "i32", "(i32.rem_s (i32.const -2147483648) (i32.const -1))", 0 },
+    { "i32", "(i32.rem_u (i32.const -1) (i32.const 10))", 5 },
+    { "i32", "(i32.shr_u (i32.const -8) (i32.const 33))", 0x7FFFFFFC },
+    { "i32", "(i32.shr_s (i32.const -8) (i32.const 1))", -4 },
+    { "i32", "(i32.shl (i32.const 1) (i32.const 35))", 8 },
+    { "i32", "(i32.rotl (i32.const 0x80000001) (i32.const 1))", 3 },
+    { "i32", "(i32.clz (i32.const 0))", 32 },
+    { "i32", "(i32.ctz (i32.const 0))", 32 },
+    { "i32", "(i32.extend8_s (i32.const 0x80))", -128 },
+    { "i64", "(i64.div_u (i64.const -1) (i64.const 3))", 0x5555555555555555 },
+    { "i64", "(i64.rem_s (i64.const -7) (i64.const 3))", -1 },
+    { "i64", "(i64.mul (i64.const 0x100000000) (i64.const 0x100000000))", 0 },
+    { "i64", "(i64.mul (i64.const 7) (i64.const 8))", 56 },
+    { "i64", "(i64.div_u (i64.const -1) (i64.const 0x100000000))", 0xFFFFFFFF },
+    { "i64", "(i64.rem_u (i64.const -1) (i64.const 16))", 15 },
+    { "i64", "(i64.rotr (i64.const 1) (i64.const 1))", INT64_MIN },
+    { "i64", "(i64.shr_u (i64.const -1) (i64.const 60))", 15 },
+    { "i64", "(i64.clz (i64.const 1))", 63 },
+    { "i64", "(i64.popcnt (i64.const -1))", 64 },
+    { "i64", "(i64.extend32_s (i64.const 0x80000000))", -2147483648ll },
+    { "i32", "(i32.wrap_i64 (i64.const 0x123456789))", 0x23456789 },
+    { "i64", "(i64.extend_i32_u (i32.const -1))", 0xFFFFFFFF },
+    { "i64", "(i64.extend_i32_s (i32.const -1))", -1 },
+    { "i32", "(i64.lt_u (i64.const -1) (i64.const 0))", 0 },
+    { "i64", "(i64.reinterpret_f64 (f64.min (f64.const 0.0) (f64.const -0.0)))", INT64_MIN },
+    { "i64", "(i64.reinterpret_f64 (f64.max (f64.const -0.0) (f64.const 0.0)))", 0 },
+    { "i32", "(f64.eq (f64.min (f64.const nan) (f64.const 1.0)) (f64.const 1.0))", 0 },
+    { "i32", "(f32.eq (f32.max (f32.const 1.0) (f32.const nan)) (f32.const 1.0))", 0 },
+    { "i32", "(i32.reinterpret_f32 (f32.copysign (f32.const 2.0) (f32.const -1.0)))", (int32_t)0xC0000000 },
+    { "i32", "(i32.reinterpret_f32 (f32.neg (f32.const 0.0)))", (int32_t)0x80000000 },
+    { "i32", "(i32.trunc_f64_s (f64.nearest (f64.const 2.5)))", 2 },
+    { "i32", "(i32.trunc_f64_s (f64.nearest (f64.const -3.5)))", -4 },
+    { "i32", "(i32.trunc_f32_u (f32.const 3000000000.0))", (int32_t)3000000000u },
+    { "i64", "(i64.trunc_f64_u (f64.const 1e19))", (int64_t)10000000000000000000ull },
+    { "i32", "(i32.trunc_f64_s (f64.const -2147483648.9))", INT32_MIN },
+    { "i32", "(i32.trunc_f64_u (f64.const -0.9))", 0 },
+    { "i32", "(i32.trunc_sat_f32_s (f32.const nan))", 0 },
+    { "i32", "(i32.trunc_sat_f64_s (f64.const 1e10))", INT32_MAX },
+    { "i32", "(i32.trunc_sat_f64_u (f64.const -5.0))", 0 },
+    { "i64", "(i64.trunc_sat_f64_u (f64.const inf))", -1 },
+    { "i32", "(i32.trunc_f64_s (f64.sqrt (f64.const 144.0)))", 12 },
+    { "i32", "(i32.trunc_f32_s (f32.div (f32.const 7.0) (f32.const 2.0)))", 3 },
+    { "i32", "(i32.trunc_f32_s (f32.sub (f32.const 7.0) (f32.const 2.0)))", 5 },
+    { "i64", "(i64.reinterpret_f64 (f64.convert_i64_u (i64.const -1)))", 0x43F0000000000000 },
+    { "i32", "(i32.reinterpret_f32 (f32.convert_i32_u (i32.const -1)))", 0x4F800000 },
+    { "i32", "(i32.reinterpret_f32 (f32.demote_f64 (f64.const 1.5)))", 0x3FC00000 },
+    { "i32", "(f64.le (f64.promote_f32 (f32.const 0.5)) (f64.const 0.5))", 1 },
+    { "i32", "(f32.gt (f32.floor (f32.const -1.5)) (f32.const -2.0))", 0 },
+    { "i32", "(f64.ge (f64.ceil (f64.const -1.5)) (f64.const -1.0))", 1 },
+    { "i32", "(i32.trunc_f64_s (f64.abs (f64.const -7.9)))", 7 },
+    { "i32", "(i32.trunc_f32_s (f32.trunc (f32.const -7.9)))", -7 },
+    { "i32", "(f64.lt (f64.div (f64.const 1.0) (f64.const 3.0)) (f64.const 0.34))", 1 },
+    { "i64", "(i64.reinterpret_f64 (f64.reinterpret_i64 (i64.const 42)))", 42 },
+};
+
+const Case TRAPS[] = {
+    { "i32", "(i32.div_s (i32.const 1) (i32.const 0))", 0 },
+    { "i32", "(i32.div_s (i32.const -2147483648) (i32.const -1))", 0 },
+    { "i64", "(i64.rem_u (i64.const 1) (i64.const 0))", 0 },
+    { "i32", "(i32.trunc_f32_s (f32.const nan))", 0 },
+    { "i32", "(i32.trunc_f64_s (f64.const 2147483648.0))", 0 },
+    { "i32", "(i32.trunc_f64_u (f64.const -1.0))", 0 },
+    { "i64", "(i64.trunc_f32_s (f32.const 9223372036854775807.0))", 0 },
+};
+
+std::string moduleOf(const Case* cases, size_t count) {
+    std::string source = "(module\n";
+    for (size_t i = 0; i < count; ++i) {
+        source += "  (func (export \"f" + std::to_string(i) + "\") (result " + cases[i].type + ") " + cases[i].expression + ")\n";
+    }
+    return source + ")\n";
+}
+
+int64_t call(Module& module, size_t index, const char* type) {
+    module("f" + std::to_string(index), Stack());
+    Variable result = module.getResults(1)[0];
+    return std::string(type) == "i32" ? std::get<int32_t>(result) : std::get<int64_t>(result);
+}
+
+int main() {
+    int failed = 0;
+    for (bool optimize : { false, true }) {
+        const char* mode = optimize ? "optimized" : "interpreted";
+        std::vector<uint8_t> binary = compile(moduleOf(CASES, std::size(CASES)), optimize);
+        Module module(binary.data(), binary.size());
+        for (size_t i = 0; i < std::size(CASES); ++i) {
+            int64_t result = call(module, i, CASES[i].type);
+            if (result != CASES[i].expected) {
+                std::cout << mode << " " << CASES[i].expression << " = " << result << ", expected " << CASES[i].expected << std::endl;
+                failed++;
+            }
+        }
+
+        std::vector<uint8_t> trapping = compile(moduleOf(TRAPS, std::size(TRAPS)), optimize);
+        Module trapModule(trapping.data(), trapping.size());
+        for (size_t i = 0; i < std::size(TRAPS); ++i) {
+            try {
+                call(trapModule, i, TRAPS[i].type);
+                std::cout << mode << " " << TRAPS[i].expression << " didn't trap" << std::endl;
+                failed++;
+            } catch (const NumericException&) {
+            }
+        }
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    std::cout << std::size(CASES) << " expressions and " << std::size(TRAPS) << " traps right, interpreted and optimized" << std::endl;
+    return 0;
+}
@@ -0,0 +1,76 @@
+(module
+  (func (export "kernel") (param i32) (result i32) (local $i i32) (local $acc i32) (local $step i32) (local $tmp i32) (local $j i32)
+    i32.const 4
+    local.set $step
+    (loop
+      local.get $i
+      i32.const 8
+      i32.mul
+      i32.const 0
+      i32.add
+      local.set $tmp
+      local.get $tmp
+      local.get $step
+      i32.const 1
+      i32.mul
+      i32.add
+      local.get $acc
+      i32.add
+      local.set $acc
+      ;; n * 3 + 7 doesn't change in the loop, i ^ n is computed twice
+      local.get 0
+      i32.const 3
+      i32.mul
+      i32.const 7
+      i32.add
+      local.get $i
+      local.get 0
+      i32.xor
+      i32.add
+      local.get $i
+      local.get 0
+      i32.xor
+      i32.add
+      local.get $acc
+      i32.xor
+      local.set $acc
+      ;; runs four times, unrolled completely
+      i32.const 0
+      local.set $j
+      (loop
+        local.get $acc
+        local.get $j
+        i32.add
+        local.set $acc
+        local.get $j
+        i32.const 1
+        i32.add
+        local.set $j
+        local.get $j
+        i32.const 4
+        i32.lt_s
+        br_if 0
+      )
+      local.get $i
+      i32.const 16
+      i32.const 16
+      i32.sub
+      i32.const 1
+      i32.add
+      i32.add
+      local.set $i
+      local.get $i
+      local.get 0
+      i32.lt_s
+      br_if 0
+    )
+    (block
+      br 0
+      local.get $acc
+      i32.const 1
+      i32.add
+      local.set $acc
+    )
+    local.get $acc
+  )
+)
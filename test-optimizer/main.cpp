@@ -0,0 +1,59 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+
+// Compiles kernel.wat without and with the optimization passes, runs both on the interpreter and
+// compares size, run time and result.
+
+struct Result {
+    int bytes;
+    double milliseconds;
+    int32_t value;
+};
+
+Result compileAndRun(bool optimize, int32_t iterations) {
+    Lexer lexer = Lexer{"./kernel.wat"};
+    lexer.lex();
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
+    parser.parseProper();
+
+    Compiler compiler = Compiler(parser.getFunctions(), parser.getMemories(), parser.getDatas(), &arena);
+    if (!optimize) {
+        compiler.getPassManager() = PassManager();
+    }
+    ByteStream* output = compiler.compile();
+    if (optimize) {
+        compiler.getPassManager().report(std::cout);
+    }
+
+    Module module(output->getBuffer(), output->getTotalByteCount());
+    Stack arguments;
+    arguments.push(iterations);
+    auto start = std::chrono::steady_clock::now();
+    module("kernel", arguments);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    return { output->getTotalByteCount(), elapsed.count(), std::get<int32_t>(module.getResults(1)[0]) };
+}
+
+int main(int argc, char** argv) {
+    int32_t iterations = argc > 1 ? std::stoi(argv[1]) : 100000;
+
+    Result plain = compileAndRun(false, iterations);
+    Result optimized = compileAndRun(true, iterations);
+
+    std::cout << "unoptimized: " << plain.bytes << " bytes, " << plain.milliseconds << " ms" << std::endl;
+    std::cout << "optimized:   " << optimized.bytes << " bytes, " << optimized.milliseconds << " ms" << std::endl;
+    if (plain.value != optimized.value) {
+        std::cout << "results differ: " << plain.value << " != " << optimized.value << std::endl;
+        return 1;
+    }
+    std::cout << "result " << optimized.value << " in both" << std::endl;
+    return 0;
+}
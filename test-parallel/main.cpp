@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+
+// Compiles a generated module of many functions with 0 workers (everything on the calling thread)
+// and with more, up to one per core, and checks that every run gives the same module.
+
+std::string generate(int functions) {
+    std::string source = "(module\n";
+    for (int i = 0; i < functions; ++i) {
+        source += "  (func (param i32) (result i32) (local $i i32) (local $acc i32) (local $t i32)\n";
+        source += "    (loop\n";
+        source += "      local.get $i\n";
+        source += "      i32.const " + std::to_string(i % 13 + 2) + "\n";
+        source += "      i32.mul\n";
+        source += "      i32.const 0\n";
+        source += "      i32.add\n";
+        source += "      local.set $t\n";
+        source += "      local.get 0\n";
+        source += "      i32.const 3\n";
+        source += "      i32.mul\n";
+        source += "      local.get $t\n";
+        source += "      i32.add\n";
+        source += "      local.get $acc\n";
+        source += "      i32.xor\n";
+        source += "      local.set $acc\n";
+        source += "      local.get $i\n";
+        source += "      i32.const 1\n";
+        source += "      i32.add\n";
+        source += "      local.set $i\n";
+        source += "      local.get $i\n";
+        source += "      i32.const " + std::to_string(i % 7 + 2) + "\n";
+        source += "      i32.lt_u\n";
+        source += "      br_if 0\n";
+        source += "    )\n";
+        source += "    local.get $acc\n";
+        if (i > 0 && i % 3 != 0) {
+            source += "    call " + std::to_string(i - 1) + "\n";
+        }
+        source += "  )\n";
+    }
+    return source + ")\n";
+}
+
+struct Result {
+    std::vector<uint8_t> binary;
+    double milliseconds;
+};
+
+Result compile(const std::string& source, size_t workers) {
+    ThreadPool pool(workers);
+    Lexer lexer = Lexer{reinterpret_cast<const uint8_t*>(source.data()), source.size()};
+    Arena arena;
+    Parser parser = Parser(&lexer, &arena);
+    parser.parseProper();
+
+    Compiler compiler = Compiler(parser.getFunctions(), parser.getMemories(), parser.getDatas(), &arena);
+    compiler.setThreadPool(&pool);
+    auto start = std::chrono::steady_clock::now();
+    ByteStream* output = compiler.compile();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::vector<uint8_t> binary(output->getTotalByteCount());
+    std::memcpy(binary.data(), output->getBuffer(), binary.size());
+    return { binary, elapsed.count() };
+}
+
+int main(int argc, char** argv) {
+    int functions = argc > 1 ? std::stoi(argv[1]) : 4000;
+    std::string source = generate(functions);
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+
+    Result single = compile(source, 0);
+    std::cout << "functions: " << functions << ", " << single.binary.size() << " bytes" << std::endl;
+    std::cout << "1 thread:   " << single.milliseconds << " ms" << std::endl;
+    // more threads than cores as well, for a different interleaving of the functions
+    for (size_t threads = 2; threads <= std::max<size_t>(cores, 4); threads *= 2) {
+        Result parallel = compile(source, threads - 1);
+        std::cout << threads << " threads: " << parallel.milliseconds << " ms, "
+                  << single.milliseconds / parallel.milliseconds << "x" << std::endl;
+        if (parallel.binary != single.binary) {
+            std::cout << "the module differs from the one compiled on 1 thread" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "same module on every number of threads" << std::endl;
+    return 0;
+}
@@ -0,0 +1,139 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// The same module written with plain and with folded instructions has to compile to the same
+// bytes, and text the Parser can't read has to be reported at the right line and column.
+
+const char* PLAIN = R"(
+(module
+  (memory (export "memory") 1)
+  (data (i32.const 0) "A\n")
+  (func $add (export "add") (param $a i32) (param $b i32) (result i32)
+    local.get $a
+    local.get $b
+    call $twice
+    i32.add)
+  (func $twice (param i32) (result i32)
+    local.get 0
+    i32.const 2
+    i32.mul)
+  (func (export "pick") (param $x i32) (result i32)
+    block $out (result i32)
+      loop $again
+        local.get $x
+        i32.const 10
+        i32.gt_s
+        if
+          local.get $x
+          br $out
+        end
+        local.get $x
+        i32.const 3
+        i32.add
+        local.set $x
+        br $again
+      end
+      i32.const 0
+    end)
+)
+)";
+
+const char* FOLDED = R"(
+(module
+  (memory $m 1)
+  (data (memory $m) (offset i32.const 0) "\41" "\0a")
+  (func $add (param $a i32) (param $b i32) (result i32)
+    (i32.add (local.get $a) (call $twice (local.get $b))))
+  (func $twice (param i32) (result i32)
+    (i32.mul (local.get 0) (i32.const 2)))
+  (func $pick (param $x i32) (result i32)
+    (block $out (result i32)
+      (loop $again
+        (if (i32.gt_s (local.get $x) (i32.const 10))
+          (then (br $out (local.get $x))))
+        (local.set $x (i32.add (local.get $x) (i32.const 3)))
+        (br $again))
+      (i32.const 0)))
+  (export "memory" (memory $m))
+  (export "add" (func $add))
+  (export "pick" (func 2))
+)
+)";
+
+struct Failure {
+    const char* source;
+    const char* message;
+};
+
+const Failure FAILURES[] = {
+    { "(module\n  (func (result i32)\n    i32.const 1\n    i32.ad\n  )\n)", "4:5: unknown instruction 'i32.ad'" },
+    { "(module (func call $missing))", "1:20: unknown function $missing" },
+    { "(module (func (block $a br $b end)))", "1:28: unknown label $b" },
+    { "(module\n  (func (param i32) i32.const 4294967296 drop))", "2:31: the constant 4294967296 is out of range for i32" },
+    { "(module (func i32.const 1", "1:26: unexpected end of input" },
+    { "(module (func (param $x i32) (param $x i32)))", "1:37: duplicate local $x" },
+    // cut off anywhere
+    { "(module (func (export", "1:22: unexpected end of input" },
+    { "(module (func (export \"f\"", "1:26: unexpected end of input" },
+    { "(module (func (", "1:16: unexpected end of input" },
+    { "(module (func (i32.add", "1:23: expected a folded instruction or ')'" },
+    { "(module (memory 1", "1:18: unexpected end of input" },
+    // where the lexer stopped
+    { "(module (func (export \"f\")))\n\"oops", "2:1: unterminated string" },
+    { "(module\n  (func (result i32)\n    (i32.const 1) \"abc\n))", "3:19: unterminated string" },
+    { "(module (; open", "1:9: unterminated block comment" },
+    { "(module (export # (func 0)))", "1:17: unexpected character" },
+};
+
+int32_t run(std::vector<uint8_t>& binary, const std::string& name, std::vector<int32_t> arguments) {
+    Module module(binary.data(), binary.size());
+    Stack stack;
+    for (int32_t argument : arguments) {
+        stack.push(argument);
+    }
+    module(name, stack);
+    return std::get<int32_t>(module.getResults(1)[0]);
+}
+
+int main() {
+    std::vector<uint8_t> plain = compile(PLAIN);
+    std::vector<uint8_t> folded = compile(FOLDED);
+    if (plain != folded) {
+        std::cout << "the folded module differs from the plain one" << std::endl;
+        return 1;
+    }
+    int32_t sum = run(folded, "add", { 3, 4 });
+    int32_t picked = run(folded, "pick", { 1 });
+    std::cout << "same module, add(3, 4) = " << sum << ", pick(1) = " << picked << std::endl;
+    if (sum != 11 || picked != 13) {
+        std::cout << "wrong results" << std::endl;
+        return 1;
+    }
+
+    int failed = 0;
+    for (const Failure& failure : FAILURES) {
+        std::string message = "no error";
+        try {
+            compile(failure.source);
+        } catch (const ParseError& error) {
+            message = error.what();
+        }
+        if (message != failure.message) {
+            std::cout << "expected \"" << failure.message << "\", got \"" << message << "\"" << std::endl;
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        return 1;
+    }
+    std::cout << std::size(FAILURES) << " errors at the right position" << std::endl;
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+#include "../includes/simd.h"
+
+// The v128 instructions: every kernel of simd.h against its loop over the lanes in simd::scalar,
+// on random vectors and on lanes with the edge cases of their type; expressions in the text format
+// run on the interpreter as they are and after the optimizer; a loop that keeps a v128 in a local;
+// immediates the parser has to reject; and the time of the kernels against the loops.
+
+std::vector<v128_t> inputs;
+
+template <typename T>
+void addLanes(std::mt19937_64& random, std::initializer_list<T> specials) {
+    std::vector<T> values(specials);
+    for (int n = 0; n < 300; ++n) {
+        v128_t v;
+        for (int i = 0; i < simd::lanes<T>; ++i) {
+            simd::setLane<T>(v, i, values[random() % values.size()]);
+        }
+        inputs.push_back(v);
+    }
+}
+
+void makeInputs() {
+    std::mt19937_64 random(44);
+    for (int n = 0; n < 600; ++n) {
+        v128_t v;
+        for (auto& byte : v.bytes) {
+            byte = random();
+        }
+        inputs.push_back(v);
+    }
+    addLanes<int8_t>(random, { 0, 1, -1, 127, -128, 64, 15, 16, 200 - 256 });
+    addLanes<int16_t>(random, { 0, 1, -1, INT16_MAX, INT16_MIN, 255, 256, 0x7F80 });
+    addLanes<int32_t>(random, { 0, 1, -1, INT32_MAX, INT32_MIN, 0x10000, 0xFFFF, 31 });
+    addLanes<int64_t>(random, { 0, 1, -1, INT64_MAX, INT64_MIN, 0x100000000ll, 63 });
+    float f = std::numeric_limits<float>::infinity();
+    addLanes<float>(random, { 0.0f, -0.0f, 1.0f, -1.5f, 2.5f, 0.5f, f, -f, NAN, -NAN, 3e9f, -3e9f, 2147483648.0f,
+                              2147483520.0f, 4294967296.0f, 1e-45f, 8388609.5f });
+    double d = std::numeric_limits<double>::infinity();
+    addLanes<double>(random, { 0.0, -0.0, 1.0, -1.5, 2.5, 0.5, d, -d, NAN, -NAN, 1e300, 4503599627370497.5 });
+}
+
+// floats are the same if they have the same bits or are both NaN, whose payload isn't specified
+template <typename F>
+bool sameFloats(const v128_t& a, const v128_t& b) {
+    for (int i = 0; i < simd::lanes<F>; ++i) {
+        F x = simd::lane<F>(a, i), y = simd::lane<F>(b, i);
+        if (std::memcmp(&x, &y, sizeof(F)) != 0 && !(x != x && y != y)) {
+            return false;
+        }
+    }
+    return true;
+}
+bool sameBits(const v128_t& a, const v128_t& b) { return a == b; }
+
+int failed = 0;
+int checked = 0;
+
+template <typename Result>
+void report(const char* name, bool same, const v128_t& a, const v128_t& b, const Result& host, const Result& scalar) {
+    ++checked;
+    if (!same && failed++ < 20) {
+        std::cout << name << "(" << a << ", " << b << ") = " << host << ", the loop gives " << scalar << std::endl;
+    }
+}
+
+template <typename Host, typename Scalar, typename Same>
+void checkUnary(const char* name, Host host, Scalar scalar, Same same) {
+    for (const v128_t& a : inputs) {
+        auto h = host(a), s = scalar(a);
+        report(name, same(h, s), a, a, h, s);
+    }
+}
+template <typename Host, typename Scalar, typename Same>
+void checkBinary(const char* name, Host host, Scalar scalar, Same same) {
+    std::mt19937_64 random(7);
+    for (size_t n = 0; n < 20 * inputs.size(); ++n) {
+        const v128_t& a = inputs[random() % inputs.size()];
+        const v128_t& b = inputs[n % 3 == 0 ? random() % inputs.size() : n % inputs.size()];
+        v128_t h = host(a, b), s = scalar(a, b);
+        report(name, same(h, s), a, b, h, s);
+    }
+}
+template <typename Host, typename Scalar>
+void checkShift(const char* name, Host host, Scalar scalar) {
+    for (const v128_t& a : inputs) {
+        for (int32_t count : { 0, 1, 3, 7, 8, 9, 15, 16, 31, 32, 33, 63, 64, 65, -1 }) {
+            v128_t h = host(a, count), s = scalar(a, count);
+            report(name, h == s, a, a, h, s);
+        }
+    }
+}
+
+#define UNARY(kernel, same) checkUnary(#kernel, [](v128_t a) { return simd::kernel(a); }, \
+                                       [](v128_t a) { return simd::scalar::kernel(a); }, same)
+#define BINARY(kernel, same) checkBinary(#kernel, [](v128_t a, v128_t b) { return simd::kernel(a, b); }, \
+                                         [](v128_t a, v128_t b) { return simd::scalar::kernel(a, b); }, same)
+#define SHIFT(kernel) checkShift(#kernel, [](v128_t a, int32_t n) { return simd::kernel(a, n); }, \
+                                 [](v128_t a, int32_t n) { return simd::scalar::kernel(a, n); })
+
+template <typename L>
+void checkIntegers() {
+    auto same = sameBits;
+    BINARY(add<L>, same);
+    BINARY(sub<L>, same);
+    BINARY(mul<L>, same);
+    UNARY(neg<L>, same);
+    UNARY(abs<L>, same);
+    BINARY(eq<L>, same);
+    BINARY(ne<L>, same);
+    BINARY(ltS<L>, same);
+    BINARY(gtS<L>, same);
+    BINARY(leS<L>, same);
+    BINARY(geS<L>, same);
+    BINARY(ltU<L>, same);
+    BINARY(gtU<L>, same);
+    BINARY(leU<L>, same);
+    BINARY(geU<L>, same);
+    BINARY(minS<L>, same);
+    BINARY(maxS<L>, same);
+    BINARY(minU<L>, same);
+    BINARY(maxU<L>, same);
+    SHIFT(shl<L>);
+    SHIFT(shrS<L>);
+    SHIFT(shrU<L>);
+    UNARY(allTrue<L>, [](int32_t a, int32_t b) { return a == b; });
+    UNARY(bitmask<L>, [](int32_t a, int32_t b) { return a == b; });
+    if constexpr (sizeof(L) <= 2) {
+        BINARY(addSatS<L>, same);
+        BINARY(addSatU<L>, same);
+        BINARY(subSatS<L>, same);
+        BINARY(subSatU<L>, same);
+        BINARY(avgrU<L>, same);
+    }
+}
+
+template <typename F>
+void checkFloats() {
+    auto same = sameFloats<F>;
+    BINARY(fadd<F>, same);
+    BINARY(fsub<F>, same);
+    BINARY(fmul<F>, same);
+    BINARY(fdiv<F>, same);
+    BINARY(min<F>, same);
+    BINARY(max<F>, same);
+    BINARY(pmin<F>, same);
+    BINARY(pmax<F>, same);
+    BINARY(eq<F>, sameBits);
+    BINARY(ne<F>, sameBits);
+    BINARY(lt<F>, sameBits);
+    BINARY(gt<F>, sameBits);
+    BINARY(le<F>, sameBits);
+    BINARY(ge<F>, sameBits);
+    UNARY(fabs<F>, same);
+    UNARY(fneg<F>, same);
+    UNARY(sqrt<F>, same);
+    UNARY(ceil<F>, same);
+    UNARY(floor<F>, same);
+    UNARY(trunc<F>, same);
+    UNARY(nearest<F>, same);
+}
+
+void checkKernels() {
+    makeInputs();
+    checkIntegers<int8_t>();
+    checkIntegers<int16_t>();
+    checkIntegers<int32_t>();
+    checkIntegers<int64_t>();
+    checkFloats<float>();
+    checkFloats<double>();
+    BINARY(bitAnd, sameBits);
+    BINARY(bitOr, sameBits);
+    BINARY(bitXor, sameBits);
+    BINARY(bitAndNot, sameBits);
+    UNARY(bitNot, sameBits);
+    UNARY(anyTrue, [](int32_t a, int32_t b) { return a == b; });
+    UNARY(popcnt, sameBits);
+    BINARY(dot, sameBits);
+    BINARY(swizzle, sameBits);
+    // the mask: some bits of both
+    checkBinary("bitselect", [](v128_t a, v128_t b) { return simd::bitselect(a, b, simd::swizzle(b, a)); },
+                [](v128_t a, v128_t b) { return simd::scalar::bitselect(a, b, simd::scalar::swizzle(b, a)); }, sameBits);
+    UNARY(truncateSaturated<int32_t>, sameBits);
+    UNARY(truncateSaturated<uint32_t>, sameBits);
+    UNARY(convert<int32_t>, sameBits);
+    UNARY(convert<uint32_t>, sameBits);
+}
+
+struct Case {
+    const char* type;
+    const char* expression;
+    int64_t expected;
+};
+
+const Case CASES[] = {
+    { "i32", "(i32x4.extract_lane 1 (i32x4.mul (v128.const i32x4 1 2 3 4) (v128.const i32x4 5 6 7 8)))", 12 },
+    { "i32", "(i8x16.extract_lane_u 0 (i8x16.add_sat_u (v128.const i8x16 250 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0) (i8x16.splat (i32.const 10))))", 255 },
+    { "i32", "(i8x16.extract_lane_s 15 (i8x16.sub (i8x16.splat (i32.const 0)) (i8x16.splat (i32.const 1))))", -1 },
+    { "i32", "(i16x8.extract_lane_u 3 (i16x8.splat (i32.const -1)))", 65535 },
+    { "i32", "(i8x16.bitmask (i8x16.lt_s (v128.const i8x16 -1 1 -1 1 -1 1 -1 1 0 0 0 0 0 0 0 -128) (i8x16.splat (i32.const 0))))", 0x8055 },
+    { "i32", "(i32x4.bitmask (f32x4.lt (v128.const f32x4 1.0 nan -0.0 -2.5) (f32x4.splat (f32.const 0.0))))", 8 },
+    { "i32", "(v128.any_true (v128.and (v128.const i64x2 0xF0 0) (v128.const i64x2 0x0F 0)))", 0 },
+    { "i32", "(i32x4.all_true (i32x4.eq (i32x4.shl (i32x4.splat (i32.const 1)) (i32.const 33)) (i32x4.splat (i32.const 2))))", 1 },
+    { "i64", "(i64x2.extract_lane 1 (i64x2.shr_s (v128.const i64x2 0 -16) (i32.const 2)))", -4 },
+    { "i64", "(i64x2.extract_lane 0 (i64x2.mul (i64x2.splat (i64.const 0x100000001)) (i64x2.splat (i64.const 3))))", 0x300000003 },
+    { "i32", "(i32.trunc_f32_s (f32x4.extract_lane 3 (f32x4.sqrt (v128.const f32x4 1 4 9 16))))", 4 },
+    { "i64", "(i64.reinterpret_f64 (f64x2.extract_lane 0 (f64x2.min (v128.const f64x2 0.0 1) (v128.const f64x2 -0.0 2))))", INT64_MIN },
+    { "i32", "(f64.ne (f64x2.extract_lane 1 (f64x2.max (v128.const f64x2 0 nan) (f64x2.splat (f64.const 1)))) (f64.const 1))", 1 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.trunc_sat_f32x4_s (v128.const f32x4 3e9 -3e9 nan 2.7)))", INT32_MAX },
+    { "i32", "(i32x4.extract_lane 1 (i32x4.trunc_sat_f32x4_s (v128.const f32x4 3e9 -3e9 nan 2.7)))", INT32_MIN },
+    { "i32", "(i32x4.extract_lane 2 (i32x4.trunc_sat_f32x4_s (v128.const f32x4 3e9 -3e9 nan 2.7)))", 0 },
+    { "i32", "(i32x4.extract_lane 3 (i32x4.trunc_sat_f32x4_s (v128.const f32x4 3e9 -3e9 nan 2.7)))", 2 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.trunc_sat_f32x4_u (f32x4.splat (f32.const -1.0))))", 0 },
+    { "i32", "(i32.reinterpret_f32 (f32x4.extract_lane 2 (f32x4.convert_i32x4_u (i32x4.splat (i32.const -1)))))", 0x4F800000 },
+    { "i32", "(i8x16.extract_lane_u 0 (i8x16.shuffle 31 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 "
+             "(v128.const i8x16 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15) (v128.const i8x16 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 99)))", 99 },
+    { "i32", "(i8x16.extract_lane_u 1 (i8x16.swizzle (v128.const i8x16 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15) "
+             "(v128.const i8x16 3 200 0 0 0 0 0 0 0 0 0 0 0 0 0 0)))", 0 },
+    { "i32", "(i32x4.extract_lane 3 (i32x4.replace_lane 3 (i32x4.splat (i32.const 7)) (i32.const 42)))", 42 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.dot_i16x8_s (v128.const i16x8 -32768 -32768 1 1 1 1 1 1) (v128.const i16x8 -32768 -32768 1 1 1 1 1 1)))", INT32_MIN },
+    { "i32", "(i8x16.extract_lane_u 0 (i8x16.popcnt (i8x16.splat (i32.const 0xF7))))", 7 },
+    { "i32", "(i16x8.extract_lane_s 0 (i16x8.avgr_u (i16x8.splat (i32.const 1)) (i16x8.splat (i32.const 2))))", 2 },
+    { "i32", "(i32x4.extract_lane 0 (v128.bitselect (i32x4.splat (i32.const 0x12345678)) (i32x4.splat (i32.const -1)) (i32x4.splat (i32.const 0xFFFF))))", (int32_t)0xFFFF5678 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.abs (i32x4.splat (i32.const -2147483648))))", INT32_MIN },
+    { "i32", "(i8x16.extract_lane_s 0 (i8x16.shr_s (i8x16.splat (i32.const -128)) (i32.const 9)))", -64 },
+    { "i32", "(i8x16.extract_lane_u 0 (i8x16.shr_u (i8x16.splat (i32.const -128)) (i32.const 9)))", 64 },
+    { "i32", "(i8x16.extract_lane_u 1 (i8x16.shl (i8x16.splat (i32.const 0x81)) (i32.const 1)))", 2 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.min_u (i32x4.splat (i32.const -1)) (i32x4.splat (i32.const 1))))", 1 },
+    { "i32", "(i16x8.extract_lane_s 0 (i16x8.max_s (i16x8.splat (i32.const -1)) (i16x8.splat (i32.const 1))))", 1 },
+    { "i32", "(i64x2.bitmask (i64x2.ge_s (v128.const i64x2 -1 5) (v128.const i64x2 0 5)))", 2 },
+    { "i32", "(i32.trunc_f32_s (f32x4.extract_lane 0 (f32x4.nearest (f32x4.splat (f32.const 2.5)))))", 2 },
+    { "i32", "(i32.trunc_f64_s (f64x2.extract_lane 1 (f64x2.floor (f64x2.splat (f64.const -1.5)))))", -2 },
+    { "i32", "(i32.reinterpret_f32 (f32x4.extract_lane 0 (f32x4.pmin (f32x4.splat (f32.const 0.0)) (f32x4.splat (f32.const -0.0)))))", 0 },
+    { "i32", "(i32x4.extract_lane 0 (i32x4.ne (v128.not (v128.const i64x2 0 0)) (v128.xor (i32x4.splat (i32.const -1)) (v128.const i32x4 0 0 0 0))))", 0 },
+    { "i32", "(i32x4.extract_lane 2 (v128.andnot (v128.const i32x4 0 0 0xFF 0) (v128.const i32x4 0 0 0x0F 0)))", 0xF0 },
+};
+
+// fill stores vectors i, i+1, i+2, i+3 at 16 * i; sum adds them up in a v128 local
+const char* LOOP = R"(
+(module
+  (memory 1)
+  (func (export "fill") (param $n i32) (local $i i32)
+    (loop
+      (v128.store (i32.shl (local.get $i) (i32.const 4))
+        (i32x4.add (i32x4.splat (local.get $i)) (v128.const i32x4 0 1 2 3)))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if 0 (i32.lt_u (local.get $i) (local.get $n)))))
+  (func (export "sum") (param $n i32) (result i32) (local $i i32) (local $acc v128)
+    (local.set $acc (v128.const i64x2 0 0))
+    (loop
+      (local.set $acc (i32x4.add (local.get $acc) (v128.load (i32.shl (local.get $i) (i32.const 4)))))
+      (local.set $i (i32.add (local.get $i) (i32.const 1)))
+      (br_if 0 (i32.lt_u (local.get $i) (local.get $n))))
+    (i32.add (i32.add (i32x4.extract_lane 0 (local.get $acc)) (i32x4.extract_lane 1 (local.get $acc)))
+             (i32.add (i32x4.extract_lane 2 (local.get $acc)) (i32x4.extract_lane 3 (local.get $acc)))))
+  (func (export "zero") (result i32) (local $v v128)
+    (i8x16.bitmask (i8x16.eq (local.get $v) (v128.const i8x16 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0))))
+  (func (export "echo") (param v128) (result v128)
+    (i64x2.add (local.get 0) (i64x2.splat (i64.const 1))))
+)
+)";
+
+const char* REJECTED[] = {
+    "(v128.const i32x4 1 2 3)",
+    "(v128.const i8x16 256 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0)",
+    "(v128.const i16x8 -32769 0 0 0 0 0 0 0)",
+    "(v128.const i32 1 2 3 4)",
+    "(i32x4.extract_lane 4 (v128.const i32x4 1 2 3 4))",
+    "(i8x16.shuffle 32 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 (v128.const i64x2 0 0) (v128.const i64x2 0 0))",
+};
+
+std::string moduleOf(const Case* cases, size_t count) {
+    std::string source = "(module\n";
+    for (size_t i = 0; i < count; ++i) {
+        source += "  (func (export \"f" + std::to_string(i) + "\") (result " + cases[i].type + ") " + cases[i].expression + ")\n";
+    }
+    return source + ")\n";
+}
+
+Variable call(Module& module, const std::string& name, std::vector<Variable> arguments = {}) {
+    module(name, Stack(&arguments));
+    return module.getResults(1)[0];
+}
+
+void checkPrograms() {
+    for (bool optimize : { false, true }) {
+        const char* mode = optimize ? "optimized" : "interpreted";
+        std::vector<uint8_t> binary = compile(moduleOf(CASES, std::size(CASES)), optimize);
+        Module module(binary.data(), binary.size());
+        for (size_t i = 0; i < std::size(CASES); ++i) {
+            Variable result = call(module, "f" + std::to_string(i));
+            int64_t value = std::string(CASES[i].type) == "i32" ? std::get<int32_t>(result) : std::get<int64_t>(result);
+            if (value != CASES[i].expected) {
+                std::cout << mode << " " << CASES[i].expression << " = " << value << ", expected " << CASES[i].expected << std::endl;
+                failed++;
+            }
+        }
+
+        std::vector<uint8_t> loop = compile(LOOP, optimize);
+        Module loopModule(loop.data(), loop.size());
+        std::vector<Variable> count = { int32_t(100) };
+        loopModule("fill", Stack(&count));
+        // the sum of 4 * i + 6 for i below 100
+        if (std::get<int32_t>(call(loopModule, "sum", { int32_t(100) })) != 4 * 4950 + 600) {
+            std::cout << mode << " sum of the vectors in memory is wrong" << std::endl;
+            failed++;
+        }
+        if (std::get<int32_t>(call(loopModule, "zero")) != 0xFFFF) {
+            std::cout << mode << " a v128 local doesn't start as zero" << std::endl;
+            failed++;
+        }
+        v128_t echo = std::get<v128_t>(call(loopModule, "echo", { simd::splat<int64_t>(int64_t(41)) }));
+        if (simd::lane<int64_t>(echo, 0) != 42 || simd::lane<int64_t>(echo, 1) != 42) {
+            std::cout << mode << " a v128 parameter and result went wrong: " << echo << std::endl;
+            failed++;
+        }
+    }
+
+    for (const char* expression : REJECTED) {
+        try {
+            compile(std::string("(module (func (result i32) ") + expression + " drop i32.const 0))", false);
+            std::cout << expression << " was accepted" << std::endl;
+            failed++;
+        } catch (const ParseError&) {
+        }
+    }
+}
+
+// the kernel as a template argument, so it is inlined into the loop as it is in the interpreter
+template <v128_t (*kernel)(v128_t, v128_t)>
+double time() {
+    v128_t a = simd::splat<int32_t>(3), b = simd::splat<int32_t>(5);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10000000; ++i) {
+        a = kernel(a, b);
+        asm volatile("" : "+m"(a));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main() {
+    checkKernels();
+    checkPrograms();
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << checked << " kernel results agree with the lane loops, " << std::size(CASES)
+              << " expressions right interpreted and optimized" << std::endl;
+
+    std::cout << "10M x i32x4.mul: " << time<simd::mul<int32_t>>() << " ms, lanes one by one "
+              << time<simd::scalar::mul<int32_t>>() << " ms" << std::endl;
+    std::cout << "10M x f32x4.min: " << time<simd::min<float>>() << " ms, lanes one by one "
+              << time<simd::scalar::min<float>>() << " ms" << std::endl;
+    std::cout << "10M x i8x16.add_sat_u: " << time<simd::addSatU<int8_t>>() << " ms, lanes one by one "
+              << time<simd::scalar::addSatU<int8_t>>() << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,306 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Control flow as compilers emit it: br_table for switch statements, return out of nested blocks,
+// branches that carry values and drop what else is on the stack, and call_indirect through a table
+// filled by element segments, with the traps of a wrong index or type. Every module runs as it is
+// and after the optimizer; hand assembled binaries have the element segment forms the text format
+// here can't express and a table.init, which traps; text the parser has to reject; and the time of
+// a switch in a loop.
+
+const char* SOURCE = R"(
+(module
+  (type $binary (func (param i32 i32) (result i32)))
+  (table $functions 6 funcref)
+  (elem (i32.const 0) $add $sub $mul $negate)
+  (elem (table $functions) (offset (i32.const 5)) func $add)
+  (func $add (param i32 i32) (result i32) (i32.add (local.get 0) (local.get 1)))
+  (func $sub (param i32 i32) (result i32) (i32.sub (local.get 0) (local.get 1)))
+  (func $mul (param i32 i32) (result i32) (i32.mul (local.get 0) (local.get 1)))
+  (func $negate (param i32) (result i32) (i32.sub (i32.const 0) (local.get 0)))
+
+  (func (export "apply") (param $op i32) (param $a i32) (param $b i32) (result i32)
+    (call_indirect (type $binary) (local.get $a) (local.get $b) (local.get $op)))
+
+  ;; case 0, 1 and 2, everything else is the default
+  (func (export "classify") (param i32) (result i32)
+    (block $default
+      (block $two
+        (block $one
+          (block $zero
+            (br_table $zero $one $two $default (local.get 0)))
+          (return (i32.const 10)))
+        (return (i32.const 20)))
+      (return (i32.const 30)))
+    (i32.const 40))
+
+  ;; the branch carries the value of the block
+  (func (export "select") (param i32) (result i32)
+    (block $outer (result i32)
+      (drop (block $inner (result i32)
+        (br_table $inner $outer (i32.const 7) (local.get 0))))
+      (i32.const 8)))
+
+  ;; the values under the one a branch carries are dropped
+  (func (export "unwind") (result i32)
+    (i32.const 1)
+    (drop)
+    (block (result i32)
+      (i32.const 5)
+      (i32.const 6)
+      (br 0)))
+
+  (func (export "early") (param i32) (result i32)
+    (i32.const 100)
+    (block
+      (block
+        (br_if 1 (i32.eqz (local.get 0)))
+        (return (i32.const 200))))
+    (drop)
+    (i32.const 300))
+
+  ;; br_table back to a loop, from a block inside it
+  (func (export "countdown") (param $n i32) (result i32) (local $steps i32)
+    (loop $again
+      (block $done
+        (local.set $steps (i32.add (local.get $steps) (i32.const 1)))
+        (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+        (br_table $done $again (i32.gt_s (local.get $n) (i32.const 0)))))
+    (local.get $steps))
+
+  (func $forever (export "forever") (param i32) (result i32)
+    (call $forever (i32.add (local.get 0) (i32.const 1))))
+
+  ;; a switch over 8 cases in a loop, summed
+  (func (export "switches") (param $n i32) (result i32) (local $sum i32)
+    (loop $next
+      (block $end (block $7 (block $6 (block $5 (block $4 (block $3 (block $2 (block $1 (block $0
+        (br_table $0 $1 $2 $3 $4 $5 $6 $7 (i32.and (local.get $n) (i32.const 7))))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 1))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 2))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 3))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 4))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 5))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 6))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 7))) (br $end))
+        (local.set $sum (i32.add (local.get $sum) (i32.const 8))))
+      (local.set $n (i32.sub (local.get $n) (i32.const 1)))
+      (br_if $next (local.get $n)))
+    (local.get $sum))
+)
+)";
+
+// the table written with its elements, recursion through it
+const char* RECURSIVE = R"(
+(module
+  (table funcref (elem $factorial))
+  (func $factorial (export "factorial") (param i32) (result i32)
+    (if (result i32) (i32.le_s (local.get 0) (i32.const 1))
+      (then (i32.const 1))
+      (else (i32.mul (local.get 0)
+        (call_indirect (param i32) (result i32) (i32.sub (local.get 0) (i32.const 1)) (i32.const 0))))))
+)
+)";
+
+struct Case {
+    const char* function;
+    std::vector<Variable> arguments;
+    int32_t expected;
+};
+
+const Case CASES[] = {
+    { "apply", { int32_t(0), int32_t(7), int32_t(5) }, 12 },
+    { "apply", { int32_t(1), int32_t(7), int32_t(5) }, 2 },
+    { "apply", { int32_t(2), int32_t(7), int32_t(5) }, 35 },
+    { "apply", { int32_t(5), int32_t(1), int32_t(2) }, 3 },
+    { "classify", { int32_t(0) }, 10 },
+    { "classify", { int32_t(1) }, 20 },
+    { "classify", { int32_t(2) }, 30 },
+    { "classify", { int32_t(3) }, 40 },
+    { "classify", { int32_t(-1) }, 40 },
+    { "select", { int32_t(0) }, 8 },
+    { "select", { int32_t(1) }, 7 },
+    { "select", { int32_t(9) }, 7 },
+    { "unwind", {}, 6 },
+    { "early", { int32_t(0) }, 300 },
+    { "early", { int32_t(1) }, 200 },
+    { "countdown", { int32_t(5) }, 5 },
+    { "countdown", { int32_t(0) }, 1 },
+    { "switches", { int32_t(16) }, 2 * 36 },
+};
+
+// call_indirect with an element of another type, a null one and one past the table
+const Case TRAPS[] = {
+    { "apply", { int32_t(3), int32_t(1), int32_t(2) }, 0 },
+    { "apply", { int32_t(4), int32_t(1), int32_t(2) }, 0 },
+    { "apply", { int32_t(6), int32_t(1), int32_t(2) }, 0 },
+    { "apply", { int32_t(-1), int32_t(1), int32_t(2) }, 0 },
+    { "forever", { int32_t(0) }, 0 },
+};
+const char* TRAP_MESSAGES[] = {
+    "indirect call type mismatch", "uninitialized element", "undefined element", "undefined element", "call stack exhausted",
+};
+
+// A binary with what the text format above doesn't write: element segments of expressions, a
+// ref.null among them, a passive segment, and an exported table.
+//   (type (func (result i32))) (type (func (param i32) (result i32)))
+//   (func (result i32) i32.const 7) (func (result i32) i32.const 9)
+//   (func (export "pick") (param i32) (result i32) local.get 0 call_indirect (type 0))
+//   (table (export "t") 3 funcref)
+//   (elem (i32.const 0) funcref (ref.func 1) (ref.null func) (ref.func 0))
+//   (elem func 0)
+const uint8_t BINARY[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x0a, 0x02, 0x60, 0x00, 0x01, 0x7f, 0x60, 0x01, 0x7f, 0x01, 0x7f,
+    0x03, 0x04, 0x03, 0x00, 0x00, 0x01,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x03,
+    0x07, 0x0c, 0x02, 0x04, 'p', 'i', 'c', 'k', 0x00, 0x02, 0x01, 't', 0x01, 0x00,
+    0x09, 0x13, 0x02,
+        0x04, 0x41, 0x00, 0x0b, 0x03, 0xd2, 0x01, 0x0b, 0xd0, 0x70, 0x0b, 0xd2, 0x00, 0x0b,
+        0x01, 0x00, 0x01, 0x00,
+    0x0a, 0x15, 0x03,
+        0x04, 0x00, 0x41, 0x07, 0x0b,
+        0x04, 0x00, 0x41, 0x09, 0x0b,
+        0x07, 0x00, 0x20, 0x00, 0x11, 0x00, 0x00, 0x0b,
+};
+
+// table.init, which the interpreter doesn't have, has to trap rather than run its immediates as
+// instructions
+//   (type (func)) (func (export "init") (table.init 0 0 (i32.const 0) (i32.const 0) (i32.const 0)))
+//   (table 1 funcref) (elem func 0)
+const uint8_t UNSUPPORTED[] = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x04, 0x01, 0x60, 0x00, 0x00,
+    0x03, 0x02, 0x01, 0x00,
+    0x04, 0x04, 0x01, 0x70, 0x00, 0x01,
+    0x07, 0x08, 0x01, 0x04, 'i', 'n', 'i', 't', 0x00, 0x00,
+    0x09, 0x05, 0x01, 0x01, 0x00, 0x01, 0x00,
+    0x0a, 0x0e, 0x01,
+        0x0c, 0x00, 0x41, 0x00, 0x41, 0x00, 0x41, 0x00, 0xfc, 0x0c, 0x00, 0x00, 0x0b,
+};
+
+const char* REJECTED[] = {
+    "(module (func (result i32) (call_indirect (result i32) (i32.const 0))))",
+    "(module (elem (i32.const 0) $f) (func $f))",
+    "(module (table 1 funcref) (elem func $f) (func $f))",
+    "(module (table 1 funcref) (elem (i32.const 0) $g) (func $f))",
+    "(module (table 2 1 funcref))",
+    "(module (table 1 externref))",
+    "(module (table 1 funcref) (table 1 funcref) (func (call_indirect 1 (i32.const 0))))",
+    "(module (func (block (br_table (i32.const 0)))))",
+    "(module (func (block (br_table 0 2 (i32.const 0)))))",
+};
+
+int failed = 0;
+
+int32_t call(Module& module, const std::string& name, std::vector<Variable> arguments) {
+    module(name, Stack(&arguments));
+    return std::get<int32_t>(module.getResults(1)[0]);
+}
+
+void checkModule(bool optimize) {
+    const char* mode = optimize ? "optimized" : "interpreted";
+    std::vector<uint8_t> binary = compile(SOURCE, optimize);
+    Module module(binary.data(), binary.size());
+    for (const Case& c : CASES) {
+        int32_t result = call(module, c.function, c.arguments);
+        if (result != c.expected) {
+            std::cout << mode << " " << c.function << " gave " << result << ", expected " << c.expected << std::endl;
+            failed++;
+        }
+    }
+    for (size_t i = 0; i < std::size(TRAPS); ++i) {
+        try {
+            call(module, TRAPS[i].function, TRAPS[i].arguments);
+            std::cout << mode << " " << TRAPS[i].function << " didn't trap" << std::endl;
+            failed++;
+        } catch (const FunctionException& e) {
+            if (std::string(e.what()) != TRAP_MESSAGES[i]) {
+                std::cout << mode << " " << TRAPS[i].function << " trapped with " << e.what() << std::endl;
+                failed++;
+            }
+        }
+    }
+    std::vector<uint8_t> recursive = compile(RECURSIVE, optimize);
+    Module recursiveModule(recursive.data(), recursive.size());
+    if (call(recursiveModule, "factorial", { int32_t(10) }) != 3628800) {
+        std::cout << mode << " factorial through call_indirect is wrong" << std::endl;
+        failed++;
+    }
+    // the module is still usable after a trap
+    if (call(module, "apply", { int32_t(2), int32_t(6), int32_t(7) }) != 42) {
+        std::cout << mode << " call_indirect fails after a trap" << std::endl;
+        failed++;
+    }
+}
+
+void checkBinary() {
+    std::vector<uint8_t> binary(std::begin(BINARY), std::end(BINARY));
+    Module module(binary.data(), binary.size());
+    if (call(module, "pick", { int32_t(0) }) != 9 || call(module, "pick", { int32_t(2) }) != 7) {
+        std::cout << "the element expressions went into the wrong slots" << std::endl;
+        failed++;
+    }
+    try {
+        call(module, "pick", { int32_t(1) });
+        std::cout << "ref.null in an element segment didn't trap" << std::endl;
+        failed++;
+    } catch (const FunctionException&) {
+    }
+
+    std::vector<uint8_t> unsupported(std::begin(UNSUPPORTED), std::end(UNSUPPORTED));
+    Module initModule(unsupported.data(), unsupported.size());
+    std::string message = "no trap";
+    try {
+        Stack stack;
+        initModule("init", stack);
+    } catch (const FunctionException& e) {
+        message = e.what();
+    }
+    if (message != "Invalid or unsupported instruction Instruction: 12") {
+        std::cout << "table.init: " << message << std::endl;
+        failed++;
+    }
+}
+
+void checkRejected() {
+    for (const char* source : REJECTED) {
+        try {
+            compile(source, false);
+            std::cout << source << " was accepted" << std::endl;
+            failed++;
+        } catch (const ParseError&) {
+        }
+    }
+}
+
+int main() {
+    checkModule(false);
+    checkModule(true);
+    checkBinary();
+    checkRejected();
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << std::size(CASES) << " calls right and " << std::size(TRAPS)
+              << " traps raised, interpreted and optimized; element segments of a binary loaded" << std::endl;
+
+    std::vector<uint8_t> binary = compile(SOURCE, true);
+    Module module(binary.data(), binary.size());
+    auto start = std::chrono::steady_clock::now();
+    int32_t sum = call(module, "switches", { int32_t(1000000) });
+    auto end = std::chrono::steady_clock::now();
+    std::cout << "1M x br_table over 8 cases: " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms (" << sum << ")" << std::endl;
+    return 0;
+}
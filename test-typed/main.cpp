@@ -0,0 +1,148 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "../includes/lexer.h"
+#include "../includes/parser.h"
+#include "../includes/compiler.h"
+#include "../includes/module.h"
+#include "../includes/testing.h"
+
+// Functions of a module called as C++ functions: arguments and results of every type, several results
+// as a tuple, none, and an import of the embedder through its handle. Asking for a function under a
+// signature it doesn't have, or one that isn't there, throws once at the lookup. Last the time of a
+// call by name against one through its handle.
+
+const char* SOURCE = R"(
+(module
+  (import "env" "twice" (func $twice (param i32) (result i32)))
+  (memory 1)
+
+  (func (export "add") (param i32 i32) (result i32) (i32.add (local.get 0) (local.get 1)))
+  (func (export "scale") (param i64 f32 f64) (result f64)
+    (f64.mul (f64.convert_i64_s (local.get 0)) (f64.add (f64.promote_f32 (local.get 1)) (local.get 2))))
+  (func (export "divmod") (param i32 i32) (result i32 i32)
+    (i32.div_s (local.get 0) (local.get 1))
+    (i32.rem_s (local.get 0) (local.get 1)))
+  (func (export "store") (param i32) (i32.store (i32.const 0) (local.get 0)))
+  (func (export "load") (result i32) (i32.load (i32.const 0)))
+  (func (export "quadruple") (param i32) (result i32) (call $twice (call $twice (local.get 0))))
+  (func (export "fail") (param i32) (result i32) unreachable)
+)
+)";
+
+int failed = 0;
+
+void check(bool right, const std::string& what) {
+    if (!right) {
+        std::cout << what << std::endl;
+        failed++;
+    }
+}
+
+// true if the lookup of name under Signature is refused
+template <typename Signature>
+bool refused(Module& module, const std::string& name) {
+    try {
+        module.getTypedFunc<Signature>(name);
+        return false;
+    } catch (const ModuleException&) {
+        return true;
+    }
+}
+
+int main() {
+    Imports imports;
+    imports.add("env", "twice", [](int32_t value) { return value * 2; });
+
+    for (bool optimize : { false, true }) {
+        std::string mode = optimize ? "optimized: " : "interpreted: ";
+        std::vector<uint8_t> binary = compile(SOURCE, optimize);
+        Module module(binary.data(), binary.size(), imports);
+
+        auto add = module.getTypedFunc<int32_t(int32_t, int32_t)>("add");
+        check(add(3, 4) == 7 && add(-10, 4) == -6, mode + "add");
+
+        auto scale = module.getTypedFunc<float64_t(int64_t, float32_t, float64_t)>("scale");
+        check(scale(4, 0.5f, 2.0) == 10.0, mode + "scale");
+
+        auto divmod = module.getTypedFunc<std::tuple<int32_t, int32_t>(int32_t, int32_t)>("divmod");
+        auto [quotient, remainder] = divmod(17, 5);
+        check(quotient == 3 && remainder == 2, mode + "divmod");
+
+        auto store = module.getTypedFunc<void(int32_t)>("store");
+        auto load = module.getTypedFunc<int32_t()>("load");
+        store(1234);
+        check(load() == 1234, mode + "store and load");
+
+        auto quadruple = module.getTypedFunc<int32_t(int32_t)>("quadruple");
+        auto twice = module.getTypedFunc<int32_t(int32_t)>("twice");
+        check(quadruple(5) == 20 && twice(21) == 42, mode + "import of the embedder");
+
+        // a trap leaves the handles usable
+        auto fail = module.getTypedFunc<int32_t(int32_t)>("fail");
+        try {
+            fail(1);
+            check(false, mode + "the trap didn't come out of the call");
+        } catch (const FunctionException& e) {
+            check(std::string(e.what()) == "unreachable", mode + "trapped with " + e.what());
+        }
+        check(add(1, 2) == 3, mode + "add after a trap");
+
+        // a handle and a call by name on one stack
+        std::vector<Variable> arguments = { int32_t(8), int32_t(9) };
+        module("add", Stack(&arguments));
+        check(add(100, 200) == 300 && std::get<int32_t>(module.getResults(1)[0]) == 17, mode + "add by name and by handle");
+
+        check(refused<int32_t(int32_t, int32_t)>(module, "missing"), mode + "a function that isn't there was found");
+        check(refused<int32_t(int64_t, int32_t)>(module, "add"), mode + "a parameter of another type was accepted");
+        check(refused<int32_t(int32_t)>(module, "add"), mode + "a parameter too few was accepted");
+        check(refused<int64_t(int32_t, int32_t)>(module, "add"), mode + "a result of another type was accepted");
+        check(refused<int32_t(int32_t, int32_t)>(module, "divmod"), mode + "a result too few was accepted");
+        check(refused<std::tuple<int32_t, int32_t>()>(module, "load"), mode + "a result too many was accepted");
+        check(refused<void(int32_t)>(module, "quadruple"), mode + "a function without results was accepted");
+
+        // not while an execution is suspended halfway
+        Execution execution = module.start("quadruple", Stack(&arguments), 1);
+        execution.resume();
+        try {
+            add(1, 1);
+            check(false, mode + "called while an execution is suspended");
+        } catch (const ModuleException&) {
+        }
+    }
+
+    if (failed > 0) {
+        std::cout << failed << " failed" << std::endl;
+        return 1;
+    }
+    std::cout << "functions called through their handles, interpreted and optimized; other signatures refused" << std::endl;
+
+    std::vector<uint8_t> binary = compile(SOURCE, true);
+    Module module(binary.data(), binary.size(), imports);
+    const int CALLS = 1000000;
+    int32_t byName = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < CALLS; ++i) {
+        std::vector<Variable> arguments = { i, int32_t(1) };
+        module("add", Stack(&arguments));
+        Variable result;
+        module.popResults(&result, 1);
+        byName += std::get<int32_t>(result);
+    }
+    auto middle = std::chrono::steady_clock::now();
+    auto add = module.getTypedFunc<int32_t(int32_t, int32_t)>("add");
+    int32_t byHandle = 0;
+    for (int32_t i = 0; i < CALLS; ++i) {
+        byHandle += add(i, 1);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double named = std::chrono::duration<double, std::nano>(middle - start).count() / CALLS;
+    double handled = std::chrono::duration<double, std::nano>(end - middle).count() / CALLS;
+    std::cout << "1M x add: by name " << named << " ns, by handle " << handled << " ns per call, " << named / handled
+              << "x faster (" << (byName == byHandle ? "same sums" : "sums differ") << ")" << std::endl;
+    return 0;
+}
@@ -0,0 +1,581 @@
+// Generates parameterized stress modules, both as .wat text (for the Lexer/Parser/Compiler pipeline)
+// and as .wasm binary (for Module), so load time, memory footprint and interpreter throughput can
+// be measured at realistic sizes.
+//
+// usage: ./main.out [small|medium|large|huge|all] [--functions N] [--call-depth N] [--loop-iterations N]
+//                   [--data-size BYTES] [--segment-size BYTES] [--memory-pages N] [--arith-ops N]
+//                   [--seed N] [--out DIR]
+//
+// Every module comes with a .txt manifest listing its exported entry points, their arguments and
+// the expected result, e.g. "loop_3 i32 7 -> 4950007"; test-corpus runs them.
+
+#include "../includes/bytestream.h"
+#include "../includes/constants.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace constants;
+
+struct Workload {
+    std::string name;
+    int functions;
+    int callDepth;
+    int loopIterations;
+    int dataSize;
+    int segmentSize;
+    int memoryPages;
+    int arithOps;
+    uint32_t seed;
+};
+
+static const Workload presets[] = {
+    // name      functions depth  loop     data              segment memory arith seed
+    { "small",   100,      16,    1000,    4 * 1024,         1024,   1,     32,   1 },
+    { "medium",  1000,     64,    10000,   64 * 1024,        4096,   16,    64,   1 },
+    { "large",   5000,     256,   100000,  1024 * 1024,      4096,   256,   128,  1 },
+    { "huge",    20000,    1024,  1000000, 8 * 1024 * 1024,  65536,  1024,  256,  1 },
+};
+
+// Immediates an operation carries, decides how it is written in both formats
+enum class Immediate { NONE, LOCAL, CALL, I32, I64, F64, MEMARG, BLOCKTYPE };
+
+struct Op {
+    uint8_t code;
+    Immediate immediate = Immediate::NONE;
+    int64_t value = 0;
+    double float_value = 0.0;
+};
+
+struct GenFunction {
+    std::string name;
+    std::vector<uint8_t> params;
+    std::vector<uint8_t> results = {};
+    std::vector<std::pair<std::string, uint8_t>> locals = {};
+    std::vector<Op> body = {};
+    std::string expected = "";
+};
+
+struct GenData {
+    uint32_t offset;
+    std::string bytes = "";
+};
+
+// small deterministic generator, std::mt19937 output differs between standard libraries
+class Random {
+public:
+    Random(uint32_t seed) : state(seed * 2654435761u + 1) {}
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    uint32_t below(uint32_t bound) { return next() % bound; }
+
+private:
+    uint32_t state;
+};
+
+static std::string mnemonic(uint8_t code) {
+    switch (code) {
+        case LOCALGET: return "local.get";
+        case LOCALSET: return "local.set";
+        case CALL: return "call";
+        case BR_IF: return "br_if";
+        case I32CONST: return "i32.const";
+        case I64CONST: return "i64.const";
+        case F64CONST: return "f64.const";
+        case I32ADD: return "i32.add";
+        case I32SUB: return "i32.sub";
+        case I32MUL: return "i32.mul";
+        case I32LT_S: return "i32.lt_s";
+        case I64ADD: return "i64.add";
+        case I64SUB: return "i64.sub";
+        case I64MUL: return "i64.mul";
+        case F64ADD: return "f64.add";
+        case F64SUB: return "f64.sub";
+        case F64MUL: return "f64.mul";
+        case I32LOAD: return "i32.load";
+        case I32STORE: return "i32.store";
+        default: return "unknown";
+    }
+}
+
+static std::string typeName(uint8_t type) {
+    switch (type) {
+        case INT32: return "i32";
+        case INT64: return "i64";
+        case FLOAT32: return "f32";
+        default: return "f64";
+    }
+}
+
+// f64 constants are kept to values with an exact short decimal form, so the text and binary agree
+static double smallDouble(Random &random) {
+    return (double)(random.below(2000) + 1) / 8.0;
+}
+
+static GenFunction i64Kernel(int index, int ops, Random &random) {
+    GenFunction f{ "i64_kernel_" + std::to_string(index), { INT64, INT64 }, { INT64 } };
+    const uint8_t codes[] = { I64ADD, I64SUB, I64MUL };
+    uint64_t a = 3, b = 5;
+    uint64_t acc = a;
+    f.body.push_back({ LOCALGET, Immediate::LOCAL, 0 });
+    for (int i = 0; i < ops; ++i) {
+        uint64_t operand;
+        if (random.below(2)) {
+            f.body.push_back({ LOCALGET, Immediate::LOCAL, 1 });
+            operand = b;
+        } else {
+            int64_t c = random.below(1000) + 1;
+            f.body.push_back({ I64CONST, Immediate::I64, c });
+            operand = c;
+        }
+        uint8_t code = codes[random.below(3)];
+        f.body.push_back({ code });
+        acc = code == I64ADD ? acc + operand : code == I64SUB ? acc - operand : acc * operand;
+    }
+    f.expected = f.name + " i64 " + std::to_string(a) + " " + std::to_string(b) + " -> " + std::to_string((int64_t)acc);
+    return f;
+}
+
+static GenFunction f64Kernel(int index, int ops, Random &random) {
+    GenFunction f{ "f64_kernel_" + std::to_string(index), { FLOAT64, FLOAT64 }, { FLOAT64 } };
+    const uint8_t codes[] = { F64ADD, F64SUB, F64MUL };
+    double a = 1.5, b = 0.75;
+    double acc = a;
+    f.body.push_back({ LOCALGET, Immediate::LOCAL, 0 });
+    for (int i = 0; i < ops; ++i) {
+        double operand;
+        if (random.below(2)) {
+            f.body.push_back({ LOCALGET, Immediate::LOCAL, 1 });
+            operand = b;
+        } else {
+            Op c{ F64CONST, Immediate::F64 };
+            c.float_value = smallDouble(random);
+            f.body.push_back(c);
+            operand = c.float_value;
+        }
+        uint8_t code = codes[random.below(3)];
+        f.body.push_back({ code });
+        acc = code == F64ADD ? acc + operand : code == F64SUB ? acc - operand : acc * operand;
+    }
+    std::ostringstream ss;
+    ss.precision(17);
+    ss << f.name << " f64 " << a << " " << b << " -> " << acc;
+    f.expected = ss.str();
+    return f;
+}
+
+// acc = param; for (i = 0; i < iterations; ++i) acc += i;
+static GenFunction loopKernel(int index, int iterations) {
+    GenFunction f{ "loop_" + std::to_string(index), { INT32 }, { INT32 } };
+    f.locals = { { "$i", INT32 } };
+    f.body = {
+        { I32CONST, Immediate::I32, 0 },
+        { LOCALSET, Immediate::LOCAL, 1 },
+        { LOOP, Immediate::BLOCKTYPE },
+        { LOCALGET, Immediate::LOCAL, 0 },
+        { LOCALGET, Immediate::LOCAL, 1 },
+        { I32ADD },
+        { LOCALSET, Immediate::LOCAL, 0 },
+        { LOCALGET, Immediate::LOCAL, 1 },
+        { I32CONST, Immediate::I32, 1 },
+        { I32ADD },
+        { LOCALSET, Immediate::LOCAL, 1 },
+        { LOCALGET, Immediate::LOCAL, 1 },
+        { I32CONST, Immediate::I32, iterations },
+        { I32LT_S },
+        { BR_IF, Immediate::LOCAL, 0 },
+        { BLOCK_END },
+        { LOCALGET, Immediate::LOCAL, 0 },
+    };
+    uint32_t sum = 7;
+    for (int i = 0; i < iterations; ++i) {
+        sum += i;
+    }
+    f.expected = f.name + " i32 7 -> " + std::to_string((int32_t)sum);
+    return f;
+}
+
+// stores the parameter somewhere in memory and loads it back
+static GenFunction memoryKernel(int index, int memoryPages, Random &random) {
+    GenFunction f{ "memory_" + std::to_string(index), { INT32 }, { INT32 } };
+    // the offset is at most 252, the access 4 bytes, both stay inside the memory
+    int64_t address = random.below((memoryPages * 65536 - 256 - 4) / 4 + 1) * 4;
+    int64_t offset = random.below(64) * 4;
+    f.body = {
+        { I32CONST, Immediate::I32, address },
+        { LOCALGET, Immediate::LOCAL, 0 },
+        { I32STORE, Immediate::MEMARG, offset },
+        { I32CONST, Immediate::I32, address },
+        { I32LOAD, Immediate::MEMARG, offset },
+    };
+    f.expected = f.name + " i32 42 -> 42";
+    return f;
+}
+
+// chain_<head>_<n> adds one and calls the next link, the last link just adds one
+static GenFunction chainLink(int head, int link, int depth, int nextIndex) {
+    GenFunction f{ "chain_" + std::to_string(head) + "_" + std::to_string(link), { INT32 }, { INT32 } };
+    f.body = {
+        { LOCALGET, Immediate::LOCAL, 0 },
+        { I32CONST, Immediate::I32, 1 },
+        { I32ADD },
+    };
+    if (link + 1 < depth) {
+        f.body.push_back({ CALL, Immediate::CALL, nextIndex });
+    }
+    if (link == 0) {
+        f.expected = f.name + " i32 0 -> " + std::to_string(depth);
+    }
+    return f;
+}
+
+static std::vector<GenFunction> generateFunctions(const Workload &w, Random &random) {
+    std::vector<GenFunction> functions;
+    functions.reserve(w.functions);
+
+    // a quarter of the functions are call chains, the rest is split over the kernels
+    int chainFunctions = std::max(std::min(w.callDepth, w.functions), w.functions / 4 / w.callDepth * w.callDepth);
+    int head = 0;
+    while ((int)functions.size() < chainFunctions) {
+        int depth = std::min(w.callDepth, chainFunctions - (int)functions.size());
+        int first = functions.size();
+        for (int link = 0; link < depth; ++link) {
+            functions.push_back(chainLink(head, link, depth, first + link + 1));
+        }
+        ++head;
+    }
+    for (int i = 0; (int)functions.size() < w.functions; ++i) {
+        switch (i % 4) {
+            case 0: functions.push_back(i64Kernel(i / 4, w.arithOps, random)); break;
+            case 1: functions.push_back(f64Kernel(i / 4, w.arithOps, random)); break;
+            case 2: functions.push_back(loopKernel(i / 4, w.loopIterations)); break;
+            default: functions.push_back(memoryKernel(i / 4, w.memoryPages, random)); break;
+        }
+    }
+    return functions;
+}
+
+static std::vector<GenData> generateData(const Workload &w, Random &random) {
+    std::vector<GenData> datas;
+    uint32_t memorySize = w.memoryPages * 65536;
+    for (int offset = 0; offset < w.dataSize && offset < (int)memorySize; offset += w.segmentSize) {
+        GenData data{ (uint32_t)offset };
+        int length = std::min({ w.segmentSize, w.dataSize - offset, (int)memorySize - offset });
+        data.bytes.reserve(length);
+        for (int i = 0; i < length; ++i) {
+            // printable ASCII without quotes or backslashes, so the text needs no escaping
+            char c = 'a' + random.below(26);
+            data.bytes.push_back(c);
+        }
+        datas.push_back(data);
+    }
+    return datas;
+}
+
+static void writeWat(const std::string &path, const Workload &w, const std::vector<GenFunction> &functions,
+                     const std::vector<GenData> &datas) {
+    std::ostringstream out;
+    out.precision(17);
+    out << "(module\n";
+    out << "  (memory (export \"memory\") " << w.memoryPages << ")\n";
+    for (auto &data : datas) {
+        out << "  (data (i32.const " << data.offset << ") \"" << data.bytes << "\")\n";
+    }
+    for (auto &f : functions) {
+        out << "  (func (export \"" << f.name << "\")";
+        if (!f.params.empty()) {
+            out << " (param";
+            for (auto type : f.params) out << " " << typeName(type);
+            out << ")";
+        }
+        if (!f.results.empty()) {
+            out << " (result";
+            for (auto type : f.results) out << " " << typeName(type);
+            out << ")";
+        }
+        for (auto &local : f.locals) {
+            out << " (local " << local.first << " " << typeName(local.second) << ")";
+        }
+        out << "\n";
+        std::string indent = "    ";
+        for (auto &op : f.body) {
+            if (op.code == LOOP) {
+                out << indent << "(loop\n";
+                indent += "  ";
+                continue;
+            }
+            if (op.code == BLOCK_END) {
+                indent.resize(indent.size() - 2);
+                out << indent << ")\n";
+                continue;
+            }
+            out << indent << mnemonic(op.code);
+            switch (op.immediate) {
+                case Immediate::LOCAL:
+                case Immediate::CALL:
+                case Immediate::I32:
+                case Immediate::I64:
+                    out << " " << op.value;
+                    break;
+                case Immediate::F64:
+                    out << " " << op.float_value;
+                    break;
+                case Immediate::MEMARG:
+                    if (op.value != 0) out << " offset=" << op.value;
+                    break;
+                default:
+                    break;
+            }
+            out << "\n";
+        }
+        out << "  )\n";
+    }
+    out << ")\n";
+
+    std::ofstream f(path);
+    f << out.str();
+}
+
+static void writeSigned(ByteStream &bs, int64_t value) {
+    bool more = true;
+    while (more) {
+        uint8_t byte = value & 0b0111'1111;
+        value >>= 7;
+        if ((value == 0 && (byte & 0b0100'0000) == 0) || (value == -1 && (byte & 0b0100'0000) != 0)) {
+            more = false;
+        } else {
+            byte |= 0b1000'0000;
+        }
+        bs.writeByte(byte);
+    }
+}
+
+static void writeName(ByteStream &bs, const std::string &name) {
+    bs.writeUInt32(name.size());
+    for (char c : name) {
+        bs.writeByte(c);
+    }
+}
+
+static void writeSection(ByteStream &out, uint8_t id, ByteStream &section) {
+    out.writeByte(id);
+    out.writeUInt32(section.getTotalByteCount());
+    out.addFromByteStream(&section);
+}
+
+static void writeWasm(const std::string &path, const Workload &w, const std::vector<GenFunction> &functions,
+                      const std::vector<GenData> &datas) {
+    ByteStream out;
+    for (uint8_t byte : { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 }) {
+        out.writeByte(byte);
+    }
+
+    std::vector<std::pair<std::vector<uint8_t>, std::vector<uint8_t>>> types;
+    std::vector<uint32_t> typeIndices;
+    for (auto &f : functions) {
+        uint32_t index = 0;
+        while (index < types.size() && (types[index].first != f.params || types[index].second != f.results)) {
+            ++index;
+        }
+        if (index == types.size()) {
+            types.emplace_back(f.params, f.results);
+        }
+        typeIndices.push_back(index);
+    }
+
+    ByteStream typeSection;
+    typeSection.writeUInt32(types.size());
+    for (auto &type : types) {
+        typeSection.writeByte(0x60);
+        typeSection.writeUInt32(type.first.size());
+        for (auto t : type.first) typeSection.writeByte(t);
+        typeSection.writeUInt32(type.second.size());
+        for (auto t : type.second) typeSection.writeByte(t);
+    }
+    writeSection(out, TYPE_SECTION, typeSection);
+
+    ByteStream functionSection;
+    functionSection.writeUInt32(functions.size());
+    for (auto index : typeIndices) {
+        functionSection.writeUInt32(index);
+    }
+    writeSection(out, FUNCTION_SECTION, functionSection);
+
+    ByteStream memorySection;
+    memorySection.writeUInt32(1);
+    memorySection.writeByte(0); // no upper limit
+    memorySection.writeUInt32(w.memoryPages);
+    writeSection(out, MEMORY_SECTION, memorySection);
+
+    ByteStream exportSection;
+    exportSection.writeUInt32(functions.size() + 1);
+    writeName(exportSection, "memory");
+    exportSection.writeByte(2); // type = memory
+    exportSection.writeUInt32(0);
+    for (int i = 0; i < (int)functions.size(); ++i) {
+        writeName(exportSection, functions[i].name);
+        exportSection.writeByte(0); // type = function
+        exportSection.writeUInt32(i);
+    }
+    writeSection(out, EXPORT_SECTION, exportSection);
+
+    ByteStream codeSection;
+    codeSection.writeUInt32(functions.size());
+    for (auto &f : functions) {
+        ByteStream body;
+        body.writeUInt32(f.locals.size());
+        for (auto &local : f.locals) {
+            body.writeUInt32(1);
+            body.writeByte(local.second);
+        }
+        for (auto &op : f.body) {
+            body.writeByte(op.code);
+            switch (op.immediate) {
+                case Immediate::LOCAL:
+                case Immediate::CALL:
+                    body.writeUInt32(op.value);
+                    break;
+                case Immediate::I32:
+                case Immediate::I64:
+                    writeSigned(body, op.value);
+                    break;
+                case Immediate::F64:
+                    {
+                        uint64_t bits;
+                        std::memcpy(&bits, &op.float_value, sizeof(bits));
+                        for (int i = 0; i < 8; ++i) {
+                            body.writeByte(bits & 0xFF);
+                            bits >>= 8;
+                        }
+                        break;
+                    }
+                case Immediate::MEMARG:
+                    body.writeUInt32(2); // alignment
+                    body.writeUInt32(op.value);
+                    break;
+                case Immediate::BLOCKTYPE:
+                    body.writeByte(0x40); // void
+                    break;
+                default:
+                    break;
+            }
+        }
+        body.writeByte(BLOCK_END);
+        codeSection.writeUInt32(body.getTotalByteCount());
+        codeSection.addFromByteStream(&body);
+    }
+    writeSection(out, CODE_SECTION, codeSection);
+
+    ByteStream dataSection;
+    dataSection.writeUInt32(datas.size());
+    for (auto &data : datas) {
+        dataSection.writeByte(0); // flags
+        dataSection.writeByte(I32CONST);
+        writeSigned(dataSection, data.offset);
+        dataSection.writeByte(BLOCK_END);
+        dataSection.writeUInt32(data.bytes.size());
+        for (char c : data.bytes) {
+            dataSection.writeByte(c);
+        }
+    }
+    writeSection(out, DATA_SECTION, dataSection);
+
+    out.writeFile(path);
+}
+
+static void writeManifest(const std::string &path, const std::vector<GenFunction> &functions) {
+    std::ofstream f(path);
+    for (auto &function : functions) {
+        if (!function.expected.empty()) {
+            f << function.expected << "\n";
+        }
+    }
+}
+
+static void generate(const Workload &w, const std::string &directory) {
+    Random random(w.seed);
+    auto functions = generateFunctions(w, random);
+    auto datas = generateData(w, random);
+    std::string prefix = directory + "/" + w.name;
+    writeWat(prefix + ".wat", w, functions, datas);
+    writeWasm(prefix + ".wasm", w, functions, datas);
+    writeManifest(prefix + ".txt", functions);
+    std::cout << "Generated " << prefix << ".{wat,wasm,txt}: " << functions.size() << " functions, "
+              << datas.size() << " data segments, " << w.memoryPages << " memory pages" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::vector<Workload> workloads;
+    Workload custom = presets[0];
+    bool customized = false;
+    std::string directory = ".";
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() {
+            if (i + 1 >= argc) {
+                std::cout << "Missing value for " << arg << std::endl;
+                exit(1);
+            }
+            return std::stoi(argv[++i]);
+        };
+        if (arg == "all") {
+            workloads.assign(std::begin(presets), std::end(presets));
+        } else if (arg == "--out") {
+            if (i + 1 < argc) directory = argv[++i];
+        } else if (arg == "--functions") {
+            custom.functions = value(); customized = true;
+        } else if (arg == "--call-depth") {
+            custom.callDepth = value(); customized = true;
+        } else if (arg == "--loop-iterations") {
+            custom.loopIterations = value(); customized = true;
+        } else if (arg == "--data-size") {
+            custom.dataSize = value(); customized = true;
+        } else if (arg == "--segment-size") {
+            custom.segmentSize = value(); customized = true;
+        } else if (arg == "--memory-pages") {
+            custom.memoryPages = value(); customized = true;
+        } else if (arg == "--arith-ops") {
+            custom.arithOps = value(); customized = true;
+        } else if (arg == "--seed") {
+            custom.seed = value(); customized = true;
+        } else {
+            bool found = false;
+            for (auto &preset : presets) {
+                if (preset.name == arg) {
+                    custom = preset;
+                    found = true;
+                }
+            }
+            if (!found) {
+                std::cout << "Unknown argument: " << arg << std::endl;
+                return 1;
+            }
+            workloads.push_back(custom);
+        }
+    }
+
+    if (customized) {
+        // options tweak the last named preset (or "small") and replace it
+        custom.name = "custom";
+        custom.callDepth = std::max(1, custom.callDepth);
+        custom.segmentSize = std::max(1, custom.segmentSize);
+        workloads = { custom };
+    }
+    if (workloads.empty()) {
+        workloads.push_back(presets[0]);
+    }
+    for (auto &w : workloads) {
+        generate(w, directory);
+    }
+    return 0;
+}